@@ -48,4 +48,10 @@
 // Enable debug output
 #define OTA_DEBUG_MODE true             // Set to false for production
 
+// Compile-time log level is a build flag (it must reach the library sources),
+// e.g. in platformio.ini:  build_flags = -D OTA_LOG_LEVEL=OTA_LOG_LEVEL_ERROR
+// Levels: NONE, ERROR, WARN, INFO, DEBUG (default)
+// Unused features are removed the same way: OTA_ENABLE_STATUS_LED=0,
+// OTA_ENABLE_ROLLOUT=0, OTA_ENABLE_TRACE=0
+
 #endif // OTA_CONFIG_H
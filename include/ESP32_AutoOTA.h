@@ -12,6 +12,10 @@
  * - GitHub CDN cache-busting headers
  * - Callback support for custom handling
  * - Automatic retry on failure
+ * - Pluggable update sources (HTTP, SD card, UART, memory)
+ * - Lock-free runtime statistics with per-phase timings
+ * - Binary event trace retained in RTC memory across reboots
+ * - Optional task-free mode driven from loop() with poll()
  * 
  * Author: KeenanKE
  * Date: November 2025
@@ -25,21 +29,143 @@
 #include <WiFi.h>
 #include <HTTPClient.h>
 #include <Update.h>
+#include "OTAUpdateSource.h"
+#include "OTAScheduler.h"
+#include "OTASeqlock.h"
+#include "OTAFlashWriter.h"
+#include "OTAPreEraser.h"
+#include "OTAParallelSource.h"
+#include "OTARateLimiter.h"
+#include "OTAPeerShare.h"
+#include "OTAGateway.h"
+#include "OTADecrypt.h"
+#include "OTATrace.h"
 
 // Default configuration values
 #define DEFAULT_MIN_RANDOM_DELAY 60000       // 60 seconds
 #define DEFAULT_MAX_RANDOM_DELAY 180000      // 180 seconds
 #define DEFAULT_CHECK_INTERVAL 300000        // 5 minutes
-#define DEFAULT_RETRY_DELAY 60000            // 1 minute
+#define DEFAULT_RETRY_DELAY 0                // 0 = a failed check waits the check interval
 #define DEFAULT_MAX_RETRIES 3                // 3 retry attempts
 #define DEFAULT_STACK_SIZE 8192              // 8KB stack for OTA task
 #define DEFAULT_TASK_PRIORITY 1              // Low priority
+#define DEFAULT_STALL_TIMEOUT 30000          // 30 seconds without data aborts a download
+#define DEFAULT_PUSH_FALLBACK_INTERVAL 21600000 // 6 hours between polls while push is healthy
+#define DEFAULT_PUSH_HEALTH_TIMEOUT 300000   // Push channel healthy for 5 minutes after a heartbeat
+#define DEFAULT_PUSH_SPREAD 600000           // Announced checks spread over 10 minutes
+#define DEFAULT_LONG_POLL_HOLD 50000         // Server holds a long-poll request up to 50 seconds
+#ifndef OTA_LONG_POLL_MARGIN
+#define OTA_LONG_POLL_MARGIN 10000           // Extra wait for the response beyond the hold
+#endif
+#ifndef OTA_LONG_POLL_TLS_HOLD
+#define OTA_LONG_POLL_TLS_HOLD 20000         // Longest hold without keepalive: a vanished server fails within 30 s
+#endif
+#define OTA_LONG_POLL_GAP 1000               // Pause between long-poll requests
+#define OTA_PAUSE_CLOSE_MS 10000             // Pauses longer than this drop the connection
+#define OTA_RESUME_ATTEMPTS 3                // Reconnects per download after a broken transfer
+#define OTA_HEADER_TIMEOUT 5000              // Time allowed to receive an image header
+#define OTA_CHECK_BAD_CONTENT (-100)         // Version response had no usable version
+#define OTA_SIGNATURE_MAX 72                 // DER-encoded ECDSA P-256 signature
+#define OTA_GATEWAY_MAX_FAILURES 1           // Gateway failures before it is dropped and looked up again
+#define OTA_WIFI_RETRY_MS 10000              // Wait before looking at a lost WiFi connection again
+#define DEFAULT_POLL_BUDGET 20               // Work done per poll() call, in milliseconds
+
+// Compile-time feature switches: set to 0 with a build flag to remove
+// the feature's code and its members from the binary (the setters
+// become no-ops). The optional modules have theirs in their own headers:
+// OTA_ENABLE_PARALLEL, OTA_ENABLE_PEER_SHARE, OTA_ENABLE_GATEWAY,
+// OTA_ENABLE_DECRYPT, OTA_ENABLE_PRE_ERASE and OTA_ENABLE_TRACE.
+#ifndef OTA_ENABLE_STATUS_LED
+#define OTA_ENABLE_STATUS_LED 1
+#endif
+
+#ifndef OTA_ENABLE_ROLLOUT
+#define OTA_ENABLE_ROLLOUT 1
+#endif
+
+#ifndef OTA_ENABLE_SIGNING
+#define OTA_ENABLE_SIGNING 1                 // 0 removes signed release checks
+#endif
+
+#ifndef OTA_ENABLE_CONDITIONAL
+#define OTA_ENABLE_CONDITIONAL 1             // 0 removes ETag/Last-Modified version requests
+#endif
+
+// Compile-time log level: calls above the level are removed from the
+// build together with their format strings. Set with a build flag, e.g.
+// -D OTA_LOG_LEVEL=OTA_LOG_LEVEL_ERROR for production firmware.
+// At runtime errors and warnings are printed; setDebugMode(true) adds
+// info and debug messages.
+#define OTA_LOG_LEVEL_NONE 0
+#define OTA_LOG_LEVEL_ERROR 1
+#define OTA_LOG_LEVEL_WARN 2
+#define OTA_LOG_LEVEL_INFO 3
+#define OTA_LOG_LEVEL_DEBUG 4
+
+#ifndef OTA_LOG_LEVEL
+#define OTA_LOG_LEVEL OTA_LOG_LEVEL_DEBUG
+#endif
+
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_ERROR
+#define OTA_LOGE(...) logf(OTA_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define OTA_LOGE(...) do {} while (0)
+#endif
+
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_WARN
+#define OTA_LOGW(...) logf(OTA_LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define OTA_LOGW(...) do {} while (0)
+#endif
+
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_INFO
+#define OTA_LOGI(...) logf(OTA_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define OTA_LOGI(...) do {} while (0)
+#endif
+
+#if OTA_LOG_LEVEL >= OTA_LOG_LEVEL_DEBUG
+#define OTA_LOGD(...) logf(OTA_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define OTA_LOGD(...) do {} while (0)
+#endif
 
 // Callback function types
 typedef void (*OTACallback)();
 typedef void (*OTAProgressCallback)(size_t current, size_t total);
 typedef void (*OTAErrorCallback)(const char* error);
 
+/**
+ * Runtime statistics snapshot, returned by getStats()
+ * Counters accumulate since boot; latencies, throughput and flash
+ * timings describe the most recent request or download
+ */
+struct OTAStats {
+    uint32_t checkCount;            // Version checks performed
+    uint32_t checkFailures;         // Checks (including downloads) that failed
+    uint32_t okCount;               // HTTP 200 responses
+    uint32_t notModifiedCount;      // HTTP 304 responses
+    uint32_t retries;               // Checks rescheduled as retries
+    uint32_t dnsMs;                 // Name resolution
+    uint32_t connectMs;             // TCP connect (plain HTTP)
+    uint32_t tlsMs;                 // TCP connect + TLS handshake (HTTPS)
+    uint32_t ttfbMs;                // Request sent to response headers
+    uint32_t downloadBytesPerSec;   // Firmware download throughput
+    uint32_t flashWriteCalls;       // Flash write calls (one per 4 KB sector)
+    uint32_t flashWriteMs;          // Time spent writing flash
+    uint32_t flashStallMs;          // Part of flashWriteMs in writes over OTA_FLASH_STALL_US
+    uint32_t flashSectorsSkipped;   // Sectors left untouched because they already matched
+    uint32_t verifyMs;              // Signature verification of the last download
+    uint32_t throttleMs;            // Download time spent waiting on the rate limit or a pause
+    uint32_t resumes;               // Downloads continued on a new connection
+    uint32_t redirectHops;          // HTTP redirects followed
+    uint32_t redirectCacheHits;     // Requests sent straight to a cached redirect location
+    uint64_t bytesTransferred;      // Response body bytes received
+    uint32_t minFreeHeap;           // Lowest free heap seen since boot
+    uint32_t stackHighWaterMark;    // Unused OTA task stack (request task when polled), in bytes
+    uint32_t pollMaxMs;             // Longest poll() call (polled mode)
+};
+
 class ESP32_AutoOTA {
 public:
     /**
@@ -52,19 +178,44 @@ public:
      */
     ~ESP32_AutoOTA();
 
+    // Owns heap copies of the URLs and a running task
+    ESP32_AutoOTA(const ESP32_AutoOTA&) = delete;
+    ESP32_AutoOTA& operator=(const ESP32_AutoOTA&) = delete;
+
     // ========== Configuration Methods ==========
     
     /**
      * Set the URL for firmware binary
      * @param url Full URL to firmware.bin file
+     * @param copy True to keep a heap copy, false to reference the string
+     *             in place (string literals and other storage that is never freed)
      */
-    void setFirmwareURL(const char* url);
+    void setFirmwareURL(const char* url, bool copy = true);
 
     /**
      * Set the URL for version file
      * @param url Full URL to version.txt file
+     * @param copy True to keep a heap copy, false to reference the string in place
+     */
+    void setVersionURL(const char* url, bool copy = true);
+
+    /**
+     * Add a mirror serving the same firmware binary
+     * The fastest healthy mirror is tried first; a download that breaks
+     * off continues on another mirror with a Range request
+     * @param url Full URL to firmware.bin file
+     * @param copy True to keep a heap copy, false to reference the string in place
+     * @return false if OTA_MAX_MIRRORS URLs are already set
      */
-    void setVersionURL(const char* url);
+    bool addFirmwareMirror(const char* url, bool copy = true);
+
+    /**
+     * Add a mirror serving the same version file
+     * @param url Full URL to version.txt file
+     * @param copy True to keep a heap copy, false to reference the string in place
+     * @return false if OTA_MAX_MIRRORS URLs are already set
+     */
+    bool addVersionMirror(const char* url, bool copy = true);
 
     /**
      * Set current firmware version
@@ -107,8 +258,153 @@ public:
     void setMaxRetries(uint8_t retries);
 
     /**
-     * Enable/disable debug output
+     * Set delay before retrying a failed check
+     * @param delayMs Delay in milliseconds, jittered by ±10%; 0 (default) waits
+     *                the check interval
+     */
+    void setRetryDelay(unsigned long delayMs);
+
+    /**
+     * Configure checks triggered by a push channel (MQTT, WebSocket)
+     * @param fallbackIntervalMs Polling interval while the channel is healthy (default: 6 hours)
+     * @param spreadMs Window over which devices check after an announcement (default: 10 minutes)
+     */
+    void setPushPolicy(unsigned long fallbackIntervalMs, unsigned long spreadMs);
+
+    /**
+     * Write firmware straight to the OTA partition instead of through Update
+     * Skips Update's internal sector copy; the image is validated before
+     * it is made bootable
+     * @param enable True for direct partition writes (default: false)
+     */
+    void setDirectFlashWrite(bool enable);
+
+    /**
+     * Download the image over several connections at once
+     * Helps on high-latency links where one stream cannot fill the pipe.
+     * Needs a server that supports Range requests, otherwise the single
+     * connection path is used. Capped by free heap.
+     * @param connections Concurrent connections, 1 to disable (max: OTA_PARALLEL_MAX);
+     *                    ignored when built with OTA_ENABLE_PARALLEL=0
+     */
+    void setParallelDownload(uint8_t connections);
+
+    /**
+     * Limit download bandwidth
+     * @param bytesPerSecond Target rate, 0 for unlimited (default)
+     */
+    void setBandwidthLimit(uint32_t bytesPerSecond);
+
+    /**
+     * Erase the inactive OTA partition in the background while idle
+     * One sector per interval at task priority; progress is kept in NVS.
+     * Enables direct flash writes, which use the erased sectors. Nothing
+     * is erased while the running image is unconfirmed or rollback to
+     * the inactive partition is possible.
      * @param enable True to enable, false to disable
+     * @param maxBytes Bytes to pre-erase, 0 for the whole partition
+     * @param intervalMs Time between sector erases; each stalls flash
+     *                   (and the application) for tens of milliseconds
+     * Ignored with OTA_ENABLE_PRE_ERASE=0.
+     */
+    void setBackgroundErase(bool enable, size_t maxBytes = 0, unsigned long intervalMs = OTA_ERASE_INTERVAL_MS);
+
+    /**
+     * Skip sectors that already match the inactive partition's contents
+     * Incremental releases share most sectors with the image the inactive
+     * partition still holds, so those need no erase or write. Enables
+     * direct flash writes; turns off background erase (which would wipe
+     * the old contents) and vice versa.
+     * @param enable True to enable, false to disable
+     */
+    void setSkipUnchangedSectors(bool enable);
+
+    /**
+     * Configure early image validation
+     * The image header is checked as soon as the first few hundred bytes
+     * arrive; a mismatch aborts the download before anything is written.
+     * Magic byte and chip ID are always checked.
+     * @param matchProject Require the running firmware's project name
+     * @param matchVersion Require the embedded app version to equal the
+     *                     version announced by the version file
+     */
+    void setImageValidation(bool matchProject, bool matchVersion);
+
+    /**
+     * Read the remote version from the firmware image itself
+     * Each check fetches only the first bytes of the firmware URL with a
+     * Range request and reads the version from the embedded app
+     * descriptor, so no separate version file is needed.
+     * @param enable True to enable, false to use the version URL
+     */
+    void setVersionFromImage(bool enable);
+
+    /**
+     * Hold version checks open on the server until a release appears
+     * Each request carries the current version and ETag; the server
+     * answers when a newer release exists or after holdMs with 304, and
+     * the next request follows right away. Servers that answer at once
+     * are polled at the normal interval.
+     * @param enable True to enable long polling
+     * @param holdMs Time the server may hold a request (max 55 seconds,
+     *               20 seconds over HTTPS where keepalive is unavailable)
+     */
+    void setLongPoll(bool enable, unsigned long holdMs = DEFAULT_LONG_POLL_HOLD);
+
+    /**
+     * Share verified images with other devices on the LAN
+     * Needs a sha256= line in the version file. Before downloading, the
+     * device asks the LAN for a peer running that image and fetches it
+     * from the peer, falling back to the mirrors. After installing, it
+     * serves its own image to peers once it runs.
+     * @param enable True to enable sharing (ignored with OTA_ENABLE_PEER_SHARE=0)
+     * @param port TCP and UDP port used between peers
+     */
+    void setPeerSharing(bool enable, uint16_t port = OTA_PEER_PORT);
+
+    /**
+     * Look for a site gateway (OTAGateway) caching this firmware
+     * Before a check, the device asks the LAN for a gateway serving its
+     * firmware URL and puts the gateway ahead of the configured mirrors,
+     * which stay as the fallback. A gateway that keeps failing is dropped
+     * and looked up again before the next check.
+     * Any host on the LAN can answer the broadcast, so a release seen
+     * through the gateway is only installed against a digest the device
+     * trusts: with setSigningKey() the gateway's signed manifest is
+     * enough, otherwise the version file is fetched from the configured
+     * mirrors and its sha256= line is required. Not used with
+     * setVersionFromImage(), which has no manifest to check against.
+     * @param enable True to enable discovery (ignored with OTA_ENABLE_GATEWAY=0)
+     * @param port Gateway discovery port
+     */
+    void setGatewayDiscovery(bool enable, uint16_t port = OTA_GATEWAY_PORT);
+
+    /**
+     * Decrypt downloaded images (tools/ota_encrypt.py) on the way to flash
+     * Applies to firmware URL downloads and setVersionFromImage(); peer
+     * sharing is off while a key is set, since peers serve plaintext.
+     * @param key AES key, copied; NULL to turn decryption off
+     * @param keyLen 16 (AES-128) or 32 (AES-256)
+     * @return false if the key length is not supported, or the library
+     *         was built with OTA_ENABLE_DECRYPT=0
+     */
+    bool setDecryptionKey(const uint8_t* key, size_t keyLen = 32);
+
+    /**
+     * Require release manifests to be signed (tools/ota_sign.py)
+     * The version file must carry a sig= line: an ECDSA P-256 signature
+     * over the image's SHA-256. The digest is computed while the image is
+     * written, and the signature is verified before the image is made
+     * bootable. Unsigned releases are refused.
+     * @param publicKeyPem PEM public key, NULL to turn checking off
+     * @return false if the key cannot be parsed, or the library was
+     *         built with OTA_ENABLE_SIGNING=0
+     */
+    bool setSigningKey(const char* publicKeyPem);
+
+    /**
+     * Enable/disable info and debug output (errors and warnings are always printed)
+     * @param enable True to enable, false (default) to disable
      */
     void setDebugMode(bool enable);
 
@@ -149,7 +445,31 @@ public:
     bool begin();
 
     /**
-     * Stop the OTA update task
+     * Start without a task, for applications that drive the library from loop()
+     * No task is held between checks; call poll() on every pass through loop()
+     * Long polling holds a request open and is disabled in this mode
+     * @return true if started, false otherwise
+     */
+    bool beginPolled();
+
+    /**
+     * Do a bounded slice of work (polled mode)
+     * Advances the schedule, the background erase and a running download,
+     * then returns. Work that waits on the network or cannot be split (the
+     * check and its requests, discovery, reconnecting a download, the final
+     * image check) runs on a short-lived request task that poll() starts
+     * and then leaves alone until it exits. A sector flush runs whole.
+     * Returns at once when not started with beginPolled().
+     * @param budgetMs Time after which a download hands control back
+     */
+    void poll(uint32_t budgetMs = DEFAULT_POLL_BUDGET);
+
+    /**
+     * Stop the OTA update task, or polled mode
+     * Waits for the task, or poll()'s request task, to finish its current
+     * request and exit; a download in progress is aborted. Called from a
+     * callback, it only asks the task, or the poll() call it runs in, to
+     * stop; that poll() call finishes stopping before it returns.
      */
     void stop();
 
@@ -164,6 +484,65 @@ public:
      */
     void forceCheck();
 
+    /**
+     * Report that the push channel is alive
+     * Call whenever the channel is connected, e.g. from loop() while the
+     * MQTT client is connected. Polling slows to the fallback interval
+     * while heartbeats arrive, and speeds up again 5 minutes after the last.
+     */
+    void pushHeartbeat();
+
+    /**
+     * Announce a new release received on the push channel
+     * Schedules a check in this device's slot of the spread window;
+     * devices in the staggered rollout group come first
+     * @param version Announced version, NULL if unknown; ignored if already installed
+     */
+    void notifyRelease(const char* version = NULL);
+
+    /**
+     * Pause a running download, e.g. while the application needs the link
+     * The download continues where it stopped after resumeDownload(),
+     * reconnecting with a Range request if the connection was dropped
+     */
+    void pauseDownload();
+
+    /**
+     * Resume a paused download
+     */
+    void resumeDownload();
+
+    /**
+     * Check if downloads are paused
+     */
+    bool isDownloadPaused() { return _downloadPaused; }
+
+    /**
+     * Install firmware from an arbitrary source (SD card, UART, memory)
+     * Runs the same write pipeline as the automatic HTTP update and
+     * reboots on success. Call from setup() or a maintenance routine.
+     * Refused while a signing key is set: pass the digest and signature.
+     * @param source Image source, opened by this call
+     * @return false if the update failed (check getLastError())
+     */
+    bool updateFrom(OTAUpdateSource& source);
+
+    /**
+     * Install firmware that must match a digest known in advance
+     * Required for sources anyone on the network can send to
+     * (OTAMulticastSource). The digest comes from a trusted channel, e.g.
+     * the sha256= line of a version file fetched over HTTPS; the image is
+     * only made bootable if it matches. With setSigningKey() the
+     * signature over the digest is required as well.
+     * @param source Image source, opened by this call
+     * @param sha256 Expected SHA-256 of the image (32 bytes)
+     * @param signature DER signature over the digest, NULL if unsigned
+     * @param signatureLen Length of the signature
+     * @return false if the update failed (check getLastError())
+     */
+    bool updateFrom(OTAUpdateSource& source, const uint8_t* sha256, const uint8_t* signature = NULL,
+                    size_t signatureLen = 0);
+
     /**
      * Get current version string
      * @return Current version
@@ -182,27 +561,139 @@ public:
      */
     const char* getLastError();
 
+    /**
+     * Get a consistent snapshot of runtime statistics
+     * Safe to call from any task; never blocks the OTA task
+     * @return Statistics snapshot
+     */
+    OTAStats getStats();
+
 private:
     // Configuration
-    char _firmwareURL[256];
-    char _versionURL[256];
+    OTAMirrorList _firmwareMirrors;
+    OTAMirrorList _versionMirrors;
     char _currentVersion[32];
-    unsigned long _checkInterval;
-    unsigned long _minRandomDelay;
-    unsigned long _maxRandomDelay;
+    unsigned long _retryDelay;
+    uint8_t _maxRetries;
     bool _staggeredRollout;
     uint8_t _rolloutPercentage;
     int _statusLED;
-    uint8_t _maxRetries;
     bool _debugMode;
+    OTAFlashMode _flashMode;
+    bool _skipUnchanged;
+    uint8_t _parallelConnections;
+    unsigned long _pushSpread;
+    OTARateLimiter _rateLimiter;
+    volatile bool _downloadPaused;
+    bool _matchProject;
+    bool _matchVersion;
+#if OTA_ENABLE_PRE_ERASE
+    bool _backgroundErase;
+    size_t _backgroundEraseBytes;
+    unsigned long _eraseInterval;
+#else
+    static constexpr bool _backgroundErase = false;
+#endif
 
     // State
     bool _isRunning;
+    bool _polled;                   // Driven by poll() instead of a task
     TaskHandle_t _taskHandle;
+    TaskHandle_t _jobHandle;        // Polled mode: request task running a PollJob
+    uint8_t _job;
+    TaskHandle_t _pollTask;         // Task inside poll(), NULL outside it
+    volatile bool _stopRequested;   // stop() waits for the tasks to see it and exit
+    OTAScheduler _scheduler;
+    portMUX_TYPE _scheduleMux = portMUX_INITIALIZER_UNLOCKED;  // Push channel and forceCheck() calls come from other tasks
+#if OTA_ENABLE_PRE_ERASE
+    OTAPreEraser _eraser;
+    unsigned long _lastEraseStep;
+#endif
     unsigned long _lastCheckTime;
-    uint8_t _retryCount;
+    unsigned long _checkStart;
+    bool _wifiLost;                 // Polled mode: WiFi found down at a due check
+    unsigned long _wifiLostAt;
     char _lastError[128];
-    bool _forceCheckFlag;
+    char _pendingVersion[32];
+    uint8_t _pendingHash[32];
+    bool _pendingHasHash;           // Manifest SHA-256 for the install in progress
+
+    // Optional features: without the switch the flags are constants,
+    // and the code reading them compiles away
+#if OTA_ENABLE_PEER_SHARE
+    bool _peerSharing;
+    uint16_t _peerPort;
+    OTAPeerShare _peerShare;
+    char _peerURL[OTA_PEER_URL_LEN];
+#else
+    static constexpr bool _peerSharing = false;
+#endif
+#if OTA_ENABLE_GATEWAY
+    bool _gatewayDiscovery;
+    uint16_t _gatewayPort;
+    bool _gatewayActive;            // Gateway URLs are first in the mirror lists, pinned
+#else
+    static constexpr bool _gatewayDiscovery = false;
+    static constexpr bool _gatewayActive = false;
+#endif
+#if OTA_ENABLE_DECRYPT
+    uint8_t _decryptKey[32];
+    uint8_t _decryptKeyLen;         // 0 when images are not encrypted
+#else
+    static constexpr uint8_t _decryptKeyLen = 0;
+#endif
+#if OTA_ENABLE_SIGNING
+    mbedtls_pk_context _signingKey;
+    bool _hasSigningKey;
+    uint8_t _pendingSig[OTA_SIGNATURE_MAX];
+    uint8_t _pendingSigLen;
+    uint8_t _cachedSig[OTA_SIGNATURE_MAX];
+    uint8_t _cachedSigLen;
+#else
+    static constexpr bool _hasSigningKey = false;
+#endif
+
+    // Last seen remote version and its validators for conditional requests
+    bool _versionFromImage;
+    bool _longPoll;
+    uint16_t _longPollHold;
+    uint16_t _longPollAsked;    // Hold requested by the last check, capped over TLS
+    char _cachedVersion[32];
+    uint8_t _cachedHash[32];
+    bool _cachedHasHash;
+#if OTA_ENABLE_CONDITIONAL
+    char _etag[80];
+    char _lastModified[32];
+#endif
+    int8_t _validatorMirror;        // Mirror that sent the version and its validators
+
+    // Install in progress, advanced by installStep()
+    struct InstallState {
+        OTAUpdateSource* source;
+        OTAUpdateSource* owned[2];  // Heap sources deleted when the install ends
+        size_t total;
+        size_t written;
+        unsigned long startTime;
+        unsigned long lastData;
+        unsigned long pausedAt;
+        bool paused;
+        bool sourceClosed;          // Dropped during a long pause
+        bool writeFailed;
+        bool fromPeer;
+        bool reconnect;             // Polled mode: source to be reopened by a request task
+        uint16_t abortReason;
+        uint8_t resumes;
+        uint32_t throttleMs;
+    };
+    InstallState _install;
+    OTAFlashWriter _writer;
+    bool _installing;
+
+    // Statistics, written only by the OTA task, or by poll() and its
+    // request task one at a time (sequence lock)
+    OTAStats _stats;
+    OTASeqlock _statsLock;
+    uint32_t _pollMaxMs;            // Written by poll() while a request task may run
 
     // Callbacks
     OTACallback _onUpdateStart;
@@ -211,18 +702,56 @@ private:
     OTAErrorCallback _onUpdateError;
     OTACallback _onVersionCheck;
 
+    // Polled mode work that waits on the network, run by a request task
+    enum PollJob : uint8_t {
+        JOB_CHECK,                  // Discovery, version check, download start
+        JOB_RECONNECT,              // Reopen a broken or paused download
+        JOB_FINISH                  // Close, verify and install, or fall back to the mirrors
+    };
+
     // Internal methods
     static void taskWrapper(void* parameter);
+    static void jobWrapper(void* parameter);
+    void startJob(PollJob job);
+    void runJob();
+    bool runCheck();
+    bool prepare();
+    void startSchedule();
+    void checkStarted();
+    void checkCompleted(bool success);
     void otaTask();
     bool checkForUpdate();
+    int fetchRemoteVersion(char* version, size_t len, uint32_t exclude = 0);
+    bool confirmWithOrigin(const char* version);
+    int requestVersion(int mirror, char* version, size_t len);
+    bool readVersionFile(HTTPClient& http, char* version, size_t len);
+    bool readImageVersion(HTTPClient& http, char* version, size_t len);
     bool performUpdate();
-    unsigned long getRandomDelay();
+    bool startPeerInstall();
+    bool startMirrorInstall();
+    bool startInstall(OTAUpdateSource* source, bool fromPeer);
+    void discoverGateway();
+    void dropGateway();
+    bool installFrom(OTAUpdateSource& source);
+    bool installBegin(OTAUpdateSource& source);
+    bool installStep(uint32_t budgetMs, uint32_t& waitMs);
+    bool installFinish();
+    bool runInstall();
+    void releaseInstall();
+    void abortInstall();
+    bool resumeInstall();
+    bool pauseStep(uint32_t& waitMs);
+    bool resumeSource(OTAUpdateSource& source, size_t offset);
     bool shouldUpdateNow();
     uint32_t getDeviceHash();
     void setError(const char* error);
+    void recordRequest(const OTAPhaseTimes& times, int httpCode, uint8_t redirects, bool cacheHit);
+    void recordResources();
+    void statsBegin();
+    void statsEnd();
     void blinkLED(int times, int delayMs = 200);
-    void log(const char* message);
-    void logf(const char* format, ...);
+    bool ledEnabled() { return OTA_ENABLE_STATUS_LED && _statusLED >= 0; }
+    void logf(uint8_t level, const char* format, ...);
 };
 
 #endif // ESP32_AUTOOTA_H
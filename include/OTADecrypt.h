@@ -0,0 +1,125 @@
+/**
+ * OTADecrypt.h
+ *
+ * Streaming decryption of encrypted firmware images for ESP32_AutoOTA
+ *
+ * Images encrypted with tools/ota_encrypt.py start with a 16-byte
+ * header (magic "AOTE" and a random 12-byte nonce), followed by the
+ * image encrypted with AES-CTR. The counter block is the nonce followed
+ * by the 32-bit big-endian block index, so any offset can be decrypted
+ * without the bytes before it and a resumed download picks up at the
+ * right keystream position. Decryption runs in place in the caller's
+ * buffer; mbedtls uses the ESP32's AES accelerator.
+ *
+ * CTR mode provides confidentiality only. Integrity comes from the
+ * manifest's sha256= line (over the decrypted image) and the image
+ * checks in OTAFlashWriter.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_DECRYPT_H
+#define OTA_DECRYPT_H
+
+#include <Arduino.h>
+#include <mbedtls/aes.h>
+#include "OTAUpdateSource.h"
+
+#ifndef OTA_ENABLE_DECRYPT
+#define OTA_ENABLE_DECRYPT 1                 // 0 removes image decryption
+#endif
+
+#define OTA_CRYPT_MAGIC "AOTE"
+#define OTA_CRYPT_HEADER_LEN 16              // Magic and nonce before the ciphertext
+#define OTA_CRYPT_NONCE_LEN 12
+
+#if OTA_ENABLE_DECRYPT
+
+/**
+ * AES-CTR keystream positioned by image offset
+ */
+class OTAImageCipher {
+public:
+    OTAImageCipher();
+    ~OTAImageCipher();
+
+    OTAImageCipher(const OTAImageCipher&) = delete;
+    OTAImageCipher& operator=(const OTAImageCipher&) = delete;
+
+    /**
+     * Set the AES key
+     * @param key 16 or 32 bytes (AES-128 or AES-256)
+     */
+    bool setKey(const uint8_t* key, size_t keyLen);
+
+    /**
+     * Read the nonce from an image header
+     * @return false if the header is not an encrypted image
+     */
+    bool begin(const uint8_t* header);
+
+    /**
+     * Position the keystream at a byte offset of the decrypted image
+     */
+    void seek(size_t offset);
+
+    /**
+     * Decrypt in place and advance the keystream
+     */
+    void apply(uint8_t* data, size_t len);
+
+private:
+    mbedtls_aes_context _aes;
+    uint8_t _nonce[OTA_CRYPT_NONCE_LEN];
+    uint8_t _counter[16];
+    uint8_t _stream[16];
+    size_t _streamOffset;
+};
+
+/**
+ * Encrypted image from any other source
+ * Wraps the source, strips the header and delivers plaintext. size()
+ * and open(offset) refer to the decrypted image.
+ */
+class OTADecryptSource : public OTAUpdateSource {
+public:
+    /**
+     * @param source Source of the encrypted image, must outlive this one
+     * @param key AES key, copied
+     * @param keyLen 16 or 32
+     */
+    OTADecryptSource(OTAUpdateSource& source, const uint8_t* key, size_t keyLen);
+
+    bool open(size_t offset = 0) override;
+
+    /**
+     * Start on a source that the caller already opened at offset 0
+     * @return false if the header is missing or not an encrypted image
+     */
+    bool attach();
+
+    size_t size() override;
+    int read(uint8_t* buffer, size_t len) override;
+    void close() override { _source.close(); }
+    const char* name() override { return "decrypt"; }
+    bool isTrusted() override { return _source.isTrusted(); }
+
+    /**
+     * Time spent decrypting since the last open(0), in microseconds
+     */
+    uint32_t getDecryptUs() { return _decryptUs; }
+
+private:
+    OTAUpdateSource& _source;
+    OTAImageCipher _cipher;
+    bool _keyValid;
+    bool _started;          // Header read, nonce known
+    uint32_t _decryptUs;
+
+    bool readHeader();
+};
+
+#endif // OTA_ENABLE_DECRYPT
+
+#endif // OTA_DECRYPT_H
@@ -0,0 +1,211 @@
+/**
+ * OTAFlashWriter.h
+ *
+ * Sector-aligned flash writer for ESP32_AutoOTA
+ *
+ * Collects incoming bytes into a 4 KB sector buffer and hands flash
+ * only full, sector-aligned blocks. Sources can read straight into the
+ * buffer (reserve/commit), so each byte is copied once from the socket.
+ * The image header is validated (OTAImage) as soon as it has arrived,
+ * before the first sector is written. With an expected SHA-256 (from
+ * the release manifest) every byte is hashed on its way to flash and
+ * the image is only finalized if the digest matches. A detached
+ * signature is verified against the same digest, so it costs no
+ * second pass over the flash.
+ *
+ * Two back ends:
+ * - OTA_FLASH_UPDATE: Arduino Update class (default)
+ * - OTA_FLASH_PARTITION: esp_partition_* writes straight to the next
+ *   OTA partition, skipping Update's internal copy. The image is
+ *   validated and made bootable only in end(). Optionally compares
+ *   each sector with the partition's current contents and leaves
+ *   identical sectors untouched.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_FLASH_WRITER_H
+#define OTA_FLASH_WRITER_H
+
+#include <Arduino.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/pk.h>
+#include "OTAImage.h"
+
+#define OTA_SECTOR_SIZE 4096
+#ifndef OTA_FLASH_STALL_US
+#define OTA_FLASH_STALL_US 150000            // Sector writes slower than this are stalls (normal: 30-60 ms)
+#endif
+
+enum OTAFlashMode {
+    OTA_FLASH_UPDATE,
+    OTA_FLASH_PARTITION
+};
+
+class OTAFlashWriter {
+public:
+    OTAFlashWriter();
+    ~OTAFlashWriter();
+
+    /**
+     * Select the back end, before begin()
+     */
+    void setMode(OTAFlashMode mode) { _mode = mode; }
+
+    /**
+     * Skip erasing sectors below this offset if they are still blank
+     * (partition mode, see OTAPreEraser), before begin()
+     */
+    void setPreErased(size_t bytes) { _preErased = bytes; }
+
+    /**
+     * Leave sectors that already hold the incoming bytes untouched
+     * (partition mode). Saves the erase and write for sectors shared with
+     * the image previously installed in the inactive partition.
+     */
+    void setSkipUnchanged(bool enable) { _skipUnchanged = enable; }
+
+    /**
+     * Configure the early header check (chip ID and magic are always checked)
+     * @param matchProject Require the running firmware's project name
+     * @param expectedVersion Required embedded version, NULL to skip
+     */
+    void setImageCheck(bool matchProject, const char* expectedVersion) {
+        _matchProject = matchProject;
+        _expectedVersion = expectedVersion;
+    }
+
+    /**
+     * Get the result of the header check, OTA_IMAGE_OK until it ran
+     */
+    OTAImageCheck getImageCheck() { return _imageCheck; }
+
+    /**
+     * Require the image to hash to this SHA-256, before begin()
+     * @param sha256 32-byte digest, NULL to skip; must outlive the writer
+     */
+    void setExpectedHash(const uint8_t* sha256) { _expectedHash = sha256; }
+
+    /**
+     * Require a signature over the image's SHA-256, before begin()
+     * Verified in end(), before the image is made bootable
+     * @param key Public key, NULL to skip; must outlive the writer
+     * @param signature DER-encoded signature; must outlive the writer
+     */
+    void setSignature(mbedtls_pk_context* key, const uint8_t* signature, size_t len) {
+        _signingKey = key;
+        _signature = signature;
+        _signatureLen = len;
+    }
+
+    /**
+     * Check if end() rejected the image because its SHA-256 differed
+     */
+    bool getHashMismatch() { return _hashMismatch; }
+
+    /**
+     * Check if end() rejected the image because the signature did not verify
+     */
+    bool getSignatureInvalid() { return _signatureInvalid; }
+
+    /**
+     * Prepare to write an image
+     * @param size Image size in bytes
+     * @return false if the image does not fit or memory is short
+     */
+    bool begin(size_t size);
+
+    /**
+     * Get free space in the sector buffer to read into
+     * @param space Set to the first free byte
+     * @return Number of free bytes at space
+     */
+    size_t reserve(uint8_t** space);
+
+    /**
+     * Mark bytes read into reserve() space as filled, flushing full sectors
+     * @return false on a flash error
+     */
+    bool commit(size_t len);
+
+    /**
+     * Write bytes from caller memory
+     * Whole sectors are written straight from data without copying
+     * @return Bytes accepted, less than len on a flash error
+     */
+    size_t write(const uint8_t* data, size_t len);
+
+    /**
+     * Flush the final partial sector and finalize the image
+     * @return false if the image is incomplete or invalid
+     */
+    bool end();
+
+    /**
+     * Discard the image
+     */
+    void abort();
+
+    /**
+     * Get the last error (Update error code or esp_err_t)
+     */
+    int getError() { return _error; }
+
+    /**
+     * Bytes handed to flash so far
+     */
+    size_t getFlushed() { return _flushed; }
+
+    // Instrumentation
+    uint32_t getWriteCalls() { return _writeCalls; }
+    uint32_t getWriteUs() { return _writeUs; }
+    uint32_t getStallUs() { return _stallUs; }
+    uint32_t getStallCount() { return _stallCount; }
+    uint32_t getStallMaxUs() { return _stallMaxUs; }
+    uint32_t getSkippedSectors() { return _skippedSectors; }
+    uint32_t getVerifyUs() { return _verifyUs; }
+
+private:
+    OTAFlashMode _mode;
+    const esp_partition_t* _partition;
+    uint8_t* _buffer;
+    size_t _fill;
+    size_t _size;
+    size_t _flushed;
+    size_t _preErased;
+    bool _skipUnchanged;
+    bool _matchProject;
+    const char* _expectedVersion;
+    bool _imageChecked;
+    OTAImageCheck _imageCheck;
+    const uint8_t* _expectedHash;
+    bool _hashing;
+    bool _hashMismatch;
+    mbedtls_pk_context* _signingKey;
+    const uint8_t* _signature;
+    size_t _signatureLen;
+    bool _signatureInvalid;
+    mbedtls_sha256_context _sha;
+    int _error;
+    bool _active;
+
+    uint32_t _writeCalls;
+    uint32_t _writeUs;
+    uint32_t _stallUs;
+    uint32_t _stallCount;
+    uint32_t _stallMaxUs;
+    uint32_t _skippedSectors;
+    uint32_t _verifyUs;
+
+    bool flush(const uint8_t* data, size_t len);
+    bool checkHeader(const uint8_t* data, size_t len);
+    bool checkHash();
+    bool sectorBlank(size_t offset);
+    bool sectorMatches(size_t offset, const uint8_t* data, size_t len);
+    void release();
+};
+
+#endif // OTA_FLASH_WRITER_H
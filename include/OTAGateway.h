@@ -0,0 +1,146 @@
+/**
+ * OTAGateway.h
+ *
+ * Site gateway (caching proxy) for ESP32_AutoOTA
+ *
+ * One device per site keeps a copy of the version file and firmware
+ * image on a filesystem (SD card, LittleFS) and serves them to the
+ * other devices, so the origin sees one request per site instead of
+ * one per device. The upstream version file is polled with conditional
+ * requests; a new image is downloaded to a temporary file, checked
+ * against the manifest's sha256= line when there is one (sha256-enc=,
+ * required, for an encrypted image), and only then replaces the cached
+ * copy. The version file is replaced last, so a device never sees a
+ * version whose image is not there yet.
+ *
+ * Devices find the gateway with ESP32_AutoOTA::setGatewayDiscovery()
+ * and put it ahead of their configured mirrors; the configured URLs
+ * stay as the fallback.
+ *
+ * HTTP (OTA_GATEWAY_PORT):
+ *   GET /version.txt    ETag / If-None-Match
+ *   GET /firmware.bin   ETag / If-None-Match, Range
+ *
+ * Discovery (UDP, same port), <hash> identifies the upstream firmware URL:
+ *   request  "AUTOOTA?GW <hash>"          broadcast
+ *   reply    "AUTOOTA!GW <hash> <port>"   unicast to the sender
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_GATEWAY_H
+#define OTA_GATEWAY_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <WiFi.h>
+#include <WiFiServer.h>
+#include <WiFiUdp.h>
+
+#ifndef OTA_ENABLE_GATEWAY
+#define OTA_ENABLE_GATEWAY 1                 // 0 removes the gateway and its discovery
+#endif
+
+#define OTA_GATEWAY_PORT 3234
+#define OTA_GATEWAY_REFRESH_MS 300000        // Upstream version check interval
+#define OTA_GATEWAY_STACK 8192               // Server task stack size (TLS upstream)
+#define OTA_GATEWAY_DISCOVERY_MS 500         // Wait for discovery replies
+#define OTA_GATEWAY_IO_TIMEOUT 3000          // Request header and send timeout
+#define OTA_GATEWAY_STALL_MS 30000           // Upstream download without data
+#define OTA_GATEWAY_URL_LEN 32               // "http://<ip>:<port>"
+#define OTA_GATEWAY_DIR "/autoota"
+
+#if OTA_ENABLE_GATEWAY
+
+class OTAGateway {
+public:
+    /**
+     * @param fs Filesystem for the cached files, mounted before begin()
+     */
+    OTAGateway(fs::FS& fs);
+    ~OTAGateway();
+
+    /**
+     * Set the origin URLs, the same ones the devices are configured with
+     * Both strings must outlive the gateway
+     */
+    void setUpstream(const char* versionUrl, const char* firmwareUrl);
+
+    /**
+     * Set how often the origin is asked for a new version
+     */
+    void setRefreshInterval(unsigned long ms) { _refreshMs = ms; }
+
+    /**
+     * Start serving; the cache left on the filesystem is served right away
+     * @return false if no upstream is set or the task failed to start
+     */
+    bool begin(uint16_t port = OTA_GATEWAY_PORT);
+
+    /**
+     * Stop serving
+     */
+    void end();
+
+    bool isRunning() { return _task != NULL; }
+
+    /**
+     * Check the origin for a new version without waiting for the interval
+     */
+    void refresh();
+
+    /**
+     * Get the cached version, empty until the first successful fetch
+     */
+    const char* getVersion() { return _version; }
+
+    // Requests answered from the cache and downloads from the origin
+    uint32_t getRequestsServed() { return _served; }
+    uint32_t getUpstreamFetches() { return _fetches; }
+
+    /**
+     * Ask the LAN for a gateway caching this firmware URL
+     * @param firmwareUrl Origin firmware URL the device is configured with
+     * @param port Discovery port
+     * @param base Receives "http://<ip>:<port>"
+     * @param len Size of base (OTA_GATEWAY_URL_LEN)
+     * @return true if a gateway answered within OTA_GATEWAY_DISCOVERY_MS
+     */
+    static bool find(const char* firmwareUrl, uint16_t port, char* base, size_t len);
+
+private:
+    fs::FS& _fs;
+    const char* _versionUrl;
+    const char* _firmwareUrl;
+    uint16_t _port;
+    unsigned long _refreshMs;
+    TaskHandle_t _task;
+    volatile bool _stop;
+    volatile bool _refreshNow;
+
+    char _version[32];          // First line of the cached version file
+    char _upstreamTag[80];      // Origin ETag of the cached version file
+    char _tag[12];              // ETag served for both files
+    size_t _imageSize;
+    uint32_t _served;
+    uint32_t _fetches;
+
+    static void taskWrapper(void* parameter);
+    void run();
+    void loadCache();
+    bool refreshUpstream();
+    bool fetchImage(const String& manifest);
+    bool writeFile(const char* path, const String& content);
+    static bool findDigest(const char* manifest, const char* key, uint8_t digest[32]);
+    void answerDiscovery(WiFiUDP& udp);
+    void serveClient(WiFiClient& client);
+    void sendFile(WiFiClient& client, const char* path, size_t first, size_t last, bool ranged);
+    bool readLine(WiFiClient& client, char* line, size_t len);
+
+    static uint32_t hash(const char* text);
+};
+
+#endif // OTA_ENABLE_GATEWAY
+
+#endif // OTA_GATEWAY_H
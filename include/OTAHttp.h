@@ -0,0 +1,207 @@
+/**
+ * OTAHttp.h
+ *
+ * HTTP request helper for ESP32_AutoOTA
+ *
+ * Wraps HTTPClient so that name resolution, TCP connect and the TLS
+ * handshake run as separate, timed steps before the request is sent.
+ * HTTPClient then reuses the already connected client.
+ *
+ * Redirects are followed here rather than by HTTPClient, and the final
+ * location is cached (OTA_REDIRECT_CACHE_SIZE entries, shared by all
+ * requests) until it expires or fails. Repeated requests for a GitHub
+ * release asset then go straight to the signed CDN URL.
+ *
+ * Host names are resolved through a small DNS cache. An answer is fresh
+ * for OTA_DNS_TTL_MS; after that it is still used, so a slow or failing
+ * resolver does not fail the check, and refreshDNS() looks it up again
+ * off the request path.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_HTTP_H
+#define OTA_HTTP_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+
+#define OTA_HTTP_CONNECT_TIMEOUT 10000       // 10 seconds for TCP connect
+#define OTA_HTTP_MAX_HOST 128                // Longest host name we resolve
+#define OTA_HTTP_MAX_HEADERS 8               // Request headers replayed across redirects
+#define OTA_HTTP_MAX_REDIRECTS 5             // Hops followed per request
+#define OTA_REDIRECT_CACHE_SIZE 4            // Resolved locations kept
+#define OTA_REDIRECT_TTL_MS 300000           // Longest a resolved location is reused
+
+#define OTA_KEEPALIVE_IDLE_S 15              // Probe a silent connection after 15 s
+#define OTA_KEEPALIVE_INTERVAL_S 5
+#define OTA_KEEPALIVE_COUNT 3                // Unanswered probes before the socket fails
+
+#ifndef OTA_DNS_CACHE_SIZE
+#define OTA_DNS_CACHE_SIZE 4                 // Host names kept
+#endif
+#ifndef OTA_DNS_TTL_MS
+#define OTA_DNS_TTL_MS 300000                // Answer is fresh for 5 minutes
+#endif
+#ifndef OTA_DNS_STALE_MS
+#define OTA_DNS_STALE_MS 86400000            // Stale answer still used for a day while refreshed
+#endif
+
+/**
+ * Parsed http:// or https:// URL
+ * path points into the original string, which must outlive this struct
+ */
+struct OTAUrl {
+    bool secure;
+    char host[OTA_HTTP_MAX_HOST];
+    uint16_t port;
+    const char* path;
+
+    /**
+     * Split a URL into its parts
+     * @return false if the scheme is not http or https or the host is too long
+     */
+    bool parse(const char* url);
+};
+
+/**
+ * Timings of the phases of one request, in milliseconds
+ * For HTTPS the TCP connect happens inside the TLS call, so the
+ * combined time is reported in tlsMs and connectMs stays 0
+ */
+struct OTAPhaseTimes {
+    uint32_t dnsMs;
+    uint32_t connectMs;
+    uint32_t tlsMs;
+    uint32_t ttfbMs;
+};
+
+class OTAHttpRequest {
+public:
+    OTAHttpRequest();
+    ~OTAHttpRequest();
+
+    /**
+     * Resolve and connect to the host of a URL, then prepare the request
+     * @param url Full http:// or https:// URL
+     * @return false if the URL is invalid or the host cannot be reached
+     */
+    bool begin(const char* url);
+
+    /**
+     * Add a request header, kept and sent again if the request is redirected
+     * @param name Header name, must outlive the request (string literal)
+     * @param value Header value, copied
+     */
+    void addHeader(const char* name, const char* value);
+
+    /**
+     * Wait longer for the response, e.g. for a long-poll request
+     * Also enables TCP keepalive, so a peer that vanished while holding
+     * the request is noticed within seconds instead of at the timeout
+     * @param timeoutMs Time allowed for the response headers
+     */
+    void setTimeout(uint16_t timeoutMs);
+
+    /**
+     * Check if setTimeout() can enable TCP keepalive on this connection
+     * False for TLS: the ESP32 core does not expose the socket of a
+     * WiFiClientSecure, so only the timeout notices a vanished peer
+     */
+    bool canKeepAlive() const;
+
+    /**
+     * Prepare another request on the connection left open by the last one
+     * Falls back to begin() when the server has closed it or the URL now
+     * resolves to another host
+     * @param url Full URL on the same host
+     * @return false if the host cannot be reached
+     */
+    bool reuse(const char* url);
+
+    /**
+     * Send a GET request and wait for the response headers
+     * Follows redirects and caches the final location of a redirected URL
+     * @return HTTP status code, or a negative HTTPC_ERROR_* code
+     */
+    int GET();
+
+    /**
+     * Close the connection and release the client
+     */
+    void end();
+
+    /**
+     * Access the underlying client to add headers or read the body
+     */
+    HTTPClient& http() { return _http; }
+
+    /**
+     * Get phase timings of the current request
+     */
+    const OTAPhaseTimes& getTimes() const { return _times; }
+
+    /**
+     * Get redirect hops followed by the current request
+     */
+    uint8_t getRedirects() const { return _redirects; }
+
+    /**
+     * Check if the current request went straight to a cached location
+     */
+    bool getCacheHit() const { return _cacheHit; }
+
+    /**
+     * Drop all cached redirect locations
+     */
+    static void clearRedirectCache();
+
+    /**
+     * Look up again the cached host names whose answers went stale
+     * Blocks on DNS; call outside time-critical paths. A failed lookup
+     * keeps the stale address.
+     */
+    static void refreshDNS();
+
+    /**
+     * Drop all cached host name answers, e.g. after joining another network
+     */
+    static void clearDNSCache();
+
+private:
+    struct Header {
+        const char* name;
+        String value;
+    };
+
+    HTTPClient _http;
+    WiFiClient* _client;
+    OTAPhaseTimes _times;
+    bool _begun;
+
+    const char* _url;       // URL as requested
+    String _location;       // URL actually connected to
+    Header _headers[OTA_HTTP_MAX_HEADERS];
+    uint8_t _headerCount;
+    uint16_t _timeoutMs;    // 0 for the HTTPClient default
+    uint8_t _redirects;
+    bool _cacheHit;
+
+    bool connect(const char* url);
+    bool follow(const char* url);
+    void disconnect();
+    void applyTimeout();
+
+    static bool resolve(const char* host, IPAddress& ip, bool& cached);
+    static void storeHost(const char* host, const IPAddress& ip);
+    static void forgetHost(const char* host);
+
+    static bool lookupRedirect(const char* url, String& location);
+    static void storeRedirect(const char* url, const char* location);
+    static void forgetRedirect(const char* url);
+};
+
+#endif // OTA_HTTP_H
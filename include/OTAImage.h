@@ -0,0 +1,64 @@
+/**
+ * OTAImage.h
+ *
+ * Early firmware image validation for ESP32_AutoOTA
+ *
+ * Parses the image header and app descriptor (esp_app_desc_t) from the
+ * first OTA_IMAGE_HEADER_LEN bytes of a download, so an image built for
+ * another chip or project is rejected before anything reaches flash.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_IMAGE_H
+#define OTA_IMAGE_H
+
+#include <Arduino.h>
+#include <esp_app_format.h>
+
+// Image header + first segment header + app descriptor
+#define OTA_IMAGE_HEADER_LEN (sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t))
+
+enum OTAImageCheck {
+    OTA_IMAGE_OK = 0,
+    OTA_IMAGE_BAD_MAGIC,
+    OTA_IMAGE_WRONG_CHIP,
+    OTA_IMAGE_NO_APP_DESC,
+    OTA_IMAGE_WRONG_PROJECT,
+    OTA_IMAGE_WRONG_VERSION
+};
+
+struct OTAImageInfo {
+    uint16_t chipId;
+    char version[32];
+    char projectName[32];
+};
+
+class OTAImage {
+public:
+    /**
+     * Parse the start of an image
+     * @param data First bytes of the image
+     * @param len Number of bytes, at least OTA_IMAGE_HEADER_LEN
+     * @param info Filled with chip ID, version and project name
+     * @return OTA_IMAGE_OK, OTA_IMAGE_BAD_MAGIC or OTA_IMAGE_NO_APP_DESC
+     */
+    static OTAImageCheck parse(const uint8_t* data, size_t len, OTAImageInfo& info);
+
+    /**
+     * Check that an image may be installed on this device
+     * Chip ID always has to match the running firmware
+     * @param info Parsed image information
+     * @param matchProject Require the running firmware's project name
+     * @param expectedVersion Required embedded version, NULL to skip
+     */
+    static OTAImageCheck check(const OTAImageInfo& info, bool matchProject, const char* expectedVersion);
+
+    /**
+     * Get a short description of a check result
+     */
+    static const char* describe(OTAImageCheck result);
+};
+
+#endif // OTA_IMAGE_H
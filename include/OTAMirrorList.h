@@ -0,0 +1,131 @@
+/**
+ * OTAMirrorList.h
+ *
+ * Ranked mirror URLs for ESP32_AutoOTA
+ *
+ * Holds up to OTA_MAX_MIRRORS URLs serving the same file, with a small
+ * per-device score for each: a moving average of request latency plus
+ * a penalty per recent failure. The engine always tries the mirror with
+ * the lowest score first; a mirror never reached is tried before any
+ * measured one, so every mirror gets a latency. A pinned mirror (the
+ * site gateway) is tried first whatever its score. Scores are kept in
+ * NVS keyed by a hash of the URL, so they survive reboots and
+ * reordering of the list.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_MIRROR_LIST_H
+#define OTA_MIRROR_LIST_H
+
+#include <Arduino.h>
+
+#ifndef OTA_NVS_NAMESPACE
+#define OTA_NVS_NAMESPACE "autoota"
+#endif
+
+#ifndef OTA_MAX_MIRRORS
+#define OTA_MAX_MIRRORS 4                    // URLs per list, including a discovered gateway
+#endif
+#define OTA_MIRROR_UNKNOWN_MS 0              // Assumed latency of a mirror never reached
+#define OTA_MIRROR_FAILURE_MS 5000           // Score penalty per recent failure
+#define OTA_MIRROR_MAX_FAILURES 8
+
+class OTAMirrorList {
+public:
+    OTAMirrorList();
+    ~OTAMirrorList();
+
+    OTAMirrorList(const OTAMirrorList&) = delete;
+    OTAMirrorList& operator=(const OTAMirrorList&) = delete;
+
+    /**
+     * Replace the list with a single URL
+     * @param url Full URL, NULL to clear
+     * @param copy True to keep a heap copy, false to reference the string in place
+     */
+    void set(const char* url, bool copy);
+
+    /**
+     * Append a mirror
+     * @return false if the list is full or out of memory
+     */
+    bool add(const char* url, bool copy);
+
+    /**
+     * Insert a mirror ahead of the others, so it wins ties in best()
+     * @return false if the list is full or out of memory
+     */
+    bool prepend(const char* url, bool copy);
+
+    /**
+     * Try a mirror ahead of all others regardless of its score, until
+     * it is removed; the caller drops it when it fails
+     */
+    void pin(uint8_t index);
+
+    /**
+     * Remove one mirror, later entries move down by one
+     */
+    void remove(uint8_t index);
+
+    /**
+     * Remove all mirrors
+     */
+    void clear();
+
+    uint8_t count() const { return _count; }
+    const char* url(uint8_t index) const { return _mirrors[index].url; }
+    uint8_t failures(uint8_t index) const { return _mirrors[index].failures; }
+
+    /**
+     * Pick the pinned mirror, else the one with the lowest score
+     * @param exclude Bit mask of mirror indices to skip
+     * @return Mirror index, -1 if none is left
+     */
+    int best(uint32_t exclude = 0) const;
+
+    /**
+     * Get the score of a mirror, lower is better
+     */
+    uint32_t score(uint8_t index) const;
+
+    /**
+     * Record a successful request
+     * @param latencyMs Time from connect to response headers
+     */
+    void recordSuccess(uint8_t index, uint32_t latencyMs);
+
+    /**
+     * Record a failed request (unreachable, HTTP error, broken transfer)
+     */
+    void recordFailure(uint8_t index);
+
+    /**
+     * Restore scores from NVS
+     */
+    void load();
+
+    /**
+     * Persist scores to NVS if they changed
+     */
+    void save();
+
+private:
+    struct Mirror {
+        const char* url;
+        bool owned;
+        uint32_t latencyMs;     // Moving average, 0 until first success
+        uint8_t failures;       // Recent failures, halved on each success
+        bool pinned;            // Tried first, not ranked
+    };
+
+    Mirror _mirrors[OTA_MAX_MIRRORS];
+    uint8_t _count;
+    bool _dirty;
+
+    static void makeKey(const char* url, char* key);
+};
+
+#endif // OTA_MIRROR_LIST_H
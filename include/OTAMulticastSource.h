@@ -0,0 +1,125 @@
+/**
+ * OTAMulticastSource.h
+ *
+ * UDP multicast image source for ESP32_AutoOTA
+ *
+ * A site gateway streams the image to a multicast group once for all
+ * devices (tools/ota_multicast_send.py). The image is cut into groups
+ * of k blocks, and each group is followed by one XOR parity block, so
+ * a device recovers any single lost packet per group without asking
+ * for anything. A group that lost more than that is fetched from the
+ * fallback URL with an HTTP Range request as soon as the stream has
+ * moved past it; if the stream ends or the device joined too late to
+ * catch it, the rest of the image comes from the fallback URL.
+ *
+ * Groups are delivered strictly in order, so the image goes through
+ * the normal install pipeline (ESP32_AutoOTA::updateFrom()).
+ *
+ * Packet (little-endian), payload always blockSize bytes:
+ *   magic "AOTM" | image id | image size | group | blockSize (16) | k (8) | index (8)
+ * index 0..k-1 are data blocks, index k is the group's parity block.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_MULTICAST_SOURCE_H
+#define OTA_MULTICAST_SOURCE_H
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include "OTAUpdateSource.h"
+
+#define OTA_MCAST_PORT 3233
+#define OTA_MCAST_MAGIC 0x4D544F41           // "AOTM"
+#define OTA_MCAST_HEADER_LEN 20
+#define OTA_MCAST_MAX_BLOCK 1400             // Payload that fits one Ethernet frame
+#define OTA_MCAST_MAX_K 16                   // Data blocks per group
+#define OTA_MCAST_JOIN_MS 5000               // Wait for the first packet in open()
+#define OTA_MCAST_IDLE_MS 3000               // Silence that ends the session
+#define OTA_MCAST_CATCHUP_MS 20000           // Wait for a group the stream already passed
+#define OTA_MCAST_FETCH_MS 15000             // Time allowed to fetch one group over HTTP
+#define OTA_MCAST_BURST 16                   // Packets handled per read() call
+
+class OTAMulticastSource : public OTAUpdateSource {
+public:
+    /**
+     * @param group Multicast group address, e.g. 239.255.0.1
+     * @param port UDP port
+     * @param fallbackUrl URL of the same image for lost groups, NULL for
+     *                    multicast only; must outlive the source
+     */
+    OTAMulticastSource(IPAddress group, uint16_t port = OTA_MCAST_PORT, const char* fallbackUrl = NULL);
+    ~OTAMulticastSource();
+
+    bool open(size_t offset = 0) override;
+    size_t size() override { return _size; }
+    int read(uint8_t* buffer, size_t len) override;
+    size_t peek(const uint8_t** data, size_t maxLen) override;
+    void consume(size_t len) override;
+    void close() override;
+    const char* name() override { return "multicast"; }
+    bool isTrusted() override { return false; }   // Anyone on the LAN can send to the group
+
+    // Groups received complete, rebuilt from parity, and fetched over HTTP
+    uint32_t getGroupsReceived() { return _groupsReceived; }
+    uint32_t getGroupsRecovered() { return _groupsRecovered; }
+    uint32_t getGroupsFetched() { return _groupsFetched; }
+
+    /**
+     * Check if the session ended and the rest comes from the fallback URL
+     */
+    bool isUnicast() { return _unicast; }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t imageId;
+        uint32_t size;
+        uint32_t group;
+        uint16_t blockSize;
+        uint8_t k;
+        uint8_t index;
+    };
+
+    IPAddress _group;
+    uint16_t _port;
+    const char* _fallbackUrl;
+    WiFiUDP _udp;
+    OTAHttpSource _http;
+    bool _joined;
+    bool _unicast;
+    bool _failed;
+
+    // Session parameters, from the first packet
+    uint32_t _imageId;
+    size_t _size;
+    uint16_t _blockSize;
+    uint8_t _k;
+
+    uint8_t* _packet;
+    uint8_t* _buffer;       // k data blocks followed by the parity block
+    uint32_t _present;      // Bit per block index received
+    size_t _groupIndex;
+    size_t _groupLen;
+    size_t _groupPos;
+    bool _groupReady;
+    bool _groupSeen;        // A packet of this group arrived
+    uint32_t _waitStart;
+    uint32_t _lastPacket;
+
+    uint32_t _groupsReceived;
+    uint32_t _groupsRecovered;
+    uint32_t _groupsFetched;
+
+    bool receive(Header& header);
+    bool accept(const Header& header);
+    void startGroup(size_t group);
+    bool pump();
+    bool decode();
+    bool fetchGroup();
+    bool switchToUnicast();
+    void leave();
+};
+
+#endif // OTA_MULTICAST_SOURCE_H
@@ -0,0 +1,127 @@
+/**
+ * OTAParallelSource.h
+ *
+ * Multi-connection HTTP image source for ESP32_AutoOTA
+ *
+ * On high-latency links one TCP stream is limited by window size over
+ * RTT. This source fetches the image as consecutive fixed-size chunks
+ * on several connections at once, each driven by its own task. Every
+ * connection owns one chunk buffer; together they form the reorder
+ * buffer. The pipeline reads the chunks strictly in order, straight
+ * from the buffers through peek(), and a buffer is refilled with the
+ * next unassigned chunk once it has been consumed.
+ *
+ * The server must honour Range requests. Connections are kept alive
+ * between chunks where the server allows it.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_PARALLEL_SOURCE_H
+#define OTA_PARALLEL_SOURCE_H
+
+#include <Arduino.h>
+#include "OTAUpdateSource.h"
+
+#ifndef OTA_ENABLE_PARALLEL
+#define OTA_ENABLE_PARALLEL 1                // 0 removes multi-connection downloads
+#endif
+
+#define OTA_PARALLEL_MAX 4                   // Upper limit for connections
+#define OTA_PARALLEL_CHUNK 32768             // Bytes per ranged request
+#define OTA_PARALLEL_STACK 8192              // Worker task stack size
+#define OTA_PARALLEL_TLS_HEAP 45000          // Heap one TLS session needs
+#define OTA_PARALLEL_HEAP_RESERVE 32768      // Heap left for the rest of the system
+#define OTA_PARALLEL_STALL 15000             // A chunk without data for this long is retried
+#define OTA_PARALLEL_RETRIES 2               // Attempts per chunk after the first
+
+#if OTA_ENABLE_PARALLEL
+
+class OTAParallelHttpSource : public OTAUpdateSource {
+public:
+    /**
+     * @param url Firmware URL, must outlive the source
+     * @param connections Requested connections, capped by free heap
+     */
+    OTAParallelHttpSource(const char* url, uint8_t connections);
+    ~OTAParallelHttpSource();
+
+    bool open(size_t offset = 0) override;
+    size_t size() override { return _size; }
+    int read(uint8_t* buffer, size_t len) override;
+    size_t peek(const uint8_t** data, size_t maxLen) override;
+    void consume(size_t len) override;
+
+    /**
+     * Tell the workers to stop, without waiting for them
+     * open() and the destructor wait until they have exited
+     */
+    void close() override;
+    const char* name() override { return "http-parallel"; }
+
+    /**
+     * Get HTTP status code of the probe request made by open()
+     */
+    int getHTTPCode() { return _httpCode; }
+
+    /**
+     * Get timings of the probe request made by open()
+     */
+    const OTAPhaseTimes& getTimes() { return _times; }
+    uint8_t getRedirects() { return _redirects; }
+    bool getCacheHit() { return _cacheHit; }
+
+    /**
+     * Connections actually started, after the heap cap
+     */
+    uint8_t getConnections() { return _slotCount; }
+
+private:
+    enum SlotState : uint8_t {
+        SLOT_FREE,      // Consumed, worker may take the next chunk
+        SLOT_FILLING,   // Worker is downloading into the buffer
+        SLOT_DONE       // Worker exited
+    };
+
+    struct Slot {
+        OTAParallelHttpSource* owner;
+        TaskHandle_t task;
+        uint8_t* buffer;
+        size_t chunk;   // Chunk index held in buffer
+        size_t len;     // Bytes in this chunk
+        size_t fill;    // Bytes received so far
+        SlotState state;
+        bool failed;
+    };
+
+    const char* _url;
+    uint8_t _requested;
+    uint8_t _slotCount;
+    Slot _slots[OTA_PARALLEL_MAX];
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+    size_t _offset;
+    size_t _size;
+    size_t _chunkCount;
+    size_t _nextChunk;      // Next chunk to hand to a worker
+    size_t _readChunk;      // Chunk the pipeline is reading
+    size_t _readPos;        // Position inside _readChunk
+    volatile bool _stop;
+    int _httpCode;
+    OTAPhaseTimes _times;
+    uint8_t _redirects;
+    bool _cacheHit;
+
+    void join();
+    bool probe();
+    uint8_t connectionBudget(bool secure);
+    Slot* slotFor(size_t chunk);
+    static void workerTask(void* parameter);
+    void runWorker(Slot& slot);
+    bool fetchChunk(OTAHttpRequest& request, Slot& slot);
+};
+
+#endif // OTA_ENABLE_PARALLEL
+
+#endif // OTA_PARALLEL_SOURCE_H
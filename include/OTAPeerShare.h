@@ -0,0 +1,111 @@
+/**
+ * OTAPeerShare.h
+ *
+ * LAN firmware sharing between ESP32_AutoOTA devices
+ *
+ * A device that installed an image whose SHA-256 was announced in the
+ * release manifest remembers the digest in NVS. After rebooting into
+ * that image it serves its own app partition to peers over plain HTTP
+ * (GET /ota/<sha256>.bin, with Range support) and answers UDP broadcast
+ * discovery for the digest. A device about to update asks the LAN first
+ * and only goes to the mirrors if no peer answers; the flash writer
+ * verifies the digest either way.
+ *
+ * Discovery (UDP, OTA_PEER_PORT):
+ *   request  "AUTOOTA?1 <sha256 hex>"             broadcast
+ *   reply    "AUTOOTA!1 <sha256 hex> <tcp port>"  unicast to the sender
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_PEER_SHARE_H
+#define OTA_PEER_SHARE_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiServer.h>
+#include <WiFiUdp.h>
+#include <esp_ota_ops.h>
+
+#ifndef OTA_ENABLE_PEER_SHARE
+#define OTA_ENABLE_PEER_SHARE 1              // 0 removes LAN sharing between devices
+#endif
+
+#ifndef OTA_NVS_NAMESPACE
+#define OTA_NVS_NAMESPACE "autoota"
+#endif
+
+#define OTA_PEER_PORT 3232                   // TCP (image) and UDP (discovery)
+#define OTA_PEER_DISCOVERY_MS 500            // Wait for discovery replies
+#define OTA_PEER_STACK 6144                  // Server task stack size
+#define OTA_PEER_IO_TIMEOUT 3000             // Request header and send timeout
+#define OTA_PEER_URL_LEN 120                 // "http://<ip>:<port>/ota/<64 hex>.bin"
+
+#if OTA_ENABLE_PEER_SHARE
+
+class OTAPeerShare {
+public:
+    OTAPeerShare();
+    ~OTAPeerShare();
+
+    /**
+     * Start serving the running image if it is a verified one
+     * @param port TCP and UDP port
+     * @return false if there is nothing to serve or the task failed to start
+     */
+    bool begin(uint16_t port = OTA_PEER_PORT);
+
+    /**
+     * Stop serving
+     */
+    void end();
+
+    /**
+     * Check if the server task is running
+     */
+    bool isServing() { return _task != NULL; }
+
+    /**
+     * Record the digest of the image just installed in the boot partition
+     * Served after the next boot, unless the bootloader rolls it back
+     */
+    static void remember(const uint8_t* sha256, size_t size);
+
+    /**
+     * Drop the recorded digest before an install writes to a partition
+     * An install without a digest would otherwise leave it pointing at
+     * whatever lands in that partition
+     */
+    static void forget();
+
+    /**
+     * Ask the LAN for a peer serving an image
+     * @param sha256 Digest from the release manifest
+     * @param port Discovery port
+     * @param url Receives the peer's download URL
+     * @param len Size of url (OTA_PEER_URL_LEN)
+     * @return true if a peer answered within OTA_PEER_DISCOVERY_MS
+     */
+    static bool find(const uint8_t* sha256, uint16_t port, char* url, size_t len);
+
+private:
+    uint16_t _port;
+    TaskHandle_t _task;
+    volatile bool _stop;
+    const esp_partition_t* _partition;
+    size_t _size;
+    char _hash[65];         // Hex digest of the served image
+
+    static void taskWrapper(void* parameter);
+    void run();
+    void answerDiscovery(WiFiUDP& udp);
+    void serveClient(WiFiClient& client);
+    bool readLine(WiFiClient& client, char* line, size_t len);
+
+    static void toHex(const uint8_t* data, size_t len, char* hex);
+};
+
+#endif // OTA_ENABLE_PEER_SHARE
+
+#endif // OTA_PEER_SHARE_H
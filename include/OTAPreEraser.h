@@ -0,0 +1,98 @@
+/**
+ * OTAPreEraser.h
+ *
+ * Background pre-erase of the inactive OTA partition
+ *
+ * Erases the next OTA partition one sector at a time while the OTA
+ * task is idle, so a later download only has to write. Progress is
+ * kept in NVS and survives reboots. Used with direct partition writes
+ * (OTA_FLASH_PARTITION); the writer re-checks that each pre-erased
+ * sector is still blank before skipping its erase.
+ *
+ * Each erase stalls the flash cache (and so the application) for tens
+ * of milliseconds, hence the long default interval. Nothing is erased
+ * while the running image is not yet marked valid and a failed boot
+ * would roll back to the inactive partition. After that the previous
+ * release in it is erased, and with it the option to roll back to it.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_PRE_ERASER_H
+#define OTA_PRE_ERASER_H
+
+#include <Arduino.h>
+#include <esp_ota_ops.h>
+
+#ifndef OTA_ENABLE_PRE_ERASE
+#define OTA_ENABLE_PRE_ERASE 1               // 0 removes background erase
+#endif
+
+#ifndef OTA_ERASE_INTERVAL_MS
+#define OTA_ERASE_INTERVAL_MS 1000           // One sector erase per second (about 4% flash busy)
+#endif
+
+#define OTA_ERASE_SAVE_SECTORS 16            // Persist progress every 64 KB
+
+#if OTA_ENABLE_PRE_ERASE
+
+class OTAPreEraser {
+public:
+    OTAPreEraser();
+
+    /**
+     * Load progress for the current next OTA partition from NVS
+     * @param maxBytes Bytes to erase, 0 for the whole partition
+     * @return false if there is no partition to erase, or the running
+     *         image is not marked valid yet (nothing is erased then)
+     */
+    bool begin(size_t maxBytes = 0);
+
+    /**
+     * Check if there is nothing left to erase
+     */
+    bool done() { return _partition == NULL || (_redo >= _dirty && _erased >= _target); }
+
+    /**
+     * Erase the next sector
+     * @return false on a flash error (erasing stops until begin())
+     */
+    bool step();
+
+    /**
+     * End of the erased range at the start of the partition
+     * Sectors a failed download wrote below it are erased again first;
+     * until then the writer finds them not blank and erases them itself
+     */
+    size_t erasedBytes() { return _partition != NULL ? _erased : 0; }
+
+    /**
+     * A download starts writing the partition
+     * Progress in NVS is cleared, so a reset during the download starts
+     * over; it is kept in RAM for endWrite()
+     */
+    void beginWrite();
+
+    /**
+     * A download ended without installing
+     * Sectors below written are erased again, the rest of the erased
+     * range is kept
+     * @param written Bytes the download wrote to the partition
+     */
+    void endWrite(size_t written);
+
+private:
+    const esp_partition_t* _partition;
+    size_t _erased;
+    size_t _target;
+    size_t _redo;       // Next sector to erase again, below _dirty
+    size_t _dirty;      // End of the range a failed download wrote
+    uint8_t _unsaved;
+
+    void save();
+};
+
+#endif // OTA_ENABLE_PRE_ERASE
+
+#endif // OTA_PRE_ERASER_H
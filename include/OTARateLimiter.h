@@ -0,0 +1,67 @@
+/**
+ * OTARateLimiter.h
+ *
+ * Token bucket for ESP32_AutoOTA downloads
+ *
+ * Tokens (bytes) accrue at the configured rate up to a small burst, and
+ * the download pipeline only reads as many bytes as there are tokens.
+ * Like OTAScheduler it holds no timers: every call takes the current
+ * time in microseconds.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_RATE_LIMITER_H
+#define OTA_RATE_LIMITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define OTA_RATE_BURST_MS 100                // Bucket holds this much time at the target rate
+#define OTA_RATE_MIN_BURST 1460              // At least one TCP segment
+
+class OTARateLimiter {
+public:
+    OTARateLimiter();
+
+    /**
+     * Set the target rate
+     * @param bytesPerSecond Target rate, 0 for unlimited
+     */
+    void setRate(uint32_t bytesPerSecond);
+
+    uint32_t getRate() const { return _rate; }
+
+    /**
+     * Start with a full bucket
+     * @param nowUs Current time in microseconds
+     */
+    void reset(uint32_t nowUs);
+
+    /**
+     * Get bytes that may be transferred now
+     * @param nowUs Current time in microseconds
+     * @return Available tokens, SIZE_MAX when unlimited
+     */
+    size_t available(uint32_t nowUs);
+
+    /**
+     * Take tokens for bytes transferred
+     */
+    void spend(size_t bytes);
+
+    /**
+     * Get milliseconds until at least one segment of tokens is available
+     */
+    uint32_t waitMs() const;
+
+private:
+    uint32_t _rate;
+    uint32_t _burst;
+    uint32_t _tokens;
+    uint32_t _lastUs;
+    uint32_t _remainder;    // Sub-byte credit carried between refills, in bytes * 1e6
+};
+
+#endif // OTA_RATE_LIMITER_H
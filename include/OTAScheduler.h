@@ -0,0 +1,151 @@
+/**
+ * OTAScheduler.h
+ *
+ * Update check scheduling for ESP32_AutoOTA
+ *
+ * Decides when the next version check is due: random initial delay,
+ * interval with ±10% jitter, and an optional shorter retry delay after
+ * failures. While
+ * a push channel reports heartbeats, the interval stretches to a slow
+ * fallback and release announcements bring the next check forward.
+ * The scheduler holds no timers and never sleeps; every call takes
+ * the current time in milliseconds, so it can be driven by millis()
+ * on the device or stepped on virtual time in a fleet simulation.
+ * It holds no lock either: an owner that announces from another task
+ * serializes announce() with checkStarted() and checkCompleted() itself.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_SCHEDULER_H
+#define OTA_SCHEDULER_H
+
+#include <stdint.h>
+
+class OTAScheduler {
+public:
+    OTAScheduler();
+
+    /**
+     * Set check interval
+     * @param intervalMs Interval in milliseconds, jittered by ±10%
+     */
+    void setCheckInterval(uint32_t intervalMs);
+
+    /**
+     * Set random delay range for the first check
+     */
+    void setRandomDelay(uint32_t minMs, uint32_t maxMs);
+
+    /**
+     * Set retry behaviour after a failed check
+     * @param retryDelayMs Delay before a retry, jittered by ±10%; 0 waits the interval
+     * @param maxRetries Failed checks in a row before the retry counter resets
+     */
+    void setRetryPolicy(uint32_t retryDelayMs, uint8_t maxRetries);
+
+    /**
+     * Set polling while the push channel is healthy
+     * @param fallbackIntervalMs Interval used instead of the check interval
+     * @param healthTimeoutMs Push channel counts as healthy this long after a heartbeat
+     */
+    void setPushPolicy(uint32_t fallbackIntervalMs, uint32_t healthTimeoutMs);
+
+    /**
+     * Seed the jitter generator (esp_random() on device, fixed in simulation)
+     */
+    void seed(uint32_t seed);
+
+    /**
+     * Schedule the first check after a random initial delay
+     * @param now Current time in milliseconds
+     */
+    void start(uint32_t now);
+
+    /**
+     * Make the next check due immediately
+     */
+    void forceCheck();
+
+    /**
+     * Record a sign of life from the push channel
+     */
+    void pushHeartbeat(uint32_t now);
+
+    /**
+     * Check if the push channel had a heartbeat within the health timeout
+     */
+    bool isPushHealthy(uint32_t now) const;
+
+    /**
+     * Bring the next check forward, e.g. after a release announcement
+     * or a completed long-poll request
+     * @param now Current time in milliseconds
+     * @param delayMs Delay before the check
+     */
+    void announce(uint32_t now, uint32_t delayMs);
+
+    /**
+     * Check if a version check is due
+     */
+    bool isDue(uint32_t now) const;
+
+    /**
+     * Get milliseconds until the next check is due (0 if due)
+     */
+    uint32_t timeUntilDue(uint32_t now) const;
+
+    /**
+     * Record the start of a check, consuming a forced check and an
+     * announcement that is due. Announcements made after this call are
+     * kept for the next check: this one may have read the version before
+     * the release they announce.
+     * @param now Current time in milliseconds
+     */
+    void checkStarted(uint32_t now);
+
+    /**
+     * Record the result of a check and schedule the next one
+     * @param now Time the check finished
+     * @param success Result of the check
+     * @return true if this failure reached the retry limit
+     */
+    bool checkCompleted(uint32_t now, bool success);
+
+    uint32_t getCheckInterval() const { return _checkInterval; }
+    uint32_t getNextCheckTime() const { return _nextCheck; }
+    uint8_t getRetryCount() const { return _retryCount; }
+    uint8_t getMaxRetries() const { return _maxRetries; }
+
+    /**
+     * Draw a uniformly distributed value in [minValue, maxValue)
+     */
+    uint32_t random(uint32_t minValue, uint32_t maxValue);
+
+private:
+    uint32_t _checkInterval;
+    uint32_t _minRandomDelay;
+    uint32_t _maxRandomDelay;
+    uint32_t _retryDelay;
+    uint8_t _maxRetries;
+    uint32_t _fallbackInterval;
+    uint32_t _pushHealthTimeout;
+
+    uint32_t _rng;
+    uint32_t _nextCheck;
+    uint8_t _retryCount;
+    volatile bool _forced;
+    uint32_t _lastCompleted;
+    bool _pushScheduled;    // _nextCheck uses the fallback interval
+
+    // Written from the push channel's task
+    volatile uint32_t _lastHeartbeat;
+    volatile bool _heartbeatSeen;
+    volatile uint32_t _announcedCheck;
+    volatile bool _announced;
+
+    uint32_t jitter(uint32_t base);
+};
+
+#endif // OTA_SCHEDULER_H
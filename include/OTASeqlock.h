@@ -0,0 +1,62 @@
+/**
+ * OTASeqlock.h
+ *
+ * Single-writer sequence lock for ESP32_AutoOTA statistics
+ *
+ * One task writes, any task reads. The writer never waits: it bumps
+ * the sequence to odd, updates the data and bumps it back to even. A
+ * reader copies the data and retries if the sequence was odd or moved
+ * during the copy, so it never sees a half-written update.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_SEQLOCK_H
+#define OTA_SEQLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+class OTASeqlock {
+public:
+    OTASeqlock() : _seq(0) {}
+
+    /**
+     * Start an update (writer only)
+     */
+    void writeBegin() {
+        _seq.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    /**
+     * Publish an update (writer only)
+     */
+    void writeEnd() {
+        _seq.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * Copy the protected data without tearing (any task)
+     * @param copy Destination
+     * @param data Data guarded by this lock
+     * @param len Size of the data
+     */
+    void read(void* copy, const void* data, size_t len) const {
+        uint32_t before, after;
+        do {
+            before = _seq.load(std::memory_order_acquire);
+            memcpy(copy, data, len);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = _seq.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+    }
+
+private:
+    std::atomic<uint32_t> _seq;
+};
+
+#endif // OTA_SEQLOCK_H
@@ -0,0 +1,106 @@
+/**
+ * OTATrace.h
+ *
+ * Binary event trace for ESP32_AutoOTA
+ *
+ * Fixed-size ring of 12-byte records (timestamp, event ID, two args)
+ * kept in RTC memory, so the events leading up to a failed update
+ * survive the reboot. Recording is a few stores under a spinlock and
+ * never touches the UART. Decode dumps with tools/ota_trace_decode.py.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_TRACE_H
+#define OTA_TRACE_H
+
+#include <Arduino.h>
+
+#ifndef OTA_ENABLE_TRACE
+#define OTA_ENABLE_TRACE 1                   // 0 removes the trace and its RTC buffer
+#endif
+
+#ifndef OTA_TRACE_CAPACITY
+#define OTA_TRACE_CAPACITY 64                // Records kept (12 bytes each)
+#endif
+
+#define OTA_TRACE_MAGIC 0x4F545452           // "OTTR"
+#define OTA_TRACE_VERSION 1
+
+// Event IDs, keep in sync with tools/ota_trace_decode.py
+enum OTATraceEvent : uint16_t {
+    OTA_EVT_BOOT = 1,             // arg0: reset reason, arg1: boot count
+    OTA_EVT_TASK_START = 2,       // arg1: initial delay (ms)
+    OTA_EVT_CHECK_START = 3,
+    OTA_EVT_CHECK_RESULT = 4,     // arg0: HTTP code, arg1: TTFB (ms)
+    OTA_EVT_DOWNLOAD_START = 5,   // arg1: image size
+    OTA_EVT_DOWNLOAD_PROGRESS = 6,// arg1: bytes written
+    OTA_EVT_FLASH_STALL = 7,      // arg0: slowest write (ms), arg1: writes over OTA_FLASH_STALL_US; one per download
+    OTA_EVT_DOWNLOAD_END = 8,     // arg0: Update error, arg1: bytes written
+    OTA_EVT_DOWNLOAD_ABORT = 9,   // arg0: 1 write error, 2 source error, 3 stall, 4 image rejected, 5 hash mismatch, 6 bad signature; arg1: bytes received
+    OTA_EVT_REBOOT = 10,          // arg1: bytes installed
+    OTA_EVT_ROLLOUT_SKIP = 11,    // arg0: rollout percentage
+    OTA_EVT_DOWNLOAD_PAUSE = 12,  // arg1: bytes received
+    OTA_EVT_DOWNLOAD_RESUME = 13, // arg0: 1 on a new connection, arg1: offset
+    OTA_EVT_RELEASE_NOTIFY = 14,  // arg1: delay before the check (ms)
+};
+
+struct OTATraceRecord {
+    uint32_t timestampMs;
+    uint16_t event;
+    uint16_t arg0;
+    uint32_t arg1;
+};
+
+#if OTA_ENABLE_TRACE
+
+class OTATrace {
+public:
+    /**
+     * Record a BOOT event
+     * The RTC buffer is validated on first use (here or in any other
+     * call), and records from before the reboot are kept if it is intact
+     */
+    static void begin();
+
+    /**
+     * Append an event, overwriting the oldest record when full
+     */
+    static void record(uint16_t event, uint16_t arg0 = 0, uint32_t arg1 = 0);
+
+    /**
+     * Copy records oldest first
+     * @param out Destination array
+     * @param maxRecords Capacity of out
+     * @return Number of records copied
+     */
+    static size_t read(OTATraceRecord* out, size_t maxRecords);
+
+    /**
+     * Write all records as hex lines, e.g. to Serial or a WiFiClient
+     * Format: "OTATRACE <version> <count>" followed by one "T <hex>" per record
+     */
+    static void dump(Print& out);
+
+    /**
+     * Drop all records
+     */
+    static void clear();
+};
+
+#else
+
+// Trace compiled out: calls fold away
+class OTATrace {
+public:
+    static void begin() {}
+    static void record(uint16_t, uint16_t = 0, uint32_t = 0) {}
+    static size_t read(OTATraceRecord*, size_t) { return 0; }
+    static void dump(Print&) {}
+    static void clear() {}
+};
+
+#endif // OTA_ENABLE_TRACE
+
+#endif // OTA_TRACE_H
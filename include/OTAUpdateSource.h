@@ -0,0 +1,239 @@
+/**
+ * OTAUpdateSource.h
+ *
+ * Firmware image sources for ESP32_AutoOTA
+ *
+ * The install pipeline pulls bytes from an OTAUpdateSource, so the
+ * same write path is used for HTTP downloads, SD cards, UART links
+ * and images already held in memory.
+ *
+ * Author: KeenanKE
+ * License: MIT
+ */
+
+#ifndef OTA_UPDATE_SOURCE_H
+#define OTA_UPDATE_SOURCE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "OTAHttp.h"
+#include "OTAMirrorList.h"
+
+#ifndef OTA_SKIP_TIMEOUT
+#define OTA_SKIP_TIMEOUT 10000               // Stall allowed while skipping bytes a server sent again
+#endif
+
+class OTAUpdateSource {
+public:
+    virtual ~OTAUpdateSource() {}
+
+    /**
+     * Open the source positioned at a byte offset
+     * @param offset First byte to deliver (non-zero to resume a transfer)
+     * @return true if the source is ready to deliver data
+     */
+    virtual bool open(size_t offset = 0) = 0;
+
+    /**
+     * Get total image size
+     * @return Size in bytes, 0 if unknown
+     */
+    virtual size_t size() = 0;
+
+    /**
+     * Copy available bytes into a buffer
+     * @param buffer Destination buffer
+     * @param len Maximum number of bytes to copy
+     * @return Bytes copied, 0 if nothing is available yet, -1 on error
+     */
+    virtual int read(uint8_t* buffer, size_t len) = 0;
+
+    /**
+     * Zero-copy access to the next bytes of the image
+     * Sources that hold the image in addressable memory return a pointer
+     * into it; the others return 0 and the pipeline falls back to read()
+     * @param data Set to the first available byte
+     * @param maxLen Maximum number of bytes the caller wants
+     * @return Number of bytes available at data
+     */
+    virtual size_t peek(const uint8_t** data, size_t maxLen) {
+        (void)data;
+        (void)maxLen;
+        return 0;
+    }
+
+    /**
+     * Mark bytes returned by peek() as used
+     * @param len Number of bytes consumed
+     */
+    virtual void consume(size_t len) {
+        (void)len;
+    }
+
+    /**
+     * Release the underlying connection, file or buffer
+     */
+    virtual void close() = 0;
+
+    /**
+     * Get a short name for log output
+     */
+    virtual const char* name() = 0;
+
+    /**
+     * Check if only the intended sender can supply the bytes
+     * Sources any host on the network can inject into (multicast) return
+     * false, and are installed only against an expected digest
+     */
+    virtual bool isTrusted() { return true; }
+};
+
+/**
+ * Image served over HTTP(S), resumable with Range requests
+ */
+class OTAHttpSource : public OTAUpdateSource {
+public:
+    OTAHttpSource(const char* url);
+    ~OTAHttpSource();
+
+    bool open(size_t offset = 0) override;
+    size_t size() override;
+    int read(uint8_t* buffer, size_t len) override;
+    void close() override;
+    const char* name() override { return "http"; }
+
+    /**
+     * Open for a byte range only, so the server stops after it
+     * @param offset First byte
+     * @param length Bytes wanted, 0 for the rest of the image
+     */
+    bool open(size_t offset, size_t length);
+
+    /**
+     * Point the source at another URL, takes effect on the next open()
+     */
+    void setURL(const char* url) { _url = url; }
+
+    /**
+     * Get HTTP status code of the last open() call
+     */
+    int getHTTPCode() { return _httpCode; }
+
+    /**
+     * Get DNS, connect, TLS and first-byte timings of the last open() call
+     */
+    const OTAPhaseTimes& getTimes() { return _request.getTimes(); }
+
+    /**
+     * Get redirect hops and redirect cache use of the last open() call
+     */
+    uint8_t getRedirects() { return _request.getRedirects(); }
+    bool getCacheHit() { return _request.getCacheHit(); }
+
+private:
+    const char* _url;
+    OTAHttpRequest _request;
+    WiFiClient* _stream;
+    int _httpCode;
+    size_t _size;
+    bool _open;
+};
+
+/**
+ * Image served by several HTTP(S) mirrors
+ * Opens the mirror with the best score and records each outcome in the
+ * list. Reopening at an offset after a broken transfer moves to another
+ * mirror and resumes there with a Range request.
+ */
+class OTAMirrorSource : public OTAUpdateSource {
+public:
+    OTAMirrorSource(OTAMirrorList& mirrors);
+
+    bool open(size_t offset = 0) override;
+    size_t size() override { return _http.size(); }
+    int read(uint8_t* buffer, size_t len) override;
+    void close() override { _http.close(); }
+    const char* name() override { return "mirror"; }
+
+    int getHTTPCode() { return _http.getHTTPCode(); }
+    const OTAPhaseTimes& getTimes() { return _http.getTimes(); }
+    uint8_t getRedirects() { return _http.getRedirects(); }
+    bool getCacheHit() { return _http.getCacheHit(); }
+
+    /**
+     * Get the index of the mirror in use, -1 if none
+     */
+    int getMirror() { return _current; }
+
+private:
+    OTAMirrorList& _mirrors;
+    OTAHttpSource _http;
+    int _current;
+    int _last;
+
+    bool openMirror(int index, size_t offset);
+};
+
+/**
+ * Image arriving on an Arduino Stream such as a UART
+ * The stream cannot seek, so only offset 0 can be opened
+ */
+class OTAStreamSource : public OTAUpdateSource {
+public:
+    OTAStreamSource(Stream& stream, size_t size);
+
+    bool open(size_t offset = 0) override;
+    size_t size() override { return _size; }
+    int read(uint8_t* buffer, size_t len) override;
+    void close() override {}
+    const char* name() override { return "stream"; }
+
+private:
+    Stream& _stream;
+    size_t _size;
+    size_t _position;
+};
+
+/**
+ * Image stored as a file (SD card, LittleFS, SPIFFS)
+ */
+class OTAFileSource : public OTAUpdateSource {
+public:
+    OTAFileSource(fs::FS& fs, const char* path);
+
+    bool open(size_t offset = 0) override;
+    size_t size() override { return _size; }
+    int read(uint8_t* buffer, size_t len) override;
+    void close() override;
+    const char* name() override { return "file"; }
+
+private:
+    fs::FS& _fs;
+    const char* _path;
+    fs::File _file;
+    size_t _size;
+};
+
+/**
+ * Image already in addressable memory (PSRAM, memory-mapped flash)
+ * Supports zero-copy reads through peek()
+ */
+class OTAMemorySource : public OTAUpdateSource {
+public:
+    OTAMemorySource(const uint8_t* data, size_t size);
+
+    bool open(size_t offset = 0) override;
+    size_t size() override { return _size; }
+    int read(uint8_t* buffer, size_t len) override;
+    size_t peek(const uint8_t** data, size_t maxLen) override;
+    void consume(size_t len) override;
+    void close() override {}
+    const char* name() override { return "memory"; }
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+    size_t _position;
+};
+
+#endif // OTA_UPDATE_SOURCE_H
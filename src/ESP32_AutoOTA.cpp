@@ -7,25 +7,93 @@
 #include "ESP32_AutoOTA.h"
 #include <esp_system.h>
 
+// Hex digits to bytes, false on a character that is not a hex digit
+static bool parseHex(const char* hex, uint8_t* out, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char byte[3] = { hex[i * 2], hex[i * 2 + 1], '\0' };
+        char* end;
+        out[i] = (uint8_t)strtoul(byte, &end, 16);
+        if (!isxdigit((unsigned char)byte[0]) || *end != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
 // Constructor
 ESP32_AutoOTA::ESP32_AutoOTA() {
-    _firmwareURL[0] = '\0';
-    _versionURL[0] = '\0';
     strcpy(_currentVersion, "0.0.0");
-    _checkInterval = DEFAULT_CHECK_INTERVAL;
-    _minRandomDelay = DEFAULT_MIN_RANDOM_DELAY;
-    _maxRandomDelay = DEFAULT_MAX_RANDOM_DELAY;
+    _retryDelay = DEFAULT_RETRY_DELAY;
+    _maxRetries = DEFAULT_MAX_RETRIES;
     _staggeredRollout = false;
     _rolloutPercentage = 50;
     _statusLED = -1;
-    _maxRetries = DEFAULT_MAX_RETRIES;
-    _debugMode = true;
+    _debugMode = false;
+    _flashMode = OTA_FLASH_UPDATE;
+    _skipUnchanged = false;
+    _parallelConnections = 1;
+    _downloadPaused = false;
+    _matchProject = false;
+    _matchVersion = false;
+    _pendingVersion[0] = '\0';
+    _pendingHasHash = false;
+#if OTA_ENABLE_PEER_SHARE
+    _peerSharing = false;
+    _peerPort = OTA_PEER_PORT;
+    _peerURL[0] = '\0';
+#endif
+#if OTA_ENABLE_GATEWAY
+    _gatewayDiscovery = false;
+    _gatewayPort = OTA_GATEWAY_PORT;
+    _gatewayActive = false;
+#endif
+#if OTA_ENABLE_DECRYPT
+    _decryptKeyLen = 0;
+#endif
+#if OTA_ENABLE_SIGNING
+    mbedtls_pk_init(&_signingKey);
+    _hasSigningKey = false;
+    _pendingSigLen = 0;
+    _cachedSigLen = 0;
+#endif
+    _versionFromImage = false;
+    _longPoll = false;
+    _longPollHold = DEFAULT_LONG_POLL_HOLD;
+    _longPollAsked = DEFAULT_LONG_POLL_HOLD;
+    _cachedVersion[0] = '\0';
+    _cachedHasHash = false;
+#if OTA_ENABLE_CONDITIONAL
+    _etag[0] = '\0';
+    _lastModified[0] = '\0';
+#endif
+    _validatorMirror = -1;
+#if OTA_ENABLE_PRE_ERASE
+    _backgroundErase = false;
+    _backgroundEraseBytes = 0;
+    _eraseInterval = OTA_ERASE_INTERVAL_MS;
+    _lastEraseStep = 0;
+#endif
     _isRunning = false;
+    _polled = false;
     _taskHandle = NULL;
+    _jobHandle = NULL;
+    _job = JOB_CHECK;
+    _pollTask = NULL;
+    _stopRequested = false;
     _lastCheckTime = 0;
-    _retryCount = 0;
+    _checkStart = 0;
+    _wifiLost = false;
+    _wifiLostAt = 0;
+    memset(&_install, 0, sizeof(_install));
+    _installing = false;
     _lastError[0] = '\0';
-    _forceCheckFlag = false;
+    memset(&_stats, 0, sizeof(_stats));
+    _pollMaxMs = 0;
+    _scheduler.setCheckInterval(DEFAULT_CHECK_INTERVAL);
+    _scheduler.setRandomDelay(DEFAULT_MIN_RANDOM_DELAY, DEFAULT_MAX_RANDOM_DELAY);
+    _scheduler.setRetryPolicy(_retryDelay, _maxRetries);
+    _scheduler.setPushPolicy(DEFAULT_PUSH_FALLBACK_INTERVAL, DEFAULT_PUSH_HEALTH_TIMEOUT);
+    _pushSpread = DEFAULT_PUSH_SPREAD;
     _onUpdateStart = NULL;
     _onUpdateProgress = NULL;
     _onUpdateComplete = NULL;
@@ -36,18 +104,27 @@ ESP32_AutoOTA::ESP32_AutoOTA() {
 // Destructor
 ESP32_AutoOTA::~ESP32_AutoOTA() {
     stop();
+#if OTA_ENABLE_SIGNING
+    mbedtls_pk_free(&_signingKey);
+#endif
 }
 
 // ========== Configuration Methods ==========
 
-void ESP32_AutoOTA::setFirmwareURL(const char* url) {
-    strncpy(_firmwareURL, url, sizeof(_firmwareURL) - 1);
-    _firmwareURL[sizeof(_firmwareURL) - 1] = '\0';
+void ESP32_AutoOTA::setFirmwareURL(const char* url, bool copy) {
+    _firmwareMirrors.set(url, copy);
+}
+
+void ESP32_AutoOTA::setVersionURL(const char* url, bool copy) {
+    _versionMirrors.set(url, copy);
+}
+
+bool ESP32_AutoOTA::addFirmwareMirror(const char* url, bool copy) {
+    return _firmwareMirrors.add(url, copy);
 }
 
-void ESP32_AutoOTA::setVersionURL(const char* url) {
-    strncpy(_versionURL, url, sizeof(_versionURL) - 1);
-    _versionURL[sizeof(_versionURL) - 1] = '\0';
+bool ESP32_AutoOTA::addVersionMirror(const char* url, bool copy) {
+    return _versionMirrors.add(url, copy);
 }
 
 void ESP32_AutoOTA::setCurrentVersion(const char* version) {
@@ -56,12 +133,11 @@ void ESP32_AutoOTA::setCurrentVersion(const char* version) {
 }
 
 void ESP32_AutoOTA::setCheckInterval(unsigned long intervalMs) {
-    _checkInterval = intervalMs;
+    _scheduler.setCheckInterval(intervalMs);
 }
 
 void ESP32_AutoOTA::setRandomDelay(unsigned long minMs, unsigned long maxMs) {
-    _minRandomDelay = minMs;
-    _maxRandomDelay = maxMs;
+    _scheduler.setRandomDelay(minMs, maxMs);
 }
 
 void ESP32_AutoOTA::setStaggeredRollout(bool enable, uint8_t percentage) {
@@ -71,7 +147,7 @@ void ESP32_AutoOTA::setStaggeredRollout(bool enable, uint8_t percentage) {
 
 void ESP32_AutoOTA::setStatusLED(int pin) {
     _statusLED = pin;
-    if (pin >= 0) {
+    if (ledEnabled()) {
         pinMode(pin, OUTPUT);
         digitalWrite(pin, LOW);
     }
@@ -79,6 +155,120 @@ void ESP32_AutoOTA::setStatusLED(int pin) {
 
 void ESP32_AutoOTA::setMaxRetries(uint8_t retries) {
     _maxRetries = retries;
+    _scheduler.setRetryPolicy(_retryDelay, _maxRetries);
+}
+
+void ESP32_AutoOTA::setRetryDelay(unsigned long delayMs) {
+    _retryDelay = delayMs;
+    _scheduler.setRetryPolicy(_retryDelay, _maxRetries);
+}
+
+void ESP32_AutoOTA::setPushPolicy(unsigned long fallbackIntervalMs, unsigned long spreadMs) {
+    _scheduler.setPushPolicy(fallbackIntervalMs, DEFAULT_PUSH_HEALTH_TIMEOUT);
+    _pushSpread = spreadMs;
+}
+
+void ESP32_AutoOTA::setDirectFlashWrite(bool enable) {
+    _flashMode = enable ? OTA_FLASH_PARTITION : OTA_FLASH_UPDATE;
+}
+
+void ESP32_AutoOTA::setParallelDownload(uint8_t connections) {
+    _parallelConnections = OTA_ENABLE_PARALLEL ? constrain(connections, 1, OTA_PARALLEL_MAX) : 1;
+}
+
+void ESP32_AutoOTA::setBandwidthLimit(uint32_t bytesPerSecond) {
+    _rateLimiter.setRate(bytesPerSecond);
+}
+
+void ESP32_AutoOTA::setBackgroundErase(bool enable, size_t maxBytes, unsigned long intervalMs) {
+#if OTA_ENABLE_PRE_ERASE
+    _backgroundErase = enable;
+    _backgroundEraseBytes = maxBytes;
+    _eraseInterval = intervalMs;
+    if (enable) {
+        _flashMode = OTA_FLASH_PARTITION;
+        _skipUnchanged = false;
+    }
+#endif
+}
+
+void ESP32_AutoOTA::setSkipUnchangedSectors(bool enable) {
+    _skipUnchanged = enable;
+    if (enable) {
+        _flashMode = OTA_FLASH_PARTITION;
+#if OTA_ENABLE_PRE_ERASE
+        _backgroundErase = false;
+#endif
+    }
+}
+
+void ESP32_AutoOTA::setImageValidation(bool matchProject, bool matchVersion) {
+    _matchProject = matchProject;
+    _matchVersion = matchVersion;
+}
+
+void ESP32_AutoOTA::setVersionFromImage(bool enable) {
+    _versionFromImage = enable;
+    _cachedVersion[0] = '\0'; // Validators belonged to the other URL
+}
+
+void ESP32_AutoOTA::setLongPoll(bool enable, unsigned long holdMs) {
+    _longPoll = enable;
+    // HTTPClient timeouts are 16-bit milliseconds
+    _longPollHold = min(holdMs, (unsigned long)(UINT16_MAX - OTA_LONG_POLL_MARGIN));
+}
+
+void ESP32_AutoOTA::setPeerSharing(bool enable, uint16_t port) {
+#if OTA_ENABLE_PEER_SHARE
+    _peerSharing = enable;
+    _peerPort = port;
+#endif
+}
+
+void ESP32_AutoOTA::setGatewayDiscovery(bool enable, uint16_t port) {
+#if OTA_ENABLE_GATEWAY
+    _gatewayDiscovery = enable;
+    _gatewayPort = port;
+#endif
+}
+
+bool ESP32_AutoOTA::setDecryptionKey(const uint8_t* key, size_t keyLen) {
+#if OTA_ENABLE_DECRYPT
+    if (key == NULL) {
+        memset(_decryptKey, 0, sizeof(_decryptKey));
+        _decryptKeyLen = 0;
+        return true;
+    }
+    if (keyLen != 16 && keyLen != 32) {
+        return false;
+    }
+    memcpy(_decryptKey, key, keyLen);
+    _decryptKeyLen = keyLen;
+    return true;
+#else
+    return key == NULL;
+#endif
+}
+
+bool ESP32_AutoOTA::setSigningKey(const char* publicKeyPem) {
+#if !OTA_ENABLE_SIGNING
+    return publicKeyPem == NULL;
+#else
+    mbedtls_pk_free(&_signingKey);
+    mbedtls_pk_init(&_signingKey);
+    _hasSigningKey = false;
+    if (publicKeyPem == NULL) {
+        return true;
+    }
+
+    // The PEM parser wants the terminating NUL counted in the length
+    if (mbedtls_pk_parse_public_key(&_signingKey, (const unsigned char*)publicKeyPem, strlen(publicKeyPem) + 1) != 0) {
+        setError("Invalid signing key");
+        return false;
+    }
+    _hasSigningKey = true;
+    return true;
+#endif
 }
 
 void ESP32_AutoOTA::setDebugMode(bool enable) {
@@ -109,13 +299,16 @@ void ESP32_AutoOTA::onVersionCheck(OTACallback callback) {
 
 // ========== Control Methods ==========
 
-bool ESP32_AutoOTA::begin() {
-    if (_isRunning) {
-        log("[AutoOTA] Already running");
+// Checks and setup shared by begin() and beginPolled()
+bool ESP32_AutoOTA::prepare() {
+    // A task told to stop from a callback may still be on its way out
+    if (_isRunning || _taskHandle != NULL || _jobHandle != NULL) {
+        OTA_LOGW("Already running");
         return false;
     }
 
-    if (strlen(_firmwareURL) == 0 || strlen(_versionURL) == 0) {
+    if (_firmwareMirrors.count() == 0 || _firmwareMirrors.url(0)[0] == '\0' ||
+        (!_versionFromImage && (_versionMirrors.count() == 0 || _versionMirrors.url(0)[0] == '\0'))) {
         setError("Firmware or version URL not set");
         return false;
     }
@@ -125,7 +318,28 @@ bool ESP32_AutoOTA::begin() {
         return false;
     }
 
-    log("[AutoOTA] Starting OTA task...");
+    OTATrace::begin();
+
+    _stopRequested = false;
+    _firmwareMirrors.load();
+    _versionMirrors.load();
+
+    _scheduler.seed(esp_random());
+
+#if OTA_ENABLE_PEER_SHARE
+    if (_peerSharing && _decryptKeyLen == 0 && _peerShare.begin(_peerPort)) {
+        OTA_LOGI("Sharing running firmware with peers on port %u", _peerPort);
+    }
+#endif
+    return true;
+}
+
+bool ESP32_AutoOTA::begin() {
+    if (!prepare()) {
+        return false;
+    }
+
+    OTA_LOGI("Starting OTA task...");
     
     BaseType_t result = xTaskCreate(
         taskWrapper,
@@ -138,7 +352,7 @@ bool ESP32_AutoOTA::begin() {
 
     if (result == pdPASS) {
         _isRunning = true;
-        log("[AutoOTA] Task started successfully");
+        OTA_LOGI("Task started successfully");
         return true;
     } else {
         setError("Failed to create task");
@@ -146,13 +360,103 @@ bool ESP32_AutoOTA::begin() {
     }
 }
 
+bool ESP32_AutoOTA::beginPolled() {
+    if (!prepare()) {
+        return false;
+    }
+
+    if (_longPoll) {
+        OTA_LOGW("Long polling would block poll(), disabled");
+        _longPoll = false;
+    }
+
+    _polled = true;
+    _isRunning = true;
+    _wifiLost = false;
+    startSchedule();
+    OTA_LOGI("Polled mode started");
+    return true;
+}
+
+void ESP32_AutoOTA::poll(uint32_t budgetMs) {
+    if (!_polled) return;
+
+    unsigned long start = millis();
+    _pollTask = xTaskGetCurrentTaskHandle();
+
+    if (_jobHandle != NULL) {
+        // A request task owns the state until it exits
+    } else if (_installing) {
+        uint32_t waitMs;
+        // A callback may have called stop(): leave the teardown to it below
+        if (!installStep(budgetMs, waitMs) && !_stopRequested) {
+            startJob(_install.reconnect ? JOB_RECONNECT : JOB_FINISH);
+        }
+    } else if (_scheduler.timeUntilDue(start) > 0) {
+#if OTA_ENABLE_PRE_ERASE
+        // Use idle time to pre-erase the next partition, rate-limited
+        if (_backgroundErase && !_eraser.done() && start - _lastEraseStep >= _eraseInterval) {
+            _eraser.step();
+            _lastEraseStep = millis();
+        }
+#endif
+    } else if (WiFi.status() != WL_CONNECTED) {
+        if (!_wifiLost || start - _wifiLostAt >= OTA_WIFI_RETRY_MS) {
+            OTA_LOGW("WiFi disconnected, waiting...");
+            _wifiLost = true;
+            _wifiLostAt = start;
+        }
+    } else {
+        _wifiLost = false;
+        startJob(JOB_CHECK);
+    }
+
+    // Not in _stats: the request task may be writing them meanwhile
+    uint32_t elapsed = millis() - start;
+    if (elapsed > _pollMaxMs) {
+        _pollMaxMs = elapsed;
+    }
+
+    _pollTask = NULL;
+    if (_stopRequested && _polled) {
+        stop();
+    }
+}
+
 void ESP32_AutoOTA::stop() {
-    if (_taskHandle != NULL) {
-        vTaskDelete(_taskHandle);
-        _taskHandle = NULL;
+    // The task, or poll()'s request task, finishes its request and exits.
+    // From one of their callbacks it can only be asked to.
+    TaskHandle_t current = xTaskGetCurrentTaskHandle();
+    bool fromTask = current == _taskHandle || current == _jobHandle;
+    _stopRequested = true;
+
+    // Called back from inside poll(): the download it is running still
+    // holds the install state, so poll() calls stop() again on its way out
+    if (current == _pollTask) {
+        OTA_LOGI("Stop requested");
+        return;
     }
+
+    if (!fromTask) {
+        if (_taskHandle != NULL) {
+            xTaskNotifyGive(_taskHandle);
+        }
+        while (_taskHandle != NULL || _jobHandle != NULL) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+
+        // Polled mode holds a download between poll() calls; the task
+        // aborts its own before it exits
+        if (_installing) {
+            abortInstall();
+        }
+    }
+#if OTA_ENABLE_PEER_SHARE
+    _peerShare.end();
+#endif
+    _polled = false;
     _isRunning = false;
-    log("[AutoOTA] Task stopped");
+    OTA_LOGI("Task stopped");
 }
 
 bool ESP32_AutoOTA::isRunning() {
@@ -160,8 +464,53 @@ bool ESP32_AutoOTA::isRunning() {
 }
 
 void ESP32_AutoOTA::forceCheck() {
-    _forceCheckFlag = true;
-    log("[AutoOTA] Force check requested");
+    portENTER_CRITICAL(&_scheduleMux);
+    _scheduler.forceCheck();
+    portEXIT_CRITICAL(&_scheduleMux);
+    if (_taskHandle != NULL) {
+        xTaskNotifyGive(_taskHandle); // Wake the task if it is waiting
+    }
+    OTA_LOGD("Force check requested");
+}
+
+void ESP32_AutoOTA::pushHeartbeat() {
+    portENTER_CRITICAL(&_scheduleMux);
+    _scheduler.pushHeartbeat(millis());
+    portEXIT_CRITICAL(&_scheduleMux);
+}
+
+void ESP32_AutoOTA::notifyRelease(const char* version) {
+    if (version != NULL && strcmp(version, _currentVersion) == 0) {
+        OTA_LOGD("Announced release %s is already installed", version);
+        return;
+    }
+
+    // Slot ordered by the same percentile as the staggered rollout,
+    // with the rest of the hash spreading devices within a percentile
+    uint32_t hash = getDeviceHash();
+    uint32_t slot = (hash % 100) * 100 + (hash / 100) % 100;
+    uint32_t delayMs = (uint64_t)slot * _pushSpread / 10000;
+
+    portENTER_CRITICAL(&_scheduleMux);
+    _scheduler.pushHeartbeat(millis());
+    _scheduler.announce(millis(), delayMs);
+    portEXIT_CRITICAL(&_scheduleMux);
+    OTATrace::record(OTA_EVT_RELEASE_NOTIFY, 0, delayMs);
+    OTA_LOGI("Release %s announced, checking in %lu ms", version ? version : "", (unsigned long)delayMs);
+
+    if (_taskHandle != NULL) {
+        xTaskNotifyGive(_taskHandle); // Recompute the wait
+    }
+}
+
+void ESP32_AutoOTA::pauseDownload() {
+    _downloadPaused = true;
+    OTA_LOGD("Download pause requested");
+}
+
+void ESP32_AutoOTA::resumeDownload() {
+    _downloadPaused = false;
+    OTA_LOGD("Download resume requested");
 }
 
 const char* ESP32_AutoOTA::getCurrentVersion() {
@@ -176,201 +525,997 @@ const char* ESP32_AutoOTA::getLastError() {
     return _lastError;
 }
 
+OTAStats ESP32_AutoOTA::getStats() {
+    OTAStats snapshot;
+    _statsLock.read(&snapshot, &_stats, sizeof(snapshot));
+    snapshot.pollMaxMs = _pollMaxMs;
+    return snapshot;
+}
+
 // ========== Private Methods ==========
 
 void ESP32_AutoOTA::taskWrapper(void* parameter) {
     ESP32_AutoOTA* instance = static_cast<ESP32_AutoOTA*>(parameter);
     instance->otaTask();
+    instance->_taskHandle = NULL;
+    vTaskDelete(NULL);
 }
 
-void ESP32_AutoOTA::otaTask() {
+void ESP32_AutoOTA::jobWrapper(void* parameter) {
+    ESP32_AutoOTA* instance = static_cast<ESP32_AutoOTA*>(parameter);
+    instance->runJob();
+    instance->_jobHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+// Hand work that waits on the network to a request task, so poll() returns
+void ESP32_AutoOTA::startJob(PollJob job) {
+    _job = job;
+
+    // Same priority as loop(), so both keep their share of a single core.
+    // The stack is only held until the job is done.
+    if (xTaskCreate(jobWrapper, "AutoOTA_Job", DEFAULT_STACK_SIZE, this, uxTaskPriorityGet(NULL),
+                    &_jobHandle) != pdPASS) {
+        _jobHandle = NULL;
+        OTA_LOGW("No memory for the request task, running it in poll()");
+        runJob();
+    }
+}
+
+void ESP32_AutoOTA::runJob() {
+    if (_job == JOB_CHECK) {
+        // A download it started continues in the next poll() calls
+        bool success = runCheck();
+        if (!_installing) {
+            checkCompleted(success);
+        }
+        return;
+    }
+
+    if (_job == JOB_RECONNECT) {
+        _install.reconnect = false;
+        if (resumeInstall()) {
+            return;
+        }
+    }
+
+    // Reboots on success
+    bool success = installFinish();
+    if (!success && _install.fromPeer && !_stopRequested) {
+        OTA_LOGW("Peer download failed, using the mirrors");
+        success = startMirrorInstall();
+    }
+    if (!_installing) {
+        checkCompleted(success);
+    }
+}
+
+// One check, and in task mode the download it starts (task and poll())
+bool ESP32_AutoOTA::runCheck() {
+    if (_gatewayDiscovery && !_gatewayActive) {
+        discoverGateway();
+    }
+    checkStarted();
+    return checkForUpdate();
+}
+
+void ESP32_AutoOTA::startSchedule() {
     // Random initial delay (60-180 seconds by default)
-    unsigned long initialDelay = getRandomDelay();
-    logf("[AutoOTA] Waiting %lu seconds before first check...", initialDelay / 1000);
-    vTaskDelay(initialDelay / portTICK_PERIOD_MS);
+    _scheduler.start(millis());
+    OTA_LOGI("Waiting %lu seconds before first check...", (unsigned long)_scheduler.timeUntilDue(millis()) / 1000);
+    OTATrace::record(OTA_EVT_TASK_START, 0, _scheduler.timeUntilDue(millis()));
+
+#if OTA_ENABLE_PRE_ERASE
+    if (_backgroundErase && !_eraser.begin(_backgroundEraseBytes)) {
+        OTA_LOGI("Background erase off: running image not confirmed yet");
+    }
+#endif
+}
+
+void ESP32_AutoOTA::otaTask() {
+    startSchedule();
 
-    log("[AutoOTA] Starting update monitoring");
+    // stop() sets the flag and wakes us, then waits for the task to exit
+    while (!_stopRequested) {
+        // Sleep until the next check is due; forceCheck() wakes us early
+        uint32_t wait = _scheduler.timeUntilDue(millis());
+        if (wait > 0) {
+#if OTA_ENABLE_PRE_ERASE
+            // Use idle time to pre-erase the next partition, rate-limited
+            if (_backgroundErase && !_eraser.done()) {
+                _eraser.step();
+                wait = min(wait, (uint32_t)_eraseInterval);
+            }
+#endif
+            ulTaskNotifyTake(pdTRUE, wait / portTICK_PERIOD_MS);
+            continue;
+        }
 
-    while (true) {
         // Check if WiFi is connected
         if (WiFi.status() != WL_CONNECTED) {
-            log("[AutoOTA] WiFi disconnected, waiting...");
-            vTaskDelay(10000 / portTICK_PERIOD_MS);
+            OTA_LOGW("WiFi disconnected, waiting...");
+            ulTaskNotifyTake(pdTRUE, OTA_WIFI_RETRY_MS / portTICK_PERIOD_MS);
             continue;
         }
 
         // Check for updates
-        if (_forceCheckFlag || (millis() - _lastCheckTime >= _checkInterval)) {
-            _forceCheckFlag = false;
-            
-            if (checkForUpdate()) {
-                _retryCount = 0; // Reset retry count on success
-            } else {
-                _retryCount++;
-                if (_retryCount >= _maxRetries) {
-                    logf("[AutoOTA] Max retries reached (%d), resetting counter", _maxRetries);
-                    _retryCount = 0;
-                }
-            }
-            
-            _lastCheckTime = millis();
+        bool success = runCheck();
+        if (_stopRequested) {
+            break;
         }
+        checkCompleted(success);
+    }
+}
 
-        // Randomize next check interval (±10% variation)
-        unsigned long variation = _checkInterval / 10;
-        unsigned long nextCheck = _checkInterval + random(-variation, variation);
-        vTaskDelay(nextCheck / portTICK_PERIOD_MS);
+// notifyRelease() may run on the push channel's task meanwhile: an
+// announcement from here on is kept for the next check
+void ESP32_AutoOTA::checkStarted() {
+    portENTER_CRITICAL(&_scheduleMux);
+    _checkStart = millis();
+    _scheduler.checkStarted(_checkStart);
+    portEXIT_CRITICAL(&_scheduleMux);
+}
+
+// Bookkeeping after a check and any download it started
+void ESP32_AutoOTA::checkCompleted(bool success) {
+    _lastCheckTime = millis();
+
+    portENTER_CRITICAL(&_scheduleMux);
+    bool exhausted = _scheduler.checkCompleted(_lastCheckTime, success);
+
+    // The server held the request until its timeout: ask again right away.
+    // An immediate answer means it does not long-poll, keep the interval.
+    if (_longPoll && success && _lastCheckTime - _checkStart >= _longPollAsked / 2) {
+        _scheduler.announce(_lastCheckTime, OTA_LONG_POLL_GAP);
+    }
+    portEXIT_CRITICAL(&_scheduleMux);
+
+    statsBegin();
+    _stats.checkCount++;
+    if (!success) {
+        _stats.checkFailures++;
+        if (!exhausted) {
+            _stats.retries++;
+        }
+    }
+    statsEnd();
+    recordResources();
+
+    if (_gatewayActive &&
+        (_firmwareMirrors.failures(0) >= OTA_GATEWAY_MAX_FAILURES ||
+         _versionMirrors.failures(0) >= OTA_GATEWAY_MAX_FAILURES)) {
+        dropGateway();
+    }
+
+    _firmwareMirrors.save();
+    _versionMirrors.save();
+
+    // Stale DNS answers were used for this check, refresh them for the next
+    OTAHttpRequest::refreshDNS();
+
+    if (exhausted) {
+        OTA_LOGW("Max retries reached (%d), waiting for next interval", _maxRetries);
+    } else if (!success) {
+        OTA_LOGW("Check failed, retry %d of %d", _scheduler.getRetryCount(), _maxRetries);
     }
 }
 
 bool ESP32_AutoOTA::checkForUpdate() {
-    log("[AutoOTA] Checking for firmware update...");
+    OTA_LOGI("Checking for firmware update...");
+    OTATrace::record(OTA_EVT_CHECK_START);
     
     if (_onVersionCheck) {
         _onVersionCheck();
     }
 
-    HTTPClient http;
-    http.begin(_versionURL);
+    char remoteVersion[sizeof(_cachedVersion)];
+    int httpCode = fetchRemoteVersion(remoteVersion, sizeof(remoteVersion));
     
-    // Cache-busting headers
-    http.addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-    http.addHeader("Pragma", "no-cache");
-    http.addHeader("Expires", "0");
+    if (httpCode != HTTP_CODE_OK && httpCode != HTTP_CODE_NOT_MODIFIED) {
+        OTA_LOGW("Version check failed: HTTP %d", httpCode);
+        setError(httpCode == OTA_CHECK_BAD_CONTENT ? "Version check failed: invalid response" : "Version check failed");
+        return false;
+    }
 
-    int httpCode = http.GET();
-    
-    if (httpCode == HTTP_CODE_OK) {
-        String remoteVersion = http.getString();
-        remoteVersion.trim();
+    if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+        OTA_LOGD("Version unchanged since last check (HTTP 304)");
+    }
         
-        logf("[AutoOTA] Current: %s, Remote: %s", _currentVersion, remoteVersion.c_str());
+    OTA_LOGI("Current: %s, Remote: %s", _currentVersion, remoteVersion);
 
-        if (remoteVersion.equals(_currentVersion)) {
-            log("[AutoOTA] Firmware is up to date");
-            http.end();
-            return true;
+    if (strcmp(remoteVersion, _currentVersion) == 0) {
+        OTA_LOGI("Firmware is up to date");
+        return true;
+    }
+
+    OTA_LOGI("New version available!");
+    
+    // Check staggered rollout
+    if (OTA_ENABLE_ROLLOUT && _staggeredRollout && !shouldUpdateNow()) {
+        OTA_LOGI("Staggered rollout: Delaying update (device not in %d%% group)", _rolloutPercentage);
+        OTATrace::record(OTA_EVT_ROLLOUT_SKIP, _rolloutPercentage);
+        return true;
+    }
+
+    // Expected embedded version for early image validation
+    strcpy(_pendingVersion, remoteVersion);
+    memcpy(_pendingHash, _cachedHash, sizeof(_pendingHash));
+    _pendingHasHash = _cachedHasHash;
+#if OTA_ENABLE_SIGNING
+    memcpy(_pendingSig, _cachedSig, _cachedSigLen);
+    _pendingSigLen = _cachedSigLen;
+
+    if (_hasSigningKey && _pendingSigLen == 0) {
+        setError("Update rejected: release is not signed");
+        return false;
+    }
+#endif
+
+    // Whoever answered the gateway broadcast wrote this manifest. Without
+    // a signature only the origin's digest vouches for the image.
+    if (_gatewayActive && _validatorMirror == 0 && !_hasSigningKey && !confirmWithOrigin(remoteVersion)) {
+        return false;
+    }
+    return performUpdate();
+}
+
+// Fetch the version file from the configured mirrors and take its digest
+bool ESP32_AutoOTA::confirmWithOrigin(const char* version) {
+    char confirmed[sizeof(_cachedVersion)];
+    int httpCode = fetchRemoteVersion(confirmed, sizeof(confirmed), 1u << 0);
+    if (httpCode != HTTP_CODE_OK || strcmp(confirmed, version) != 0 || !_cachedHasHash) {
+        // Counts against the gateway, which is dropped after the check
+        _versionMirrors.recordFailure(0);
+        setError("Update rejected: gateway release not confirmed by the origin");
+        return false;
+    }
+
+    memcpy(_pendingHash, _cachedHash, sizeof(_pendingHash));
+    _pendingHasHash = true;
+#if OTA_ENABLE_SIGNING
+    _pendingSigLen = 0;
+#endif
+    return true;
+}
+
+int ESP32_AutoOTA::fetchRemoteVersion(char* version, size_t len, uint32_t exclude) {
+    OTAMirrorList& mirrors = _versionFromImage ? _firmwareMirrors : _versionMirrors;
+
+    // Best mirror first, fall through the others until one answers
+    int httpCode = HTTPC_ERROR_CONNECTION_REFUSED;
+    uint32_t tried = exclude;
+    int mirror;
+    while ((mirror = mirrors.best(tried)) >= 0) {
+        tried |= 1u << mirror;
+
+        unsigned long start = millis();
+        httpCode = requestVersion(mirror, version, len);
+        if (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_NOT_MODIFIED) {
+            mirrors.recordSuccess(mirror, millis() - start);
+            break;
+        }
+
+        mirrors.recordFailure(mirror);
+        if (mirrors.count() > 1) {
+            OTA_LOGW("Mirror %s failed: HTTP %d", mirrors.url(mirror), httpCode);
+        }
+    }
+    return httpCode;
+}
+
+int ESP32_AutoOTA::requestVersion(int mirror, char* version, size_t len) {
+    const char* url = (_versionFromImage ? _firmwareMirrors : _versionMirrors).url(mirror);
+
+    OTAHttpRequest request;
+    HTTPClient& http = request.http();
+    bool connected = request.begin(url);
+    
+    // Cache-busting headers
+    request.addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
+    request.addHeader("Pragma", "no-cache");
+    request.addHeader("Expires", "0");
+
+    // Conditional request: an unchanged file costs a 304 and no body.
+    // Validators only mean something to the mirror that issued them.
+#if OTA_ENABLE_CONDITIONAL
+    if (_cachedVersion[0] != '\0' && _validatorMirror == mirror) {
+        if (_etag[0] != '\0') {
+            request.addHeader("If-None-Match", _etag);
+        }
+        if (_lastModified[0] != '\0') {
+            request.addHeader("If-Modified-Since", _lastModified);
+        }
+    }
+
+    static const char* headerKeys[] = { "ETag", "Last-Modified" };
+    http.collectHeaders(headerKeys, 2);
+#endif
+
+    if (_longPoll) {
+        // Server holds the request until it has something newer than this.
+        // Without keepalive only the timeout notices a server that vanished
+        // during the hold, so over TLS the hold is kept short.
+        _longPollAsked = _longPollHold;
+        if (!request.canKeepAlive()) {
+            _longPollAsked = min(_longPollAsked, (uint16_t)OTA_LONG_POLL_TLS_HOLD);
+        }
+        char prefer[24];
+        snprintf(prefer, sizeof(prefer), "wait=%u", (unsigned)(_longPollAsked / 1000));
+        request.addHeader("Prefer", prefer);
+        request.addHeader("X-Current-Version", _currentVersion);
+        request.setTimeout(_longPollAsked + OTA_LONG_POLL_MARGIN);
+    }
+
+    if (_versionFromImage) {
+        // Only the image header and app descriptor
+        char range[32];
+        size_t prefix = _decryptKeyLen > 0 ? OTA_CRYPT_HEADER_LEN : 0;
+        snprintf(range, sizeof(range), "bytes=0-%u", (unsigned)(prefix + OTA_IMAGE_HEADER_LEN - 1));
+        request.addHeader("Range", range);
+    }
+
+    int httpCode = connected ? request.GET() : HTTPC_ERROR_CONNECTION_REFUSED;
+    recordRequest(request.getTimes(), httpCode, request.getRedirects(), request.getCacheHit());
+    OTATrace::record(OTA_EVT_CHECK_RESULT, (uint16_t)httpCode, request.getTimes().ttfbMs);
+
+    if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+        // Same content as last time, so the same version
+        strncpy(version, _cachedVersion, len - 1);
+        version[len - 1] = '\0';
+    } else if (httpCode == HTTP_CODE_OK || (_versionFromImage && httpCode == HTTP_CODE_PARTIAL_CONTENT)) {
+        _cachedHasHash = false;
+#if OTA_ENABLE_SIGNING
+        _cachedSigLen = 0;
+#endif
+        bool valid = _versionFromImage ? readImageVersion(http, version, len) : readVersionFile(http, version, len);
+        if (valid) {
+            strncpy(_cachedVersion, version, sizeof(_cachedVersion) - 1);
+            _cachedVersion[sizeof(_cachedVersion) - 1] = '\0';
+#if OTA_ENABLE_CONDITIONAL
+            strncpy(_etag, http.header("ETag").c_str(), sizeof(_etag) - 1);
+            _etag[sizeof(_etag) - 1] = '\0';
+            strncpy(_lastModified, http.header("Last-Modified").c_str(), sizeof(_lastModified) - 1);
+            _lastModified[sizeof(_lastModified) - 1] = '\0';
+#endif
+            _validatorMirror = mirror;
+            httpCode = HTTP_CODE_OK;
         } else {
-            log("[AutoOTA] New version available!");
-            
-            // Check staggered rollout
-            if (_staggeredRollout && !shouldUpdateNow()) {
-                logf("[AutoOTA] Staggered rollout: Delaying update (device not in %d%% group)", _rolloutPercentage);
-                http.end();
-                return true;
+            _cachedVersion[0] = '\0';
+            httpCode = OTA_CHECK_BAD_CONTENT;
+        }
+    }
+
+    request.end();
+    return httpCode;
+}
+
+bool ESP32_AutoOTA::readVersionFile(HTTPClient& http, char* version, size_t len) {
+    String body = http.getString();
+
+    statsBegin();
+    _stats.bytesTransferred += body.length();
+    statsEnd();
+
+    // First line is the version, "key=value" lines may follow:
+    //   sha256=<64 hex digits>   digest of the firmware image
+    //   sig=<hex DER>            ECDSA P-256 signature over that digest
+    char* line = (char*)body.c_str();
+    bool first = true;
+    while (line != NULL && *line != '\0') {
+        char* next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        size_t n = strlen(line);
+        while (n > 0 && isspace((unsigned char)line[n - 1])) {
+            line[--n] = '\0';
+        }
+        while (isspace((unsigned char)*line)) {
+            line++;
+            n--;
+        }
+
+        if (first) {
+            if (n == 0 || n >= len) {
+                return false;
             }
-            
-            http.end();
-            return performUpdate();
+            strcpy(version, line);
+            first = false;
+        } else if (strncmp(line, "sha256=", 7) == 0 && n == 7 + 64) {
+            _cachedHasHash = parseHex(line + 7, _cachedHash, sizeof(_cachedHash));
+        } else if (strncmp(line, "sig=", 4) == 0 && (n - 4) % 2 == 0 && (n - 4) / 2 <= OTA_SIGNATURE_MAX) {
+#if OTA_ENABLE_SIGNING
+            _cachedSigLen = parseHex(line + 4, _cachedSig, (n - 4) / 2) ? (n - 4) / 2 : 0;
+#endif
         }
-    } else {
-        logf("[AutoOTA] Version check failed: HTTP %d", httpCode);
-        setError("Version check failed");
-        http.end();
+        line = next;
+    }
+    return !first;
+}
+
+bool ESP32_AutoOTA::readImageVersion(HTTPClient& http, char* version, size_t len) {
+    uint8_t buffer[OTA_CRYPT_HEADER_LEN + OTA_IMAGE_HEADER_LEN];
+    size_t want = (_decryptKeyLen > 0 ? OTA_CRYPT_HEADER_LEN : 0) + OTA_IMAGE_HEADER_LEN;
+    size_t received = 0;
+    unsigned long start = millis();
+    WiFiClient* stream = http.getStreamPtr();
+
+    // A server that ignores Range sends the whole image; stop after the header
+    while (received < want && millis() - start < OTA_HEADER_TIMEOUT) {
+        size_t available = stream->available();
+        if (available > 0) {
+            received += stream->read(buffer + received, min(available, want - received));
+        } else if (!http.connected()) {
+            break;
+        } else {
+            delay(1);
+        }
+    }
+
+    statsBegin();
+    _stats.bytesTransferred += received;
+    statsEnd();
+
+    uint8_t* header = buffer;
+#if OTA_ENABLE_DECRYPT
+    if (_decryptKeyLen > 0) {
+        OTAImageCipher cipher;
+        if (received < OTA_CRYPT_HEADER_LEN || !cipher.setKey(_decryptKey, _decryptKeyLen) || !cipher.begin(buffer)) {
+            return false;
+        }
+        header += OTA_CRYPT_HEADER_LEN;
+        received -= OTA_CRYPT_HEADER_LEN;
+        cipher.apply(header, received);
+    }
+#endif
+
+    OTAImageInfo info;
+    if (OTAImage::parse(header, received, info) != OTA_IMAGE_OK || info.version[0] == '\0') {
         return false;
     }
+    strncpy(version, info.version, len - 1);
+    version[len - 1] = '\0';
+    return true;
 }
 
 bool ESP32_AutoOTA::performUpdate() {
-    log("[AutoOTA] Starting firmware download...");
-    blinkLED(3, 100); // Quick blinks to indicate update starting
+    OTA_LOGI("Starting firmware download...");
+    if (!_polled) {
+        blinkLED(3, 100); // Quick blinks to indicate update starting
+    }
     
     if (_onUpdateStart) {
         _onUpdateStart();
     }
 
-    HTTPClient http;
-    http.begin(_firmwareURL);
+    // A peer on the LAN is faster than any mirror; the digest guards the bytes
+    if (_peerSharing && _decryptKeyLen == 0 && _pendingHasHash && startPeerInstall()) {
+        if (_polled || runInstall()) {
+            return true;
+        }
+        OTA_LOGW("Peer download failed, using the mirrors");
+    }
+
+    if (!startMirrorInstall()) {
+        return false;
+    }
+
+    // In polled mode poll() carries the download on
+    return _polled || runInstall();
+}
+
+bool ESP32_AutoOTA::startPeerInstall() {
+#if OTA_ENABLE_PEER_SHARE
+    // Kept in a member, the source reads the URL again when it resumes
+    if (!OTAPeerShare::find(_pendingHash, _peerPort, _peerURL, sizeof(_peerURL))) {
+        OTA_LOGD("No peer has the new firmware");
+        return false;
+    }
+
+    OTA_LOGI("Downloading from peer %s", _peerURL);
+    OTAHttpSource* source = new OTAHttpSource(_peerURL);
+    if (!source->open()) {
+        OTA_LOGW("Peer download failed, using the mirrors");
+        delete source;
+        return false;
+    }
+    return startInstall(source, true);
+#else
+    return false;
+#endif
+}
+
+bool ESP32_AutoOTA::startMirrorInstall() {
+#if OTA_ENABLE_PARALLEL
+    if (_parallelConnections > 1) {
+        OTAParallelHttpSource* parallel = new OTAParallelHttpSource(_firmwareMirrors.url(_firmwareMirrors.best()), _parallelConnections);
+        bool opened = parallel->open();
+        recordRequest(parallel->getTimes(), parallel->getHTTPCode(), parallel->getRedirects(), parallel->getCacheHit());
+        if (opened) {
+            OTA_LOGI("Downloading over %u connections", parallel->getConnections());
+            return startInstall(parallel, false);
+        }
+        OTA_LOGW("Parallel download unavailable (HTTP %d), using one connection", parallel->getHTTPCode());
+        delete parallel;
+    }
+#endif
+
+    OTAMirrorSource* source = new OTAMirrorSource(_firmwareMirrors);
+    bool opened = source->open();
+    recordRequest(source->getTimes(), source->getHTTPCode(), source->getRedirects(), source->getCacheHit());
+    OTATrace::record(OTA_EVT_CHECK_RESULT, (uint16_t)source->getHTTPCode(), source->getTimes().ttfbMs);
     
-    // Cache-busting headers
-    http.addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-    http.addHeader("Pragma", "no-cache");
-    http.addHeader("Expires", "0");
+    if (!opened) {
+        char errorMsg[64];
+        snprintf(errorMsg, sizeof(errorMsg), "Download failed: HTTP %d", source->getHTTPCode());
+        delete source;
+        setError(errorMsg);
+        return false;
+    }
+
+    return startInstall(source, false);
+}
+
+// Takes ownership of an opened heap source
+bool ESP32_AutoOTA::startInstall(OTAUpdateSource* source, bool fromPeer) {
+    _install.owned[0] = source;
+    _install.owned[1] = NULL;
+    _install.fromPeer = fromPeer;
+
+#if OTA_ENABLE_DECRYPT
+    if (_decryptKeyLen > 0) {
+        // Decrypted in place in the writer's sector buffer, nothing extra held
+        OTADecryptSource* decrypted = new OTADecryptSource(*source, _decryptKey, _decryptKeyLen);
+        _install.owned[1] = decrypted;
+        if (!decrypted->attach()) {
+            setError("Download is not an encrypted image");
+            source->close();
+            releaseInstall();
+            return false;
+        }
+        source = decrypted;
+    }
+#endif
+
+    if (!installBegin(*source)) {
+        releaseInstall();
+        return false;
+    }
+    return true;
+}
+
+// Drop a download in progress without reporting it (stop())
+void ESP32_AutoOTA::abortInstall() {
+    _install.source->close();
+    _writer.abort();
+#if OTA_ENABLE_PRE_ERASE
+    if (_backgroundErase) {
+        _eraser.endWrite(_writer.getFlushed());
+    }
+#endif
+    releaseInstall();
+    _installing = false;
+}
+
+void ESP32_AutoOTA::releaseInstall() {
+    // The decrypting wrapper first, it reads from the other
+    delete _install.owned[1];
+    delete _install.owned[0];
+    _install.owned[0] = NULL;
+    _install.owned[1] = NULL;
+}
+
+void ESP32_AutoOTA::discoverGateway() {
+#if OTA_ENABLE_GATEWAY
+    // Its image is checked against a manifest digest, which needs a manifest
+    if (_versionFromImage) {
+        return;
+    }
+
+    // The configured firmware URL tells the gateway which image we want
+    char base[OTA_GATEWAY_URL_LEN];
+    if (!OTAGateway::find(_firmwareMirrors.url(0), _gatewayPort, base, sizeof(base))) {
+        return;
+    }
+
+    char url[OTA_GATEWAY_URL_LEN + 16];
+    snprintf(url, sizeof(url), "%s/firmware.bin", base);
+    if (!_firmwareMirrors.prepend(url, true)) {
+        OTA_LOGW("Mirror list full, gateway %s not used", base);
+        return;
+    }
+    snprintf(url, sizeof(url), "%s/version.txt", base);
+    if (!_versionMirrors.prepend(url, true)) {
+        _firmwareMirrors.remove(0);
+        OTA_LOGW("Mirror list full, gateway %s not used", base);
+        return;
+    }
+
+    // Used while it works, not ranked against the origin by latency
+    _firmwareMirrors.pin(0);
+    _versionMirrors.pin(0);
 
-    int httpCode = http.GET();
+    // Mirror indices moved up by one
+    _validatorMirror = -1;
+    _gatewayActive = true;
+    OTA_LOGI("Using site gateway %s", base);
+#endif
+}
+
+void ESP32_AutoOTA::dropGateway() {
+#if OTA_ENABLE_GATEWAY
+    OTA_LOGW("Site gateway %s failing, using the mirrors", _firmwareMirrors.url(0));
+    _firmwareMirrors.remove(0);
+    _versionMirrors.remove(0);
+    _validatorMirror = -1;
+    _gatewayActive = false;
+#endif
+}
+
+bool ESP32_AutoOTA::updateFrom(OTAUpdateSource& source) {
+    return updateFrom(source, NULL);
+}
+
+bool ESP32_AutoOTA::updateFrom(OTAUpdateSource& source, const uint8_t* sha256, const uint8_t* signature,
+                               size_t signatureLen) {
+    if (_installing) {
+        setError("Update already in progress");
+        return false;
+    }
+
+    // Whatever arrives on an open channel is only installed by digest
+    if (!source.isTrusted() && sha256 == NULL) {
+        setError("Update rejected: untrusted source needs an expected SHA-256");
+        return false;
+    }
+    // A signature only means something over a digest, even from a trusted source
+    if (_hasSigningKey && (sha256 == NULL || signature == NULL || signatureLen == 0)) {
+        setError("Update rejected: release is not signed");
+        return false;
+    }
+    if (signatureLen > OTA_SIGNATURE_MAX) {
+        setError("Update rejected: signature too long");
+        return false;
+    }
+
+    OTA_LOGI("Installing firmware from %s source...", source.name());
+    blinkLED(3, 100);
+
+    // stop() from one of the callbacks aborts this install
+    _stopRequested = false;
+
+    if (_onUpdateStart) {
+        _onUpdateStart();
+    }
+
+    _pendingVersion[0] = '\0'; // No announced version to compare against
+    _pendingHasHash = sha256 != NULL;
+    if (_pendingHasHash) {
+        memcpy(_pendingHash, sha256, sizeof(_pendingHash));
+    }
+#if OTA_ENABLE_SIGNING
+    _pendingSigLen = signature != NULL ? signatureLen : 0;
+    if (_pendingSigLen > 0) {
+        memcpy(_pendingSig, signature, _pendingSigLen);
+    }
+#endif
+
+    if (!source.open()) {
+        setError("Failed to open update source");
+        return false;
+    }
+
+    return installFrom(source);
+}
+
+bool ESP32_AutoOTA::installFrom(OTAUpdateSource& source) {
+    // Caller's source, nothing to delete
+    _install.owned[0] = NULL;
+    _install.owned[1] = NULL;
+    _install.fromPeer = false;
+    return installBegin(source) && runInstall();
+}
+
+// Run an install to the end, blocking (task mode and updateFrom())
+bool ESP32_AutoOTA::runInstall() {
+    uint32_t waitMs;
+    while (installStep(UINT32_MAX, waitMs)) {
+        delay(waitMs);
+    }
+    if (_stopRequested) {
+        abortInstall();
+        return false;
+    }
+    return installFinish();
+}
+
+bool ESP32_AutoOTA::installBegin(OTAUpdateSource& source) {
+    size_t total = source.size();
     
-    if (httpCode == HTTP_CODE_OK) {
-        int contentLength = http.getSize();
+    if (total == 0) {
+        setError("Content length is zero");
+        source.close();
+        return false;
+    }
+
+    OTA_LOGI("Firmware size: %u bytes", (unsigned)total);
+    
+    _writer.setMode(_flashMode);
+#if OTA_ENABLE_PRE_ERASE
+    _writer.setPreErased(_backgroundErase ? _eraser.erasedBytes() : 0);
+#else
+    _writer.setPreErased(0);
+#endif
+    _writer.setSkipUnchanged(_skipUnchanged);
+    _writer.setImageCheck(_matchProject, _matchVersion && _pendingVersion[0] ? _pendingVersion : NULL);
+    _writer.setExpectedHash(_pendingHasHash ? _pendingHash : NULL);
+#if OTA_ENABLE_SIGNING
+    _writer.setSignature(_pendingSigLen > 0 && _hasSigningKey ? &_signingKey : NULL, _pendingSig, _pendingSigLen);
+#else
+    _writer.setSignature(NULL, NULL, 0);
+#endif
+
+#if OTA_ENABLE_PEER_SHARE
+    // The recorded digest may name the partition about to be overwritten
+    OTAPeerShare::forget();
+#endif
+    
+    if (!_writer.begin(total)) {
+        setError(_writer.getError() == ESP_ERR_NO_MEM ? "Not enough memory for OTA" : "Not enough space for OTA");
+        source.close();
+        return false;
+    }
+
+#if OTA_ENABLE_PRE_ERASE
+    if (_backgroundErase) {
+        _eraser.beginWrite();
+    }
+#endif
+
+    OTA_LOGD("Writing firmware to flash...");
+    OTATrace::record(OTA_EVT_DOWNLOAD_START, 0, total);
+    
+    _install.source = &source;
+    _install.total = total;
+    _install.written = 0;
+    _install.startTime = millis();
+    _install.lastData = _install.startTime;
+    _install.paused = false;
+    _install.sourceClosed = false;
+    _install.writeFailed = false;
+    _install.abortReason = 0;
+    _install.resumes = 0;
+    _install.reconnect = false;
+    _install.throttleMs = 0;
+    _rateLimiter.reset(micros());
+    _installing = true;
+    return true;
+}
+
+/**
+ * Move the install forward until budgetMs has passed or it has to wait
+ * @param waitMs Set to the time to wait before the next call, 0 if none
+ * @return false once the install is complete or has failed
+ */
+bool ESP32_AutoOTA::installStep(uint32_t budgetMs, uint32_t& waitMs) {
+    InstallState& s = _install;
+    OTAUpdateSource& source = *s.source;
+    unsigned long sliceStart = millis();
+    waitMs = 0;
+    
+    while (s.written < s.total) {
+        if (_stopRequested) {
+            return false;
+        }
+
+        if (_downloadPaused || s.paused) {
+            if (!pauseStep(waitMs)) {
+                s.abortReason = 2;
+                return false;
+            }
+            if (waitMs > 0) {
+                return true;
+            }
+            continue;
+        }
+
+        size_t remaining = s.total - s.written;
+
+        // Rate limit: wait for at least one segment worth of tokens
+        size_t allowance = _rateLimiter.available(micros());
+        if (allowance < min(remaining, (size_t)OTA_RATE_MIN_BURST)) {
+            waitMs = max(_rateLimiter.waitMs(), (uint32_t)1);
+            s.throttleMs += waitMs;
+            return true;
+        }
+        remaining = min(remaining, allowance);
+
+        const uint8_t* data = NULL;
+        size_t bytesRead = source.peek(&data, remaining);
+        size_t bytesWritten;
         
-        if (contentLength > 0) {
-            logf("[AutoOTA] Firmware size: %d bytes", contentLength);
-            
-            bool canBegin = Update.begin(contentLength);
-            
-            if (canBegin) {
-                log("[AutoOTA] Writing firmware to flash...");
-                
-                WiFiClient& stream = http.getStream();
-                size_t written = 0;
-                size_t total = contentLength;
-                uint8_t buffer[128];
-                
-                while (http.connected() && (written < total)) {
-                    size_t available = stream.available();
-                    if (available) {
-                        size_t bytesToRead = min(available, sizeof(buffer));
-                        size_t bytesRead = stream.readBytes(buffer, bytesToRead);
-                        
-                        size_t bytesWritten = Update.write(buffer, bytesRead);
-                        written += bytesWritten;
-                        
-                        // Progress callback
-                        if (_onUpdateProgress && (written % 10240 == 0 || written == total)) {
-                            _onUpdateProgress(written, total);
-                        }
-                        
-                        // Blink LED during update
-                        if (_statusLED >= 0 && written % 4096 == 0) {
-                            digitalWrite(_statusLED, !digitalRead(_statusLED));
-                        }
-                    }
-                    delay(1);
+        if (bytesRead > 0) {
+            // Zero-copy source: whole sectors go to flash straight from its memory
+            bytesWritten = _writer.write(data, bytesRead);
+            source.consume(bytesWritten);
+        } else {
+            // Read straight into the writer's sector buffer
+            uint8_t* space;
+            size_t room = _writer.reserve(&space);
+            int n = source.read(space, min(room, remaining));
+            if (n < 0) {
+                // Broken connection: continue on a new one where it stopped,
+                // from a request task in polled mode
+                if (_polled) {
+                    s.reconnect = true;
+                    return false;
                 }
-                
-                if (_statusLED >= 0) {
-                    digitalWrite(_statusLED, LOW);
+                if (resumeInstall()) {
+                    continue;
                 }
-                
-                logf("[AutoOTA] Wrote: %d bytes", written);
-                
-                if (Update.end()) {
-                    if (Update.isFinished()) {
-                        log("[AutoOTA] Update successful! Rebooting...");
-                        
-                        if (_onUpdateComplete) {
-                            _onUpdateComplete();
-                        }
-                        
-                        blinkLED(5, 200); // Success pattern
-                        delay(1000);
-                        ESP.restart();
-                        return true;
-                    } else {
-                        setError("Update not finished");
-                    }
-                } else {
-                    char errorMsg[64];
-                    snprintf(errorMsg, sizeof(errorMsg), "Update failed: error %d", Update.getError());
-                    setError(errorMsg);
+                return false;
+            }
+            if (n == 0) {
+                if (millis() - s.lastData > DEFAULT_STALL_TIMEOUT) {
+                    s.abortReason = 3;
+                    return false;
                 }
-            } else {
-                setError("Not enough space for OTA");
+                waitMs = 1;
+                return true;
             }
-        } else {
-            setError("Content length is zero");
+            bytesRead = n;
+            bytesWritten = _writer.commit(n) ? n : 0;
+        }
+
+        _rateLimiter.spend(bytesRead);
+
+        statsBegin();
+        _stats.bytesTransferred += bytesRead;
+        statsEnd();
+        
+        if (bytesWritten != bytesRead) {
+            s.writeFailed = true;
+            s.abortReason = _writer.getImageCheck() != OTA_IMAGE_OK ? 4 : 1;
+            s.written += bytesRead;
+            return false;
+        }
+
+        size_t previous = s.written;
+        s.written += bytesWritten;
+        s.lastData = millis();
+        
+        if (s.written / 65536 != previous / 65536) {
+            OTATrace::record(OTA_EVT_DOWNLOAD_PROGRESS, 0, s.written);
+        }
+
+        // Progress callback
+        if (_onUpdateProgress && (s.written / 10240 != previous / 10240 || s.written == s.total)) {
+            _onUpdateProgress(s.written, s.total);
+        }
+        
+        // Blink LED during update
+        if (ledEnabled() && s.written / 4096 != previous / 4096) {
+            digitalWrite(_statusLED, !digitalRead(_statusLED));
+        }
+
+        if (millis() - sliceStart >= budgetMs) {
+            return s.written < s.total;
         }
-    } else {
-        char errorMsg[64];
-        snprintf(errorMsg, sizeof(errorMsg), "Download failed: HTTP %d", httpCode);
-        setError(errorMsg);
     }
-    
-    http.end();
     return false;
 }
 
-unsigned long ESP32_AutoOTA::getRandomDelay() {
-    return random(_minRandomDelay, _maxRandomDelay);
+/**
+ * Close the source, finalize or discard the image and report the result
+ * Reboots when the image was installed
+ */
+bool ESP32_AutoOTA::installFinish() {
+    InstallState& s = _install;
+    size_t written = s.written;
+    size_t total = s.total;
+
+    s.source->close();
+    
+    if (ledEnabled()) {
+        digitalWrite(_statusLED, LOW);
+    }
+    
+    OTA_LOGD("Wrote: %u bytes", (unsigned)written);
+
+    // One record per download, so slow flash cannot evict the others
+    if (_writer.getStallCount() > 0) {
+        OTATrace::record(OTA_EVT_FLASH_STALL, min(_writer.getStallMaxUs() / 1000, (uint32_t)0xFFFF),
+                         _writer.getStallCount());
+    }
+
+    bool ended = false;
+    if (s.writeFailed || written < total) {
+        OTATrace::record(OTA_EVT_DOWNLOAD_ABORT, s.abortReason, written);
+        _writer.abort();
+    } else {
+        ended = _writer.end();
+        OTATrace::record(OTA_EVT_DOWNLOAD_END, _writer.getError(), written);
+        if (_writer.getImageCheck() != OTA_IMAGE_OK) {
+            OTATrace::record(OTA_EVT_DOWNLOAD_ABORT, 4, written);
+        } else if (_writer.getHashMismatch()) {
+            OTATrace::record(OTA_EVT_DOWNLOAD_ABORT, 5, written);
+        } else if (_writer.getSignatureInvalid()) {
+            OTATrace::record(OTA_EVT_DOWNLOAD_ABORT, 6, written);
+        }
+    }
+
+    releaseInstall();
+    _installing = false;
+
+    unsigned long elapsed = millis() - s.startTime;
+    statsBegin();
+    _stats.downloadBytesPerSec = elapsed > 0 ? (uint64_t)written * 1000 / elapsed : 0;
+    _stats.flashWriteCalls = _writer.getWriteCalls();
+    _stats.flashWriteMs = _writer.getWriteUs() / 1000;
+    _stats.flashStallMs = _writer.getStallUs() / 1000;
+    _stats.flashSectorsSkipped = _writer.getSkippedSectors();
+    _stats.verifyMs = _writer.getVerifyUs() / 1000;
+    _stats.throttleMs = s.throttleMs;
+    _stats.resumes += s.resumes;
+    statsEnd();
+    
+    if (ended) {
+        if (_writer.getVerifyUs() > 0) {
+            OTA_LOGI("Signature verified in %u ms", (unsigned)(_writer.getVerifyUs() / 1000));
+        }
+        OTA_LOGI("Update successful! Rebooting...");
+        OTATrace::record(OTA_EVT_REBOOT, 0, written);
+
+        // Keep what this download taught us about the mirrors
+        _firmwareMirrors.save();
+        _versionMirrors.save();
+
+#if OTA_ENABLE_PEER_SHARE
+        if (_peerSharing && _decryptKeyLen == 0 && _pendingHasHash) {
+            OTAPeerShare::remember(_pendingHash, total);
+        }
+#endif
+        
+        if (_onUpdateComplete) {
+            _onUpdateComplete();
+        }
+        
+        blinkLED(5, 200); // Success pattern
+        delay(1000);
+        ESP.restart();
+        return true;
+    }
+
+#if OTA_ENABLE_PRE_ERASE
+    if (_backgroundErase) {
+        // Sectors past the written ones are still erased
+        _eraser.endWrite(_writer.getFlushed());
+    }
+#endif
+
+    char errorMsg[64];
+    if (_writer.getImageCheck() != OTA_IMAGE_OK) {
+        snprintf(errorMsg, sizeof(errorMsg), "Image rejected: %s", OTAImage::describe(_writer.getImageCheck()));
+    } else if (_writer.getHashMismatch()) {
+        snprintf(errorMsg, sizeof(errorMsg), "Image rejected: SHA-256 mismatch");
+    } else if (_writer.getSignatureInvalid()) {
+        snprintf(errorMsg, sizeof(errorMsg), "Image rejected: bad signature");
+    } else if (!s.writeFailed && written < total) {
+        snprintf(errorMsg, sizeof(errorMsg), "Download incomplete: %u of %u bytes", (unsigned)written, (unsigned)total);
+    } else {
+        snprintf(errorMsg, sizeof(errorMsg), "Update failed: error %d", _writer.getError());
+    }
+
+    // The gateway served a check's download that was rejected: drop it
+    // after this check rather than download the same image from it again
+    // (updateFrom() leaves no pending version)
+    bool rejected = _writer.getImageCheck() != OTA_IMAGE_OK || _writer.getHashMismatch() ||
+                    _writer.getSignatureInvalid();
+    if (_gatewayActive && rejected && !_install.fromPeer && _pendingVersion[0] != '\0') {
+        _firmwareMirrors.recordFailure(0);
+    }
+    setError(errorMsg);
+    return false;
 }
 
 bool ESP32_AutoOTA::shouldUpdateNow() {
@@ -398,15 +1543,136 @@ void ESP32_AutoOTA::setError(const char* error) {
     strncpy(_lastError, error, sizeof(_lastError) - 1);
     _lastError[sizeof(_lastError) - 1] = '\0';
     
-    logf("[AutoOTA] ERROR: %s", error);
+    OTA_LOGE("ERROR: %s", error);
     
     if (_onUpdateError) {
         _onUpdateError(error);
     }
 }
 
+/**
+ * Hold a paused install without blocking
+ * @param waitMs Set while the pause lasts
+ * @return false if the source could not be reopened after the pause, or
+ *         in polled mode has to be reopened by a request task
+ */
+bool ESP32_AutoOTA::pauseStep(uint32_t& waitMs) {
+    InstallState& s = _install;
+
+    if (!s.paused) {
+        OTA_LOGI("Download paused at %u bytes", (unsigned)s.written);
+        OTATrace::record(OTA_EVT_DOWNLOAD_PAUSE, 0, s.written);
+        s.paused = true;
+        s.pausedAt = millis();
+        s.sourceClosed = false;
+    }
+
+    if (_downloadPaused) {
+        // Not reading lets the TCP window close, so the sender backs off;
+        // a long pause drops the connection instead of letting it time out
+        if (!s.sourceClosed && millis() - s.pausedAt > OTA_PAUSE_CLOSE_MS) {
+            s.source->close();
+            s.sourceClosed = true;
+        }
+        waitMs = 10;
+        return true;
+    }
+
+    OTA_LOGI("Download resumed");
+    s.paused = false;
+    s.throttleMs += millis() - s.pausedAt;
+    s.lastData = millis();
+    _rateLimiter.reset(micros());
+
+    if (!s.sourceClosed) {
+        OTATrace::record(OTA_EVT_DOWNLOAD_RESUME, 0, s.written);
+        return true;
+    }
+    if (_polled) {
+        // Reopened by a request task, see resumeInstall()
+        s.reconnect = true;
+        return false;
+    }
+    s.sourceClosed = false;
+    return resumeSource(*s.source, s.written);
+}
+
+/**
+ * Reopen the source where the install stopped: after a long pause, or
+ * after a broken transfer (limited to OTA_RESUME_ATTEMPTS)
+ * @return false if the install has to be given up
+ */
+bool ESP32_AutoOTA::resumeInstall() {
+    InstallState& s = _install;
+    if (s.sourceClosed) {
+        s.sourceClosed = false;
+        if (!resumeSource(*s.source, s.written)) {
+            s.abortReason = 2;
+            return false;
+        }
+    } else {
+        if (s.resumes >= OTA_RESUME_ATTEMPTS || !resumeSource(*s.source, s.written)) {
+            s.abortReason = 2;
+            return false;
+        }
+        s.resumes++;
+    }
+    s.abortReason = 0;
+    s.lastData = millis();
+    return true;
+}
+
+bool ESP32_AutoOTA::resumeSource(OTAUpdateSource& source, size_t offset) {
+    size_t total = source.size();
+    source.close();
+
+    // The image must not have changed while we were away
+    if (!source.open(offset) || source.size() != total) {
+        OTA_LOGW("Failed to resume %s source at %u bytes", source.name(), (unsigned)offset);
+        return false;
+    }
+
+    OTA_LOGD("Resumed %s source at %u bytes", source.name(), (unsigned)offset);
+    OTATrace::record(OTA_EVT_DOWNLOAD_RESUME, 1, offset);
+    return true;
+}
+
+void ESP32_AutoOTA::recordRequest(const OTAPhaseTimes& times, int httpCode, uint8_t redirects, bool cacheHit) {
+    statsBegin();
+    _stats.redirectHops += redirects;
+    if (cacheHit) {
+        _stats.redirectCacheHits++;
+    }
+    _stats.dnsMs = times.dnsMs;
+    _stats.connectMs = times.connectMs;
+    _stats.tlsMs = times.tlsMs;
+    _stats.ttfbMs = times.ttfbMs;
+    if (httpCode == HTTP_CODE_OK) {
+        _stats.okCount++;
+    } else if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+        _stats.notModifiedCount++;
+    }
+    statsEnd();
+}
+
+void ESP32_AutoOTA::recordResources() {
+    statsBegin();
+    _stats.minFreeHeap = ESP.getMinFreeHeap();
+    _stats.stackHighWaterMark = uxTaskGetStackHighWaterMark(NULL);
+    statsEnd();
+}
+
+// Sequence lock: odd while a write is in progress, readers retry
+void ESP32_AutoOTA::statsBegin() {
+    _statsLock.writeBegin();
+}
+
+void ESP32_AutoOTA::statsEnd() {
+    _statsLock.writeEnd();
+}
+
 void ESP32_AutoOTA::blinkLED(int times, int delayMs) {
-    if (_statusLED < 0) return;
+    if (!ledEnabled()) return;
     
     for (int i = 0; i < times; i++) {
         digitalWrite(_statusLED, HIGH);
@@ -416,18 +1682,14 @@ void ESP32_AutoOTA::blinkLED(int times, int delayMs) {
     }
 }
 
-void ESP32_AutoOTA::log(const char* message) {
-    if (_debugMode) {
-        Serial.println(message);
-    }
-}
-
-void ESP32_AutoOTA::logf(const char* format, ...) {
-    if (_debugMode) {
+void ESP32_AutoOTA::logf(uint8_t level, const char* format, ...) {
+    if (_debugMode || level <= OTA_LOG_LEVEL_WARN) {
         char buffer[256];
+        // Prefix added here instead of in every format string
+        int prefix = snprintf(buffer, sizeof(buffer), "[AutoOTA] ");
         va_list args;
         va_start(args, format);
-        vsnprintf(buffer, sizeof(buffer), format, args);
+        vsnprintf(buffer + prefix, sizeof(buffer) - prefix, format, args);
         va_end(args);
         Serial.println(buffer);
     }
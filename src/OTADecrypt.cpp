@@ -0,0 +1,136 @@
+/**
+ * OTADecrypt.cpp
+ *
+ * Implementation of the streaming image decryption
+ */
+
+#include "OTADecrypt.h"
+
+#if OTA_ENABLE_DECRYPT
+
+#define OTA_CRYPT_HEADER_TIMEOUT 10000
+
+// ========== OTAImageCipher ==========
+
+OTAImageCipher::OTAImageCipher() {
+    mbedtls_aes_init(&_aes);
+    memset(_nonce, 0, sizeof(_nonce));
+    memset(_counter, 0, sizeof(_counter));
+    memset(_stream, 0, sizeof(_stream));
+    _streamOffset = 0;
+}
+
+OTAImageCipher::~OTAImageCipher() {
+    mbedtls_aes_free(&_aes);
+}
+
+bool OTAImageCipher::setKey(const uint8_t* key, size_t keyLen) {
+    if (keyLen != 16 && keyLen != 32) {
+        return false;
+    }
+    return mbedtls_aes_setkey_enc(&_aes, key, keyLen * 8) == 0;
+}
+
+bool OTAImageCipher::begin(const uint8_t* header) {
+    if (memcmp(header, OTA_CRYPT_MAGIC, 4) != 0) {
+        return false;
+    }
+    memcpy(_nonce, header + 4, OTA_CRYPT_NONCE_LEN);
+    seek(0);
+    return true;
+}
+
+void OTAImageCipher::seek(size_t offset) {
+    uint32_t block = offset / 16;
+    memcpy(_counter, _nonce, OTA_CRYPT_NONCE_LEN);
+    _counter[12] = block >> 24;
+    _counter[13] = block >> 16;
+    _counter[14] = block >> 8;
+    _counter[15] = block;
+
+    // mbedtls generates a block when the stream offset is 0; mid-block,
+    // generate it here and move the counter on, as mbedtls would have
+    _streamOffset = offset % 16;
+    if (_streamOffset != 0) {
+        mbedtls_aes_crypt_ecb(&_aes, MBEDTLS_AES_ENCRYPT, _counter, _stream);
+        for (int i = 15; i >= 0 && ++_counter[i] == 0; i--) {
+        }
+    }
+}
+
+void OTAImageCipher::apply(uint8_t* data, size_t len) {
+    mbedtls_aes_crypt_ctr(&_aes, len, &_streamOffset, _counter, _stream, data, data);
+}
+
+// ========== OTADecryptSource ==========
+
+OTADecryptSource::OTADecryptSource(OTAUpdateSource& source, const uint8_t* key, size_t keyLen)
+    : _source(source) {
+    _keyValid = _cipher.setKey(key, keyLen);
+    _started = false;
+    _decryptUs = 0;
+}
+
+bool OTADecryptSource::open(size_t offset) {
+    if (!_keyValid) {
+        return false;
+    }
+
+    // The nonce is read once; a resume skips the header and seeks
+    if (offset == 0 || !_started) {
+        _started = false;
+        _decryptUs = 0;
+        if (!_source.open(0) || !readHeader()) {
+            _source.close();
+            return false;
+        }
+        if (offset == 0) {
+            return true;
+        }
+        _source.close();
+    }
+
+    if (!_source.open(OTA_CRYPT_HEADER_LEN + offset)) {
+        return false;
+    }
+    _cipher.seek(offset);
+    return true;
+}
+
+bool OTADecryptSource::attach() {
+    _decryptUs = 0;
+    return _keyValid && readHeader();
+}
+
+size_t OTADecryptSource::size() {
+    size_t size = _source.size();
+    return size > OTA_CRYPT_HEADER_LEN ? size - OTA_CRYPT_HEADER_LEN : 0;
+}
+
+int OTADecryptSource::read(uint8_t* buffer, size_t len) {
+    int n = _source.read(buffer, len);
+    if (n > 0) {
+        uint32_t start = micros();
+        _cipher.apply(buffer, n);
+        _decryptUs += micros() - start;
+    }
+    return n;
+}
+
+bool OTADecryptSource::readHeader() {
+    uint8_t header[OTA_CRYPT_HEADER_LEN];
+    size_t received = 0;
+    uint32_t start = millis();
+
+    while (received < sizeof(header) && millis() - start < OTA_CRYPT_HEADER_TIMEOUT) {
+        int n = _source.read(header + received, sizeof(header) - received);
+        if (n < 0) return false;
+        if (n == 0) delay(1);
+        received += n;
+    }
+
+    _started = received == sizeof(header) && _cipher.begin(header);
+    return _started;
+}
+
+#endif // OTA_ENABLE_DECRYPT
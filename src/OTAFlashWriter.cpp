@@ -0,0 +1,314 @@
+/**
+ * OTAFlashWriter.cpp
+ *
+ * Implementation of the sector-aligned flash writer
+ */
+
+#include "OTAFlashWriter.h"
+
+OTAFlashWriter::OTAFlashWriter() {
+    _mode = OTA_FLASH_UPDATE;
+    _partition = NULL;
+    _buffer = NULL;
+    _fill = 0;
+    _size = 0;
+    _flushed = 0;
+    _preErased = 0;
+    _skipUnchanged = false;
+    _matchProject = false;
+    _expectedVersion = NULL;
+    _imageChecked = false;
+    _imageCheck = OTA_IMAGE_OK;
+    _expectedHash = NULL;
+    _hashing = false;
+    _hashMismatch = false;
+    _signingKey = NULL;
+    _signature = NULL;
+    _signatureLen = 0;
+    _signatureInvalid = false;
+    _error = 0;
+    _active = false;
+    _writeCalls = 0;
+    _writeUs = 0;
+    _stallUs = 0;
+    _stallCount = 0;
+    _stallMaxUs = 0;
+    _skippedSectors = 0;
+    _verifyUs = 0;
+}
+
+OTAFlashWriter::~OTAFlashWriter() {
+    abort();
+}
+
+bool OTAFlashWriter::begin(size_t size) {
+    abort();
+
+    _size = size;
+    _fill = 0;
+    _flushed = 0;
+    _error = 0;
+    _writeCalls = 0;
+    _writeUs = 0;
+    _stallUs = 0;
+    _stallCount = 0;
+    _stallMaxUs = 0;
+    _skippedSectors = 0;
+    _imageChecked = false;
+    _imageCheck = OTA_IMAGE_OK;
+    _hashMismatch = false;
+    _signatureInvalid = false;
+    _verifyUs = 0;
+
+    if (_mode == OTA_FLASH_UPDATE) {
+        if (!Update.begin(size)) {
+            _error = Update.getError();
+            return false;
+        }
+    } else {
+        _partition = esp_ota_get_next_update_partition(NULL);
+        if (_partition == NULL || size > _partition->size) {
+            _error = ESP_ERR_INVALID_SIZE;
+            return false;
+        }
+    }
+
+    _buffer = (uint8_t*)malloc(OTA_SECTOR_SIZE);
+    if (_buffer == NULL) {
+        if (_mode == OTA_FLASH_UPDATE) {
+            Update.abort();
+        }
+        _error = ESP_ERR_NO_MEM;
+        return false;
+    }
+
+    if (_expectedHash != NULL || _signingKey != NULL) {
+        mbedtls_sha256_init(&_sha);
+        mbedtls_sha256_starts(&_sha, 0);
+        _hashing = true;
+    }
+
+    _active = true;
+    return true;
+}
+
+size_t OTAFlashWriter::reserve(uint8_t** space) {
+    if (!_active) return 0;
+    *space = _buffer + _fill;
+    return OTA_SECTOR_SIZE - _fill;
+}
+
+bool OTAFlashWriter::commit(size_t len) {
+    _fill += len;
+
+    // Reject a wrong image as soon as its header is in, before any flash write
+    if (!_imageChecked && _flushed == 0 && _fill >= OTA_IMAGE_HEADER_LEN) {
+        if (!checkHeader(_buffer, _fill)) return false;
+    }
+
+    if (_fill < OTA_SECTOR_SIZE) {
+        return true;
+    }
+
+    bool ok = flush(_buffer, _fill);
+    _fill = 0;
+    return ok;
+}
+
+size_t OTAFlashWriter::write(const uint8_t* data, size_t len) {
+    if (!_active) return 0;
+
+    size_t accepted = 0;
+    while (accepted < len) {
+        // Whole sector at a sector boundary: write from caller memory
+        if (_fill == 0 && len - accepted >= OTA_SECTOR_SIZE) {
+            if (!_imageChecked && !checkHeader(data + accepted, OTA_SECTOR_SIZE)) break;
+            if (!flush(data + accepted, OTA_SECTOR_SIZE)) break;
+            accepted += OTA_SECTOR_SIZE;
+            continue;
+        }
+
+        size_t n = min((size_t)OTA_SECTOR_SIZE - _fill, len - accepted);
+        memcpy(_buffer + _fill, data + accepted, n);
+        if (!commit(n)) break;
+        accepted += n;
+    }
+    return accepted;
+}
+
+bool OTAFlashWriter::end() {
+    if (!_active) return false;
+
+    // Images shorter than the header never got checked
+    bool ok = _imageChecked || checkHeader(_buffer, _fill);
+    if (ok && _fill > 0) {
+        ok = flush(_buffer, _fill);
+        _fill = 0;
+    }
+    if (ok && _hashing) {
+        ok = checkHash();
+    }
+
+    if (_mode == OTA_FLASH_UPDATE) {
+        if (ok && _flushed == _size && Update.end() && Update.isFinished()) {
+            release();
+            return true;
+        }
+        _error = Update.getError();
+        Update.abort();
+        release();
+        return false;
+    }
+
+    if (ok && _flushed == _size) {
+        // Validates the image before pointing the bootloader at it
+        esp_err_t err = esp_ota_set_boot_partition(_partition);
+        if (err != ESP_OK) {
+            _error = err;
+            ok = false;
+        }
+    } else {
+        ok = false;
+    }
+    release();
+    return ok;
+}
+
+void OTAFlashWriter::abort() {
+    if (_active && _mode == OTA_FLASH_UPDATE) {
+        Update.abort();
+    }
+    release();
+}
+
+bool OTAFlashWriter::flush(const uint8_t* data, size_t len) {
+    // Every byte passes here exactly once and in order, skipped sectors included
+    if (_hashing) {
+        mbedtls_sha256_update(&_sha, data, len);
+    }
+
+    uint32_t start = micros();
+    bool ok;
+
+    if (_mode == OTA_FLASH_UPDATE) {
+        ok = Update.write((uint8_t*)data, len) == len;
+        if (!ok) {
+            _error = Update.getError();
+        }
+    } else if (_skipUnchanged && sectorMatches(_flushed, data, len)) {
+        _skippedSectors++;
+        _flushed += len;
+        return true;
+    } else {
+        esp_err_t err = ESP_OK;
+        if (_flushed >= _preErased || !sectorBlank(_flushed)) {
+            err = esp_partition_erase_range(_partition, _flushed, OTA_SECTOR_SIZE);
+        }
+        if (err == ESP_OK) {
+            err = esp_partition_write(_partition, _flushed, data, len);
+        }
+        ok = err == ESP_OK;
+        if (!ok) {
+            _error = err;
+        }
+    }
+
+    uint32_t elapsed = micros() - start;
+    _writeUs += elapsed;
+    _writeCalls++;
+    // Every sector erase takes tens of ms; only outliers count as stalls
+    if (elapsed > OTA_FLASH_STALL_US) {
+        _stallUs += elapsed;
+        _stallCount++;
+        _stallMaxUs = max(_stallMaxUs, elapsed);
+    }
+
+    if (ok) {
+        _flushed += len;
+    }
+    return ok;
+}
+
+bool OTAFlashWriter::checkHeader(const uint8_t* data, size_t len) {
+    _imageChecked = true;
+
+    OTAImageInfo info;
+    _imageCheck = OTAImage::parse(data, len, info);
+    if (_imageCheck == OTA_IMAGE_OK) {
+        _imageCheck = OTAImage::check(info, _matchProject, _expectedVersion);
+    }
+
+    if (_imageCheck != OTA_IMAGE_OK) {
+        _error = ESP_ERR_INVALID_ARG;
+        return false;
+    }
+    return true;
+}
+
+bool OTAFlashWriter::checkHash() {
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&_sha, digest);
+    mbedtls_sha256_free(&_sha);
+    _hashing = false;
+
+    if (_expectedHash != NULL && memcmp(digest, _expectedHash, sizeof(digest)) != 0) {
+        _hashMismatch = true;
+        _error = ESP_ERR_INVALID_CRC;
+        return false;
+    }
+
+    if (_signingKey != NULL) {
+        uint32_t start = micros();
+        int err = mbedtls_pk_verify(_signingKey, MBEDTLS_MD_SHA256, digest, sizeof(digest),
+                                    _signature, _signatureLen);
+        _verifyUs = micros() - start;
+        if (err != 0) {
+            _signatureInvalid = true;
+            _error = err;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool OTAFlashWriter::sectorBlank(size_t offset) {
+    // A read is far cheaper than an erase, and guards against stale NVS progress
+    uint32_t chunk[64];
+    for (size_t pos = 0; pos < OTA_SECTOR_SIZE; pos += sizeof(chunk)) {
+        if (esp_partition_read(_partition, offset + pos, chunk, sizeof(chunk)) != ESP_OK) {
+            return false;
+        }
+        for (size_t i = 0; i < sizeof(chunk) / sizeof(chunk[0]); i++) {
+            if (chunk[i] != 0xFFFFFFFF) return false;
+        }
+    }
+    return true;
+}
+
+bool OTAFlashWriter::sectorMatches(size_t offset, const uint8_t* data, size_t len) {
+    // Compare in small chunks; a mismatch usually shows in the first one
+    uint8_t chunk[256];
+    for (size_t pos = 0; pos < len; pos += sizeof(chunk)) {
+        size_t n = min(sizeof(chunk), len - pos);
+        if (esp_partition_read(_partition, offset + pos, chunk, n) != ESP_OK) {
+            return false;
+        }
+        if (memcmp(chunk, data + pos, n) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void OTAFlashWriter::release() {
+    if (_hashing) {
+        mbedtls_sha256_free(&_sha);
+        _hashing = false;
+    }
+    if (_buffer != NULL) {
+        free(_buffer);
+        _buffer = NULL;
+    }
+    _fill = 0;
+    _active = false;
+}
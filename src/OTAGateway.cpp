@@ -0,0 +1,514 @@
+/**
+ * OTAGateway.cpp
+ *
+ * Implementation of the site gateway
+ */
+
+#include "OTAGateway.h"
+#include "OTAUpdateSource.h"
+#include "OTADecrypt.h"
+#include <mbedtls/sha256.h>
+
+#if OTA_ENABLE_GATEWAY
+
+#define OTA_GATEWAY_CHUNK 1436               // One TCP segment per write
+#define OTA_GATEWAY_POLL_MS 20
+#define OTA_GATEWAY_MAX_MANIFEST 512
+
+static const char* VERSION_PATH = OTA_GATEWAY_DIR "/version.txt";
+static const char* VERSION_TMP = OTA_GATEWAY_DIR "/version.tmp";
+static const char* IMAGE_PATH = OTA_GATEWAY_DIR "/firmware.bin";
+static const char* IMAGE_TMP = OTA_GATEWAY_DIR "/firmware.tmp";
+
+static const char* DISCOVER_PREFIX = "AUTOOTA?GW ";
+static const char* ANSWER_PREFIX = "AUTOOTA!GW ";
+
+OTAGateway::OTAGateway(fs::FS& fs) : _fs(fs) {
+    _versionUrl = NULL;
+    _firmwareUrl = NULL;
+    _port = OTA_GATEWAY_PORT;
+    _refreshMs = OTA_GATEWAY_REFRESH_MS;
+    _task = NULL;
+    _stop = false;
+    _refreshNow = false;
+    _version[0] = '\0';
+    _upstreamTag[0] = '\0';
+    _tag[0] = '\0';
+    _imageSize = 0;
+    _served = 0;
+    _fetches = 0;
+}
+
+OTAGateway::~OTAGateway() {
+    end();
+}
+
+void OTAGateway::setUpstream(const char* versionUrl, const char* firmwareUrl) {
+    _versionUrl = versionUrl;
+    _firmwareUrl = firmwareUrl;
+}
+
+// ========== Lifecycle ==========
+
+bool OTAGateway::begin(uint16_t port) {
+    if (_task != NULL) return true;
+    if (_versionUrl == NULL || _firmwareUrl == NULL) return false;
+
+    _fs.mkdir(OTA_GATEWAY_DIR);
+    loadCache();
+
+    _port = port;
+    _stop = false;
+    _refreshNow = true;
+
+    BaseType_t result = xTaskCreate(taskWrapper, "OTA_Gateway", OTA_GATEWAY_STACK, this, 1, &_task);
+    if (result != pdPASS) {
+        _task = NULL;
+        return false;
+    }
+    return true;
+}
+
+void OTAGateway::end() {
+    if (_task == NULL) return;
+
+    // The task finishes the request or download it is on, then exits
+    _stop = true;
+    while (_task != NULL) {
+        vTaskDelay(pdMS_TO_TICKS(OTA_GATEWAY_POLL_MS));
+    }
+}
+
+void OTAGateway::refresh() {
+    _refreshNow = true;
+}
+
+void OTAGateway::taskWrapper(void* parameter) {
+    OTAGateway* gateway = (OTAGateway*)parameter;
+    gateway->run();
+    gateway->_task = NULL;
+    vTaskDelete(NULL);
+}
+
+void OTAGateway::run() {
+    WiFiServer server(_port);
+    WiFiUDP udp;
+    server.begin();
+    server.setNoDelay(true);
+    udp.begin(_port);
+
+    unsigned long lastRefresh = 0;
+
+    while (!_stop) {
+        // Requests wait in the listen backlog during an upstream download;
+        // devices that give up use their configured mirrors
+        if (_refreshNow || millis() - lastRefresh >= _refreshMs) {
+            _refreshNow = false;
+            refreshUpstream();
+            lastRefresh = millis();
+        }
+
+        answerDiscovery(udp);
+
+        WiFiClient client = server.available();
+        if (client) {
+            serveClient(client);
+            client.stop();
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(OTA_GATEWAY_POLL_MS));
+    }
+
+    udp.stop();
+    server.end();
+}
+
+// ========== Cache ==========
+
+void OTAGateway::loadCache() {
+    fs::File version = _fs.open(VERSION_PATH, FILE_READ);
+    fs::File image = _fs.open(IMAGE_PATH, FILE_READ);
+
+    if (version && image && version.size() > 0 && version.size() <= OTA_GATEWAY_MAX_MANIFEST) {
+        char manifest[OTA_GATEWAY_MAX_MANIFEST + 1];
+        size_t len = version.readBytes(manifest, OTA_GATEWAY_MAX_MANIFEST);
+        manifest[len] = '\0';
+
+        snprintf(_tag, sizeof(_tag), "%08x", (unsigned)hash(manifest));
+        size_t versionLen = strcspn(manifest, "\r\n");
+        if (versionLen < sizeof(_version)) {
+            memcpy(_version, manifest, versionLen);
+            _version[versionLen] = '\0';
+        }
+        _imageSize = image.size();
+    }
+
+    if (version) version.close();
+    if (image) image.close();
+}
+
+bool OTAGateway::refreshUpstream() {
+    OTAHttpRequest request;
+    if (!request.begin(_versionUrl)) {
+        return false;
+    }
+
+    HTTPClient& http = request.http();
+    request.addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
+    if (_upstreamTag[0] != '\0' && _tag[0] != '\0') {
+        request.addHeader("If-None-Match", _upstreamTag);
+    }
+    static const char* headerKeys[] = { "ETag" };
+    http.collectHeaders(headerKeys, 1);
+
+    int httpCode = request.GET();
+    if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+        request.end();
+        return true;
+    }
+    if (httpCode != HTTP_CODE_OK) {
+        request.end();
+        return false;
+    }
+
+    String manifest = http.getString();
+    String etag = http.header("ETag");
+    request.end();
+    if (manifest.length() == 0 || manifest.length() > OTA_GATEWAY_MAX_MANIFEST) {
+        return false;
+    }
+
+    char tag[sizeof(_tag)];
+    snprintf(tag, sizeof(tag), "%08x", (unsigned)hash(manifest.c_str()));
+
+    if (strcmp(tag, _tag) != 0 || _imageSize == 0) {
+        // Image first, version file last
+        if (!fetchImage(manifest) || !writeFile(VERSION_TMP, manifest)) {
+            return false;
+        }
+        _fs.remove(VERSION_PATH);
+        _fs.rename(VERSION_TMP, VERSION_PATH);
+
+        strcpy(_tag, tag);
+        size_t versionLen = strcspn(manifest.c_str(), "\r\n");
+        versionLen = min(versionLen, sizeof(_version) - 1);
+        memcpy(_version, manifest.c_str(), versionLen);
+        _version[versionLen] = '\0';
+    }
+
+    strncpy(_upstreamTag, etag.c_str(), sizeof(_upstreamTag) - 1);
+    _upstreamTag[sizeof(_upstreamTag) - 1] = '\0';
+    return true;
+}
+
+bool OTAGateway::fetchImage(const String& manifest) {
+    OTAHttpSource source(_firmwareUrl);
+    if (!source.open() || source.size() == 0) {
+        source.close();
+        return false;
+    }
+    size_t size = source.size();
+
+    _fs.remove(IMAGE_TMP);
+    fs::File file = _fs.open(IMAGE_TMP, FILE_WRITE);
+    if (!file) {
+        source.close();
+        return false;
+    }
+
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+
+    uint8_t buffer[1024];
+    bool encrypted = false;
+    size_t received = 0;
+    uint32_t lastData = millis();
+    while (received < size && !_stop && millis() - lastData < OTA_GATEWAY_STALL_MS) {
+        int n = source.read(buffer, sizeof(buffer));
+        if (n < 0) break;
+        if (n == 0) {
+            delay(1);
+            continue;
+        }
+        if (file.write(buffer, n) != (size_t)n) break;
+        if (received == 0) {
+            encrypted = n >= 4 && memcmp(buffer, OTA_CRYPT_MAGIC, 4) == 0;
+        }
+        mbedtls_sha256_update(&sha, buffer, n);
+        received += n;
+        lastData = millis();
+    }
+    file.close();
+    source.close();
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+
+    // The manifest's digest, when it has one, must match before anything is
+    // served. The sha256= line of an encrypted image covers the plaintext,
+    // which only the devices see; its ciphertext is checked against the
+    // sha256-enc= line, and without one it is not cached at all.
+    uint8_t expected[32];
+    bool hasDigest = findDigest(manifest.c_str(), encrypted ? "sha256-enc=" : "sha256=", expected);
+    bool ok = received == size && (hasDigest ? memcmp(digest, expected, sizeof(digest)) == 0 : !encrypted);
+
+    if (!ok) {
+        _fs.remove(IMAGE_TMP);
+        return false;
+    }
+
+    _fs.remove(IMAGE_PATH);
+    _fs.rename(IMAGE_TMP, IMAGE_PATH);
+    _imageSize = size;
+    _fetches++;
+    return true;
+}
+
+bool OTAGateway::findDigest(const char* manifest, const char* key, uint8_t digest[32]) {
+    size_t keyLen = strlen(key);
+    for (const char* line = manifest; line != NULL; line = strchr(line, '\n')) {
+        if (*line == '\n') line++;
+        if (strncmp(line, key, keyLen) != 0) continue;
+
+        const char* hex = line + keyLen;
+        for (size_t i = 0; i < 64; i++) {
+            if (!isxdigit((unsigned char)hex[i])) return false;
+        }
+        for (size_t i = 0; i < 32; i++) {
+            char byte[3] = { hex[i * 2], hex[i * 2 + 1], '\0' };
+            digest[i] = (uint8_t)strtoul(byte, NULL, 16);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool OTAGateway::writeFile(const char* path, const String& content) {
+    fs::File file = _fs.open(path, FILE_WRITE);
+    if (!file) return false;
+    bool ok = file.write((const uint8_t*)content.c_str(), content.length()) == content.length();
+    file.close();
+    return ok;
+}
+
+// ========== Server ==========
+
+void OTAGateway::answerDiscovery(WiFiUDP& udp) {
+    if (udp.parsePacket() <= 0) return;
+
+    char packet[40];
+    int len = udp.read(packet, sizeof(packet) - 1);
+    if (len <= 0) return;
+    packet[len] = '\0';
+
+    char expected[40];
+    snprintf(expected, sizeof(expected), "%s%08x", DISCOVER_PREFIX, (unsigned)hash(_firmwareUrl));
+    if (strcmp(packet, expected) != 0 || _tag[0] == '\0') {
+        return;
+    }
+
+    char reply[48];
+    int replyLen = snprintf(reply, sizeof(reply), "%s%08x %u", ANSWER_PREFIX, (unsigned)hash(_firmwareUrl), _port);
+    udp.beginPacket(udp.remoteIP(), udp.remotePort());
+    udp.write((const uint8_t*)reply, replyLen);
+    udp.endPacket();
+}
+
+bool OTAGateway::readLine(WiFiClient& client, char* line, size_t len) {
+    size_t n = 0;
+    uint32_t start = millis();
+
+    while (millis() - start < OTA_GATEWAY_IO_TIMEOUT) {
+        if (!client.connected() && client.available() == 0) {
+            return false;
+        }
+        int c = client.read();
+        if (c < 0) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+            continue;
+        }
+        if (c == '\n') {
+            if (n > 0 && line[n - 1] == '\r') n--;
+            line[n] = '\0';
+            return true;
+        }
+        if (n < len - 1) {
+            line[n++] = (char)c;
+        }
+    }
+    return false;
+}
+
+void OTAGateway::serveClient(WiFiClient& client) {
+    char line[160];
+    if (!readLine(client, line, sizeof(line))) return;
+
+    const char* path = NULL;
+    if (strncmp(line, "GET /version.txt ", 17) == 0) {
+        path = VERSION_PATH;
+    } else if (strncmp(line, "GET /firmware.bin ", 18) == 0) {
+        path = IMAGE_PATH;
+    }
+
+    size_t first = 0;
+    size_t last = SIZE_MAX;
+    bool ranged = false;
+    bool notModified = false;
+    while (readLine(client, line, sizeof(line)) && line[0] != '\0') {
+        if (strncasecmp(line, "Range: bytes=", 13) == 0) {
+            char* end;
+            first = strtoul(line + 13, &end, 10);
+            if (*end == '-' && end[1] != '\0') {
+                last = strtoul(end + 1, NULL, 10);
+            }
+            ranged = true;
+        } else if (strncasecmp(line, "If-None-Match:", 14) == 0) {
+            notModified = _tag[0] != '\0' && strstr(line + 14, _tag) != NULL;
+        }
+    }
+
+    if (path == NULL) {
+        client.print("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+    if (_tag[0] == '\0') {
+        // Nothing cached yet, the device uses its other mirrors
+        client.print("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+
+    _served++;
+    if (notModified) {
+        char header[96];
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 304 Not Modified\r\nETag: \"%s\"\r\nConnection: close\r\n\r\n", _tag);
+        client.print(header);
+        return;
+    }
+
+    sendFile(client, path, first, last, ranged);
+}
+
+void OTAGateway::sendFile(WiFiClient& client, const char* path, size_t first, size_t last, bool ranged) {
+    fs::File file = _fs.open(path, FILE_READ);
+    size_t size = file ? file.size() : 0;
+    if (size == 0) {
+        client.print("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        if (file) file.close();
+        return;
+    }
+
+    if (last >= size) {
+        last = size - 1;
+    }
+    char header[224];
+    if (first > last || !file.seek(first)) {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%u\r\nConnection: close\r\n\r\n",
+                 (unsigned)size);
+        client.print(header);
+        file.close();
+        return;
+    }
+
+    size_t length = last - first + 1;
+    if (ranged) {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\nETag: \"%s\"\r\n"
+                 "Content-Length: %u\r\nContent-Range: bytes %u-%u/%u\r\nConnection: close\r\n\r\n",
+                 _tag, (unsigned)length, (unsigned)first, (unsigned)last, (unsigned)size);
+    } else {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nETag: \"%s\"\r\n"
+                 "Content-Length: %u\r\nConnection: close\r\n\r\n",
+                 _tag, (unsigned)length);
+    }
+    client.print(header);
+
+    uint8_t chunk[OTA_GATEWAY_CHUNK];
+    size_t remaining = length;
+    uint32_t lastProgress = millis();
+    while (remaining > 0 && client.connected() && !_stop) {
+        size_t n = file.read(chunk, min(sizeof(chunk), remaining));
+        if (n == 0) break;
+
+        size_t sent = 0;
+        while (sent < n && client.connected()) {
+            size_t w = client.write(chunk + sent, n - sent);
+            if (w > 0) {
+                sent += w;
+                lastProgress = millis();
+            } else if (millis() - lastProgress > OTA_GATEWAY_IO_TIMEOUT) {
+                file.close();
+                return;
+            } else {
+                vTaskDelay(pdMS_TO_TICKS(1));
+            }
+        }
+        remaining -= sent;
+    }
+    file.close();
+}
+
+// ========== Discovery ==========
+
+bool OTAGateway::find(const char* firmwareUrl, uint16_t port, char* base, size_t len) {
+    if (WiFi.status() != WL_CONNECTED) {
+        return false;
+    }
+
+    WiFiUDP udp;
+    if (!udp.begin(0)) {
+        return false;
+    }
+
+    uint32_t urlHash = hash(firmwareUrl);
+    char packet[40];
+    int packetLen = snprintf(packet, sizeof(packet), "%s%08x", DISCOVER_PREFIX, (unsigned)urlHash);
+    udp.beginPacket(WiFi.broadcastIP(), port);
+    udp.write((const uint8_t*)packet, packetLen);
+    udp.endPacket();
+
+    char expected[24];
+    snprintf(expected, sizeof(expected), "%s%08x ", ANSWER_PREFIX, (unsigned)urlHash);
+
+    bool found = false;
+    uint32_t start = millis();
+    while (!found && millis() - start < OTA_GATEWAY_DISCOVERY_MS) {
+        if (udp.parsePacket() <= 0) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        char reply[48];
+        int n = udp.read(reply, sizeof(reply) - 1);
+        if (n <= 0) continue;
+        reply[n] = '\0';
+
+        size_t prefixLen = strlen(expected);
+        if (strncmp(reply, expected, prefixLen) != 0) continue;
+
+        unsigned tcpPort = strtoul(reply + prefixLen, NULL, 10);
+        if (tcpPort == 0 || tcpPort > 65535) continue;
+
+        IPAddress gateway = udp.remoteIP();
+        snprintf(base, len, "http://%u.%u.%u.%u:%u", gateway[0], gateway[1], gateway[2], gateway[3], tcpPort);
+        found = true;
+    }
+
+    udp.stop();
+    return found;
+}
+
+// FNV-1a, the same hash the mirror list uses for its NVS keys
+uint32_t OTAGateway::hash(const char* text) {
+    uint32_t h = 2166136261u;
+    for (const char* p = text; *p; p++) {
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    }
+    return h;
+}
+
+#endif // OTA_ENABLE_GATEWAY
@@ -0,0 +1,541 @@
+/**
+ * OTAHttp.cpp
+ *
+ * Implementation of the HTTP request helper
+ */
+
+#include "OTAHttp.h"
+#include <freertos/semphr.h>
+#include <lwip/sockets.h>
+
+// Guards the redirect and DNS caches, shared by the OTA task and parallel
+// download workers; a mutex rather than a spinlock because entries are
+// allocated and copied under it
+static SemaphoreHandle_t cacheLock() {
+    static SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+    return lock;
+}
+
+// FNV-1a, to compare cache keys cheaply
+static uint32_t cacheKey(const char* text) {
+    uint32_t hash = 2166136261u;
+    for (const char* p = text; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    return hash;
+}
+
+// ========== OTAUrl ==========
+
+bool OTAUrl::parse(const char* url) {
+    const char* hostStart;
+    if (strncmp(url, "https://", 8) == 0) {
+        secure = true;
+        port = 443;
+        hostStart = url + 8;
+    } else if (strncmp(url, "http://", 7) == 0) {
+        secure = false;
+        port = 80;
+        hostStart = url + 7;
+    } else {
+        return false;
+    }
+
+    const char* hostEnd = hostStart;
+    while (*hostEnd && *hostEnd != ':' && *hostEnd != '/') {
+        hostEnd++;
+    }
+
+    size_t hostLen = hostEnd - hostStart;
+    if (hostLen == 0 || hostLen >= sizeof(host)) {
+        return false;
+    }
+    memcpy(host, hostStart, hostLen);
+    host[hostLen] = '\0';
+
+    if (*hostEnd == ':') {
+        port = atoi(hostEnd + 1);
+        while (*hostEnd && *hostEnd != '/') {
+            hostEnd++;
+        }
+    }
+
+    path = *hostEnd ? hostEnd : "/";
+    return port != 0;
+}
+
+// ========== OTAHttpRequest ==========
+
+OTAHttpRequest::OTAHttpRequest() {
+    _client = NULL;
+    _begun = false;
+    _url = NULL;
+    _headerCount = 0;
+    _timeoutMs = 0;
+    _redirects = 0;
+    _cacheHit = false;
+    memset(&_times, 0, sizeof(_times));
+}
+
+OTAHttpRequest::~OTAHttpRequest() {
+    end();
+}
+
+bool OTAHttpRequest::begin(const char* url) {
+    end();
+    memset(&_times, 0, sizeof(_times));
+    _url = url;
+    _headerCount = 0;
+    _redirects = 0;
+    _cacheHit = false;
+
+    // Skip the redirect chain when we already know where it ends
+    String location;
+    if (lookupRedirect(url, location)) {
+        if (connect(location.c_str())) {
+            _cacheHit = true;
+            return true;
+        }
+        forgetRedirect(url);
+    }
+    return connect(url);
+}
+
+void OTAHttpRequest::addHeader(const char* name, const char* value) {
+    _http.addHeader(name, value);
+    if (_headerCount < OTA_HTTP_MAX_HEADERS) {
+        _headers[_headerCount].name = name;
+        _headers[_headerCount].value = value;
+        _headerCount++;
+    }
+}
+
+void OTAHttpRequest::setTimeout(uint16_t timeoutMs) {
+    _timeoutMs = timeoutMs;
+    applyTimeout();
+}
+
+bool OTAHttpRequest::canKeepAlive() const {
+    return _client != NULL && _client->fd() >= 0;
+}
+
+bool OTAHttpRequest::reuse(const char* url) {
+    String location;
+    bool cached = lookupRedirect(url, location);
+    if (!cached) {
+        location = url;
+    }
+
+    // Only a connection to the same scheme, host and port can carry the request
+    OTAUrl current;
+    OTAUrl target;
+    bool sameOrigin = current.parse(_location.c_str()) && target.parse(location.c_str()) &&
+                      current.secure == target.secure && current.port == target.port &&
+                      strcmp(current.host, target.host) == 0;
+    if (_client == NULL || !_client->connected() || !sameOrigin) {
+        return begin(url);
+    }
+
+    // HTTPClient keeps the socket open across end() while keep-alive holds
+    if (_begun) {
+        _http.end();
+    }
+    memset(&_times, 0, sizeof(_times));
+    _url = url;
+    _headerCount = 0;
+    _redirects = 0;
+    _cacheHit = cached;
+    _location = location;
+    _http.setReuse(true);
+    _begun = _http.begin(*_client, _location);
+    if (!_begun) {
+        end();
+        return false;
+    }
+    return true;
+}
+
+int OTAHttpRequest::GET() {
+    unsigned long start = millis();
+    int code = _http.GET();
+
+    while (true) {
+        bool redirect = code == HTTP_CODE_MOVED_PERMANENTLY || code == HTTP_CODE_FOUND ||
+                        code == HTTP_CODE_SEE_OTHER || code == HTTP_CODE_TEMPORARY_REDIRECT ||
+                        code == HTTP_CODE_PERMANENT_REDIRECT;
+
+        if (redirect && _redirects < OTA_HTTP_MAX_REDIRECTS) {
+            String location = _http.getLocation();
+            if (location.startsWith("/")) {
+                // Relative location, same origin as the current request
+                OTAUrl current;
+                current.parse(_location.c_str());
+                char origin[OTA_HTTP_MAX_HOST + 16];
+                snprintf(origin, sizeof(origin), "%s://%s:%u", current.secure ? "https" : "http",
+                         current.host, current.port);
+                String absolute = origin;
+                absolute += location.c_str();
+                location = absolute;
+            }
+            if (location.length() == 0) {
+                break;
+            }
+            _redirects++;
+            if (!follow(location.c_str())) {
+                code = HTTPC_ERROR_CONNECTION_REFUSED;
+                break;
+            }
+            code = _http.GET();
+            continue;
+        }
+
+        if (_cacheHit && (code < 0 || code >= 400)) {
+            // Cached location expired or revoked: start over from the original URL
+            forgetRedirect(_url);
+            _cacheHit = false;
+            if (!follow(_url)) {
+                code = HTTPC_ERROR_CONNECTION_REFUSED;
+                break;
+            }
+            code = _http.GET();
+            continue;
+        }
+        break;
+    }
+
+    bool success = (code >= 200 && code < 300) || code == HTTP_CODE_NOT_MODIFIED;
+    if (_redirects > 0 && success) {
+        storeRedirect(_url, _location.c_str());
+    }
+
+    _times.ttfbMs = millis() - start;
+    return code;
+}
+
+void OTAHttpRequest::end() {
+    disconnect();
+    _location = "";
+}
+
+// Resolve, connect and prepare the request; phase times add up across redirects
+bool OTAHttpRequest::connect(const char* url) {
+    OTAUrl target;
+    if (!target.parse(url)) {
+        return false;
+    }
+
+    // DNS, answered from the cache when possible
+    unsigned long start = millis();
+    IPAddress ip;
+    bool cached;
+    if (!resolve(target.host, ip, cached)) {
+        return false;
+    }
+    _times.dnsMs += millis() - start;
+
+    // TCP connect, plus TLS handshake for https
+    start = millis();
+    bool connected;
+    if (target.secure) {
+        WiFiClientSecure* secureClient = new WiFiClientSecure();
+        secureClient->setInsecure();
+        _client = secureClient;
+        connected = secureClient->connect(ip, target.port, target.host, NULL, NULL, NULL);
+        _times.tlsMs += millis() - start;
+    } else {
+        _client = new WiFiClient();
+        connected = _client->connect(ip, target.port, OTA_HTTP_CONNECT_TIMEOUT);
+        _times.connectMs += millis() - start;
+    }
+
+    if (!connected) {
+        disconnect();
+        if (cached) {
+            // The host may have moved: look it up again and retry once
+            forgetHost(target.host);
+            return connect(url);
+        }
+        return false;
+    }
+
+    // HTTPClient reuses the connected client instead of dialing again
+    _location = url;
+    _begun = _http.begin(*_client, _location);
+    if (!_begun) {
+        disconnect();
+        return false;
+    }
+    applyTimeout();
+    return true;
+}
+
+// Applied again after every connect, redirects open new sockets
+void OTAHttpRequest::applyTimeout() {
+    if (_timeoutMs == 0) return;
+
+    _http.setTimeout(_timeoutMs);
+
+    // TLS clients do not expose their socket; the timeout still bounds the wait
+    if (!canKeepAlive()) return;
+    int fd = _client->fd();
+
+    int enable = 1;
+    int idle = OTA_KEEPALIVE_IDLE_S;
+    int interval = OTA_KEEPALIVE_INTERVAL_S;
+    int count = OTA_KEEPALIVE_COUNT;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+}
+
+// Move the request to another URL, sending the same headers
+bool OTAHttpRequest::follow(const char* url) {
+    String target = url; // url may point into _location
+    disconnect();
+    if (!connect(target.c_str())) {
+        return false;
+    }
+    for (uint8_t i = 0; i < _headerCount; i++) {
+        _http.addHeader(_headers[i].name, _headers[i].value);
+    }
+    return true;
+}
+
+void OTAHttpRequest::disconnect() {
+    if (_begun) {
+        // Without this HTTPClient keeps a kept-alive _client, which is deleted below
+        _http.setReuse(false);
+        _http.end();
+        _begun = false;
+    }
+    if (_client != NULL) {
+        _client->stop();
+        delete _client;
+        _client = NULL;
+    }
+}
+
+// ========== Redirect cache ==========
+
+struct OTARedirectEntry {
+    uint32_t key;           // FNV-1a hash of the requested URL
+    char* location;
+    uint32_t expiresAt;     // millis()
+};
+
+static OTARedirectEntry redirectCache[OTA_REDIRECT_CACHE_SIZE];
+
+// Signed CDN URLs stop working when the signature expires; reuse them
+// for at most half their lifetime to leave room for the download
+static uint32_t redirectTTL(const char* location) {
+    uint32_t ttl = OTA_REDIRECT_TTL_MS;
+    const char* expires = strstr(location, "X-Amz-Expires=");
+    if (expires != NULL) {
+        uint32_t signedMs = strtoul(expires + 14, NULL, 10) * 1000;
+        ttl = min(ttl, signedMs / 2);
+    }
+    return ttl;
+}
+
+bool OTAHttpRequest::lookupRedirect(const char* url, String& location) {
+    uint32_t key = cacheKey(url);
+    bool found = false;
+
+    xSemaphoreTake(cacheLock(), portMAX_DELAY);
+    for (size_t i = 0; i < OTA_REDIRECT_CACHE_SIZE; i++) {
+        OTARedirectEntry& entry = redirectCache[i];
+        if (entry.location == NULL || entry.key != key) continue;
+
+        if ((int32_t)(millis() - entry.expiresAt) >= 0) {
+            free(entry.location);
+            entry.location = NULL;
+        } else {
+            location = entry.location;
+            found = true;
+        }
+        break;
+    }
+    xSemaphoreGive(cacheLock());
+    return found;
+}
+
+void OTAHttpRequest::storeRedirect(const char* url, const char* location) {
+    uint32_t key = cacheKey(url);
+    uint32_t ttl = redirectTTL(location);
+    if (ttl == 0) return;
+
+    char* copy = strdup(location);
+    if (copy == NULL) return;
+
+    xSemaphoreTake(cacheLock(), portMAX_DELAY);
+    // Same URL, else a free slot, else the entry closest to expiry
+    OTARedirectEntry* slot = NULL;
+    for (size_t i = 0; i < OTA_REDIRECT_CACHE_SIZE && slot == NULL; i++) {
+        if (redirectCache[i].location != NULL && redirectCache[i].key == key) {
+            slot = &redirectCache[i];
+        }
+    }
+    for (size_t i = 0; i < OTA_REDIRECT_CACHE_SIZE && slot == NULL; i++) {
+        if (redirectCache[i].location == NULL) {
+            slot = &redirectCache[i];
+        }
+    }
+    if (slot == NULL) {
+        slot = &redirectCache[0];
+        for (size_t i = 1; i < OTA_REDIRECT_CACHE_SIZE; i++) {
+            if ((int32_t)(redirectCache[i].expiresAt - slot->expiresAt) < 0) {
+                slot = &redirectCache[i];
+            }
+        }
+    }
+    free(slot->location);
+    slot->key = key;
+    slot->location = copy;
+    slot->expiresAt = millis() + ttl;
+    xSemaphoreGive(cacheLock());
+}
+
+void OTAHttpRequest::forgetRedirect(const char* url) {
+    uint32_t key = cacheKey(url);
+
+    xSemaphoreTake(cacheLock(), portMAX_DELAY);
+    for (size_t i = 0; i < OTA_REDIRECT_CACHE_SIZE; i++) {
+        OTARedirectEntry& entry = redirectCache[i];
+        if (entry.location != NULL && entry.key == key) {
+            free(entry.location);
+            entry.location = NULL;
+        }
+    }
+    xSemaphoreGive(cacheLock());
+}
+
+void OTAHttpRequest::clearRedirectCache() {
+    xSemaphoreTake(cacheLock(), portMAX_DELAY);
+    for (size_t i = 0; i < OTA_REDIRECT_CACHE_SIZE; i++) {
+        free(redirectCache[i].location);
+        redirectCache[i].location = NULL;
+    }
+    xSemaphoreGive(cacheLock());
+}
+
+// ========== DNS cache ==========
+
+struct OTADnsEntry {
+    char* host;
+    uint32_t key;
+    IPAddress address;
+    uint32_t resolvedAt;    // millis()
+    bool refresh;           // Stale, refreshDNS() should look it up
+};
+
+static OTADnsEntry dnsCache[OTA_DNS_CACHE_SIZE];
+
+bool OTAHttpRequest::resolve(const char* host, IPAddress& ip, bool& cached) {
+    uint32_t key = cacheKey(host);
+    cached = false;
+
+    xSemaphoreTake(cacheLock(), portMAX_DELAY);
+    for (size_t i = 0; i < OTA_DNS_CACHE_SIZE; i++) {
+        OTADnsEntry& entry = dnsCache[i];
+        if (entry.host == NULL || entry.key != key || strcmp(entry.host, host) != 0) continue;
+
+        uint32_t age = millis() - entry.resolvedAt;
+        if (age < OTA_DNS_STALE_MS) {
+            ip = entry.address;
+            cached = true;
+            if (age >= OTA_DNS_TTL_MS) {
+                entry.refresh = true;
+            }
+        }
+        break;
+    }
+    xSemaphoreGive(cacheLock());
+
+    if (cached) {
+        return true;
+    }
+
+    if (WiFi.hostByName(host, ip) != 1) {
+        return false;
+    }
+    storeHost(host, ip);
+    return true;
+}
+
+void OTAHttpRequest::storeHost(const char* host, const IPAddress& ip) {
+    uint32_t key = cacheKey(host);
+
+    xSemaphoreTake(cacheLock(), portMAX_DELAY);
+    // Same host, else a free slot, else the oldest answer
+    OTADnsEntry* slot = NULL;
+    for (size_t i = 0; i < OTA_DNS_CACHE_SIZE && slot == NULL; i++) {
+        OTADnsEntry& entry = dnsCache[i];
+        if (entry.host != NULL && entry.key == key && strcmp(entry.host, host) == 0) {
+            slot = &entry;
+        }
+    }
+    if (slot == NULL) {
+        slot = &dnsCache[0];
+        for (size_t i = 0; i < OTA_DNS_CACHE_SIZE; i++) {
+            if (dnsCache[i].host == NULL) {
+                slot = &dnsCache[i];
+                break;
+            }
+            if ((int32_t)(dnsCache[i].resolvedAt - slot->resolvedAt) < 0) {
+                slot = &dnsCache[i];
+            }
+        }
+        free(slot->host);
+        slot->host = strdup(host);
+        slot->key = key;
+    }
+    slot->address = ip;
+    slot->resolvedAt = millis();
+    slot->refresh = false;
+    xSemaphoreGive(cacheLock());
+}
+
+void OTAHttpRequest::forgetHost(const char* host) {
+    uint32_t key = cacheKey(host);
+
+    xSemaphoreTake(cacheLock(), portMAX_DELAY);
+    for (size_t i = 0; i < OTA_DNS_CACHE_SIZE; i++) {
+        OTADnsEntry& entry = dnsCache[i];
+        if (entry.host != NULL && entry.key == key && strcmp(entry.host, host) == 0) {
+            free(entry.host);
+            entry.host = NULL;
+        }
+    }
+    xSemaphoreGive(cacheLock());
+}
+
+void OTAHttpRequest::refreshDNS() {
+    for (size_t i = 0; i < OTA_DNS_CACHE_SIZE; i++) {
+        // Copy the name out, the lookup must not hold the lock
+        char host[OTA_HTTP_MAX_HOST];
+        host[0] = '\0';
+        xSemaphoreTake(cacheLock(), portMAX_DELAY);
+        OTADnsEntry& entry = dnsCache[i];
+        if (entry.host != NULL && entry.refresh) {
+            strncpy(host, entry.host, sizeof(host) - 1);
+            host[sizeof(host) - 1] = '\0';
+            entry.refresh = false;
+        }
+        xSemaphoreGive(cacheLock());
+
+        IPAddress ip;
+        if (host[0] != '\0' && WiFi.hostByName(host, ip) == 1) {
+            storeHost(host, ip);
+        }
+    }
+}
+
+void OTAHttpRequest::clearDNSCache() {
+    xSemaphoreTake(cacheLock(), portMAX_DELAY);
+    for (size_t i = 0; i < OTA_DNS_CACHE_SIZE; i++) {
+        free(dnsCache[i].host);
+        dnsCache[i].host = NULL;
+    }
+    xSemaphoreGive(cacheLock());
+}
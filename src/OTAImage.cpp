@@ -0,0 +1,73 @@
+/**
+ * OTAImage.cpp
+ *
+ * Implementation of early image validation
+ */
+
+#include "OTAImage.h"
+#include <esp_ota_ops.h>
+#include <esp_idf_version.h>
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#include <esp_app_desc.h>
+#endif
+
+OTAImageCheck OTAImage::parse(const uint8_t* data, size_t len, OTAImageInfo& info) {
+    memset(&info, 0, sizeof(info));
+    if (len < OTA_IMAGE_HEADER_LEN) {
+        return OTA_IMAGE_NO_APP_DESC;
+    }
+
+    esp_image_header_t header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != ESP_IMAGE_HEADER_MAGIC) {
+        return OTA_IMAGE_BAD_MAGIC;
+    }
+    info.chipId = header.chip_id;
+
+    // The app descriptor opens the first segment
+    esp_app_desc_t desc;
+    memcpy(&desc, data + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(desc));
+    if (desc.magic_word != ESP_APP_DESC_MAGIC_WORD) {
+        return OTA_IMAGE_NO_APP_DESC;
+    }
+
+    // The descriptor's fields need not be terminated; info was zeroed above
+    memcpy(info.version, desc.version, sizeof(info.version) - 1);
+    memcpy(info.projectName, desc.project_name, sizeof(info.projectName) - 1);
+    return OTA_IMAGE_OK;
+}
+
+OTAImageCheck OTAImage::check(const OTAImageInfo& info, bool matchProject, const char* expectedVersion) {
+    if (info.chipId != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+        return OTA_IMAGE_WRONG_CHIP;
+    }
+
+    if (matchProject) {
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+        const esp_app_desc_t* running = esp_app_get_description();
+#else
+        const esp_app_desc_t* running = esp_ota_get_app_description();
+#endif
+        if (strncmp(info.projectName, running->project_name, sizeof(info.projectName)) != 0) {
+            return OTA_IMAGE_WRONG_PROJECT;
+        }
+    }
+
+    if (expectedVersion != NULL && strncmp(info.version, expectedVersion, sizeof(info.version)) != 0) {
+        return OTA_IMAGE_WRONG_VERSION;
+    }
+
+    return OTA_IMAGE_OK;
+}
+
+const char* OTAImage::describe(OTAImageCheck result) {
+    switch (result) {
+        case OTA_IMAGE_OK: return "ok";
+        case OTA_IMAGE_BAD_MAGIC: return "not a firmware image";
+        case OTA_IMAGE_WRONG_CHIP: return "built for another chip";
+        case OTA_IMAGE_NO_APP_DESC: return "missing app descriptor";
+        case OTA_IMAGE_WRONG_PROJECT: return "built for another project";
+        case OTA_IMAGE_WRONG_VERSION: return "embedded version mismatch";
+    }
+    return "unknown";
+}
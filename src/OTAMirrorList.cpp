@@ -0,0 +1,166 @@
+/**
+ * OTAMirrorList.cpp
+ *
+ * Implementation of the ranked mirror list
+ */
+
+#include "OTAMirrorList.h"
+#include <Preferences.h>
+
+OTAMirrorList::OTAMirrorList() {
+    memset(_mirrors, 0, sizeof(_mirrors));
+    _count = 0;
+    _dirty = false;
+}
+
+OTAMirrorList::~OTAMirrorList() {
+    clear();
+}
+
+void OTAMirrorList::set(const char* url, bool copy) {
+    clear();
+    if (url != NULL) {
+        add(url, copy);
+    }
+}
+
+bool OTAMirrorList::add(const char* url, bool copy) {
+    if (url == NULL || _count >= OTA_MAX_MIRRORS) {
+        return false;
+    }
+
+    Mirror& mirror = _mirrors[_count];
+    mirror.owned = copy;
+    // Exact-size copy instead of a fixed 256-byte buffer per URL
+    mirror.url = copy ? strdup(url) : url;
+    if (mirror.url == NULL) {
+        return false;
+    }
+    mirror.latencyMs = 0;
+    mirror.failures = 0;
+    mirror.pinned = false;
+    _count++;
+    return true;
+}
+
+bool OTAMirrorList::prepend(const char* url, bool copy) {
+    if (!add(url, copy)) {
+        return false;
+    }
+
+    Mirror added = _mirrors[_count - 1];
+    memmove(&_mirrors[1], &_mirrors[0], (_count - 1) * sizeof(Mirror));
+    _mirrors[0] = added;
+    return true;
+}
+
+void OTAMirrorList::pin(uint8_t index) {
+    if (index < _count) {
+        _mirrors[index].pinned = true;
+    }
+}
+
+void OTAMirrorList::remove(uint8_t index) {
+    if (index >= _count) return;
+
+    if (_mirrors[index].owned) {
+        free((void*)_mirrors[index].url);
+    }
+    memmove(&_mirrors[index], &_mirrors[index + 1], (_count - index - 1) * sizeof(Mirror));
+    _count--;
+    memset(&_mirrors[_count], 0, sizeof(Mirror));
+}
+
+void OTAMirrorList::clear() {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_mirrors[i].owned) {
+            free((void*)_mirrors[i].url);
+        }
+    }
+    memset(_mirrors, 0, sizeof(_mirrors));
+    _count = 0;
+}
+
+int OTAMirrorList::best(uint32_t exclude) const {
+    int bestIndex = -1;
+    uint32_t bestScore = UINT32_MAX;
+
+    // Ties go to the earlier entry, so the configured order is the tie-break
+    for (uint8_t i = 0; i < _count; i++) {
+        if (exclude & (1u << i)) continue;
+        if (_mirrors[i].pinned) return i;
+        uint32_t s = score(i);
+        if (s < bestScore) {
+            bestScore = s;
+            bestIndex = i;
+        }
+    }
+    return bestIndex;
+}
+
+uint32_t OTAMirrorList::score(uint8_t index) const {
+    const Mirror& mirror = _mirrors[index];
+    uint32_t latency = mirror.latencyMs > 0 ? mirror.latencyMs : OTA_MIRROR_UNKNOWN_MS;
+    return latency + mirror.failures * OTA_MIRROR_FAILURE_MS;
+}
+
+void OTAMirrorList::recordSuccess(uint8_t index, uint32_t latencyMs) {
+    Mirror& mirror = _mirrors[index];
+    if (latencyMs == 0) {
+        latencyMs = 1;
+    }
+    // Moving average over roughly the last four requests
+    mirror.latencyMs = mirror.latencyMs == 0 ? latencyMs : (mirror.latencyMs * 3 + latencyMs) / 4;
+    mirror.failures /= 2;
+    _dirty = true;
+}
+
+void OTAMirrorList::recordFailure(uint8_t index) {
+    Mirror& mirror = _mirrors[index];
+    if (mirror.failures < OTA_MIRROR_MAX_FAILURES) {
+        mirror.failures++;
+    }
+    _dirty = true;
+}
+
+void OTAMirrorList::load() {
+    if (_count == 0) return;
+
+    Preferences prefs;
+    if (!prefs.begin(OTA_NVS_NAMESPACE, true)) return;
+
+    char key[12];
+    for (uint8_t i = 0; i < _count; i++) {
+        makeKey(_mirrors[i].url, key);
+        uint32_t packed = prefs.getUInt(key, 0);
+        _mirrors[i].latencyMs = packed >> 8;
+        _mirrors[i].failures = packed & 0xFF;
+    }
+    prefs.end();
+    _dirty = false;
+}
+
+void OTAMirrorList::save() {
+    if (!_dirty) return;
+
+    Preferences prefs;
+    if (!prefs.begin(OTA_NVS_NAMESPACE, false)) return;
+
+    char key[12];
+    for (uint8_t i = 0; i < _count; i++) {
+        makeKey(_mirrors[i].url, key);
+        uint32_t latency = min(_mirrors[i].latencyMs, (uint32_t)0xFFFFFF);
+        prefs.putUInt(key, (latency << 8) | _mirrors[i].failures);
+    }
+    prefs.end();
+    _dirty = false;
+}
+
+// NVS keys are limited to 15 characters: "m" + FNV-1a hash of the URL
+void OTAMirrorList::makeKey(const char* url, char* key) {
+    uint32_t hash = 2166136261u;
+    for (const char* p = url; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    sprintf(key, "m%08x", (unsigned)hash);
+}
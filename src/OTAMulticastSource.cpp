@@ -0,0 +1,302 @@
+/**
+ * OTAMulticastSource.cpp
+ *
+ * Implementation of the multicast image source
+ */
+
+#include "OTAMulticastSource.h"
+
+OTAMulticastSource::OTAMulticastSource(IPAddress group, uint16_t port, const char* fallbackUrl)
+    : _http(fallbackUrl) {
+    _group = group;
+    _port = port;
+    _fallbackUrl = fallbackUrl;
+    _joined = false;
+    _unicast = false;
+    _failed = false;
+    _imageId = 0;
+    _size = 0;
+    _blockSize = 0;
+    _k = 0;
+    _packet = NULL;
+    _buffer = NULL;
+    _present = 0;
+    _groupIndex = 0;
+    _groupLen = 0;
+    _groupPos = 0;
+    _groupReady = false;
+    _groupSeen = false;
+    _waitStart = 0;
+    _lastPacket = 0;
+    _groupsReceived = 0;
+    _groupsRecovered = 0;
+    _groupsFetched = 0;
+}
+
+OTAMulticastSource::~OTAMulticastSource() {
+    close();
+    free(_buffer);
+}
+
+// ========== OTAUpdateSource ==========
+
+bool OTAMulticastSource::open(size_t offset) {
+    close();
+    _failed = false;
+
+    _packet = (uint8_t*)malloc(OTA_MCAST_HEADER_LEN + OTA_MCAST_MAX_BLOCK);
+    if (_packet == NULL || !_udp.beginMulticast(_group, _port)) {
+        close();
+        return false;
+    }
+    _joined = true;
+
+    // The first packet tells the image size and the block layout
+    Header header;
+    bool received = false;
+    uint32_t start = millis();
+    while (!(received = receive(header)) && millis() - start < OTA_MCAST_JOIN_MS) {
+        delay(10);
+    }
+
+    if (!received) {
+        // No session running: the whole image from the fallback URL
+        leave();
+        if (_fallbackUrl == NULL || !_http.open(offset)) {
+            close();
+            return false;
+        }
+        _unicast = true;
+        _size = _http.size();
+        return true;
+    }
+
+    if (_buffer == NULL || header.blockSize != _blockSize || header.k != _k) {
+        free(_buffer);
+        _buffer = (uint8_t*)malloc((size_t)(header.k + 1) * header.blockSize);
+        if (_buffer == NULL) {
+            close();
+            return false;
+        }
+    }
+    _imageId = header.imageId;
+    _size = header.size;
+    _blockSize = header.blockSize;
+    _k = header.k;
+
+    size_t groupBytes = (size_t)_k * _blockSize;
+    startGroup(offset / groupBytes);
+    _groupPos = offset % groupBytes;
+    _lastPacket = millis();
+    accept(header);
+    return true;
+}
+
+int OTAMulticastSource::read(uint8_t* buffer, size_t len) {
+    if (!_unicast) {
+        const uint8_t* data;
+        size_t n = peek(&data, len);
+        if (n > 0) {
+            memcpy(buffer, data, n);
+            consume(n);
+            return n;
+        }
+        if (!_unicast) {
+            return _failed ? -1 : 0;
+        }
+    }
+    return _http.read(buffer, len);
+}
+
+size_t OTAMulticastSource::peek(const uint8_t** data, size_t maxLen) {
+    if (_unicast || !pump()) {
+        return 0;
+    }
+    *data = _buffer + _groupPos;
+    return min(maxLen, _groupLen - _groupPos);
+}
+
+void OTAMulticastSource::consume(size_t len) {
+    _groupPos += len;
+    if (_groupPos >= _groupLen && (_groupIndex + 1) * _k * _blockSize < _size) {
+        startGroup(_groupIndex + 1);
+    }
+}
+
+void OTAMulticastSource::close() {
+    leave();
+    _http.close();
+    _unicast = false;
+    free(_packet);
+    _packet = NULL;
+}
+
+// ========== Reception ==========
+
+bool OTAMulticastSource::receive(Header& header) {
+    int packetLen = _udp.parsePacket();
+    if (packetLen <= 0) {
+        return false;
+    }
+
+    int n = _udp.read(_packet, OTA_MCAST_HEADER_LEN + OTA_MCAST_MAX_BLOCK);
+    if (n < OTA_MCAST_HEADER_LEN) {
+        return false;
+    }
+
+    memcpy(&header, _packet, OTA_MCAST_HEADER_LEN);
+    if (header.magic != OTA_MCAST_MAGIC || header.size == 0 ||
+        header.k == 0 || header.k > OTA_MCAST_MAX_K || header.index > header.k ||
+        header.blockSize == 0 || header.blockSize > OTA_MCAST_MAX_BLOCK ||
+        n != OTA_MCAST_HEADER_LEN + header.blockSize) {
+        return false;
+    }
+
+    // Once locked on, other sessions on the same group are ignored
+    if (_size > 0 && (header.imageId != _imageId || header.size != _size ||
+                      header.blockSize != _blockSize || header.k != _k)) {
+        return false;
+    }
+    return true;
+}
+
+bool OTAMulticastSource::accept(const Header& header) {
+    if (header.group != _groupIndex) {
+        return false;
+    }
+
+    size_t dataBlocks = (_groupLen + _blockSize - 1) / _blockSize;
+    if (header.index < header.k && header.index >= dataBlocks) {
+        return false;
+    }
+
+    memcpy(_buffer + (size_t)header.index * _blockSize, _packet + OTA_MCAST_HEADER_LEN, _blockSize);
+    _present |= 1u << header.index;
+    _groupSeen = true;
+    return decode();
+}
+
+void OTAMulticastSource::startGroup(size_t group) {
+    size_t groupBytes = (size_t)_k * _blockSize;
+    _groupIndex = group;
+    _groupLen = min(groupBytes, _size - group * groupBytes);
+    _groupPos = 0;
+    _present = 0;
+    _groupReady = false;
+    _groupSeen = false;
+    _waitStart = millis();
+}
+
+bool OTAMulticastSource::pump() {
+    if (_groupReady) return true;
+    if (_failed) return false;
+
+    Header header;
+    for (int i = 0; i < OTA_MCAST_BURST && receive(header); i++) {
+        _lastPacket = millis();
+        if (header.group == _groupIndex) {
+            if (accept(header)) return true;
+        } else if (_groupSeen) {
+            // The stream moved on and left this group short
+            return fetchGroup();
+        }
+    }
+
+    uint32_t now = millis();
+    if (now - _lastPacket > OTA_MCAST_IDLE_MS || now - _waitStart > OTA_MCAST_CATCHUP_MS) {
+        // Session over, or this group is not coming round again
+        return switchToUnicast();
+    }
+    return false;
+}
+
+bool OTAMulticastSource::decode() {
+    size_t dataBlocks = (_groupLen + _blockSize - 1) / _blockSize;
+    uint32_t dataMask = (1u << dataBlocks) - 1;
+    uint32_t missing = dataMask & ~_present;
+
+    if (missing == 0) {
+        _groupReady = true;
+        _groupsReceived++;
+        return true;
+    }
+
+    // One data block short: it is the XOR of the parity and the others
+    if ((missing & (missing - 1)) != 0 || !(_present & (1u << _k))) {
+        return false;
+    }
+
+    uint8_t* rebuilt = _buffer + (size_t)__builtin_ctz(missing) * _blockSize;
+    memcpy(rebuilt, _buffer + (size_t)_k * _blockSize, _blockSize);
+    for (size_t b = 0; b < dataBlocks; b++) {
+        if (!(missing & (1u << b))) {
+            const uint8_t* block = _buffer + b * _blockSize;
+            for (size_t i = 0; i < _blockSize; i++) {
+                rebuilt[i] ^= block[i];
+            }
+        }
+    }
+
+    _groupReady = true;
+    _groupsRecovered++;
+    return true;
+}
+
+// ========== Unicast fallback ==========
+
+bool OTAMulticastSource::fetchGroup() {
+    if (_fallbackUrl == NULL) {
+        _failed = true;
+        return false;
+    }
+
+    size_t start = _groupIndex * _k * _blockSize;
+    if (!_http.open(start, _groupLen) || _http.size() != _size) {
+        _http.close();
+        _failed = true;
+        return false;
+    }
+
+    size_t fill = 0;
+    uint32_t begin = millis();
+    while (fill < _groupLen && millis() - begin < OTA_MCAST_FETCH_MS) {
+        int n = _http.read(_buffer + fill, _groupLen - fill);
+        if (n < 0) break;
+        if (n == 0) delay(1);
+        fill += n;
+    }
+    _http.close();
+
+    if (fill < _groupLen) {
+        _failed = true;
+        return false;
+    }
+
+    _groupReady = true;
+    _groupsFetched++;
+    return true;
+}
+
+bool OTAMulticastSource::switchToUnicast() {
+    leave();
+    if (_fallbackUrl == NULL) {
+        _failed = true;
+        return false;
+    }
+
+    size_t offset = _groupIndex * _k * _blockSize + _groupPos;
+    if (!_http.open(offset) || _http.size() != _size) {
+        _http.close();
+        _failed = true;
+        return false;
+    }
+    _unicast = true;
+    return false;
+}
+
+void OTAMulticastSource::leave() {
+    if (_joined) {
+        _udp.stop();
+        _joined = false;
+    }
+}
@@ -0,0 +1,339 @@
+/**
+ * OTAParallelSource.cpp
+ *
+ * Implementation of the multi-connection HTTP image source
+ */
+
+#include "OTAParallelSource.h"
+
+#if OTA_ENABLE_PARALLEL
+
+OTAParallelHttpSource::OTAParallelHttpSource(const char* url, uint8_t connections) {
+    _url = url;
+    _requested = connections;
+    _slotCount = 0;
+    memset(_slots, 0, sizeof(_slots));
+    _offset = 0;
+    _size = 0;
+    _chunkCount = 0;
+    _nextChunk = 0;
+    _readChunk = 0;
+    _readPos = 0;
+    _stop = false;
+    _httpCode = 0;
+    memset(&_times, 0, sizeof(_times));
+    _redirects = 0;
+    _cacheHit = false;
+}
+
+OTAParallelHttpSource::~OTAParallelHttpSource() {
+    join();
+}
+
+bool OTAParallelHttpSource::open(size_t offset) {
+    join();
+
+    _offset = offset;
+    if (!probe() || offset >= _size) {
+        return false;
+    }
+
+    _chunkCount = (_size - offset + OTA_PARALLEL_CHUNK - 1) / OTA_PARALLEL_CHUNK;
+    _nextChunk = 0;
+    _readChunk = 0;
+    _readPos = 0;
+    _stop = false;
+
+    OTAUrl target;
+    target.parse(_url);
+    uint8_t count = min(min(_requested, connectionBudget(target.secure)), (uint8_t)OTA_PARALLEL_MAX);
+    if (_chunkCount < count) {
+        count = _chunkCount;
+    }
+
+    // Chunk buffers first, so a short heap shrinks the connection count
+    for (_slotCount = 0; _slotCount < count; _slotCount++) {
+        Slot& slot = _slots[_slotCount];
+        slot.buffer = (uint8_t*)malloc(OTA_PARALLEL_CHUNK);
+        if (slot.buffer == NULL) {
+            break;
+        }
+        slot.owner = this;
+        slot.state = SLOT_FREE;
+        slot.failed = false;
+        slot.chunk = 0;
+        slot.fill = 0;
+        slot.len = 0;
+    }
+
+    UBaseType_t priority = uxTaskPriorityGet(NULL);
+    uint8_t started = 0;
+    for (uint8_t i = 0; i < _slotCount; i++) {
+        if (xTaskCreate(workerTask, "OTA_Range", OTA_PARALLEL_STACK, &_slots[i], priority, &_slots[i].task) == pdPASS) {
+            started++;
+        } else {
+            _slots[i].task = NULL;
+            _slots[i].state = SLOT_DONE;
+        }
+    }
+
+    if (started == 0) {
+        join();
+        return false;
+    }
+    return true;
+}
+
+int OTAParallelHttpSource::read(uint8_t* buffer, size_t len) {
+    const uint8_t* data;
+    size_t available = peek(&data, len);
+
+    if (available == 0) {
+        if (_stop || _readChunk >= _chunkCount) return -1;
+
+        // Nothing yet: fail only if the chunk can no longer arrive
+        portENTER_CRITICAL(&_mux);
+        Slot* slot = slotFor(_readChunk);
+        bool failed = slot != NULL ? slot->failed : true;
+        if (slot == NULL) {
+            for (uint8_t i = 0; i < _slotCount; i++) {
+                if (_slots[i].state != SLOT_DONE) {
+                    failed = false;
+                }
+            }
+        }
+        portEXIT_CRITICAL(&_mux);
+        return failed ? -1 : 0;
+    }
+
+    memcpy(buffer, data, available);
+    consume(available);
+    return available;
+}
+
+size_t OTAParallelHttpSource::peek(const uint8_t** data, size_t maxLen) {
+    if (_stop || _readChunk >= _chunkCount) return 0;
+
+    portENTER_CRITICAL(&_mux);
+    Slot* slot = slotFor(_readChunk);
+    size_t fill = slot != NULL ? slot->fill : 0;
+    portEXIT_CRITICAL(&_mux);
+
+    if (fill <= _readPos) return 0;
+
+    *data = slot->buffer + _readPos;
+    return min(fill - _readPos, maxLen);
+}
+
+void OTAParallelHttpSource::consume(size_t len) {
+    _readPos += len;
+
+    portENTER_CRITICAL(&_mux);
+    Slot* slot = slotFor(_readChunk);
+    if (slot != NULL && _readPos >= slot->len) {
+        // Chunk fully used, its buffer can take the next one
+        if (slot->state == SLOT_FILLING) {
+            slot->state = SLOT_FREE;
+        }
+        _readChunk++;
+        _readPos = 0;
+    }
+    portEXIT_CRITICAL(&_mux);
+}
+
+// Returns at once; the workers still own their buffers until open() or
+// the destructor joins them
+void OTAParallelHttpSource::close() {
+    _stop = true;
+}
+
+// ========== Internals ==========
+
+void OTAParallelHttpSource::join() {
+    _stop = true;
+
+    // Workers notice _stop within one request timeout
+    for (uint8_t i = 0; i < _slotCount; i++) {
+        Slot& slot = _slots[i];
+        while (slot.task != NULL && slot.state != SLOT_DONE) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        free(slot.buffer);
+        slot.buffer = NULL;
+        slot.task = NULL;
+    }
+    _slotCount = 0;
+}
+
+bool OTAParallelHttpSource::probe() {
+    OTAHttpRequest request;
+    if (!request.begin(_url)) {
+        _httpCode = HTTPC_ERROR_CONNECTION_REFUSED;
+        return false;
+    }
+
+    HTTPClient& http = request.http();
+    request.addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
+    request.addHeader("Pragma", "no-cache");
+    request.addHeader("Expires", "0");
+    request.addHeader("Range", "bytes=0-0");
+
+    static const char* headerKeys[] = { "Content-Range" };
+    http.collectHeaders(headerKeys, 1);
+
+    _httpCode = request.GET();
+    _times = request.getTimes();
+    _redirects = request.getRedirects();
+    _cacheHit = request.getCacheHit();
+
+    // 200 means the server ignores Range and cannot serve chunks
+    if (_httpCode != HTTP_CODE_PARTIAL_CONTENT) {
+        return false;
+    }
+
+    // "bytes 0-0/<total>"
+    String contentRange = http.header("Content-Range");
+    const char* total = strrchr(contentRange.c_str(), '/');
+    _size = total != NULL ? strtoul(total + 1, NULL, 10) : 0;
+    return _size > 0;
+}
+
+uint8_t OTAParallelHttpSource::connectionBudget(bool secure) {
+    size_t perConnection = OTA_PARALLEL_CHUNK + OTA_PARALLEL_STACK;
+    if (secure) {
+        perConnection += OTA_PARALLEL_TLS_HEAP;
+    }
+
+    size_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap <= OTA_PARALLEL_HEAP_RESERVE) {
+        return 0;
+    }
+    size_t budget = (freeHeap - OTA_PARALLEL_HEAP_RESERVE) / perConnection;
+    return budget > OTA_PARALLEL_MAX ? OTA_PARALLEL_MAX : budget;
+}
+
+// Call with _mux held
+OTAParallelHttpSource::Slot* OTAParallelHttpSource::slotFor(size_t chunk) {
+    for (uint8_t i = 0; i < _slotCount; i++) {
+        Slot& slot = _slots[i];
+        if (slot.state != SLOT_FREE && slot.chunk == chunk) {
+            return &slot;
+        }
+    }
+    return NULL;
+}
+
+void OTAParallelHttpSource::workerTask(void* parameter) {
+    Slot* slot = (Slot*)parameter;
+    slot->owner->runWorker(*slot);
+    vTaskDelete(NULL);
+}
+
+void OTAParallelHttpSource::runWorker(Slot& slot) {
+    OTAHttpRequest request;
+
+    while (!_stop) {
+        // Take the next unassigned chunk; chunks are handed out in order,
+        // so the one the pipeline waits for is always in some buffer
+        portENTER_CRITICAL(&_mux);
+        bool more = _nextChunk < _chunkCount;
+        if (more) {
+            slot.chunk = _nextChunk++;
+            size_t start = slot.chunk * OTA_PARALLEL_CHUNK;
+            slot.len = min((size_t)OTA_PARALLEL_CHUNK, _size - _offset - start);
+            slot.fill = 0;
+            slot.state = SLOT_FILLING;
+        }
+        portEXIT_CRITICAL(&_mux);
+
+        if (!more) break;
+
+        if (!fetchChunk(request, slot)) {
+            portENTER_CRITICAL(&_mux);
+            slot.failed = true;
+            portEXIT_CRITICAL(&_mux);
+            break;
+        }
+
+        // Hold the buffer until the pipeline has consumed it
+        while (!_stop && slot.state == SLOT_FILLING) {
+            vTaskDelay(1);
+        }
+    }
+
+    request.end();
+
+    portENTER_CRITICAL(&_mux);
+    slot.state = SLOT_DONE;
+    portEXIT_CRITICAL(&_mux);
+}
+
+bool OTAParallelHttpSource::fetchChunk(OTAHttpRequest& request, Slot& slot) {
+    size_t start = _offset + slot.chunk * OTA_PARALLEL_CHUNK;
+
+    for (int attempt = 0; attempt <= OTA_PARALLEL_RETRIES && !_stop; attempt++) {
+        if (!request.reuse(_url)) {
+            request.end();
+            continue;
+        }
+
+        HTTPClient& http = request.http();
+        request.addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
+        request.addHeader("Pragma", "no-cache");
+        request.addHeader("Expires", "0");
+
+        // Resume inside the chunk after a broken connection
+        char range[40];
+        snprintf(range, sizeof(range), "bytes=%u-%u",
+                 (unsigned)(start + slot.fill), (unsigned)(start + slot.len - 1));
+        request.addHeader("Range", range);
+
+        static const char* headerKeys[] = { "Content-Range" };
+        http.collectHeaders(headerKeys, 1);
+
+        if (request.GET() != HTTP_CODE_PARTIAL_CONTENT) {
+            request.end();
+            continue;
+        }
+
+        // "bytes <first>-<last>/<total>" must be the range asked for in the
+        // image probed, or the bytes would land at the wrong offset
+        String contentRange = http.header("Content-Range");
+        const char* total = strrchr(contentRange.c_str(), '/');
+        if (!contentRange.startsWith("bytes ") || total == NULL ||
+            strtoul(contentRange.c_str() + 6, NULL, 10) != start + slot.fill ||
+            strtoul(total + 1, NULL, 10) != _size) {
+            request.end();
+            continue;
+        }
+
+        WiFiClient* stream = http.getStreamPtr();
+        unsigned long lastData = millis();
+        while (!_stop && slot.fill < slot.len) {
+            size_t available = stream->available();
+            if (available == 0) {
+                if (!http.connected() || millis() - lastData > OTA_PARALLEL_STALL) {
+                    break;
+                }
+                vTaskDelay(1);
+                continue;
+            }
+
+            int n = stream->read(slot.buffer + slot.fill, min(available, slot.len - slot.fill));
+            if (n <= 0) break;
+            lastData = millis();
+
+            portENTER_CRITICAL(&_mux);
+            slot.fill += n;
+            portEXIT_CRITICAL(&_mux);
+        }
+
+        if (slot.fill == slot.len) {
+            return true;
+        }
+        request.end();
+    }
+    return false;
+}
+
+#endif // OTA_ENABLE_PARALLEL
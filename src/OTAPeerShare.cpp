@@ -0,0 +1,330 @@
+/**
+ * OTAPeerShare.cpp
+ *
+ * Implementation of LAN firmware sharing
+ */
+
+#include "OTAPeerShare.h"
+#include <Preferences.h>
+
+#if OTA_ENABLE_PEER_SHARE
+
+#define OTA_PEER_CHUNK 1436                  // One TCP segment per write
+#define OTA_PEER_POLL_MS 20
+
+static const char* DISCOVER_PREFIX = "AUTOOTA?1 ";
+static const char* ANSWER_PREFIX = "AUTOOTA!1 ";
+
+OTAPeerShare::OTAPeerShare() {
+    _port = OTA_PEER_PORT;
+    _task = NULL;
+    _stop = false;
+    _partition = NULL;
+    _size = 0;
+    _hash[0] = '\0';
+}
+
+OTAPeerShare::~OTAPeerShare() {
+    end();
+}
+
+// ========== Lifecycle ==========
+
+bool OTAPeerShare::begin(uint16_t port) {
+    if (_task != NULL) return true;
+
+    // Only an image that was verified on its way in and is the one
+    // running now; a rolled-back or overwritten partition is not served
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    uint8_t sha[32];
+    bool found = false;
+
+    Preferences prefs;
+    if (running != NULL && prefs.begin(OTA_NVS_NAMESPACE, true)) {
+        found = prefs.getUInt("peer_part", 0) == running->address &&
+                prefs.getBytes("peer_sha", sha, sizeof(sha)) == sizeof(sha);
+        _size = prefs.getUInt("peer_size", 0);
+        prefs.end();
+    }
+    if (!found || _size == 0 || _size > running->size) {
+        return false;
+    }
+
+    toHex(sha, sizeof(sha), _hash);
+    _partition = running;
+    _port = port;
+    _stop = false;
+
+    BaseType_t result = xTaskCreate(taskWrapper, "OTA_Peer", OTA_PEER_STACK, this, 1, &_task);
+    if (result != pdPASS) {
+        _task = NULL;
+        return false;
+    }
+    return true;
+}
+
+void OTAPeerShare::end() {
+    if (_task == NULL) return;
+
+    // The task finishes the client it is serving, then exits
+    _stop = true;
+    while (_task != NULL) {
+        vTaskDelay(pdMS_TO_TICKS(OTA_PEER_POLL_MS));
+    }
+}
+
+void OTAPeerShare::remember(const uint8_t* sha256, size_t size) {
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+    if (boot == NULL) return;
+
+    Preferences prefs;
+    if (prefs.begin(OTA_NVS_NAMESPACE, false)) {
+        prefs.putBytes("peer_sha", sha256, 32);
+        prefs.putUInt("peer_size", size);
+        prefs.putUInt("peer_part", boot->address);
+        prefs.end();
+    }
+}
+
+void OTAPeerShare::forget() {
+    Preferences prefs;
+    if (prefs.begin(OTA_NVS_NAMESPACE, false)) {
+        if (prefs.isKey("peer_part")) {
+            prefs.remove("peer_sha");
+            prefs.remove("peer_size");
+            prefs.remove("peer_part");
+        }
+        prefs.end();
+    }
+}
+
+// ========== Server ==========
+
+void OTAPeerShare::taskWrapper(void* parameter) {
+    OTAPeerShare* share = (OTAPeerShare*)parameter;
+    share->run();
+    share->_task = NULL;
+    vTaskDelete(NULL);
+}
+
+void OTAPeerShare::run() {
+    WiFiServer server(_port);
+    WiFiUDP udp;
+    server.begin();
+    server.setNoDelay(true);
+    udp.begin(_port);
+
+    while (!_stop) {
+        answerDiscovery(udp);
+
+        // One client at a time keeps the cost to this device bounded;
+        // other peers wait in the listen backlog or use the mirrors
+        WiFiClient client = server.available();
+        if (client) {
+            serveClient(client);
+            client.stop();
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(OTA_PEER_POLL_MS));
+    }
+
+    udp.stop();
+    server.end();
+}
+
+void OTAPeerShare::answerDiscovery(WiFiUDP& udp) {
+    if (udp.parsePacket() <= 0) return;
+
+    char packet[80];
+    int len = udp.read(packet, sizeof(packet) - 1);
+    if (len <= 0) return;
+    packet[len] = '\0';
+
+    size_t prefixLen = strlen(DISCOVER_PREFIX);
+    if (strncmp(packet, DISCOVER_PREFIX, prefixLen) != 0 ||
+        strncasecmp(packet + prefixLen, _hash, 64) != 0) {
+        return;
+    }
+
+    char reply[96];
+    int replyLen = snprintf(reply, sizeof(reply), "%s%s %u", ANSWER_PREFIX, _hash, _port);
+    udp.beginPacket(udp.remoteIP(), udp.remotePort());
+    udp.write((const uint8_t*)reply, replyLen);
+    udp.endPacket();
+}
+
+bool OTAPeerShare::readLine(WiFiClient& client, char* line, size_t len) {
+    size_t n = 0;
+    uint32_t start = millis();
+
+    while (millis() - start < OTA_PEER_IO_TIMEOUT) {
+        if (!client.connected() && client.available() == 0) {
+            return false;
+        }
+        int c = client.read();
+        if (c < 0) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+            continue;
+        }
+        if (c == '\n') {
+            if (n > 0 && line[n - 1] == '\r') n--;
+            line[n] = '\0';
+            return true;
+        }
+        // Overlong lines are truncated, only the request line matters
+        if (n < len - 1) {
+            line[n++] = (char)c;
+        }
+    }
+    return false;
+}
+
+void OTAPeerShare::serveClient(WiFiClient& client) {
+    char line[160];
+    if (!readLine(client, line, sizeof(line))) return;
+
+    char path[100];
+    snprintf(path, sizeof(path), "GET /ota/%s.bin ", _hash);
+    bool match = strncasecmp(line, path, strlen(path)) == 0;
+
+    // Headers: only Range is used, as "bytes=<first>-[<last>]" or the
+    // suffix "bytes=-<length>"
+    size_t first = 0;
+    size_t last = _size - 1;
+    bool ranged = false;
+    while (readLine(client, line, sizeof(line)) && line[0] != '\0') {
+        if (strncasecmp(line, "Range: bytes=", 13) == 0) {
+            if (line[13] == '-') {
+                size_t suffix = strtoul(line + 14, NULL, 10);
+                first = suffix == 0 ? _size : (suffix < _size ? _size - suffix : 0);
+            } else {
+                char* end;
+                first = strtoul(line + 13, &end, 10);
+                if (*end == '-' && end[1] != '\0') {
+                    last = strtoul(end + 1, NULL, 10);
+                }
+            }
+            ranged = true;
+        }
+    }
+
+    if (!match) {
+        client.print("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+    if (last >= _size) {
+        last = _size - 1;
+    }
+    if (first > last) {
+        char header[96];
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%u\r\nConnection: close\r\n\r\n",
+                 (unsigned)_size);
+        client.print(header);
+        return;
+    }
+
+    char header[192];
+    size_t length = last - first + 1;
+    if (ranged) {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\n"
+                 "Content-Length: %u\r\nContent-Range: bytes %u-%u/%u\r\nConnection: close\r\n\r\n",
+                 (unsigned)length, (unsigned)first, (unsigned)last, (unsigned)_size);
+    } else {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                 "Content-Length: %u\r\nConnection: close\r\n\r\n",
+                 (unsigned)length);
+    }
+    client.print(header);
+
+    // Straight from the running partition; the client checks the digest
+    uint8_t chunk[OTA_PEER_CHUNK];
+    size_t offset = first;
+    uint32_t lastProgress = millis();
+    while (offset <= last && client.connected() && !_stop) {
+        size_t n = min((size_t)sizeof(chunk), last - offset + 1);
+        if (esp_partition_read(_partition, offset, chunk, n) != ESP_OK) {
+            break;
+        }
+
+        size_t sent = 0;
+        while (sent < n && client.connected()) {
+            size_t w = client.write(chunk + sent, n - sent);
+            if (w > 0) {
+                sent += w;
+                lastProgress = millis();
+            } else if (millis() - lastProgress > OTA_PEER_IO_TIMEOUT) {
+                return;
+            } else {
+                vTaskDelay(pdMS_TO_TICKS(1));
+            }
+        }
+        offset += sent;
+    }
+}
+
+// ========== Discovery ==========
+
+bool OTAPeerShare::find(const uint8_t* sha256, uint16_t port, char* url, size_t len) {
+    if (WiFi.status() != WL_CONNECTED) {
+        return false;
+    }
+
+    char hash[65];
+    toHex(sha256, 32, hash);
+
+    WiFiUDP udp;
+    if (!udp.begin(0)) {
+        return false;
+    }
+
+    char packet[80];
+    int packetLen = snprintf(packet, sizeof(packet), "%s%s", DISCOVER_PREFIX, hash);
+    udp.beginPacket(WiFi.broadcastIP(), port);
+    udp.write((const uint8_t*)packet, packetLen);
+    udp.endPacket();
+
+    // First answer wins: any peer holding the digest serves identical bytes
+    bool found = false;
+    uint32_t start = millis();
+    while (!found && millis() - start < OTA_PEER_DISCOVERY_MS) {
+        if (udp.parsePacket() <= 0) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        char reply[96];
+        int n = udp.read(reply, sizeof(reply) - 1);
+        if (n <= 0) continue;
+        reply[n] = '\0';
+
+        size_t prefixLen = strlen(ANSWER_PREFIX);
+        if (strncmp(reply, ANSWER_PREFIX, prefixLen) != 0 ||
+            strncasecmp(reply + prefixLen, hash, 64) != 0 ||
+            reply[prefixLen + 64] != ' ') {
+            continue;
+        }
+
+        unsigned tcpPort = strtoul(reply + prefixLen + 65, NULL, 10);
+        if (tcpPort == 0 || tcpPort > 65535) continue;
+
+        IPAddress peer = udp.remoteIP();
+        snprintf(url, len, "http://%u.%u.%u.%u:%u/ota/%s.bin",
+                 peer[0], peer[1], peer[2], peer[3], tcpPort, hash);
+        found = true;
+    }
+
+    udp.stop();
+    return found;
+}
+
+void OTAPeerShare::toHex(const uint8_t* data, size_t len, char* hex) {
+    for (size_t i = 0; i < len; i++) {
+        sprintf(hex + i * 2, "%02x", data[i]);
+    }
+    hex[len * 2] = '\0';
+}
+
+#endif // OTA_ENABLE_PEER_SHARE
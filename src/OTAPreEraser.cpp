@@ -0,0 +1,125 @@
+/**
+ * OTAPreEraser.cpp
+ *
+ * Implementation of the background partition eraser
+ */
+
+#include "OTAPreEraser.h"
+#include "OTAFlashWriter.h"
+#include <Preferences.h>
+
+#if OTA_ENABLE_PRE_ERASE
+
+#ifndef OTA_NVS_NAMESPACE
+#define OTA_NVS_NAMESPACE "autoota"
+#endif
+
+OTAPreEraser::OTAPreEraser() {
+    _partition = NULL;
+    _erased = 0;
+    _target = 0;
+    _redo = 0;
+    _dirty = 0;
+    _unsaved = 0;
+}
+
+bool OTAPreEraser::begin(size_t maxBytes) {
+    _partition = NULL;
+    _erased = 0;
+    _redo = 0;
+    _dirty = 0;
+    _unsaved = 0;
+
+    // Until the running image is confirmed, a failed boot rolls back to
+    // the inactive partition. Not esp_ota_check_rollback_is_possible():
+    // it stays true after every update, and always with a factory app.
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+        (state == ESP_OTA_IMG_NEW || state == ESP_OTA_IMG_PENDING_VERIFY)) {
+        return false;
+    }
+
+    _partition = esp_ota_get_next_update_partition(NULL);
+    if (_partition == NULL) return false;
+
+    _target = _partition->size;
+    if (maxBytes > 0 && maxBytes < _target) {
+        _target = (maxBytes + OTA_SECTOR_SIZE - 1) / OTA_SECTOR_SIZE * OTA_SECTOR_SIZE;
+    }
+
+    // Progress only counts for the partition it was recorded against
+    Preferences prefs;
+    if (prefs.begin(OTA_NVS_NAMESPACE, true)) {
+        if (prefs.getUInt("erase_part", 0) == _partition->address) {
+            _erased = prefs.getUInt("erase_len", 0);
+            _redo = prefs.getUInt("erase_redo", 0);
+            _dirty = prefs.getUInt("erase_dirty", 0);
+        }
+        prefs.end();
+    }
+    return true;
+}
+
+bool OTAPreEraser::step() {
+    if (done()) return true;
+
+    // Sectors a failed download wrote come first, then the rest
+    bool redo = _redo < _dirty;
+    size_t offset = redo ? _redo : _erased;
+    if (esp_partition_erase_range(_partition, offset, OTA_SECTOR_SIZE) != ESP_OK) {
+        _partition = NULL;
+        return false;
+    }
+
+    if (redo) {
+        _redo += OTA_SECTOR_SIZE;
+    } else {
+        _erased += OTA_SECTOR_SIZE;
+    }
+    if (++_unsaved >= OTA_ERASE_SAVE_SECTORS || done()) {
+        save();
+    }
+    return true;
+}
+
+void OTAPreEraser::beginWrite() {
+    if (_partition == NULL) return;
+
+    Preferences prefs;
+    if (prefs.begin(OTA_NVS_NAMESPACE, false)) {
+        prefs.putUInt("erase_len", 0);
+        prefs.putUInt("erase_dirty", 0);
+        prefs.end();
+    }
+}
+
+void OTAPreEraser::endWrite(size_t written) {
+    if (_partition == NULL) return;
+
+    size_t dirty = (written + OTA_SECTOR_SIZE - 1) / OTA_SECTOR_SIZE * OTA_SECTOR_SIZE;
+    if (dirty >= _erased) {
+        // Nothing erased beyond what was written
+        _erased = 0;
+        _redo = 0;
+        _dirty = 0;
+    } else if (dirty > 0) {
+        _redo = 0;
+        _dirty = max(_dirty, dirty);
+    }
+    save();
+}
+
+void OTAPreEraser::save() {
+    _unsaved = 0;
+
+    Preferences prefs;
+    if (prefs.begin(OTA_NVS_NAMESPACE, false)) {
+        prefs.putUInt("erase_part", _partition->address);
+        prefs.putUInt("erase_len", _erased);
+        prefs.putUInt("erase_redo", _redo);
+        prefs.putUInt("erase_dirty", _dirty);
+        prefs.end();
+    }
+}
+
+#endif // OTA_ENABLE_PRE_ERASE
@@ -0,0 +1,60 @@
+/**
+ * OTARateLimiter.cpp
+ *
+ * Implementation of the download token bucket
+ */
+
+#include "OTARateLimiter.h"
+
+OTARateLimiter::OTARateLimiter() {
+    _rate = 0;
+    _burst = 0;
+    _tokens = 0;
+    _lastUs = 0;
+    _remainder = 0;
+}
+
+void OTARateLimiter::setRate(uint32_t bytesPerSecond) {
+    _rate = bytesPerSecond;
+    _burst = (uint64_t)bytesPerSecond * OTA_RATE_BURST_MS / 1000;
+    if (_burst < OTA_RATE_MIN_BURST) {
+        _burst = OTA_RATE_MIN_BURST;
+    }
+    if (_tokens > _burst) {
+        _tokens = _burst;
+    }
+}
+
+void OTARateLimiter::reset(uint32_t nowUs) {
+    _tokens = _burst;
+    _lastUs = nowUs;
+    _remainder = 0;
+}
+
+size_t OTARateLimiter::available(uint32_t nowUs) {
+    if (_rate == 0) return SIZE_MAX;
+
+    // Refill; the remainder keeps low rates exact despite short intervals
+    uint64_t credit = (uint64_t)(nowUs - _lastUs) * _rate + _remainder;
+    _lastUs = nowUs;
+    uint64_t earned = credit / 1000000;
+    _remainder = credit % 1000000;
+
+    uint64_t tokens = _tokens + earned;
+    if (tokens >= _burst) {
+        tokens = _burst;
+        _remainder = 0;
+    }
+    _tokens = tokens;
+    return _tokens;
+}
+
+void OTARateLimiter::spend(size_t bytes) {
+    _tokens = bytes >= _tokens ? 0 : _tokens - bytes;
+}
+
+uint32_t OTARateLimiter::waitMs() const {
+    if (_rate == 0 || _tokens >= OTA_RATE_MIN_BURST) return 0;
+    uint32_t needed = OTA_RATE_MIN_BURST - _tokens;
+    return ((uint64_t)needed * 1000 + _rate - 1) / _rate;
+}
@@ -0,0 +1,162 @@
+/**
+ * OTAScheduler.cpp
+ *
+ * Implementation of the update check scheduler
+ */
+
+#include "OTAScheduler.h"
+
+// Configured by the owner (ESP32_AutoOTA applies its DEFAULT_* values)
+OTAScheduler::OTAScheduler() {
+    _checkInterval = 0;
+    _minRandomDelay = 0;
+    _maxRandomDelay = 0;
+    _retryDelay = 0;
+    _maxRetries = 0;
+    _fallbackInterval = 0;
+    _pushHealthTimeout = 0;
+    _rng = 0x2545F491;
+    _nextCheck = 0;
+    _retryCount = 0;
+    _forced = false;
+    _lastCompleted = 0;
+    _pushScheduled = false;
+    _lastHeartbeat = 0;
+    _heartbeatSeen = false;
+    _announcedCheck = 0;
+    _announced = false;
+}
+
+void OTAScheduler::setCheckInterval(uint32_t intervalMs) {
+    _checkInterval = intervalMs;
+}
+
+void OTAScheduler::setRandomDelay(uint32_t minMs, uint32_t maxMs) {
+    _minRandomDelay = minMs;
+    _maxRandomDelay = maxMs;
+}
+
+void OTAScheduler::setRetryPolicy(uint32_t retryDelayMs, uint8_t maxRetries) {
+    _retryDelay = retryDelayMs;
+    _maxRetries = maxRetries;
+}
+
+void OTAScheduler::setPushPolicy(uint32_t fallbackIntervalMs, uint32_t healthTimeoutMs) {
+    _fallbackInterval = fallbackIntervalMs;
+    _pushHealthTimeout = healthTimeoutMs;
+}
+
+void OTAScheduler::seed(uint32_t seed) {
+    _rng = seed ? seed : 0x2545F491; // xorshift state must be non-zero
+}
+
+void OTAScheduler::start(uint32_t now) {
+    _retryCount = 0;
+    _nextCheck = now + random(_minRandomDelay, _maxRandomDelay);
+}
+
+void OTAScheduler::forceCheck() {
+    _forced = true;
+}
+
+void OTAScheduler::pushHeartbeat(uint32_t now) {
+    _lastHeartbeat = now;
+    _heartbeatSeen = true;
+}
+
+bool OTAScheduler::isPushHealthy(uint32_t now) const {
+    // Signed: a heartbeat from another task may be stamped after now
+    return _heartbeatSeen && _fallbackInterval > 0 && (int32_t)(now - _lastHeartbeat) < (int32_t)_pushHealthTimeout;
+}
+
+void OTAScheduler::announce(uint32_t now, uint32_t delayMs) {
+    uint32_t due = now + delayMs;
+    // A second announcement never pushes an earlier one back
+    if (!_announced || (int32_t)(due - _announcedCheck) < 0) {
+        _announcedCheck = due;
+        _announced = true;
+    }
+}
+
+bool OTAScheduler::isDue(uint32_t now) const {
+    if (_forced || (int32_t)(now - _nextCheck) >= 0) return true;
+    if (_announced && (int32_t)(now - _announcedCheck) >= 0) return true;
+
+    // Push channel went quiet: fall back to the normal interval
+    return _pushScheduled && !isPushHealthy(now) && now - _lastCompleted >= _checkInterval;
+}
+
+uint32_t OTAScheduler::timeUntilDue(uint32_t now) const {
+    if (isDue(now)) return 0;
+    uint32_t wait = _nextCheck - now;
+    if (_announced && _announcedCheck - now < wait) {
+        wait = _announcedCheck - now;
+    }
+    if (_pushScheduled) {
+        // Wake up when the push channel would turn unhealthy, or when a
+        // normal interval has passed since it did
+        uint32_t limit = isPushHealthy(now) ? _lastHeartbeat + _pushHealthTimeout - now
+                                            : _lastCompleted + _checkInterval - now;
+        if (limit < wait) {
+            wait = limit;
+        }
+    }
+    return wait;
+}
+
+void OTAScheduler::checkStarted(uint32_t now) {
+    _forced = false;
+    // Served by this check; one announced from here on may announce a
+    // release this check has already missed, so it stays
+    if (_announced && (int32_t)(now - _announcedCheck) >= 0) {
+        _announced = false;
+    }
+}
+
+bool OTAScheduler::checkCompleted(uint32_t now, bool success) {
+
+    // The push channel announces releases, polling is only a safety net
+    _lastCompleted = now;
+    _pushScheduled = isPushHealthy(now);
+    uint32_t interval = _pushScheduled ? _fallbackInterval : _checkInterval;
+
+    if (success) {
+        _retryCount = 0;
+        _nextCheck = now + jitter(interval);
+        return false;
+    }
+
+    _retryCount++;
+    if (_retryCount >= _maxRetries) {
+        // Out of retries, wait a full interval before trying again
+        _retryCount = 0;
+        _nextCheck = now + jitter(interval);
+        return true;
+    }
+
+    if (_retryDelay == 0) {
+        _nextCheck = now + jitter(interval);
+        return false;
+    }
+
+    _pushScheduled = false;
+    _nextCheck = now + jitter(_retryDelay);
+    return false;
+}
+
+uint32_t OTAScheduler::random(uint32_t minValue, uint32_t maxValue) {
+    if (maxValue <= minValue) return minValue;
+
+    // xorshift32: cheap, seedable and identical on device and host
+    _rng ^= _rng << 13;
+    _rng ^= _rng >> 17;
+    _rng ^= _rng << 5;
+
+    return minValue + _rng % (maxValue - minValue);
+}
+
+uint32_t OTAScheduler::jitter(uint32_t base) {
+    // Randomize interval (±10% variation)
+    uint32_t variation = base / 10;
+    return random(base - variation, base + variation + 1);
+}
@@ -0,0 +1,112 @@
+/**
+ * OTATrace.cpp
+ *
+ * Implementation of the binary event trace
+ */
+
+#include "OTATrace.h"
+#include <esp_system.h>
+
+#if OTA_ENABLE_TRACE
+
+struct OTATraceBuffer {
+    uint32_t magic;
+    uint32_t head;      // Next slot to write
+    uint32_t count;     // Valid records, up to OTA_TRACE_CAPACITY
+    uint32_t bootCount;
+    OTATraceRecord records[OTA_TRACE_CAPACITY];
+};
+
+// Not zeroed on reset, so the trace survives ESP.restart(), panics and watchdogs
+RTC_NOINIT_ATTR static OTATraceBuffer traceBuffer;
+static portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+static bool traceChecked = false;   // In normal RAM: false after every reset
+
+// Check the buffer once per boot, before its indexes are first used.
+// Call with traceMux held.
+static void checkBuffer() {
+    if (traceChecked) return;
+    traceChecked = true;
+    if (traceBuffer.magic != OTA_TRACE_MAGIC ||
+        traceBuffer.head >= OTA_TRACE_CAPACITY ||
+        traceBuffer.count > OTA_TRACE_CAPACITY) {
+        // Power-on or corrupted: start fresh
+        traceBuffer.magic = OTA_TRACE_MAGIC;
+        traceBuffer.head = 0;
+        traceBuffer.count = 0;
+        traceBuffer.bootCount = 0;
+    }
+}
+
+void OTATrace::begin() {
+    static bool started = false;
+    if (started) return;
+    started = true;
+
+    portENTER_CRITICAL(&traceMux);
+    checkBuffer();
+    traceBuffer.bootCount++;
+    portEXIT_CRITICAL(&traceMux);
+
+    record(OTA_EVT_BOOT, esp_reset_reason(), traceBuffer.bootCount);
+}
+
+void OTATrace::record(uint16_t event, uint16_t arg0, uint32_t arg1) {
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&traceMux);
+    checkBuffer();
+    OTATraceRecord& slot = traceBuffer.records[traceBuffer.head];
+    slot.timestampMs = now;
+    slot.event = event;
+    slot.arg0 = arg0;
+    slot.arg1 = arg1;
+    traceBuffer.head = (traceBuffer.head + 1) % OTA_TRACE_CAPACITY;
+    if (traceBuffer.count < OTA_TRACE_CAPACITY) {
+        traceBuffer.count++;
+    }
+    portEXIT_CRITICAL(&traceMux);
+}
+
+size_t OTATrace::read(OTATraceRecord* out, size_t maxRecords) {
+    portENTER_CRITICAL(&traceMux);
+    checkBuffer();
+    size_t count = min((size_t)traceBuffer.count, maxRecords);
+    size_t first = (traceBuffer.head + OTA_TRACE_CAPACITY - traceBuffer.count) % OTA_TRACE_CAPACITY;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = traceBuffer.records[(first + i) % OTA_TRACE_CAPACITY];
+    }
+    portEXIT_CRITICAL(&traceMux);
+    return count;
+}
+
+void OTATrace::dump(Print& out) {
+    // Copy first so the lock is never held while printing
+    OTATraceRecord records[OTA_TRACE_CAPACITY];
+    size_t count = read(records, OTA_TRACE_CAPACITY);
+
+    char line[40];
+    snprintf(line, sizeof(line), "OTATRACE %d %u", OTA_TRACE_VERSION, (unsigned)count);
+    out.println(line);
+
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* bytes = (const uint8_t*)&records[i];
+        char* p = line;
+        *p++ = 'T';
+        *p++ = ' ';
+        for (size_t k = 0; k < sizeof(OTATraceRecord); k++) {
+            p += sprintf(p, "%02x", bytes[k]);
+        }
+        out.println(line);
+    }
+}
+
+void OTATrace::clear() {
+    portENTER_CRITICAL(&traceMux);
+    checkBuffer();
+    traceBuffer.head = 0;
+    traceBuffer.count = 0;
+    portEXIT_CRITICAL(&traceMux);
+}
+
+#endif // OTA_ENABLE_TRACE
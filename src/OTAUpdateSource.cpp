@@ -0,0 +1,273 @@
+/**
+ * OTAUpdateSource.cpp
+ *
+ * Implementation of the firmware image sources
+ */
+
+#include "OTAUpdateSource.h"
+
+// ========== OTAHttpSource ==========
+
+OTAHttpSource::OTAHttpSource(const char* url) {
+    _url = url;
+    _stream = NULL;
+    _httpCode = 0;
+    _size = 0;
+    _open = false;
+}
+
+OTAHttpSource::~OTAHttpSource() {
+    close();
+}
+
+bool OTAHttpSource::open(size_t offset) {
+    return open(offset, 0);
+}
+
+bool OTAHttpSource::open(size_t offset, size_t length) {
+    close();
+
+    _open = true;
+    if (!_request.begin(_url)) {
+        _httpCode = HTTPC_ERROR_CONNECTION_REFUSED;
+        close();
+        return false;
+    }
+
+    HTTPClient& http = _request.http();
+
+    // Cache-busting headers
+    _request.addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
+    _request.addHeader("Pragma", "no-cache");
+    _request.addHeader("Expires", "0");
+
+    if (length > 0) {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%u-%u", (unsigned)offset, (unsigned)(offset + length - 1));
+        _request.addHeader("Range", range);
+    } else if (offset > 0) {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%u-", (unsigned)offset);
+        _request.addHeader("Range", range);
+    }
+
+    static const char* headerKeys[] = { "Content-Range" };
+    http.collectHeaders(headerKeys, 1);
+
+    _httpCode = _request.GET();
+
+    if (_httpCode != HTTP_CODE_OK && _httpCode != HTTP_CODE_PARTIAL_CONTENT) {
+        close();
+        return false;
+    }
+
+    int contentLength = http.getSize();
+    _stream = http.getStreamPtr();
+
+    // Position of the first byte in the response body
+    size_t first = 0;
+    if (_httpCode == HTTP_CODE_PARTIAL_CONTENT) {
+        // "bytes <first>-<last>/<total>"; a range starting past the offset leaves a gap
+        String contentRange = http.header("Content-Range");
+        if (!contentRange.startsWith("bytes ")) {
+            close();
+            return false;
+        }
+        first = strtoul(contentRange.c_str() + 6, NULL, 10);
+        if (first > offset) {
+            close();
+            return false;
+        }
+        const char* total = strrchr(contentRange.c_str(), '/');
+        _size = total != NULL ? strtoul(total + 1, NULL, 10) : 0;
+        if (_size == 0 && contentLength > 0) {
+            _size = first + contentLength;
+        }
+    } else {
+        _size = contentLength > 0 ? contentLength : 0;
+    }
+
+    // Server ignored the Range header or answered an earlier range, skip what we already have
+    uint8_t discard[128];
+    size_t skipped = first;
+    unsigned long lastData = millis();
+    while (skipped < offset) {
+        int n = read(discard, min(sizeof(discard), offset - skipped));
+        if (n < 0 || (n == 0 && millis() - lastData > OTA_SKIP_TIMEOUT)) {
+            close();
+            return false;
+        }
+        if (n == 0) {
+            delay(1);
+            continue;
+        }
+        lastData = millis();
+        skipped += n;
+    }
+    return true;
+}
+
+size_t OTAHttpSource::size() {
+    return _size;
+}
+
+int OTAHttpSource::read(uint8_t* buffer, size_t len) {
+    if (_stream == NULL) return -1;
+
+    size_t available = _stream->available();
+    if (available == 0) {
+        return _request.http().connected() ? 0 : -1;
+    }
+
+    return _stream->readBytes(buffer, min(available, len));
+}
+
+void OTAHttpSource::close() {
+    if (_open) {
+        _request.end();
+        _open = false;
+    }
+    _stream = NULL;
+}
+
+// ========== OTAMirrorSource ==========
+
+OTAMirrorSource::OTAMirrorSource(OTAMirrorList& mirrors)
+    : _mirrors(mirrors), _http(NULL) {
+    _current = -1;
+    _last = -1;
+}
+
+bool OTAMirrorSource::open(size_t offset) {
+    close();
+    _current = -1;
+
+    // Resuming: move away from the mirror that broke off, unless it is the only one left
+    bool skipLast = offset > 0 && _last >= 0 && _mirrors.count() > 1;
+    uint32_t tried = skipLast ? 1u << _last : 0;
+
+    int index;
+    while ((index = _mirrors.best(tried)) >= 0) {
+        tried |= 1u << index;
+        if (openMirror(index, offset)) {
+            return true;
+        }
+    }
+
+    // Every other mirror failed, go back to the one we left
+    return skipLast && openMirror(_last, offset);
+}
+
+bool OTAMirrorSource::openMirror(int index, size_t offset) {
+    _http.setURL(_mirrors.url(index));
+
+    unsigned long start = millis();
+    if (!_http.open(offset)) {
+        _mirrors.recordFailure(index);
+        return false;
+    }
+
+    _mirrors.recordSuccess(index, millis() - start);
+    _current = index;
+    _last = index;
+    return true;
+}
+
+int OTAMirrorSource::read(uint8_t* buffer, size_t len) {
+    int n = _http.read(buffer, len);
+    if (n < 0 && _current >= 0) {
+        _mirrors.recordFailure(_current);
+        _current = -1;
+    }
+    return n;
+}
+
+// ========== OTAStreamSource ==========
+
+OTAStreamSource::OTAStreamSource(Stream& stream, size_t size)
+    : _stream(stream) {
+    _size = size;
+    _position = 0;
+}
+
+bool OTAStreamSource::open(size_t offset) {
+    _position = 0;
+    return offset == 0;
+}
+
+int OTAStreamSource::read(uint8_t* buffer, size_t len) {
+    if (_position >= _size) return -1;
+
+    size_t available = _stream.available();
+    if (available == 0) return 0;
+
+    size_t bytesRead = _stream.readBytes(buffer, min(min(available, len), _size - _position));
+    _position += bytesRead;
+    return bytesRead;
+}
+
+// ========== OTAFileSource ==========
+
+OTAFileSource::OTAFileSource(fs::FS& fs, const char* path)
+    : _fs(fs) {
+    _path = path;
+    _size = 0;
+}
+
+bool OTAFileSource::open(size_t offset) {
+    close();
+
+    _file = _fs.open(_path, FILE_READ);
+    if (!_file) return false;
+
+    _size = _file.size();
+    if (offset > _size || !_file.seek(offset)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+int OTAFileSource::read(uint8_t* buffer, size_t len) {
+    if (!_file) return -1;
+    if (_file.available() == 0) return -1;
+    return _file.read(buffer, len);
+}
+
+void OTAFileSource::close() {
+    if (_file) {
+        _file.close();
+    }
+}
+
+// ========== OTAMemorySource ==========
+
+OTAMemorySource::OTAMemorySource(const uint8_t* data, size_t size) {
+    _data = data;
+    _size = size;
+    _position = 0;
+}
+
+bool OTAMemorySource::open(size_t offset) {
+    if (_data == NULL || offset > _size) return false;
+    _position = offset;
+    return true;
+}
+
+int OTAMemorySource::read(uint8_t* buffer, size_t len) {
+    if (_position >= _size) return -1;
+
+    size_t n = min(len, _size - _position);
+    memcpy(buffer, _data + _position, n);
+    _position += n;
+    return n;
+}
+
+size_t OTAMemorySource::peek(const uint8_t** data, size_t maxLen) {
+    *data = _data + _position;
+    return min(maxLen, _size - _position);
+}
+
+void OTAMemorySource::consume(size_t len) {
+    _position += min(len, _size - _position);
+}
@@ -0,0 +1,125 @@
+/**
+ * bench_decrypt.cpp - Decryption throughput and its share of an install
+ *
+ * Decrypts an image encrypted by Fixtures::encryptImage() (the format of
+ * tools/ota_encrypt.py) with OTAImageCipher, for AES-128 and AES-256 at
+ * the chunk sizes a download delivers, and checks the result against the
+ * plain image. Then installs the same image plain with OTAHttpSource and
+ * encrypted through OTADecryptSource, and reports the time spent in
+ * decryption. The host has no AES accelerator: the numbers compare
+ * chunk sizes and key lengths, not the ESP32's absolute throughput.
+ * Fails if any decryption does not match the plain image.
+ *
+ *   bench_decrypt [--kb 1024] [--rounds 4]
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <OTADecrypt.h>
+
+#include "Bench.h"
+#include "Fixtures.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static const size_t CHUNKS[] = {512, 1436, 4096};
+
+static void fail(const char* what) {
+    fprintf(stderr, "%s\n", what);
+    exit(1);
+}
+
+/**
+ * Decrypt the whole image a chunk at a time, rounds times
+ * @return Throughput in KB/s
+ */
+static double cipherRate(const Bytes& image, const Bytes& encrypted, const uint8_t* key, size_t keyLen,
+                         size_t chunk, int rounds) {
+    OTAImageCipher cipher;
+    if (!cipher.setKey(key, keyLen) || !cipher.begin(encrypted.data())) fail("cipher setup failed");
+
+    Bytes buffer(encrypted.begin() + OTA_CRYPT_HEADER_LEN, encrypted.end());
+    uint64_t busy = 0;
+    for (int round = 0; round < rounds; round++) {
+        std::copy(encrypted.begin() + OTA_CRYPT_HEADER_LEN, encrypted.end(), buffer.begin());
+        cipher.seek(0);
+        uint64_t start = Bench::nowMicros();
+        for (size_t offset = 0; offset < buffer.size(); offset += chunk) {
+            cipher.apply(buffer.data() + offset, std::min(chunk, buffer.size() - offset));
+        }
+        busy += Bench::nowMicros() - start;
+        if (buffer != image) fail("decrypted image differs from the plain image");
+    }
+    return image.size() / 1024.0 * rounds / (busy / 1e6);
+}
+
+struct Install {
+    double downloadMs;
+    double decryptMs;
+};
+
+static Install install(const std::string& url, const Bytes& image, const uint8_t* key, size_t keyLen) {
+    HostSim::resetFlash();
+    ESP32_AutoOTA ota;
+    OTAHttpSource http(url.c_str());
+    OTADecryptSource decrypt(http, key, keyLen);
+    OTAUpdateSource& source = key ? (OTAUpdateSource&)decrypt : (OTAUpdateSource&)http;
+
+    uint64_t start = Bench::nowMicros();
+    bool ok = ota.updateFrom(source);
+    Install result;
+    // The library waits a second before restarting
+    result.downloadMs = (Bench::nowMicros() - start) / 1000.0 - 1000.0;
+    result.decryptMs = key ? decrypt.getDecryptUs() / 1000.0 : 0;
+
+    if (!ok || memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) != 0) {
+        fprintf(stderr, "%s install failed: %s\n", key ? "encrypted" : "plain", ota.getLastError());
+        exit(1);
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    Bench::Args args(argc, argv);
+    size_t size = (size_t)args.get("kb", 1024) * 1024;
+    int rounds = (int)args.get("rounds", 4);
+
+    uint8_t key[32];
+    uint8_t nonce[OTA_CRYPT_NONCE_LEN];
+    for (size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t)(i * 7 + 3);
+    memset(nonce, 0xa5, sizeof(nonce));
+
+    Bytes image = Fixtures::makeImage(size);
+    double mb = size / (1024.0 * 1024.0);
+
+    for (size_t keyLen : {16, 32}) {
+        Bytes encrypted = Fixtures::encryptImage(image, key, keyLen, nonce);
+        char title[64];
+        snprintf(title, sizeof(title), "OTAImageCipher, AES-%u", (unsigned)keyLen * 8);
+        Bench::section(title);
+        for (size_t chunk : CHUNKS) {
+            char name[64];
+            snprintf(name, sizeof(name), "%u-byte chunks", (unsigned)chunk);
+            Bench::report(name, cipherRate(image, encrypted, key, keyLen, chunk, rounds), "KB/s");
+        }
+    }
+
+    Bytes encrypted = Fixtures::encryptImage(image, key, sizeof(key), nonce);
+    TestServer server;
+    TestRoute plainRoute;
+    plainRoute.body = Fixtures::toString(image);
+    server.route("/fw.bin", plainRoute);
+    TestRoute encryptedRoute;
+    encryptedRoute.body = Fixtures::toString(encrypted);
+    server.route("/fw.enc", encryptedRoute);
+
+    Install plain = install(server.url("/fw.bin"), image, nullptr, 0);
+    Install decrypted = install(server.url("/fw.enc"), image, key, sizeof(key));
+    Bench::section("Install (updateFrom)");
+    Bench::report("plain, download time per MB", plain.downloadMs / mb, "ms");
+    Bench::report("encrypted, download time per MB", decrypted.downloadMs / mb, "ms");
+    Bench::report("encrypted, decryption per MB", decrypted.decryptMs / mb, "ms");
+    Bench::report("decryption share of the install", 100.0 * decrypted.decryptMs / decrypted.downloadMs, "%");
+    return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * bench_flash_write.cpp - Flash write calls and time per MB
+ *
+ * Writes the same image through four paths against the simulated flash
+ * (per-call Update overhead, sector erase and program latency):
+ *
+ * - Update.write() with 128-byte chunks (the loop before OTAFlashWriter)
+ * - Update.write() with whatever a TCP read returns (1 to 1460 bytes)
+ * - OTAFlashWriter on Update (OTA_FLASH_UPDATE), whole sectors only
+ * - OTAFlashWriter on the partition (OTA_FLASH_PARTITION), no Update copy
+ *
+ * Fails if the writer makes more than one flash write per sector or is
+ * slower than the 128-byte loop.
+ *
+ *   bench_flash_write [--kb 1024] [--call-us 25] [--erase-us 30000] [--write-us-per-kb 350]
+ */
+
+#include <HostSim.h>
+#include <OTAFlashWriter.h>
+#include <Update.h>
+
+#include <functional>
+
+#include "Bench.h"
+#include "Fixtures.h"
+
+using Fixtures::Bytes;
+
+struct Result {
+    uint32_t updateCalls;
+    uint32_t flashWrites;
+    double wallMs;
+    double flashMs;
+    bool ok;
+};
+
+static Result measure(const Bytes& image, const std::function<bool()>& write) {
+    HostSim::resetFlash();
+    HostSim::resetUpdateCounters();
+    uint64_t start = Bench::nowMicros();
+    bool ok = write();
+    Result result;
+    result.wallMs = (Bench::nowMicros() - start) / 1000.0;
+    result.updateCalls = HostSim::updateCounters().writeCalls;
+    result.flashWrites = HostSim::flashCounters().writeCalls;
+    result.flashMs = HostSim::flashCounters().busyMicros / 1000.0;
+    result.ok = ok && memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0;
+    return result;
+}
+
+static bool updateChunks(const Bytes& image, const std::function<size_t()>& chunk) {
+    if (!Update.begin(image.size())) return false;
+    size_t offset = 0;
+    while (offset < image.size()) {
+        size_t len = std::min(chunk(), image.size() - offset);
+        if (Update.write((uint8_t*)image.data() + offset, len) != len) return false;
+        offset += len;
+    }
+    return Update.end();
+}
+
+static bool writer(const Bytes& image, OTAFlashMode mode) {
+    OTAFlashWriter flash;
+    flash.setMode(mode);
+    if (!flash.begin(image.size())) return false;
+    size_t offset = 0;
+    while (offset < image.size()) {
+        // Read into the sector buffer, a TCP segment at a time
+        uint8_t* space;
+        size_t len = std::min(std::min(flash.reserve(&space), (size_t)1460), image.size() - offset);
+        memcpy(space, image.data() + offset, len);
+        if (!flash.commit(len)) return false;
+        offset += len;
+    }
+    return flash.end();
+}
+
+static void report(const char* title, const Result& result, double mb) {
+    Bench::section(title);
+    Bench::report("Update.write() calls per MB", result.updateCalls / mb, "calls");
+    Bench::report("flash write calls per MB", result.flashWrites / mb, "calls");
+    Bench::report("write time per MB", result.wallMs / mb, "ms");
+    Bench::report("of which flash busy", result.flashMs / mb, "ms");
+}
+
+int main(int argc, char** argv) {
+    Bench::Args args(argc, argv);
+    size_t size = (size_t)args.get("kb", 1024) * 1024;
+    HostSim::setUpdateCallOverhead((uint32_t)args.get("call-us", 25));
+    HostSim::setFlashLatency((uint32_t)args.get("erase-us", 30000), (uint32_t)args.get("write-us-per-kb", 350));
+
+    Bytes image = Fixtures::makeImage(size);
+    double mb = size / (1024.0 * 1024.0);
+    std::srand(1);
+
+    Result small = measure(image, [&] { return updateChunks(image, [] { return (size_t)128; }); });
+    Result segments = measure(image, [&] {
+        return updateChunks(image, [] { return (size_t)(1 + std::rand() % 1460); });
+    });
+    Result update = measure(image, [&] { return writer(image, OTA_FLASH_UPDATE); });
+    Result partition = measure(image, [&] { return writer(image, OTA_FLASH_PARTITION); });
+
+    report("Update.write(), 128-byte chunks", small, mb);
+    report("Update.write(), TCP read sizes", segments, mb);
+    report("OTAFlashWriter, Update back end", update, mb);
+    report("OTAFlashWriter, partition back end", partition, mb);
+
+    bool ok = small.ok && segments.ok && update.ok && partition.ok;
+    uint32_t sectors = (size + OTA_SECTOR_SIZE - 1) / OTA_SECTOR_SIZE;
+    // Update holds back the magic byte and writes it in end()
+    if (update.updateCalls > sectors || update.flashWrites > sectors + 1 || partition.flashWrites > sectors + 1) {
+        fprintf(stderr, "writer made more than one write per sector\n");
+        ok = false;
+    }
+    if (update.wallMs >= small.wallMs || partition.wallMs >= small.wallMs) {
+        fprintf(stderr, "writer slower than 128-byte Update.write() calls\n");
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
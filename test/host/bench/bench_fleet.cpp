@@ -0,0 +1,218 @@
+/**
+ * bench_fleet.cpp - Fleet load simulation on virtual time
+ *
+ * Thousands of OTAScheduler instances, each seeded differently, are
+ * stepped as a discrete-event simulation: every device boots at t=0
+ * (a site-wide power cut is the worst case), the version server is
+ * down for a while, then a release is published. Reports the server
+ * load per second and how fast the fleet converges on the release.
+ * With a rollout percentage below 100, only devices whose hash falls in
+ * the group download it, as with setStaggeredRollout(); convergence is
+ * measured over that group.
+ *
+ *   bench_fleet [--devices 10000] [--hours 6] [--interval-ms 300000]
+ *               [--min-delay-ms 60000] [--max-delay-ms 180000]
+ *               [--rollout-percent 100] [--retry-delay-ms 0] [--max-retries 3]
+ *               [--image-kb 1024] [--device-kbps 100] [--outage-start-min 20]
+ *               [--outage-min 10] [--release-min 60]
+ *
+ * Each run compares the configured settings with a 60 s retry delay, no
+ * random delay and no staggered rollout, and ends with the origin peak
+ * of every setting.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <OTAScheduler.h>
+
+#include <queue>
+#include <string>
+
+#include "Bench.h"
+
+struct FleetConfig {
+    uint32_t devices;
+    uint32_t durationMs;
+    uint32_t intervalMs;
+    uint32_t minDelayMs;
+    uint32_t maxDelayMs;
+    uint8_t rolloutPercent;
+    uint32_t retryDelayMs;
+    uint8_t maxRetries;
+    uint32_t imageBytes;
+    uint32_t deviceBytesPerSecond;
+    uint32_t outageStartMs;
+    uint32_t outageMs;
+    uint32_t releaseMs;
+};
+
+// Version request plus response, headers included
+static const uint32_t VERSION_EXCHANGE_BYTES = 600;
+// Time a version check takes from start to completion
+static const uint32_t CHECK_DURATION_MS = 300;
+
+// Requests and bytes at the origin in its busiest second
+struct OriginPeak {
+    double requests;
+    double bytes;
+};
+
+// Stands in for the MAC hash of ESP32_AutoOTA::shouldUpdateNow()
+static bool inRolloutGroup(uint32_t device, uint8_t percent) {
+    uint32_t hash = (device + 1) * 2654435761u;
+    hash ^= hash >> 16;
+    return hash % 100 < percent;
+}
+
+static OriginPeak simulate(const char* title, const FleetConfig& config) {
+    std::vector<OTAScheduler> fleet(config.devices);
+    std::vector<bool> updated(config.devices, false);
+    std::vector<double> convergedAt;
+
+    uint32_t seconds = config.durationMs / 1000 + 1;
+    std::vector<double> requests(seconds, 0);
+    std::vector<double> bytes(seconds, 0);
+
+    typedef std::pair<uint32_t, uint32_t> Event; // (time, device)
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+
+    for (uint32_t i = 0; i < config.devices; i++) {
+        OTAScheduler& scheduler = fleet[i];
+        scheduler.setCheckInterval(config.intervalMs);
+        scheduler.setRandomDelay(config.minDelayMs, config.maxDelayMs);
+        scheduler.setRetryPolicy(config.retryDelayMs, config.maxRetries);
+        scheduler.seed(0x9E3779B9u * (i + 1));
+        scheduler.start(0);
+        events.push(Event(scheduler.getNextCheckTime(), i));
+    }
+
+    uint32_t group = 0;
+    for (uint32_t i = 0; i < config.devices; i++) {
+        if (inRolloutGroup(i, config.rolloutPercent)) group++;
+    }
+
+    uint64_t checks = 0;
+    uint64_t failures = 0;
+    while (!events.empty()) {
+        Event event = events.top();
+        events.pop();
+        uint32_t now = event.first;
+        if (now >= config.durationMs) break;
+        OTAScheduler& scheduler = fleet[event.second];
+
+        if (!scheduler.isDue(now)) {
+            events.push(Event(now + std::max<uint32_t>(scheduler.timeUntilDue(now), 1), event.second));
+            continue;
+        }
+
+        checks++;
+        requests[now / 1000] += 1;
+        bytes[now / 1000] += VERSION_EXCHANGE_BYTES;
+        scheduler.checkStarted(now);
+        bool serverUp = now < config.outageStartMs || now >= config.outageStartMs + config.outageMs;
+        uint32_t done = now + CHECK_DURATION_MS;
+
+        if (serverUp && now >= config.releaseMs && !updated[event.second] &&
+            inRolloutGroup(event.second, config.rolloutPercent)) {
+            // Download the image at the device's link rate
+            uint32_t downloadMs = (uint32_t)((uint64_t)config.imageBytes * 1000 / config.deviceBytesPerSecond);
+            requests[done / 1000 < seconds ? done / 1000 : seconds - 1] += 1;
+            for (uint32_t t = done; t < done + downloadMs && t < config.durationMs; t += 1000) {
+                uint32_t slice = std::min<uint32_t>(1000, done + downloadMs - t);
+                bytes[t / 1000] += (double)config.deviceBytesPerSecond * slice / 1000;
+            }
+            done += downloadMs;
+            updated[event.second] = true;
+            convergedAt.push_back((double)(done - config.releaseMs));
+        }
+
+        if (!serverUp) failures++;
+        scheduler.checkCompleted(done, serverUp);
+        events.push(Event(done + std::max<uint32_t>(scheduler.timeUntilDue(done), 1), event.second));
+    }
+
+    OriginPeak peak;
+    peak.requests = *std::max_element(requests.begin(), requests.end());
+    peak.bytes = *std::max_element(bytes.begin(), bytes.end());
+
+    Bench::section(title);
+    Bench::report("devices in rollout group", (double)group, "");
+    Bench::report("checks", (double)checks, "");
+    Bench::report("failed checks (outage)", (double)failures, "");
+    Bench::report("peak requests", peak.requests, "req/s");
+    Bench::report("p99 requests", Bench::percentile(requests, 0.99), "req/s");
+    uint32_t afterOutage = (config.outageStartMs + config.outageMs) / 1000;
+    double outagePeak = 0;
+    for (uint32_t s = afterOutage; s < afterOutage + 60 && s < seconds; s++) {
+        outagePeak = std::max(outagePeak, requests[s]);
+    }
+    Bench::report("peak requests in minute after outage", outagePeak, "req/s");
+    Bench::report("peak bytes", peak.bytes / 1e6, "MB/s");
+    Bench::report("p99 bytes", Bench::percentile(bytes, 0.99) / 1e6, "MB/s");
+
+    std::sort(convergedAt.begin(), convergedAt.end());
+    const double targets[] = {0.5, 0.9, 0.99, 1.0};
+    for (double target : targets) {
+        char name[48];
+        snprintf(name, sizeof(name), "time to %g%% updated", target * 100);
+        size_t needed = (size_t)(target * group + 0.5);
+        if (needed == 0) needed = 1;
+        if (convergedAt.size() >= needed) {
+            Bench::report(name, convergedAt[needed - 1] / 60000, "min");
+        } else {
+            Bench::report(name, -1, "min (not reached)");
+        }
+    }
+    return peak;
+}
+
+int main(int argc, char** argv) {
+    Bench::Args args(argc, argv);
+    FleetConfig config;
+    config.devices = (uint32_t)args.get("devices", 10000);
+    config.durationMs = (uint32_t)(args.get("hours", 6) * 3600000);
+    config.intervalMs = (uint32_t)args.get("interval-ms", DEFAULT_CHECK_INTERVAL);
+    config.minDelayMs = (uint32_t)args.get("min-delay-ms", DEFAULT_MIN_RANDOM_DELAY);
+    config.maxDelayMs = (uint32_t)args.get("max-delay-ms", DEFAULT_MAX_RANDOM_DELAY);
+    config.rolloutPercent = (uint8_t)std::min(args.get("rollout-percent", 100), 100.0);
+    config.retryDelayMs = (uint32_t)args.get("retry-delay-ms", DEFAULT_RETRY_DELAY);
+    config.maxRetries = (uint8_t)args.get("max-retries", DEFAULT_MAX_RETRIES);
+    config.imageBytes = (uint32_t)(args.get("image-kb", 1024) * 1024);
+    config.deviceBytesPerSecond = (uint32_t)(args.get("device-kbps", 100) * 1024);
+    config.outageStartMs = (uint32_t)(args.get("outage-start-min", 20) * 60000);
+    config.outageMs = (uint32_t)(args.get("outage-min", 10) * 60000);
+    config.releaseMs = (uint32_t)(args.get("release-min", 60) * 60000);
+
+    printf("%u devices, %.1f h, interval %u ms, max retries %u, image %u KB\n", config.devices,
+           config.durationMs / 3600000.0, config.intervalMs, config.maxRetries, config.imageBytes / 1024);
+
+    std::vector<std::pair<std::string, OriginPeak>> peaks;
+    char title[96];
+    snprintf(title, sizeof(title), "delay %u-%u ms, rollout %u%%, retry delay %u ms%s", config.minDelayMs,
+             config.maxDelayMs, config.rolloutPercent, config.retryDelayMs,
+             config.retryDelayMs == 0 ? " (wait the interval)" : "");
+    peaks.push_back(std::make_pair(title, simulate(title, config)));
+
+    if (config.retryDelayMs != 60000) {
+        FleetConfig shortRetry = config;
+        shortRetry.retryDelayMs = 60000;
+        peaks.push_back(std::make_pair("retry delay 60000 ms", simulate("retry delay 60000 ms", shortRetry)));
+    }
+    if (config.maxDelayMs != 0) {
+        FleetConfig noDelay = config;
+        noDelay.minDelayMs = 0;
+        noDelay.maxDelayMs = 0;
+        peaks.push_back(std::make_pair("no random delay", simulate("no random delay", noDelay)));
+    }
+    if (config.rolloutPercent != 100) {
+        FleetConfig everyone = config;
+        everyone.rolloutPercent = 100;
+        peaks.push_back(std::make_pair("no staggered rollout", simulate("no staggered rollout", everyone)));
+    }
+
+    Bench::section("origin peak per setting");
+    for (const auto& peak : peaks) {
+        printf("  %-72s %8.0f req/s %8.3f MB/s\n", peak.first.c_str(), peak.second.requests,
+               peak.second.bytes / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * bench_multicast.cpp - One multicast stream against a fleet of receivers
+ *
+ * A MulticastSender streams the image once to 1..500 OTAMulticastSource
+ * receivers in this process, each with its own socket and its own
+ * random packet loss (HostSim::setPacketLoss). Worker threads read every
+ * receiver and compare its bytes with the image as they arrive. Groups
+ * parity cannot rebuild come from the fallback URL, so the server's
+ * byte count is what the fleet still pulls over unicast; without
+ * multicast it would be receivers x image size.
+ * Fails if a receiver does not get the exact image, or if the fallback
+ * carries 20% or more of what unicast would.
+ *
+ *   bench_multicast [--kb 1024] [--rate-kb 1024] [--loss 0.01] [--receivers 1,10,100,500]
+ *                   [--block 1024] [--k 8]
+ */
+
+#include <HostSim.h>
+#include <OTAMulticastSource.h>
+
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+#include "Bench.h"
+#include "Fixtures.h"
+#include "MulticastSender.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static const IPAddress GROUP(239, 255, 0, 2);
+static const size_t WORKERS = 8;
+
+struct Receiver {
+    std::unique_ptr<OTAMulticastSource> source;
+    size_t received = 0;
+    bool failed = false;
+    double doneMs = 0;
+};
+
+struct Result {
+    std::vector<double> doneMs;
+    uint32_t complete;
+    uint32_t recovered;
+    uint32_t fetched;
+    uint32_t unicast;           // Receivers whose session ended early
+    uint64_t fallbackBytes;
+    uint32_t packetsSent;
+};
+
+static Result run(const Bytes& image, TestServer& server, const std::string& url, size_t count,
+                  uint32_t rate, double loss, uint16_t block, uint8_t k) {
+    uint16_t port = 50000 + getpid() % 10000;
+    MulticastSender sender(GROUP, port);
+    sender.load(image, block, k);
+    HostSim::setPacketLoss(loss, 1);
+
+    std::vector<Receiver> receivers(count);
+    for (Receiver& receiver : receivers) {
+        receiver.source.reset(new OTAMulticastSource(GROUP, port, url.c_str()));
+    }
+
+    // All receivers lock on to the beacon before the stream starts
+    sender.beacon();
+    std::atomic<size_t> opened(0);
+    std::atomic<bool> streaming(false);
+    uint64_t start = 0;
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < std::min(WORKERS, count); w++) {
+        workers.emplace_back([&, w]() {
+            for (size_t i = w; i < count; i += WORKERS) {
+                if (!receivers[i].source->open()) receivers[i].failed = true;
+                opened++;
+            }
+            while (!streaming) delay(1);
+
+            std::vector<uint8_t> buffer(16384);
+            bool pending = true;
+            while (pending) {
+                pending = false;
+                bool progress = false;
+                for (size_t i = w; i < count; i += WORKERS) {
+                    Receiver& receiver = receivers[i];
+                    if (receiver.failed || receiver.received == image.size()) continue;
+                    pending = true;
+                    int n = receiver.source->read(buffer.data(), buffer.size());
+                    if (n < 0 || receiver.received + n > image.size() ||
+                        memcmp(buffer.data(), &image[receiver.received], n) != 0) {
+                        receiver.failed = true;
+                        continue;
+                    }
+                    receiver.received += n;
+                    progress |= n > 0;
+                    if (receiver.received == image.size()) {
+                        receiver.doneMs = (Bench::nowMicros() - start) / 1000.0;
+                    }
+                }
+                if (!progress) delay(1);
+            }
+        });
+    }
+    while (opened < count) delay(1);
+
+    uint64_t servedBefore = server.bytesSent();
+    start = Bench::nowMicros();
+    streaming = true;
+    sender.start(rate);
+    sender.wait();
+    for (std::thread& worker : workers) worker.join();
+    HostSim::setPacketLoss(0);
+
+    Result result = {};
+    for (Receiver& receiver : receivers) {
+        if (!receiver.failed && receiver.received == image.size()) {
+            result.complete++;
+            result.doneMs.push_back(receiver.doneMs);
+        }
+        result.recovered += receiver.source->getGroupsRecovered();
+        result.fetched += receiver.source->getGroupsFetched();
+        result.unicast += receiver.source->isUnicast() ? 1 : 0;
+        receiver.source->close();
+    }
+    result.fallbackBytes = server.bytesSent() - servedBefore;
+    result.packetsSent = sender.packetsSent();
+    return result;
+}
+
+int main(int argc, char** argv) {
+    Bench::Args args(argc, argv);
+    size_t size = (size_t)args.get("kb", 1024) * 1024;
+    uint32_t rate = (uint32_t)(args.get("rate-kb", 1024) * 1024);
+    double loss = args.get("loss", 0.01);
+    uint16_t block = (uint16_t)args.get("block", 1024);
+    uint8_t k = (uint8_t)args.get("k", 8);
+
+    Bytes image = Fixtures::makeImage(size);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    server.route("/fw.bin", route);
+    std::string url = server.url("/fw.bin");
+
+    Bench::section("Stream");
+    Bench::report("image", size / 1024.0, "KB");
+    Bench::report("send rate", rate / 1024.0, "KB/s");
+    Bench::report("loss per receiver", loss * 100, "%");
+    Bench::report("block x data blocks per group", block * k, "bytes");
+
+    bool ok = true;
+    std::stringstream list(args.text("receivers", "1,10,100,500"));
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        size_t count = (size_t)atoi(item.c_str());
+        if (count == 0) continue;
+        Result result = run(image, server, url, count, rate, loss, block, k);
+        double unicastBytes = (double)count * size;
+
+        char title[64];
+        snprintf(title, sizeof(title), "%u receivers", (unsigned)count);
+        Bench::section(title);
+        Bench::report("receivers with the exact image", result.complete, "");
+        Bench::report("completion time, mean", result.doneMs.empty() ? 0 :
+                      std::accumulate(result.doneMs.begin(), result.doneMs.end(), 0.0) / result.doneMs.size(), "ms");
+        Bench::report("completion time, p95", Bench::percentile(result.doneMs, 0.95), "ms");
+        Bench::report("completion time, max", Bench::percentile(result.doneMs, 1.0), "ms");
+        Bench::report("groups rebuilt from parity", result.recovered, "");
+        Bench::report("groups fetched by range", result.fetched, "");
+        Bench::report("receivers that fell back to unicast", result.unicast, "");
+        Bench::report("packets multicast", result.packetsSent, "");
+        Bench::report("fallback bytes", result.fallbackBytes / 1024.0, "KB");
+        Bench::report("fallback share of unicast bytes", result.fallbackBytes * 100.0 / unicastBytes, "%");
+
+        if (result.complete != count) {
+            fprintf(stderr, "%u of %u receivers got the exact image\n", result.complete, (unsigned)count);
+            ok = false;
+        }
+        if (result.fallbackBytes >= unicastBytes * 0.2) {
+            fprintf(stderr, "fallback carried %.1f%% of the unicast bytes at %u receivers\n",
+                    result.fallbackBytes * 100.0 / unicastBytes, (unsigned)count);
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
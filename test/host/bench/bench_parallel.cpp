@@ -0,0 +1,105 @@
+/**
+ * bench_parallel.cpp - Parallel ranged download against one stream on a long link
+ *
+ * The test server models a high-latency link: every request waits one
+ * round trip for its headers, every connection one more for the
+ * handshake, and every response body is paced to window / RTT, the
+ * most one TCP stream can carry. A link cap shared by all connections
+ * bounds the total. The same image is installed with OTAHttpSource and
+ * with OTAParallelHttpSource at 2..OTA_PARALLEL_MAX connections. The
+ * default window is lwIP's default TCP_WND on the ESP32.
+ * Fails if the most connections are not faster than one stream.
+ *
+ *   bench_parallel [--kb 1024] [--rtt-ms 600] [--window-kb 5.6] [--link-kbps 1024]
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <esp_ota_ops.h>
+
+#include "Bench.h"
+#include "Fixtures.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+struct Result {
+    double downloadMs;
+    uint32_t connections;   // Opened by the download, the probe included
+};
+
+static Result install(const TestServer& server, const std::string& url, const Bytes& image, uint8_t connections) {
+    HostSim::resetFlash();
+    uint32_t opened = server.connections();
+
+    ESP32_AutoOTA ota;
+    OTAUpdateSource* source;
+    if (connections > 1) {
+        source = new OTAParallelHttpSource(url.c_str(), connections);
+    } else {
+        source = new OTAHttpSource(url.c_str());
+    }
+
+    uint64_t start = Bench::nowMicros();
+    bool ok = ota.updateFrom(*source);
+    Result result;
+    // The library waits a second before restarting
+    result.downloadMs = (Bench::nowMicros() - start) / 1000.0 - 1000.0;
+    result.connections = server.connections() - opened;
+    delete source;
+
+    if (!ok || memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) != 0) {
+        fprintf(stderr, "%u connection download failed: %s\n", connections, ota.getLastError());
+        exit(1);
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    Bench::Args args(argc, argv);
+    size_t size = (size_t)args.get("kb", 1024) * 1024;
+    uint32_t rttMs = (uint32_t)args.get("rtt-ms", 600);
+    double windowKb = args.get("window-kb", 5.6);
+    uint32_t streamRate = (uint32_t)(windowKb * 1024 * 1000 / rttMs);
+    HostSim::setBandwidth((uint32_t)(args.get("link-kbps", 1024) * 1024));
+    HostSim::setConnectLatency(rttMs);
+
+    Bytes image = Fixtures::makeImage(size);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    route.headerDelayMs = rttMs;
+    route.bytesPerSecond = streamRate;
+    server.route("/fw.bin", route);
+    std::string url = server.url("/fw.bin");
+
+    double mb = size / (1024.0 * 1024.0);
+    Bench::section("Link");
+    Bench::report("round trip", rttMs, "ms");
+    Bench::report("one stream at window / RTT", streamRate / 1024.0, "KB/s");
+    Bench::report("link cap", args.get("link-kbps", 1024), "KB/s");
+
+    Result single = install(server, url, image, 1);
+    Bench::section("One stream (OTAHttpSource)");
+    Bench::report("download time per MB", single.downloadMs / mb, "ms");
+    Bench::report("throughput", size / 1024.0 / (single.downloadMs / 1000.0), "KB/s");
+
+    Result widest = single;
+    for (uint8_t connections = 2; connections <= OTA_PARALLEL_MAX; connections++) {
+        Result parallel = install(server, url, image, connections);
+        char title[64];
+        snprintf(title, sizeof(title), "%u connections (OTAParallelHttpSource)", connections);
+        Bench::section(title);
+        Bench::report("connections opened, probe included", parallel.connections, "");
+        Bench::report("download time per MB", parallel.downloadMs / mb, "ms");
+        Bench::report("throughput", size / 1024.0 / (parallel.downloadMs / 1000.0), "KB/s");
+        Bench::report("speedup over one stream", single.downloadMs / parallel.downloadMs, "x");
+        widest = parallel;
+    }
+
+    if (widest.connections <= 2 || widest.downloadMs >= single.downloadMs) {
+        fprintf(stderr, "parallel download not faster than one stream\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * bench_pre_erase.cpp - Download time with and without background erase
+ *
+ * Downloads the same image over HTTP into the simulated flash, which
+ * charges erase and program latency, once into a partition that has to
+ * be erased on the way and once after the background eraser has cleared
+ * it. Also reports how busy the eraser keeps the flash at the default
+ * interval. Fails if the pre-erased download is not faster.
+ *
+ *   bench_pre_erase [--kb 1024] [--erase-us 35000] [--write-us-per-kb 350] [--bandwidth 0]
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+
+#include "Bench.h"
+#include "Fixtures.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+struct Result {
+    double downloadMs;
+    uint32_t erasesDuringDownload;
+};
+
+static Result download(const std::string& url, size_t size, bool preErase, uint32_t eraseUs) {
+    HostSim::resetFlash();
+    HostSim::clearPreferences();
+
+    ESP32_AutoOTA ota;
+    ota.setFirmwareURL(url.c_str());
+    ota.setVersionURL(url.c_str());
+    ota.setRandomDelay(3600000, 3600000);
+    ota.setDirectFlashWrite(true);
+    if (preErase) {
+        ota.setBackgroundErase(true, size, 1);
+        ota.beginPolled();
+        uint32_t sectors = (size + OTA_SECTOR_SIZE - 1) / OTA_SECTOR_SIZE;
+        while (HostSim::flashCounters().sectorErases < sectors) {
+            ota.poll();
+        }
+        ota.stop();
+    }
+
+    HostSim::resetFlashCounters();
+    OTAHttpSource source(url.c_str());
+    uint64_t start = Bench::nowMicros();
+    bool ok = ota.updateFrom(source);
+    Result result;
+    // The library waits a second before restarting
+    result.downloadMs = (Bench::nowMicros() - start) / 1000.0 - 1000.0;
+    result.erasesDuringDownload = HostSim::flashCounters().sectorErases;
+    if (!ok) {
+        fprintf(stderr, "download failed: %s\n", ota.getLastError());
+        exit(1);
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    Bench::Args args(argc, argv);
+    size_t size = (size_t)args.get("kb", 1024) * 1024;
+    uint32_t eraseUs = (uint32_t)args.get("erase-us", 35000);
+    HostSim::setFlashLatency(eraseUs, (uint32_t)args.get("write-us-per-kb", 350));
+    HostSim::setBandwidth((uint32_t)args.get("bandwidth", 0));
+
+    Bytes image = Fixtures::makeImage(size);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    server.route("/fw.bin", route);
+    std::string url = server.url("/fw.bin");
+
+    Result plain = download(url, size, false, eraseUs);
+    Result erased = download(url, size, true, eraseUs);
+    double mb = size / (1024.0 * 1024.0);
+
+    Bench::section("Download into a partition erased on the way");
+    Bench::report("download time per MB", plain.downloadMs / mb, "ms");
+    Bench::report("sector erases during download", plain.erasesDuringDownload, "");
+    Bench::section("Download into a pre-erased partition");
+    Bench::report("download time per MB", erased.downloadMs / mb, "ms");
+    Bench::report("sector erases during download", erased.erasesDuringDownload, "");
+    Bench::report("time saved", 100.0 * (1 - erased.downloadMs / plain.downloadMs), "%");
+    Bench::section("Background eraser at the default interval");
+    Bench::report("flash busy", 100.0 * eraseUs / 1000.0 / OTA_ERASE_INTERVAL_MS, "%");
+    Bench::report("time to erase 1.5 MB", 1536 / 4 * (double)OTA_ERASE_INTERVAL_MS / 60000.0, "min");
+
+    if (erased.erasesDuringDownload != 0 || erased.downloadMs >= plain.downloadMs) {
+        fprintf(stderr, "pre-erased download not faster\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * bench_skip_unchanged.cpp - Skip-unchanged writes between consecutive builds
+ *
+ * The inactive partition holds the previous build; the next build is
+ * installed from a file (OTAFileSource), once with plain partition
+ * writes and once with setSkipUnchangedSectors(). Reports sectors
+ * skipped, erases and write time for each.
+ *
+ * Pass two real consecutive build outputs with --old and --new. Without
+ * them, generated builds are written to files first: a release with a
+ * few sectors changed in place, and one where code inserted part way
+ * moves everything after it. Fails if skipping ever erases more.
+ *
+ *   bench_skip_unchanged [--old firmware-1.bin --new firmware-2.bin] [--kb 1024]
+ *                        [--erase-us 35000] [--write-us-per-kb 350]
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <esp_app_format.h>
+
+#include "Bench.h"
+#include "Fixtures.h"
+
+using Fixtures::Bytes;
+
+struct Result {
+    uint32_t skipped;
+    uint32_t erases;
+    uint64_t bytesWritten;
+    double writeMs;
+};
+
+static Result install(const std::string& root, const Bytes& previous, bool skip) {
+    HostSim::resetFlash();
+    HostSim::flashImage(HostSim::app1(), previous.data(), previous.size());
+    HostSim::resetFlashCounters();
+
+    fs::FS storage = HostSim::hostFS(root.c_str());
+    OTAFileSource source(storage, "/new.bin");
+    ESP32_AutoOTA ota;
+    if (skip) {
+        ota.setSkipUnchangedSectors(true);
+    } else {
+        ota.setDirectFlashWrite(true);
+    }
+    if (!ota.updateFrom(source)) {
+        fprintf(stderr, "install failed: %s\n", ota.getLastError());
+        exit(1);
+    }
+
+    OTAStats stats = ota.getStats();
+    Result result;
+    result.skipped = stats.flashSectorsSkipped;
+    result.erases = HostSim::flashCounters().sectorErases;
+    result.bytesWritten = HostSim::flashCounters().bytesWritten;
+    result.writeMs = stats.flashWriteMs;
+    return result;
+}
+
+static bool compare(const char* title, const Bytes& previous, const Bytes& next) {
+    std::string root = Fixtures::tempDir("skip");
+    if (!Fixtures::writeFile(root + "/new.bin", next)) {
+        fprintf(stderr, "cannot write %s/new.bin\n", root.c_str());
+        exit(1);
+    }
+    Result plain = install(root, previous, false);
+    Result skip = install(root, previous, true);
+
+    uint32_t sectors = (next.size() + OTA_SECTOR_SIZE - 1) / OTA_SECTOR_SIZE;
+    Bench::section(title);
+    Bench::report("sectors in the image", sectors, "");
+    Bench::report("sectors skipped", skip.skipped, "");
+    Bench::report("sector erases, plain", plain.erases, "");
+    Bench::report("sector erases, skipping", skip.erases, "");
+    Bench::report("bytes programmed, plain", plain.bytesWritten, "B");
+    Bench::report("bytes programmed, skipping", skip.bytesWritten, "B");
+    Bench::report("flash write time, plain", plain.writeMs, "ms");
+    Bench::report("flash write time, skipping", skip.writeMs, "ms");
+    return skip.erases <= plain.erases;
+}
+
+int main(int argc, char** argv) {
+    Bench::Args args(argc, argv);
+    HostSim::setFlashLatency((uint32_t)args.get("erase-us", 35000), (uint32_t)args.get("write-us-per-kb", 350));
+    HostSim::setSerialEcho(false);
+
+    const char* oldPath = args.text("old", NULL);
+    const char* newPath = args.text("new", NULL);
+    if (oldPath != NULL && newPath != NULL) {
+        Bytes previous = Fixtures::readFile(oldPath);
+        Bytes next = Fixtures::readFile(newPath);
+        if (previous.empty() || next.empty()) {
+            fprintf(stderr, "cannot read %s or %s\n", oldPath, newPath);
+            return 1;
+        }
+        // Real builds carry their own project name
+        const esp_app_desc_t* desc = (const esp_app_desc_t*)(next.data() + sizeof(esp_image_header_t) +
+                                                               sizeof(esp_image_segment_header_t));
+        HostSim::setRunningApp("0", desc->project_name);
+        return compare("Builds from --old and --new", previous, next) ? 0 : 1;
+    }
+
+    size_t size = (size_t)args.get("kb", 1024) * 1024;
+    Bytes previous = Fixtures::makeImage(size, "1.0.0");
+    bool ok = compare("Patch release, 4 sectors changed in place", previous,
+                      Fixtures::nextBuild(previous, "1.0.1", 4));
+    ok &= compare("Feature release, 2 KB of code inserted at 60%", previous,
+                  Fixtures::nextBuild(previous, "1.1.0", 4, size * 6 / 10, 2048));
+    ok &= compare("Unrelated image", previous, Fixtures::makeImage(size, "2.0.0", "host_app", 9));
+    return ok ? 0 : 1;
+}
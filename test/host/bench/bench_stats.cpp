@@ -0,0 +1,72 @@
+/**
+ * bench_stats.cpp - Cost of statistics updates and snapshots
+ *
+ * Times the sequence-locked counter update the library makes on every
+ * check and download step, and getStats()-sized snapshots, with and
+ * without a concurrent reader. Fails if an update costs 1 µs or more.
+ *
+ *   bench_stats [--iterations 10000000]
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <OTASeqlock.h>
+
+#include <thread>
+
+#include "Bench.h"
+
+int main(int argc, char** argv) {
+    Bench::Args args(argc, argv);
+    uint64_t iterations = (uint64_t)args.get("iterations", 10000000);
+
+    OTASeqlock lock;
+    OTAStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    auto updates = [&](uint64_t count) {
+        uint64_t start = Bench::nowMicros();
+        for (uint64_t i = 0; i < count; i++) {
+            lock.writeBegin();
+            stats.checkCount++;
+            stats.bytesTransferred += 512;
+            lock.writeEnd();
+        }
+        return (double)(Bench::nowMicros() - start) * 1000.0 / count;
+    };
+
+    Bench::section("OTAStats counter update (writeBegin, two fields, writeEnd)");
+    double uncontended = updates(iterations);
+    Bench::report("uncontended", uncontended, "ns/update");
+
+    std::atomic<bool> running(true);
+    std::atomic<uint64_t> snapshots(0);
+    std::thread reader([&]() {
+        OTAStats copy;
+        while (running) {
+            lock.read(&copy, &stats, sizeof(copy));
+            snapshots++;
+        }
+    });
+    double contended = updates(iterations);
+    running = false;
+    reader.join();
+    Bench::report("with a reader in a loop", contended, "ns/update");
+
+    Bench::section("getStats() snapshot");
+    uint64_t start = Bench::nowMicros();
+    uint64_t reads = iterations / 10;
+    OTAStats copy;
+    volatile uint32_t sink = 0;
+    for (uint64_t i = 0; i < reads; i++) {
+        lock.read(&copy, &stats, sizeof(copy));
+        sink = sink + copy.checkCount;
+    }
+    Bench::report("uncontended", (double)(Bench::nowMicros() - start) * 1000.0 / reads, "ns/snapshot");
+    Bench::report("struct size", sizeof(OTAStats), "bytes");
+
+    if (uncontended >= 1000 || contended >= 1000) {
+        printf("FAIL: counter update costs 1 us or more\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+/**
+ * bench_trace.cpp - Logging overhead: binary trace vs text logging
+ *
+ * Times OTATrace::record() against formatting the same event as a log
+ * line with Serial.printf(). On the host Serial only captures text, so
+ * the time a 115200 baud UART needs for the line is reported next to
+ * it: that is what a blocking log call costs on the device once the
+ * UART FIFO is full.
+ *
+ *   bench_trace [--iterations 2000000]
+ */
+
+#include <HostSim.h>
+#include <OTATrace.h>
+
+#include "Bench.h"
+
+class NullPrint : public Print {
+public:
+    size_t write(uint8_t c) override {
+        (void)c;
+        return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        (void)buffer;
+        return size;
+    }
+};
+
+int main(int argc, char** argv) {
+    Bench::Args args(argc, argv);
+    uint64_t iterations = (uint64_t)args.get("iterations", 2000000);
+
+    HostSim::setSerialEcho(false);
+    OTATrace::begin();
+
+    Bench::section("OTATrace::record()");
+    uint64_t start = Bench::nowMicros();
+    for (uint64_t i = 0; i < iterations; i++) {
+        OTATrace::record(OTA_EVT_DOWNLOAD_PROGRESS, 0, (uint32_t)i);
+    }
+    double recordNs = (double)(Bench::nowMicros() - start) * 1000.0 / iterations;
+    Bench::report("record", recordNs, "ns/event");
+    Bench::report("record size", sizeof(OTATraceRecord), "bytes");
+
+    NullPrint sink;
+    uint64_t dumps = iterations / 1000 + 1;
+    start = Bench::nowMicros();
+    for (uint64_t i = 0; i < dumps; i++) {
+        OTATrace::dump(sink);
+    }
+    Bench::report("dump of a full buffer", (double)(Bench::nowMicros() - start) / dumps, "us");
+
+    Bench::section("Serial.printf() of the same event");
+    uint64_t lines = iterations / 10;
+    size_t bytes = 0;
+    start = Bench::nowMicros();
+    for (uint64_t i = 0; i < lines; i++) {
+        bytes += Serial.printf("[AutoOTA] Progress: %u bytes\n", (unsigned)i);
+        if ((i & 0x3FF) == 0) HostSim::clearSerialOutput();
+    }
+    double printfNs = (double)(Bench::nowMicros() - start) * 1000.0 / lines;
+    double lineBytes = (double)bytes / lines;
+    Bench::report("format and buffer (host)", printfNs, "ns/line");
+    Bench::report("line length", lineBytes, "bytes");
+    Bench::report("UART time at 115200 baud", lineBytes * 10 / 115200 * 1e6, "us/line");
+    Bench::report("UART line / trace record", lineBytes * 10 / 115200 * 1e9 / recordNs, "x");
+    return 0;
+}
@@ -0,0 +1,89 @@
+# Print the flash and RAM the library adds to a linked application, and
+# the RAM each ESP32_AutoOTA instance takes, for each build variant,
+# against the first variant.
+#
+#   cmake -DVARIANTS="label=library,linker map,probe|..." -P SizeReport.cmake
+#
+# Sizes are summed over the input sections from the library that the
+# linker kept (the probe is linked with --gc-sections): code and
+# read-only data count as flash, initialised and zeroed data as RAM.
+# The instance size is printed by the probe itself. These are host
+# compiler numbers (64-bit pointers, where the ESP32 has 32-bit ones),
+# so compare variants rather than reading them as ESP32 sizes.
+
+function(linked_size library map out_flash out_ram)
+    get_filename_component(archive ${library} NAME)
+    file(STRINGS ${map} lines)
+    set(flash 0)
+    set(ram 0)
+    set(kept FALSE)
+    set(section "")
+    foreach(line IN LISTS lines)
+        if(NOT kept)
+            if(line MATCHES "^Linker script and memory map")
+                set(kept TRUE)
+            endif()
+            continue()
+        endif()
+
+        # An input section is named on its own line or followed by
+        # address, size and the object it came from
+        set(bytes "")
+        if(line MATCHES "^ ([._A-Za-z][^ ]*)$")
+            set(section ${CMAKE_MATCH_1})
+        elseif(line MATCHES "^ ([._A-Za-z][^ ]*) +0x[0-9a-f]+ +0x([0-9a-f]+) (.+)$")
+            set(section ${CMAKE_MATCH_1})
+            set(bytes ${CMAKE_MATCH_2})
+            set(object "${CMAKE_MATCH_3}")
+        elseif(line MATCHES "^ +0x[0-9a-f]+ +0x([0-9a-f]+) (.+)$")
+            set(bytes ${CMAKE_MATCH_1})
+            set(object "${CMAKE_MATCH_2}")
+        endif()
+        if(bytes STREQUAL "")
+            continue()
+        endif()
+        string(FIND "${object}" "${archive}(" position)
+        if(position LESS 0)
+            continue()
+        endif()
+
+        math(EXPR bytes "0x${bytes}")
+        if(section MATCHES "^\\.(text|rodata)")
+            math(EXPR flash "${flash} + ${bytes}")
+        elseif(section MATCHES "^(\\.data|\\.bss|COMMON|rtc_noinit)")
+            math(EXPR ram "${ram} + ${bytes}")
+        endif()
+    endforeach()
+    set(${out_flash} ${flash} PARENT_SCOPE)
+    set(${out_ram} ${ram} PARENT_SCOPE)
+endfunction()
+
+set(baseline_flash "")
+string(REPLACE "|" ";" VARIANTS "${VARIANTS}")
+foreach(variant IN LISTS VARIANTS)
+    string(REGEX MATCH "^(.+)=([^=,]+),([^=,]+),([^=,]+)$" parsed "${variant}")
+    set(label ${CMAKE_MATCH_1})
+    set(probe ${CMAKE_MATCH_4})
+    linked_size(${CMAKE_MATCH_2} ${CMAKE_MATCH_3} flash ram)
+    execute_process(COMMAND ${probe} --instance-size OUTPUT_VARIABLE instance
+                    OUTPUT_STRIP_TRAILING_WHITESPACE RESULT_VARIABLE failed)
+    if(failed OR NOT instance MATCHES "^[0-9]+$")
+        message(FATAL_ERROR "${probe} did not print its instance size")
+    endif()
+    if(baseline_flash STREQUAL "")
+        set(baseline_flash ${flash})
+        set(baseline_ram ${ram})
+        set(baseline_instance ${instance})
+        message("variant                                     flash      RAM      instance")
+    endif()
+    math(EXPR flash_delta "${flash} - ${baseline_flash}")
+    math(EXPR ram_delta "${ram} - ${baseline_ram}")
+    math(EXPR instance_delta "${instance} - ${baseline_instance}")
+    string(LENGTH "${label}" length)
+    math(EXPR padding "40 - ${length}")
+    if(padding LESS 1)
+        set(padding 1)
+    endif()
+    string(REPEAT " " ${padding} pad)
+    message("${label}${pad}${flash} (${flash_delta})  ${ram} (${ram_delta})  ${instance} (${instance_delta})")
+endforeach()
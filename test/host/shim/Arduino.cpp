@@ -0,0 +1,312 @@
+/**
+ * Arduino.cpp (host shim)
+ *
+ * Core runtime: time, String, Print/Stream, Serial, IPAddress and the
+ * ESP class.
+ */
+
+#include <Arduino.h>
+#include "HostSim.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+
+// ========== Time ==========
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+    return (unsigned long)(uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros() {
+    return (unsigned long)(uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(uint32_t ms) {
+    vTaskDelay(ms);
+}
+
+void delayMicroseconds(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+// ========== GPIO ==========
+
+static uint8_t pinLevels[64];
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    if (pin < sizeof(pinLevels)) pinLevels[pin] = val;
+}
+
+int digitalRead(uint8_t pin) {
+    return pin < sizeof(pinLevels) ? pinLevels[pin] : LOW;
+}
+
+// ========== Random ==========
+
+static std::mutex randomLock;
+static std::mt19937 randomEngine(std::random_device{}());
+
+uint32_t esp_random(void) {
+    std::lock_guard<std::mutex> guard(randomLock);
+    return (uint32_t)randomEngine();
+}
+
+void randomSeed(unsigned long seed) {
+    std::lock_guard<std::mutex> guard(randomLock);
+    if (seed != 0) randomEngine.seed((uint32_t)seed);
+}
+
+long random(long howbig) {
+    if (howbig <= 0) return 0;
+    return esp_random() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+    if (howsmall >= howbig) return howsmall;
+    return random(howbig - howsmall) + howsmall;
+}
+
+// ========== String ==========
+
+std::string String::format(unsigned long value, unsigned char base) {
+    if (base < 2 || base > 36) base = 10;
+    char buffer[72];
+    char* p = buffer + sizeof(buffer) - 1;
+    *p = '\0';
+    do {
+        unsigned digit = value % base;
+        *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        value /= base;
+    } while (value != 0);
+    return std::string(p);
+}
+
+std::string String::format(long value, unsigned char base) {
+    if (value < 0 && base == 10) {
+        return "-" + format((unsigned long)(-(value + 1)) + 1, base);
+    }
+    return format((unsigned long)value, base);
+}
+
+// ========== Print / Stream ==========
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        if (write(*buffer++) == 0) break;
+        n++;
+    }
+    return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    if ((size_t)len < sizeof(buffer)) {
+        return write((const uint8_t*)buffer, len);
+    }
+    std::string big(len + 1, '\0');
+    va_start(args, format);
+    vsnprintf(&big[0], big.size(), format, args);
+    va_end(args);
+    return write((const uint8_t*)big.data(), len);
+}
+
+int Stream::timedRead() {
+    unsigned long start = millis();
+    do {
+        int c = read();
+        if (c >= 0) return c;
+        delay(1);
+    } while (millis() - start < _timeout);
+    return -1;
+}
+
+size_t Stream::readBytes(char* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+        int c = timedRead();
+        if (c < 0) break;
+        buffer[count++] = (char)c;
+    }
+    return count;
+}
+
+String Stream::readString() {
+    std::string result;
+    int c;
+    while ((c = timedRead()) >= 0) result += (char)c;
+    return String(result);
+}
+
+String Stream::readStringUntil(char terminator) {
+    std::string result;
+    int c;
+    while ((c = timedRead()) >= 0 && c != terminator) result += (char)c;
+    return String(result);
+}
+
+// ========== Serial ==========
+
+HardwareSerial Serial;
+
+static std::mutex serialLock;
+static std::string serialCapture;
+static bool serialEcho = true;
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    std::lock_guard<std::mutex> guard(serialLock);
+    serialCapture.append((const char*)buffer, size);
+    if (serialEcho) {
+        fwrite(buffer, 1, size, stdout);
+        fflush(stdout);
+    }
+    return size;
+}
+
+void HostSim::setSerialEcho(bool echo) {
+    std::lock_guard<std::mutex> guard(serialLock);
+    serialEcho = echo;
+}
+
+std::string HostSim::serialOutput() {
+    std::lock_guard<std::mutex> guard(serialLock);
+    return serialCapture;
+}
+
+void HostSim::clearSerialOutput() {
+    std::lock_guard<std::mutex> guard(serialLock);
+    serialCapture.clear();
+}
+
+// ========== IPAddress ==========
+
+String IPAddress::toString() const {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(buffer);
+}
+
+bool IPAddress::fromString(const char* address) {
+    unsigned a, b, c, d;
+    char tail;
+    if (address == NULL || sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4) {
+        return false;
+    }
+    if (a > 255 || b > 255 || c > 255 || d > 255) {
+        return false;
+    }
+    *this = IPAddress(a, b, c, d);
+    return true;
+}
+
+// ========== ESP ==========
+
+EspClass ESP;
+
+static std::atomic<uint32_t> restarts(0);
+static std::atomic<uint32_t> freeHeap(200000);
+static std::atomic<uint32_t> minFreeHeap(200000);
+static esp_reset_reason_t resetReason = ESP_RST_POWERON;
+
+void EspClass::restart() {
+    restarts++;
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return freeHeap;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    return minFreeHeap;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    return freeHeap / 2;
+}
+
+uint32_t EspClass::getHeapSize() {
+    return 320 * 1024;
+}
+
+uint32_t EspClass::getCycleCount() {
+    return (uint32_t)(micros() * 240);
+}
+
+const char* EspClass::getSdkVersion() {
+    return "host";
+}
+
+void esp_restart(void) {
+    ESP.restart();
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return resetReason;
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_OTA_VALIDATE_FAILED: return "ESP_ERR_OTA_VALIDATE_FAILED";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+// Bounds of the rtc_noinit section, provided by the linker when it exists
+extern "C" uint8_t __start_rtc_noinit[] __attribute__((weak));
+extern "C" uint8_t __stop_rtc_noinit[] __attribute__((weak));
+
+void HostSim::fillRtcMemory(uint8_t value) {
+    uint8_t* start = __start_rtc_noinit;
+    uint8_t* stop = __stop_rtc_noinit;
+    if (start != NULL && stop > start) {
+        memset(start, value, stop - start);
+    }
+}
+
+uint32_t HostSim::restartCount() {
+    return restarts;
+}
+
+void HostSim::setFreeHeap(uint32_t bytes) {
+    freeHeap = bytes;
+    if (bytes < minFreeHeap) minFreeHeap = bytes;
+}
+
+void HostSim::setResetReason(esp_reset_reason_t reason) {
+    resetReason = reason;
+}
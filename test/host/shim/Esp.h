@@ -0,0 +1,24 @@
+/**
+ * Esp.h (host shim)
+ */
+
+#ifndef HOST_ESP_H
+#define HOST_ESP_H
+
+#include <stdint.h>
+
+class EspClass {
+public:
+    /** Counts the restart (HostSim::restartCount()) and returns */
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    uint32_t getHeapSize();
+    uint32_t getCycleCount();
+    const char* getSdkVersion();
+};
+
+extern EspClass ESP;
+
+#endif // HOST_ESP_H
@@ -0,0 +1,71 @@
+/**
+ * FS.h (host shim)
+ *
+ * fs::FS rooted in a host directory (see HostSim::hostFS()). Paths
+ * are absolute within the root, as on SPIFFS/LittleFS.
+ */
+
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+class File : public Stream {
+public:
+    File() {}
+    File(FILE* file, const std::string& path);
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t read(uint8_t* buffer, size_t size);
+    size_t readBytes(char* buffer, size_t length) override;
+    void flush() override;
+
+    bool seek(uint32_t pos);
+    size_t position() const;
+    size_t size() const;
+    void close();
+    const char* path() const { return _path.c_str(); }
+    operator bool() const { return _file != nullptr; }
+
+private:
+    std::shared_ptr<FILE> _file;
+    std::string _path;
+};
+
+class FS {
+public:
+    FS() {}
+    explicit FS(const std::string& root) : _root(root) {}
+
+    File open(const char* path, const char* mode = FILE_READ, bool create = false);
+    bool exists(const char* path);
+    bool remove(const char* path);
+    bool rename(const char* from, const char* to);
+    bool mkdir(const char* path);
+    bool rmdir(const char* path);
+
+private:
+    std::string _root;
+
+    std::string hostPath(const char* path) const;
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+
+#endif // HOST_FS_H
@@ -0,0 +1,386 @@
+/**
+ * Flash.cpp (host shim)
+ *
+ * Simulated SPI flash, the ESP-IDF partition and OTA APIs on top of
+ * it, and the Arduino Update class.
+ */
+
+#include <Arduino.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <esp_idf_version.h>
+#include "HostSim.h"
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define FLASH_SIZE (4 * 1024 * 1024)
+#define SECTOR_SIZE 4096
+
+static esp_partition_t partitions[2] = {
+    {NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, 0x140000, SECTOR_SIZE, "app0", false},
+    {NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x150000, 0x140000, SECTOR_SIZE, "app1", false},
+};
+
+static std::mutex flashLock;
+static std::vector<uint8_t> flash(FLASH_SIZE, 0xFF);
+static HostSim::FlashCounters counters;
+static uint32_t eraseMicros = 0;
+static uint32_t writeMicrosPerKB = 0;
+static uint32_t readMicrosPerKB = 0;
+
+static const esp_partition_t* runningPartition = &partitions[0];
+static const esp_partition_t* bootPartition = &partitions[0];
+static esp_ota_img_states_t runningState = ESP_OTA_IMG_VALID;
+static esp_app_desc_t runningApp;
+
+// Flash operations stall the caller, as they do on the chip
+static void flashBusy(uint64_t micros) {
+    if (micros == 0) return;
+    counters.busyMicros += micros;
+    std::this_thread::sleep_for(std::chrono::microseconds(micros));
+}
+
+static bool inRange(const esp_partition_t* partition, size_t offset, size_t size) {
+    return partition != NULL && offset <= partition->size && size <= partition->size - offset;
+}
+
+// ========== esp_partition ==========
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+    if (!inRange(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+    std::lock_guard<std::mutex> guard(flashLock);
+    memcpy(dst, &flash[partition->address + offset], size);
+    counters.readCalls++;
+    counters.bytesRead += size;
+    flashBusy((uint64_t)size * readMicrosPerKB / 1024);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size) {
+    if (!inRange(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+    std::lock_guard<std::mutex> guard(flashLock);
+    uint8_t* target = &flash[partition->address + offset];
+    const uint8_t* data = (const uint8_t*)src;
+    bool dirty = false;
+    for (size_t i = 0; i < size; i++) {
+        // NOR flash can only clear bits; setting one needs an erase first
+        if ((target[i] & data[i]) != data[i]) dirty = true;
+        target[i] &= data[i];
+    }
+    if (dirty) counters.dirtyWrites++;
+    counters.writeCalls++;
+    counters.bytesWritten += size;
+    flashBusy((uint64_t)size * writeMicrosPerKB / 1024);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    if (!inRange(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+    if (offset % SECTOR_SIZE != 0 || size % SECTOR_SIZE != 0) return ESP_ERR_INVALID_SIZE;
+    std::lock_guard<std::mutex> guard(flashLock);
+    memset(&flash[partition->address + offset], 0xFF, size);
+    counters.sectorErases += size / SECTOR_SIZE;
+    flashBusy((uint64_t)(size / SECTOR_SIZE) * eraseMicros);
+    return ESP_OK;
+}
+
+// ========== esp_ota ==========
+
+const esp_partition_t* esp_ota_get_running_partition(void) {
+    return runningPartition;
+}
+
+const esp_partition_t* esp_ota_get_boot_partition(void) {
+    return bootPartition;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+    if (start_from == NULL) start_from = runningPartition;
+    return start_from == &partitions[0] ? &partitions[1] : &partitions[0];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    if (partition != &partitions[0] && partition != &partitions[1]) return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> guard(flashLock);
+    if (flash[partition->address] != ESP_IMAGE_HEADER_MAGIC) return ESP_ERR_OTA_VALIDATE_FAILED;
+    bootPartition = partition;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_partition_description(const esp_partition_t* partition, esp_app_desc_t* app_desc) {
+    if (partition == NULL || app_desc == NULL) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = esp_partition_read(partition, sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t),
+                                       app_desc, sizeof(esp_app_desc_t));
+    if (err != ESP_OK) return err;
+    return app_desc->magic_word == ESP_APP_DESC_MAGIC_WORD ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* ota_state) {
+    if (partition == NULL || ota_state == NULL) return ESP_ERR_INVALID_ARG;
+    *ota_state = partition == runningPartition ? runningState : ESP_OTA_IMG_UNDEFINED;
+    return ESP_OK;
+}
+
+// As on the chip: another app partition holds a valid image to go back to
+bool esp_ota_check_rollback_is_possible(void) {
+    for (const esp_partition_t& partition : partitions) {
+        esp_app_desc_t desc;
+        if (&partition != runningPartition && esp_ota_get_partition_description(&partition, &desc) == ESP_OK) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void) {
+    runningState = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+static void initRunningApp() {
+    if (runningApp.magic_word == ESP_APP_DESC_MAGIC_WORD) return;
+    runningApp.magic_word = ESP_APP_DESC_MAGIC_WORD;
+    strncpy(runningApp.version, "1.0.0", sizeof(runningApp.version) - 1);
+    strncpy(runningApp.project_name, "host_app", sizeof(runningApp.project_name) - 1);
+    strncpy(runningApp.idf_ver, "host", sizeof(runningApp.idf_ver) - 1);
+}
+
+const esp_app_desc_t* esp_ota_get_app_description(void) {
+    initRunningApp();
+    return &runningApp;
+}
+
+const esp_app_desc_t* esp_app_get_description(void) {
+    initRunningApp();
+    return &runningApp;
+}
+
+// ========== Update ==========
+
+UpdateClass Update;
+
+static uint32_t updateCallMicros = 0;
+static HostSim::UpdateCounters updateStats;
+
+UpdateClass::UpdateClass() {
+    _partition = NULL;
+    _error = UPDATE_ERROR_OK;
+    reset();
+}
+
+void UpdateClass::reset() {
+    _bufferLen = 0;
+    _size = 0;
+    _progress = 0;
+    _skipByte = 0xFF;
+}
+
+bool UpdateClass::begin(size_t size, int command, int ledPin, uint8_t ledOn, const char* label) {
+    (void)ledPin;
+    (void)ledOn;
+    (void)label;
+    if (_size > 0) {
+        return false;   // Already running
+    }
+    _error = UPDATE_ERROR_OK;
+    updateStats.begins++;
+
+    if (command != U_FLASH || size == 0) {
+        _error = UPDATE_ERROR_BAD_ARGUMENT;
+        return false;
+    }
+    _partition = esp_ota_get_next_update_partition(NULL);
+    if (_partition == NULL) {
+        _error = UPDATE_ERROR_NO_PARTITION;
+        return false;
+    }
+    if (size == UPDATE_SIZE_UNKNOWN) {
+        size = _partition->size;
+    } else if (size > _partition->size) {
+        _error = UPDATE_ERROR_SIZE;
+        return false;
+    }
+    _size = size;
+    _progress = 0;
+    _bufferLen = 0;
+    return true;
+}
+
+// Erase and program one buffered sector, holding back the magic byte
+bool UpdateClass::writeBuffer() {
+    if (_progress == 0) {
+        if (_buffer[0] != ESP_IMAGE_HEADER_MAGIC) {
+            _error = UPDATE_ERROR_MAGIC_BYTE;
+            return false;
+        }
+        _skipByte = _buffer[0];
+        _buffer[0] = 0xFF;
+    }
+    if (_progress % SECTOR_SIZE == 0 &&
+        esp_partition_erase_range(_partition, _progress, SECTOR_SIZE) != ESP_OK) {
+        _error = UPDATE_ERROR_ERASE;
+        return false;
+    }
+    if (esp_partition_write(_partition, _progress, _buffer, _bufferLen) != ESP_OK) {
+        _error = UPDATE_ERROR_WRITE;
+        return false;
+    }
+    _progress += _bufferLen;
+    _bufferLen = 0;
+    return true;
+}
+
+size_t UpdateClass::write(uint8_t* data, size_t len) {
+    updateStats.writeCalls++;
+    if (updateCallMicros > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(updateCallMicros));
+    }
+    if (hasError() || !isRunning()) return 0;
+    if (len > remaining()) {
+        _error = UPDATE_ERROR_SPACE;
+        return 0;
+    }
+
+    size_t left = len;
+    while (_bufferLen + left > SECTOR_SIZE) {
+        size_t toBuffer = SECTOR_SIZE - _bufferLen;
+        memcpy(_buffer + _bufferLen, data + (len - left), toBuffer);
+        _bufferLen += toBuffer;
+        if (!writeBuffer()) return len - left;
+        left -= toBuffer;
+    }
+    memcpy(_buffer + _bufferLen, data + (len - left), left);
+    _bufferLen += left;
+    if (_bufferLen == remaining() || _bufferLen == SECTOR_SIZE) {
+        if (!writeBuffer()) return len - left;
+    }
+    updateStats.bytesWritten += len;
+    return len;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+    if (hasError() || _size == 0) {
+        return false;
+    }
+    if (!isFinished() && !evenIfRemaining) {
+        _error = UPDATE_ERROR_ABORT;
+        reset();
+        return false;
+    }
+    if (evenIfRemaining) {
+        if (_bufferLen > 0) writeBuffer();
+        _size = _progress;
+    }
+
+    // Restore the magic byte, making the image bootable, then switch to it
+    if (esp_partition_write(_partition, 0, &_skipByte, 1) != ESP_OK ||
+        esp_ota_set_boot_partition(_partition) != ESP_OK) {
+        _error = UPDATE_ERROR_ACTIVATE;
+        reset();
+        return false;
+    }
+    // Like the core: state is cleared once the new image is activated
+    updateStats.ends++;
+    reset();
+    return true;
+}
+
+void UpdateClass::abort() {
+    updateStats.aborts++;
+    reset();
+    _error = UPDATE_ERROR_ABORT;
+}
+
+const char* UpdateClass::errorString() {
+    switch (_error) {
+        case UPDATE_ERROR_OK: return "No Error";
+        case UPDATE_ERROR_WRITE: return "Flash Write Failed";
+        case UPDATE_ERROR_ERASE: return "Flash Erase Failed";
+        case UPDATE_ERROR_SPACE: return "Not Enough Space";
+        case UPDATE_ERROR_SIZE: return "Bad Size Given";
+        case UPDATE_ERROR_MAGIC_BYTE: return "Wrong Magic Byte";
+        case UPDATE_ERROR_ACTIVATE: return "Could Not Activate The Firmware";
+        case UPDATE_ERROR_NO_PARTITION: return "Partition Could Not be Found";
+        case UPDATE_ERROR_BAD_ARGUMENT: return "Bad Argument";
+        case UPDATE_ERROR_ABORT: return "Aborted";
+        default: return "UNKNOWN";
+    }
+}
+
+// ========== HostSim ==========
+
+void HostSim::setFlashLatency(uint32_t eraseMicrosPerSector, uint32_t writePerKB, uint32_t readPerKB) {
+    std::lock_guard<std::mutex> guard(flashLock);
+    eraseMicros = eraseMicrosPerSector;
+    writeMicrosPerKB = writePerKB;
+    readMicrosPerKB = readPerKB;
+}
+
+void HostSim::resetFlash() {
+    std::lock_guard<std::mutex> guard(flashLock);
+    std::fill(flash.begin(), flash.end(), 0xFF);
+    memset(&counters, 0, sizeof(counters));
+    runningPartition = &partitions[0];
+    bootPartition = &partitions[0];
+    runningState = ESP_OTA_IMG_VALID;
+}
+
+HostSim::FlashCounters HostSim::flashCounters() {
+    std::lock_guard<std::mutex> guard(flashLock);
+    return counters;
+}
+
+void HostSim::resetFlashCounters() {
+    std::lock_guard<std::mutex> guard(flashLock);
+    memset(&counters, 0, sizeof(counters));
+}
+
+const uint8_t* HostSim::partitionData(const esp_partition_t* partition) {
+    return &flash[partition->address];
+}
+
+void HostSim::flashImage(const esp_partition_t* partition, const uint8_t* data, size_t len) {
+    std::lock_guard<std::mutex> guard(flashLock);
+    memset(&flash[partition->address], 0xFF, partition->size);
+    memcpy(&flash[partition->address], data, min(len, (size_t)partition->size));
+}
+
+const esp_partition_t* HostSim::app0() {
+    return &partitions[0];
+}
+
+const esp_partition_t* HostSim::app1() {
+    return &partitions[1];
+}
+
+void HostSim::bootNewImage() {
+    runningPartition = bootPartition;
+    runningState = ESP_OTA_IMG_VALID;
+}
+
+void HostSim::setRunningState(esp_ota_img_states_t state) {
+    runningState = state;
+}
+
+void HostSim::setRunningApp(const char* version, const char* project) {
+    initRunningApp();
+    memset(runningApp.version, 0, sizeof(runningApp.version));
+    memset(runningApp.project_name, 0, sizeof(runningApp.project_name));
+    strncpy(runningApp.version, version, sizeof(runningApp.version) - 1);
+    strncpy(runningApp.project_name, project, sizeof(runningApp.project_name) - 1);
+}
+
+void HostSim::setUpdateCallOverhead(uint32_t micros) {
+    updateCallMicros = micros;
+}
+
+HostSim::UpdateCounters HostSim::updateCounters() {
+    return updateStats;
+}
+
+void HostSim::resetUpdateCounters() {
+    memset(&updateStats, 0, sizeof(updateStats));
+}
@@ -0,0 +1,246 @@
+/**
+ * FreeRTOS.cpp (host shim)
+ *
+ * Tasks are detached pthreads. Each has a record holding its
+ * notification count and a deletion flag; blocking calls wait on the
+ * record's condition variable so a notification or vTaskDelete()
+ * wakes them immediately. Records are never freed, so a stale handle
+ * stays safe to notify, as it mostly is on the device.
+ */
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+
+struct TaskRecord {
+    std::mutex lock;
+    std::condition_variable wake;
+    uint32_t notifications = 0;
+    std::atomic<bool> deleted{false};
+    UBaseType_t priority = 1;
+    TaskFunction_t function = NULL;
+    void* parameter = NULL;
+    std::string name;
+};
+
+static thread_local TaskRecord* currentTask = NULL;
+
+static TaskRecord* self() {
+    if (currentTask == NULL) {
+        // Threads not started through xTaskCreate (main, test threads)
+        currentTask = new TaskRecord();
+        currentTask->name = "main";
+    }
+    return currentTask;
+}
+
+// A task deleted by another one exits at its next blocking call
+static void exitIfDeleted(TaskRecord* task) {
+    if (task->deleted) {
+        pthread_exit(NULL);
+    }
+}
+
+static void* taskEntry(void* arg) {
+    TaskRecord* task = (TaskRecord*)arg;
+    currentTask = task;
+    task->function(task->parameter);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth,
+                       void* parameter, UBaseType_t priority, TaskHandle_t* handle) {
+    (void)stackDepth;
+    TaskRecord* task = new TaskRecord();
+    task->function = function;
+    task->parameter = parameter;
+    task->priority = priority;
+    task->name = name != NULL ? name : "";
+
+    // Handle first: the task may use it before xTaskCreate returns on the device too
+    if (handle != NULL) *handle = task;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int err = pthread_create(&thread, &attr, taskEntry, task);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        if (handle != NULL) *handle = NULL;
+        delete task;
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth,
+                                   void* parameter, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core) {
+    (void)core;
+    return xTaskCreate(function, name, stackDepth, parameter, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    TaskRecord* task = (TaskRecord*)handle;
+    if (task == NULL || task == self()) {
+        pthread_exit(NULL);
+    }
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->deleted = true;
+    }
+    task->wake.notify_all();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    TaskRecord* task = self();
+    exitIfDeleted(task);
+    if (ticks == 0) {
+        std::this_thread::yield();
+        return;
+    }
+    std::unique_lock<std::mutex> guard(task->lock);
+    task->wake.wait_for(guard, std::chrono::milliseconds(ticks), [task] { return task->deleted.load(); });
+    guard.unlock();
+    exitIfDeleted(task);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return self();
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)millis();
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t handle) {
+    TaskRecord* task = handle != NULL ? (TaskRecord*)handle : self();
+    return task->priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle) {
+    (void)handle;
+    return 2048;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle) {
+    TaskRecord* task = (TaskRecord*)handle;
+    if (task == NULL) return pdFAIL;
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->notifications++;
+    }
+    task->wake.notify_all();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    TaskRecord* task = self();
+    exitIfDeleted(task);
+    std::unique_lock<std::mutex> guard(task->lock);
+    auto ready = [task] { return task->notifications > 0 || task->deleted.load(); };
+    if (ticks == portMAX_DELAY) {
+        task->wake.wait(guard, ready);
+    } else {
+        task->wake.wait_for(guard, std::chrono::milliseconds(ticks), ready);
+    }
+    if (task->deleted) {
+        guard.unlock();
+        pthread_exit(NULL);
+    }
+    uint32_t value = task->notifications;
+    if (value > 0) {
+        task->notifications = clearOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+// ========== Critical sections ==========
+
+static std::atomic<uint32_t> nextThreadId(1);
+static thread_local uint32_t threadId = 0;
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+    if (threadId == 0) threadId = nextThreadId++;
+    if (__atomic_load_n(&mux->owner, __ATOMIC_ACQUIRE) == threadId) {
+        mux->count++;
+        return;
+    }
+    uint32_t expected = 0;
+    while (!__atomic_compare_exchange_n(&mux->owner, &expected, threadId, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        expected = 0;
+        sched_yield();
+    }
+    mux->count = 1;
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+    if (--mux->count == 0) {
+        __atomic_store_n(&mux->owner, 0, __ATOMIC_RELEASE);
+    }
+}
+
+// ========== Semaphores ==========
+
+struct Semaphore {
+    std::mutex lock;
+    std::condition_variable available;
+    UBaseType_t count;
+    UBaseType_t maxCount;
+};
+
+static SemaphoreHandle_t createSemaphore(UBaseType_t maxCount, UBaseType_t initialCount) {
+    Semaphore* semaphore = new Semaphore();
+    semaphore->count = initialCount;
+    semaphore->maxCount = maxCount;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return createSemaphore(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return createSemaphore(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+    return createSemaphore(maxCount, initialCount);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks) {
+    Semaphore* semaphore = (Semaphore*)handle;
+    std::unique_lock<std::mutex> guard(semaphore->lock);
+    auto ready = [semaphore] { return semaphore->count > 0; };
+    if (ticks == portMAX_DELAY) {
+        semaphore->available.wait(guard, ready);
+    } else if (!semaphore->available.wait_for(guard, std::chrono::milliseconds(ticks), ready)) {
+        return pdFALSE;
+    }
+    semaphore->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+    Semaphore* semaphore = (Semaphore*)handle;
+    {
+        std::lock_guard<std::mutex> guard(semaphore->lock);
+        if (semaphore->count >= semaphore->maxCount) return pdFALSE;
+        semaphore->count++;
+    }
+    semaphore->available.notify_one();
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t handle) {
+    delete (Semaphore*)handle;
+}
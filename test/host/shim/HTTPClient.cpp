@@ -0,0 +1,320 @@
+/**
+ * HTTPClient.cpp (host shim)
+ *
+ * Follows the ESP32 core's HTTPClient: request line and default
+ * headers, header parsing with the same keep-alive rules, and the
+ * same disconnect behaviour (discard what has arrived, keep the
+ * socket only when reuse was requested and the server allows it).
+ */
+
+#include <HTTPClient.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+
+HTTPClient::HTTPClient()
+    : _client(NULL), _ownedClient(NULL), _port(80), _secure(false), _reuse(true), _canReuse(false),
+      _tcpTimeout(HTTPCLIENT_DEFAULT_TCP_TIMEOUT), _connectTimeout(5000), _userAgent("ESP32HTTPClient"),
+      _returnCode(0), _size(-1) {}
+
+HTTPClient::~HTTPClient() {
+    if (_client != NULL) {
+        _client->stop();
+    }
+    delete _ownedClient;
+}
+
+void HTTPClient::clear() {
+    _returnCode = 0;
+    _size = -1;
+    _requestHeaders = "";
+    _location = "";
+    for (size_t i = 0; i < _collected.size(); i++) {
+        _collected[i].value = "";
+    }
+}
+
+bool HTTPClient::parseUrl(const String& url) {
+    String rest = url;
+    int index = rest.indexOf("://");
+    if (index < 0) return false;
+    String protocol = rest.substring(0, index);
+    rest = rest.substring(index + 3);
+    if (protocol == "http") {
+        _secure = false;
+        _port = 80;
+    } else if (protocol == "https") {
+        _secure = true;
+        _port = 443;
+    } else {
+        return false;
+    }
+
+    index = rest.indexOf('/');
+    String host = index >= 0 ? rest.substring(0, index) : rest;
+    _uri = index >= 0 ? rest.substring(index) : String("/");
+    index = host.indexOf(':');
+    if (index >= 0) {
+        _host = host.substring(0, index);
+        _port = (uint16_t)host.substring(index + 1).toInt();
+    } else {
+        _host = host;
+    }
+    return _host.length() > 0;
+}
+
+bool HTTPClient::begin(WiFiClient& client, String url) {
+    _client = &client;
+    clear();
+    return parseUrl(url);
+}
+
+bool HTTPClient::begin(String url) {
+    clear();
+    if (!parseUrl(url)) return false;
+    if (_client != NULL && _client != _ownedClient) {
+        disconnect(false);
+    }
+    delete _ownedClient;
+    _ownedClient = _secure ? new WiFiClientSecure() : new WiFiClient();
+    _client = _ownedClient;
+    return true;
+}
+
+void HTTPClient::end() {
+    disconnect(false);
+    clear();
+}
+
+// Like the core, forgets the client unless it stays open for reuse
+void HTTPClient::disconnect(bool preserveClient) {
+    if (_client == NULL) return;
+    if (connected()) {
+        if (_client->available() > 0) {
+            _client->flush();
+        }
+        if (_reuse && _canReuse) {
+            return;
+        }
+        _client->stop();
+    }
+    if (!preserveClient) {
+        _client = NULL;
+    }
+}
+
+void HTTPClient::setTimeout(uint16_t timeout) {
+    _tcpTimeout = timeout;
+    if (_client != NULL) {
+        _client->setTimeout(timeout);
+    }
+}
+
+void HTTPClient::addHeader(const String& name, const String& value, bool first, bool replace) {
+    // The core sets these itself
+    if (name.equalsIgnoreCase("Connection") || name.equalsIgnoreCase("User-Agent") ||
+        name.equalsIgnoreCase("Host")) {
+        return;
+    }
+
+    String line = name + ": " + value + "\r\n";
+    if (replace) {
+        String prefix = name + ":";
+        std::string headers = _requestHeaders.str();
+        size_t pos = 0;
+        while (pos < headers.size()) {
+            size_t end = headers.find("\r\n", pos);
+            if (end == std::string::npos) break;
+            if (strncasecmp(headers.c_str() + pos, prefix.c_str(), prefix.length()) == 0) {
+                headers.erase(pos, end + 2 - pos);
+                continue;
+            }
+            pos = end + 2;
+        }
+        _requestHeaders = String(headers);
+    }
+    if (first) {
+        _requestHeaders = line + _requestHeaders;
+    } else {
+        _requestHeaders += line;
+    }
+}
+
+void HTTPClient::collectHeaders(const char* headerKeys[], const size_t headerKeysCount) {
+    _collected.clear();
+    for (size_t i = 0; i < headerKeysCount; i++) {
+        Header header;
+        header.key = headerKeys[i];
+        _collected.push_back(header);
+    }
+}
+
+String HTTPClient::header(const char* name) {
+    for (size_t i = 0; i < _collected.size(); i++) {
+        if (_collected[i].key.equalsIgnoreCase(name)) {
+            return _collected[i].value;
+        }
+    }
+    return String();
+}
+
+bool HTTPClient::hasHeader(const char* name) {
+    for (size_t i = 0; i < _collected.size(); i++) {
+        if (_collected[i].key.equalsIgnoreCase(name) && _collected[i].value.length() > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HTTPClient::connected() {
+    if (_client == NULL) return false;
+    return _client->available() > 0 || _client->connected();
+}
+
+bool HTTPClient::connect() {
+    if (_client == NULL) return false;
+    if (_client->connected()) {
+        // Reusing a kept-alive connection: drop leftovers of the last response
+        while (_client->available() > 0) {
+            _client->read();
+        }
+        return true;
+    }
+    if (!_client->connect(_host.c_str(), _port, _connectTimeout)) {
+        return false;
+    }
+    _client->setTimeout(_tcpTimeout);
+    return true;
+}
+
+int HTTPClient::sendRequest() {
+    String request = "GET " + _uri + " HTTP/1.1\r\nHost: " + _host;
+    if (_port != 80 && _port != 443) {
+        request += ":";
+        request += String((unsigned int)_port);
+    }
+    request += "\r\nUser-Agent: ";
+    request += _userAgent;
+    request += "\r\nConnection: ";
+    request += _reuse ? "keep-alive" : "close";
+    request += "\r\nAccept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n";
+    request += _requestHeaders;
+    request += "\r\n";
+    return _client->write((const uint8_t*)request.c_str(), request.length()) == request.length();
+}
+
+int HTTPClient::GET() {
+    if (!connect()) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+    if (!sendRequest()) {
+        return HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+    return handleHeaderResponse();
+}
+
+int HTTPClient::handleHeaderResponse() {
+    _returnCode = 0;
+    _size = -1;
+    _canReuse = _reuse;
+    _location = "";
+    for (size_t i = 0; i < _collected.size(); i++) {
+        _collected[i].value = "";
+    }
+
+    std::string line;
+    bool firstLine = true;
+    unsigned long lastData = millis();
+    while (connected()) {
+        int c = _client->available() > 0 ? _client->read() : -1;
+        if (c < 0) {
+            if (millis() - lastData > _tcpTimeout) {
+                return HTTPC_ERROR_READ_TIMEOUT;
+            }
+            delay(1);
+            continue;
+        }
+        lastData = millis();
+        if (c != '\n') {
+            if (c != '\r') line += (char)c;
+            continue;
+        }
+
+        if (firstLine) {
+            firstLine = false;
+            if (line.compare(0, 7, "HTTP/1.") != 0 || line.size() < 12) {
+                return HTTPC_ERROR_NO_HTTP_SERVER;
+            }
+            if (_canReuse) _canReuse = line[7] != '0';
+            _returnCode = atoi(line.c_str() + 9);
+        } else if (line.empty()) {
+            return _returnCode > 0 ? _returnCode : HTTPC_ERROR_NO_HTTP_SERVER;
+        } else {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                String name = String(line.substr(0, colon));
+                String value = String(line.substr(colon + 1));
+                value.trim();
+                if (name.equalsIgnoreCase("Content-Length")) {
+                    _size = value.toInt();
+                }
+                if (name.equalsIgnoreCase("Connection") && value.indexOf("close") >= 0 &&
+                    value.indexOf("keep-alive") < 0) {
+                    _canReuse = false;
+                }
+                if (name.equalsIgnoreCase("Location")) {
+                    _location = value;
+                }
+                for (size_t i = 0; i < _collected.size(); i++) {
+                    if (_collected[i].key.equalsIgnoreCase(name)) {
+                        _collected[i].value = value;
+                    }
+                }
+            }
+        }
+        line.clear();
+    }
+    return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+WiFiClient* HTTPClient::getStreamPtr() {
+    return connected() ? _client : NULL;
+}
+
+String HTTPClient::getString() {
+    std::string body;
+    if (_client == NULL) return String();
+    unsigned long lastData = millis();
+    uint8_t buffer[512];
+    while (_size < 0 || body.size() < (size_t)_size) {
+        size_t want = sizeof(buffer);
+        if (_size >= 0) want = min(want, (size_t)_size - body.size());
+        int n = _client->available() > 0 ? _client->read(buffer, want) : 0;
+        if (n > 0) {
+            body.append((const char*)buffer, n);
+            lastData = millis();
+        } else if (!connected() || millis() - lastData > _tcpTimeout) {
+            break;
+        } else {
+            delay(1);
+        }
+    }
+    return String(body);
+}
+
+String HTTPClient::errorToString(int error) {
+    switch (error) {
+        case HTTPC_ERROR_CONNECTION_REFUSED: return "connection refused";
+        case HTTPC_ERROR_SEND_HEADER_FAILED: return "send header failed";
+        case HTTPC_ERROR_SEND_PAYLOAD_FAILED: return "send payload failed";
+        case HTTPC_ERROR_NOT_CONNECTED: return "not connected";
+        case HTTPC_ERROR_CONNECTION_LOST: return "connection lost";
+        case HTTPC_ERROR_NO_STREAM: return "no stream";
+        case HTTPC_ERROR_NO_HTTP_SERVER: return "no HTTP server";
+        case HTTPC_ERROR_TOO_LESS_RAM: return "too less ram";
+        case HTTPC_ERROR_ENCODING: return "Transfer-Encoding not supported";
+        case HTTPC_ERROR_STREAM_WRITE: return "Stream write error";
+        case HTTPC_ERROR_READ_TIMEOUT: return "read Timeout";
+        default: return String();
+    }
+}
@@ -0,0 +1,120 @@
+/**
+ * HTTPClient.h (host shim)
+ *
+ * HTTP/1.1 GET client with the ESP32 core's behaviour where the
+ * library depends on it: it reuses an already connected client,
+ * returns the same negative HTTPC_ERROR_* codes, only keeps headers
+ * named in collectHeaders(), and keeps the socket open across end()
+ * when setReuse(true) and the server allows keep-alive.
+ */
+
+#ifndef HOST_HTTPCLIENT_H
+#define HOST_HTTPCLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <vector>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+#define HTTPCLIENT_DEFAULT_TCP_TIMEOUT (5000)
+
+typedef enum {
+    HTTP_CODE_CONTINUE = 100,
+    HTTP_CODE_OK = 200,
+    HTTP_CODE_NO_CONTENT = 204,
+    HTTP_CODE_PARTIAL_CONTENT = 206,
+    HTTP_CODE_MOVED_PERMANENTLY = 301,
+    HTTP_CODE_FOUND = 302,
+    HTTP_CODE_SEE_OTHER = 303,
+    HTTP_CODE_NOT_MODIFIED = 304,
+    HTTP_CODE_TEMPORARY_REDIRECT = 307,
+    HTTP_CODE_PERMANENT_REDIRECT = 308,
+    HTTP_CODE_BAD_REQUEST = 400,
+    HTTP_CODE_FORBIDDEN = 403,
+    HTTP_CODE_NOT_FOUND = 404,
+    HTTP_CODE_RANGE_NOT_SATISFIABLE = 416,
+    HTTP_CODE_TOO_MANY_REQUESTS = 429,
+    HTTP_CODE_INTERNAL_SERVER_ERROR = 500,
+    HTTP_CODE_SERVICE_UNAVAILABLE = 503,
+} t_http_codes;
+
+typedef enum {
+    HTTPC_DISABLE_FOLLOW_REDIRECTS,
+    HTTPC_STRICT_FOLLOW_REDIRECTS,
+    HTTPC_FORCE_FOLLOW_REDIRECTS,
+} followRedirects_t;
+
+class HTTPClient {
+public:
+    HTTPClient();
+    ~HTTPClient();
+
+    bool begin(WiFiClient& client, String url);
+    bool begin(String url);
+    void end();
+
+    void setReuse(bool reuse) { _reuse = reuse; }
+    void setTimeout(uint16_t timeout);
+    void setConnectTimeout(int32_t timeout) { _connectTimeout = timeout; }
+    void setUserAgent(const String& userAgent) { _userAgent = userAgent; }
+    void setFollowRedirects(followRedirects_t follow) { (void)follow; }
+
+    void addHeader(const String& name, const String& value, bool first = false, bool replace = true);
+    void collectHeaders(const char* headerKeys[], const size_t headerKeysCount);
+    String header(const char* name);
+    bool hasHeader(const char* name);
+    int headers() const { return (int)_collected.size(); }
+
+    int GET();
+    int getSize() const { return _size; }
+    String getLocation() const { return _location; }
+    WiFiClient& getStream() { return *_client; }
+    WiFiClient* getStreamPtr();
+    String getString();
+    bool connected();
+
+    static String errorToString(int error);
+
+private:
+    struct Header {
+        String key;
+        String value;
+    };
+
+    WiFiClient* _client;
+    WiFiClient* _ownedClient;
+    String _host;
+    uint16_t _port;
+    String _uri;
+    bool _secure;
+    bool _reuse;
+    bool _canReuse;
+    uint16_t _tcpTimeout;
+    int32_t _connectTimeout;
+    String _userAgent;
+    String _requestHeaders;
+    std::vector<Header> _collected;
+    int _returnCode;
+    int _size;
+    String _location;
+
+    bool parseUrl(const String& url);
+    bool connect();
+    int sendRequest();
+    int handleHeaderResponse();
+    void disconnect(bool preserveClient = false);
+    void clear();
+};
+
+#endif // HOST_HTTPCLIENT_H
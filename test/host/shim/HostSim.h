@@ -0,0 +1,199 @@
+/**
+ * HostSim.h - Simulation controls for the host shim build
+ *
+ * The shims model the parts of an ESP32 that matter to OTA behaviour:
+ * a 4 MB flash with two OTA slots whose erase/write cost is
+ * configurable, a device network link with a bandwidth cap, a DNS
+ * table and NVS. Tests drive and inspect them through this namespace;
+ * library code never includes it.
+ */
+
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <esp_ota_ops.h>
+#include <string>
+
+namespace HostSim {
+
+// ========== Flash ==========
+
+/**
+ * Flash access counters, accumulated since the last resetFlash()
+ */
+struct FlashCounters {
+    uint32_t sectorErases;      ///< Sectors erased (esp_partition_erase_range and Update)
+    uint32_t writeCalls;        ///< esp_partition_write calls (including Update's)
+    uint64_t bytesWritten;      ///< Bytes programmed
+    uint32_t readCalls;         ///< esp_partition_read calls
+    uint64_t bytesRead;         ///< Bytes read back
+    uint32_t dirtyWrites;       ///< Writes that tried to set a 0 bit back to 1 (missing erase)
+    uint64_t busyMicros;        ///< Simulated time spent in flash operations
+};
+
+/**
+ * Set the simulated flash cost. Operations sleep for this long so
+ * timing-sensitive code (stall detection, poll budgets) sees it.
+ *
+ * @param eraseMicrosPerSector Time to erase one 4 KB sector (~30-45 ms on real parts)
+ * @param writeMicrosPerKB Time to program 1 KB
+ * @param readMicrosPerKB Time to read 1 KB
+ */
+void setFlashLatency(uint32_t eraseMicrosPerSector, uint32_t writeMicrosPerKB, uint32_t readMicrosPerKB = 0);
+
+/**
+ * Erase both OTA slots, zero the counters and make app0 the running
+ * and boot partition again. Latency settings are kept.
+ */
+void resetFlash();
+
+FlashCounters flashCounters();
+void resetFlashCounters();
+
+/**
+ * Raw view of a partition's contents (for comparing against the image)
+ */
+const uint8_t* partitionData(const esp_partition_t* partition);
+
+/**
+ * Copy an image into a partition, as if it had been flashed over serial
+ */
+void flashImage(const esp_partition_t* partition, const uint8_t* data, size_t len);
+
+const esp_partition_t* app0();
+const esp_partition_t* app1();
+
+/**
+ * Run the boot partition, as after the restart that follows an install
+ * (ESP.restart() itself returns and only counts)
+ */
+void bootNewImage();
+
+/**
+ * OTA state of the running image, as reported by
+ * esp_ota_get_state_partition(). esp_ota_check_rollback_is_possible()
+ * follows the partitions: true while the other one holds an app image.
+ */
+void setRunningState(esp_ota_img_states_t state);
+
+/**
+ * Description returned for the running app (version/project checks)
+ */
+void setRunningApp(const char* version, const char* project);
+
+// ========== Update (Arduino Update class) ==========
+
+struct UpdateCounters {
+    uint32_t writeCalls;        ///< Update.write() calls
+    uint64_t bytesWritten;      ///< Bytes accepted by Update.write()
+    uint32_t begins;            ///< Update.begin() calls
+    uint32_t ends;              ///< Successful Update.end() calls
+    uint32_t aborts;            ///< Update.abort() calls
+};
+
+/**
+ * Fixed cost of each Update.write() call (bookkeeping, MD5, copy)
+ */
+void setUpdateCallOverhead(uint32_t micros);
+
+UpdateCounters updateCounters();
+void resetUpdateCounters();
+
+// ========== Network ==========
+
+/**
+ * Cap the device's download rate in bytes/s (0 = unlimited). The cap
+ * is shared by every socket of the process, like a single Wi-Fi link.
+ */
+void setBandwidth(uint32_t bytesPerSecond);
+
+/**
+ * Extra delay added to every TCP connect, modelling round-trip time
+ */
+void setConnectLatency(uint32_t ms);
+
+/**
+ * Drop a fraction of received UDP datagrams. Every socket draws on
+ * its own reads, so receivers in one process lose different packets
+ * like devices on one Wi-Fi network.
+ */
+void setPacketLoss(double rate, uint32_t seed = 1);
+
+/**
+ * Address the device binds servers to and sends UDP from. Processes
+ * that simulate separate devices use distinct 127.0.0.x addresses.
+ */
+void setLocalIP(IPAddress ip);
+IPAddress localIP();
+
+void setWiFiConnected(bool connected);
+
+/**
+ * Station MAC, used by the library to derive per-device jitter
+ */
+void setMacAddress(const uint8_t mac[6]);
+
+/**
+ * Bytes delivered to the device over TCP since the last reset
+ */
+uint64_t bytesReceived();
+void resetBytesReceived();
+
+// ========== DNS ==========
+
+/**
+ * Map a hostname to an address for WiFi.hostByName(). "localhost"
+ * and dotted quads resolve without an entry.
+ */
+void addHost(const char* name, IPAddress ip);
+void removeHost(const char* name);
+
+/**
+ * Time every uncached lookup takes, and whether lookups fail outright
+ */
+void setDnsDelay(uint32_t ms);
+void setDnsFailure(bool fail);
+
+uint32_t dnsLookups();
+void resetDnsLookups();
+
+// ========== System ==========
+
+/**
+ * Number of ESP.restart() calls. restart() returns on the host so
+ * tests can inspect the state an install left behind.
+ */
+uint32_t restartCount();
+
+/**
+ * Overwrite every RTC_NOINIT_ATTR variable with a byte, modelling the
+ * undefined contents of RTC memory after power-on
+ */
+void fillRtcMemory(uint8_t value);
+
+void setFreeHeap(uint32_t bytes);
+void setResetReason(esp_reset_reason_t reason);
+
+/**
+ * Drop every NVS namespace (a factory-fresh device)
+ */
+void clearPreferences();
+
+/**
+ * Echo Serial output to stdout (default on). Captured output is
+ * kept either way.
+ */
+void setSerialEcho(bool echo);
+std::string serialOutput();
+void clearSerialOutput();
+
+/**
+ * Directory that backs the host filesystem (fs::FS instances)
+ */
+fs::FS hostFS(const char* root);
+
+} // namespace HostSim
+
+#endif // HOST_SIM_H
@@ -0,0 +1,177 @@
+/**
+ * Mbedtls.cpp (host shim)
+ *
+ * The mbedtls calls the library makes, implemented with OpenSSL so
+ * the host build checks real digests, signatures and ciphertext.
+ */
+
+#include <mbedtls/aes.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/sha256.h>
+
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/bio.h>
+#include <openssl/x509.h>
+
+// ========== SHA-256 ==========
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx) {
+    ctx->md = NULL;
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx) {
+    if (ctx == NULL) return;
+    EVP_MD_CTX_free((EVP_MD_CTX*)ctx->md);
+    ctx->md = NULL;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224) {
+    if (ctx->md == NULL) ctx->md = EVP_MD_CTX_new();
+    return EVP_DigestInit_ex((EVP_MD_CTX*)ctx->md, is224 ? EVP_sha224() : EVP_sha256(), NULL) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen) {
+    if (ctx->md == NULL) return -1;
+    return EVP_DigestUpdate((EVP_MD_CTX*)ctx->md, input, ilen) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char* output) {
+    if (ctx->md == NULL) return -1;
+    unsigned int len = 0;
+    return EVP_DigestFinal_ex((EVP_MD_CTX*)ctx->md, output, &len) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256(const unsigned char* input, size_t ilen, unsigned char* output, int is224) {
+    unsigned int len = 0;
+    return EVP_Digest(input, ilen, output, &len, is224 ? EVP_sha224() : EVP_sha256(), NULL) == 1 ? 0 : -1;
+}
+
+// ========== Public keys ==========
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx) {
+    ctx->key = NULL;
+}
+
+void mbedtls_pk_free(mbedtls_pk_context* ctx) {
+    if (ctx == NULL) return;
+    EVP_PKEY_free((EVP_PKEY*)ctx->key);
+    ctx->key = NULL;
+}
+
+// PEM (length includes the terminating NUL, as mbedtls requires) or DER
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen) {
+    if (ctx->key != NULL) return MBEDTLS_ERR_PK_BAD_INPUT_DATA;
+    EVP_PKEY* parsed = NULL;
+    if (keylen > 0 && key[keylen - 1] == '\0') {
+        BIO* bio = BIO_new_mem_buf(key, (int)keylen - 1);
+        parsed = PEM_read_bio_PUBKEY(bio, NULL, NULL, NULL);
+        BIO_free(bio);
+    } else {
+        const unsigned char* p = key;
+        parsed = d2i_PUBKEY(NULL, &p, (long)keylen);
+    }
+    if (parsed == NULL) return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+    ctx->key = parsed;
+    return 0;
+}
+
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t md_alg, const unsigned char* hash,
+                      size_t hash_len, const unsigned char* sig, size_t sig_len) {
+    if (ctx == NULL || ctx->key == NULL || md_alg != MBEDTLS_MD_SHA256) return MBEDTLS_ERR_PK_BAD_INPUT_DATA;
+    EVP_PKEY_CTX* verify = EVP_PKEY_CTX_new((EVP_PKEY*)ctx->key, NULL);
+    int ok = verify != NULL && EVP_PKEY_verify_init(verify) == 1 &&
+             EVP_PKEY_CTX_set_signature_md(verify, EVP_sha256()) == 1 &&
+             EVP_PKEY_verify(verify, sig, sig_len, hash, hash_len) == 1;
+    EVP_PKEY_CTX_free(verify);
+    return ok ? 0 : MBEDTLS_ERR_ECP_VERIFY_FAILED;
+}
+
+// ========== AES ==========
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_aes_free(mbedtls_aes_context* ctx) {
+    if (ctx == NULL) return;
+    EVP_CIPHER_CTX_free((EVP_CIPHER_CTX*)ctx->ecb);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static const EVP_CIPHER* cipherFor(unsigned int keybits, bool ctr) {
+    switch (keybits) {
+        case 128: return ctr ? EVP_aes_128_ctr() : EVP_aes_128_ecb();
+        case 192: return ctr ? EVP_aes_192_ctr() : EVP_aes_192_ecb();
+        case 256: return ctr ? EVP_aes_256_ctr() : EVP_aes_256_ecb();
+        default: return NULL;
+    }
+}
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+    const EVP_CIPHER* cipher = cipherFor(keybits, false);
+    if (cipher == NULL) return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+    memcpy(ctx->key, key, keybits / 8);
+    ctx->keybits = keybits;
+    if (ctx->ecb == NULL) ctx->ecb = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex((EVP_CIPHER_CTX*)ctx->ecb, cipher, NULL, ctx->key, NULL);
+    EVP_CIPHER_CTX_set_padding((EVP_CIPHER_CTX*)ctx->ecb, 0);
+    return 0;
+}
+
+int mbedtls_aes_crypt_ecb(mbedtls_aes_context* ctx, int mode, const unsigned char input[16],
+                          unsigned char output[16]) {
+    if (ctx->ecb == NULL || mode != MBEDTLS_AES_ENCRYPT) return -1;
+    int len = 0;
+    return EVP_EncryptUpdate((EVP_CIPHER_CTX*)ctx->ecb, output, &len, input, 16) == 1 && len == 16 ? 0 : -1;
+}
+
+static void incrementCounter(unsigned char counter[16], uint64_t blocks) {
+    for (int i = 15; i >= 0 && blocks > 0; i--) {
+        uint64_t sum = counter[i] + (blocks & 0xFF);
+        counter[i] = (unsigned char)sum;
+        blocks = (blocks >> 8) + (sum >> 8);
+    }
+}
+
+// Same state handling as mbedtls: nc_off bytes of stream_block are used
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off,
+                          unsigned char nonce_counter[16], unsigned char stream_block[16],
+                          const unsigned char* input, unsigned char* output) {
+    if (ctx->ecb == NULL || *nc_off > 15) return -1;
+    size_t n = *nc_off;
+
+    // Finish the current keystream block
+    while (n != 0 && length > 0) {
+        *output++ = *input++ ^ stream_block[n];
+        n = (n + 1) & 0x0F;
+        length--;
+    }
+
+    // Whole blocks in one call; OpenSSL's CTR mode also counts the full 128 bits big-endian
+    size_t whole = length / 16;
+    if (whole > 0) {
+        EVP_CIPHER_CTX* ctr = EVP_CIPHER_CTX_new();
+        int len = 0;
+        EVP_EncryptInit_ex(ctr, cipherFor(ctx->keybits, true), NULL, ctx->key, nonce_counter);
+        EVP_EncryptUpdate(ctr, output, &len, input, (int)(whole * 16));
+        EVP_CIPHER_CTX_free(ctr);
+        incrementCounter(nonce_counter, whole);
+        input += whole * 16;
+        output += whole * 16;
+        length -= whole * 16;
+    }
+
+    // Partial tail: generate the next block and keep the rest for later
+    if (length > 0) {
+        mbedtls_aes_crypt_ecb(ctx, MBEDTLS_AES_ENCRYPT, nonce_counter, stream_block);
+        incrementCounter(nonce_counter, 1);
+        for (size_t i = 0; i < length; i++) {
+            output[i] = input[i] ^ stream_block[i];
+        }
+        n = length;
+    }
+    *nc_off = n;
+    return 0;
+}
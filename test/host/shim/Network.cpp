@@ -0,0 +1,680 @@
+/**
+ * Network.cpp (host shim)
+ *
+ * WiFi, WiFiClient, WiFiServer and WiFiUDP over host sockets, plus the
+ * device link model: a bandwidth cap shared by every TCP read of the
+ * process, a connect delay and a DNS table.
+ */
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include "HostSim.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#define LAN_GROUP "239.255.77.77"
+#define UDP_MAX_PACKET 1500
+#define WRITE_TIMEOUT_MS 10000
+
+// ========== Device state ==========
+
+static std::atomic<bool> wifiConnected(true);
+static std::atomic<uint32_t> localAddress((uint32_t)IPAddress(127, 0, 0, 1));
+static uint8_t macAddressBytes[6] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x01};
+static std::atomic<uint32_t> connectLatencyMs(0);
+
+void HostSim::setLocalIP(IPAddress ip) {
+    localAddress = (uint32_t)ip;
+}
+
+IPAddress HostSim::localIP() {
+    return IPAddress((uint32_t)localAddress);
+}
+
+void HostSim::setWiFiConnected(bool connected) {
+    wifiConnected = connected;
+}
+
+void HostSim::setMacAddress(const uint8_t mac[6]) {
+    memcpy(macAddressBytes, mac, sizeof(macAddressBytes));
+}
+
+void HostSim::setConnectLatency(uint32_t ms) {
+    connectLatencyMs = ms;
+}
+
+// ========== Datagram loss ==========
+
+static std::mutex lossLock;
+static double lossRate = 0;
+static std::mt19937 lossGenerator(1);
+
+void HostSim::setPacketLoss(double rate, uint32_t seed) {
+    std::lock_guard<std::mutex> guard(lossLock);
+    lossRate = rate;
+    lossGenerator.seed(seed);
+}
+
+static bool dropDatagram() {
+    std::lock_guard<std::mutex> guard(lossLock);
+    if (lossRate <= 0) return false;
+    return std::uniform_real_distribution<double>(0, 1)(lossGenerator) < lossRate;
+}
+
+// ========== Link bandwidth ==========
+
+// Token bucket refilled at the link rate; a burst of at most 20 ms
+// (or one segment) keeps short reads from exceeding the rate
+static std::mutex linkLock;
+static uint32_t linkRate = 0;
+static double linkTokens = 0;
+static std::chrono::steady_clock::time_point linkRefill = std::chrono::steady_clock::now();
+static std::atomic<uint64_t> linkBytes(0);
+
+static size_t linkAvailable(size_t want) {
+    std::lock_guard<std::mutex> guard(linkLock);
+    if (linkRate == 0) return want;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - linkRefill).count();
+    linkRefill = now;
+    double burst = max(linkRate / 50.0, 1460.0);
+    linkTokens = min(burst, linkTokens + elapsed * linkRate);
+    return min(want, (size_t)linkTokens);
+}
+
+static void linkConsume(size_t bytes) {
+    linkBytes += bytes;
+    std::lock_guard<std::mutex> guard(linkLock);
+    if (linkRate != 0) linkTokens -= bytes;
+}
+
+void HostSim::setBandwidth(uint32_t bytesPerSecond) {
+    std::lock_guard<std::mutex> guard(linkLock);
+    linkRate = bytesPerSecond;
+    linkTokens = 0;
+    linkRefill = std::chrono::steady_clock::now();
+}
+
+uint64_t HostSim::bytesReceived() {
+    return linkBytes;
+}
+
+void HostSim::resetBytesReceived() {
+    linkBytes = 0;
+}
+
+// ========== DNS ==========
+
+static std::mutex dnsLock;
+static std::map<std::string, uint32_t> hostTable;
+static std::atomic<uint32_t> dnsDelayMs(0);
+static std::atomic<bool> dnsFailure(false);
+static std::atomic<uint32_t> dnsCount(0);
+
+void HostSim::addHost(const char* name, IPAddress ip) {
+    std::lock_guard<std::mutex> guard(dnsLock);
+    hostTable[name] = (uint32_t)ip;
+}
+
+void HostSim::removeHost(const char* name) {
+    std::lock_guard<std::mutex> guard(dnsLock);
+    hostTable.erase(name);
+}
+
+void HostSim::setDnsDelay(uint32_t ms) {
+    dnsDelayMs = ms;
+}
+
+void HostSim::setDnsFailure(bool fail) {
+    dnsFailure = fail;
+}
+
+uint32_t HostSim::dnsLookups() {
+    return dnsCount;
+}
+
+void HostSim::resetDnsLookups() {
+    dnsCount = 0;
+}
+
+// ========== WiFi ==========
+
+WiFiClass WiFi;
+
+wl_status_t WiFiClass::status() {
+    return wifiConnected ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+int WiFiClass::hostByName(const char* host, IPAddress& result) {
+    if (result.fromString(host)) {
+        return 1;
+    }
+    if (strcmp(host, "localhost") == 0) {
+        result = IPAddress(127, 0, 0, 1);
+        return 1;
+    }
+
+    dnsCount++;
+    if (dnsDelayMs > 0) {
+        delay(dnsDelayMs);
+    }
+    if (dnsFailure || !wifiConnected) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> guard(dnsLock);
+    std::map<std::string, uint32_t>::iterator it = hostTable.find(host);
+    if (it == hostTable.end()) {
+        return 0;
+    }
+    result = IPAddress(it->second);
+    return 1;
+}
+
+IPAddress WiFiClass::localIP() {
+    return HostSim::localIP();
+}
+
+IPAddress WiFiClass::broadcastIP() {
+    IPAddress group;
+    group.fromString(LAN_GROUP);
+    return group;
+}
+
+IPAddress WiFiClass::subnetMask() {
+    return IPAddress(255, 0, 0, 0);
+}
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+    memcpy(mac, macAddressBytes, sizeof(macAddressBytes));
+    return mac;
+}
+
+String WiFiClass::macAddress() {
+    char buffer[18];
+    snprintf(buffer, sizeof(buffer), "%02X:%02X:%02X:%02X:%02X:%02X", macAddressBytes[0], macAddressBytes[1],
+             macAddressBytes[2], macAddressBytes[3], macAddressBytes[4], macAddressBytes[5]);
+    return String(buffer);
+}
+
+// ========== WiFiClient ==========
+
+class WiFiClientSocket {
+public:
+    explicit WiFiClientSocket(int fd) : fd(fd) {}
+    ~WiFiClientSocket() { ::close(fd); }
+    int fd;
+};
+
+static sockaddr_in socketAddress(IPAddress ip, uint16_t port) {
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = (uint32_t)ip;
+    address.sin_port = htons(port);
+    return address;
+}
+
+WiFiClient::WiFiClient() : _exposeFd(true), _connectTimeout(3000) {}
+
+WiFiClient::WiFiClient(int fd) : _exposeFd(true), _connectTimeout(3000) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    _socket = std::make_shared<WiFiClientSocket>(fd);
+}
+
+WiFiClient::~WiFiClient() {}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+    return connect(ip, port, _connectTimeout);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    stop();
+    if (!wifiConnected) return 0;
+    if (connectLatencyMs > 0) delay(connectLatencyMs);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // Connections leave from this device's address
+    sockaddr_in local = socketAddress(HostSim::localIP(), 0);
+    bind(fd, (sockaddr*)&local, sizeof(local));
+
+    sockaddr_in remote = socketAddress(ip, port);
+    if (::connect(fd, (sockaddr*)&remote, sizeof(remote)) < 0 && errno != EINPROGRESS) {
+        ::close(fd);
+        return 0;
+    }
+    pollfd waiting = {fd, POLLOUT, 0};
+    int error = 0;
+    socklen_t errorLen = sizeof(error);
+    if (poll(&waiting, 1, timeout) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) != 0 ||
+        error != 0) {
+        ::close(fd);
+        return 0;
+    }
+    _socket = std::make_shared<WiFiClientSocket>(fd);
+    return 1;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    return connect(host, port, _connectTimeout);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeout) {
+    IPAddress ip;
+    if (!WiFi.hostByName(host, ip)) return 0;
+    return connect(ip, port, timeout);
+}
+
+int WiFiClient::socketFd() const {
+    return _socket ? _socket->fd : -1;
+}
+
+int WiFiClient::fd() const {
+    return _exposeFd ? socketFd() : -1;
+}
+
+size_t WiFiClient::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+    int fd = socketFd();
+    if (fd < 0) return 0;
+    size_t sent = 0;
+    unsigned long start = millis();
+    while (sent < size) {
+        ssize_t n = send(fd, buffer + sent, size - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            break;
+        }
+        if (millis() - start > WRITE_TIMEOUT_MS) {
+            break;
+        }
+        pollfd waiting = {fd, POLLOUT, 0};
+        poll(&waiting, 1, 100);
+    }
+    return sent;
+}
+
+int WiFiClient::available() {
+    int fd = socketFd();
+    if (fd < 0) return 0;
+    int pending = 0;
+    if (ioctl(fd, FIONREAD, &pending) != 0 || pending <= 0) return 0;
+    return (int)linkAvailable(pending);
+}
+
+int WiFiClient::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+    int fd = socketFd();
+    if (fd < 0) return -1;
+    size_t allowed = min(size, (size_t)available());
+    if (allowed == 0) return 0;
+    ssize_t n = recv(fd, buffer, allowed, MSG_DONTWAIT);
+    if (n <= 0) return n == 0 || errno == EAGAIN ? 0 : -1;
+    linkConsume(n);
+    return (int)n;
+}
+
+size_t WiFiClient::readBytes(uint8_t* buffer, size_t length) {
+    int n = read(buffer, length);
+    return n > 0 ? n : 0;
+}
+
+int WiFiClient::peek() {
+    int fd = socketFd();
+    if (fd < 0 || available() == 0) return -1;
+    uint8_t c;
+    return recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 1 ? c : -1;
+}
+
+void WiFiClient::flush() {
+    // As in the ESP32 core: discard whatever has been received
+    int fd = socketFd();
+    if (fd < 0) return;
+    uint8_t discard[512];
+    while (recv(fd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+    }
+}
+
+void WiFiClient::stop() {
+    _socket.reset();
+}
+
+uint8_t WiFiClient::connected() {
+    int fd = socketFd();
+    if (fd < 0) return 0;
+    uint8_t c;
+    ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0) return 1;                                            // Data pending
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+    return 0;                                                       // Closed by the peer, nothing left
+}
+
+int WiFiClient::setSocketOption(int level, int option, const void* value, size_t len) {
+    int fd = socketFd();
+    if (fd < 0) return -1;
+    return setsockopt(fd, level, option, value, len);
+}
+
+int WiFiClient::setNoDelay(bool nodelay) {
+    int flag = nodelay ? 1 : 0;
+    return setSocketOption(IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+IPAddress WiFiClient::remoteIP() const {
+    sockaddr_in address;
+    socklen_t len = sizeof(address);
+    if (socketFd() < 0 || getpeername(socketFd(), (sockaddr*)&address, &len) != 0) return IPAddress();
+    return IPAddress((uint32_t)address.sin_addr.s_addr);
+}
+
+uint16_t WiFiClient::remotePort() const {
+    sockaddr_in address;
+    socklen_t len = sizeof(address);
+    if (socketFd() < 0 || getpeername(socketFd(), (sockaddr*)&address, &len) != 0) return 0;
+    return ntohs(address.sin_port);
+}
+
+IPAddress WiFiClient::localIP() const {
+    sockaddr_in address;
+    socklen_t len = sizeof(address);
+    if (socketFd() < 0 || getsockname(socketFd(), (sockaddr*)&address, &len) != 0) return IPAddress();
+    return IPAddress((uint32_t)address.sin_addr.s_addr);
+}
+
+// ========== WiFiClientSecure ==========
+
+WiFiClientSecure::WiFiClientSecure() {
+    _exposeFd = false;
+}
+
+int WiFiClientSecure::connect(IPAddress ip, uint16_t port, const char* host, const char* rootCA,
+                              const char* clientCert, const char* clientKey) {
+    (void)host;
+    (void)rootCA;
+    (void)clientCert;
+    (void)clientKey;
+    return WiFiClient::connect(ip, port, _connectTimeout);
+}
+
+// ========== WiFiServer ==========
+
+WiFiServer::WiFiServer(uint16_t port, uint8_t maxClients)
+    : _port(port), _maxClients(maxClients), _fd(-1), _noDelay(false) {}
+
+WiFiServer::~WiFiServer() {
+    end();
+}
+
+void WiFiServer::begin(uint16_t port) {
+    end();
+    if (port != 0) _port = port;
+    _fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_fd < 0) return;
+    int one = 1;
+    setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address = socketAddress(HostSim::localIP(), _port);
+    if (bind(_fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(_fd, _maxClients) != 0) {
+        ::close(_fd);
+        _fd = -1;
+        return;
+    }
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+}
+
+void WiFiServer::end() {
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+WiFiClient WiFiServer::available() {
+    if (_fd < 0) return WiFiClient();
+    int fd = ::accept(_fd, NULL, NULL);
+    if (fd < 0) return WiFiClient();
+    if (_noDelay) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return WiFiClient(fd);
+}
+
+// ========== WiFiUDP ==========
+
+WiFiUDP::WiFiUDP()
+    : _fd(-1), _port(0), _txBuffer(NULL), _txLen(0), _txPort(0),
+      _rxBuffer(NULL), _rxLen(0), _rxPos(0), _remotePort(0) {}
+
+WiFiUDP::~WiFiUDP() {
+    stop();
+}
+
+static bool joinGroup(int fd, IPAddress group) {
+    ip_mreq request;
+    request.imr_multiaddr.s_addr = (uint32_t)group;
+    request.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+    return setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) == 0;
+}
+
+bool WiFiUDP::open(uint16_t port) {
+    stop();
+    _fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (_fd < 0) return false;
+
+    int one = 1;
+    int zero = 0;
+    setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(_fd, IPPROTO_IP, IP_PKTINFO, &one, sizeof(one));
+    setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_ALL, &zero, sizeof(zero));
+    in_addr loopback;
+    loopback.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback));
+
+    sockaddr_in address = socketAddress(IPAddress(), port);
+    if (bind(_fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+    socklen_t len = sizeof(address);
+    getsockname(_fd, (sockaddr*)&address, &len);
+    _port = ntohs(address.sin_port);
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+
+    _rxBuffer = new uint8_t[UDP_MAX_PACKET];
+    return true;
+}
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+    if (!open(port)) return 0;
+    // Every listening socket hears LAN broadcasts
+    joinGroup(_fd, WiFi.broadcastIP());
+    return 1;
+}
+
+uint8_t WiFiUDP::begin(IPAddress address, uint16_t port) {
+    (void)address;
+    return begin(port);
+}
+
+uint8_t WiFiUDP::beginMulticast(IPAddress group, uint16_t port) {
+    if (!open(port)) return 0;
+    if (!joinGroup(_fd, group)) {
+        stop();
+        return 0;
+    }
+    _multicast = group;
+    return 1;
+}
+
+void WiFiUDP::stop() {
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    delete[] _txBuffer;
+    delete[] _rxBuffer;
+    _txBuffer = NULL;
+    _rxBuffer = NULL;
+    _txLen = 0;
+    _rxLen = 0;
+    _rxPos = 0;
+    _multicast = IPAddress();
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+    if (_fd < 0 && !open(0)) return 0;
+    if (_txBuffer == NULL) _txBuffer = new uint8_t[UDP_MAX_PACKET];
+    _txLen = 0;
+    _txIP = ip;
+    _txPort = port;
+    return 1;
+}
+
+int WiFiUDP::beginPacket(const char* host, uint16_t port) {
+    IPAddress ip;
+    if (!WiFi.hostByName(host, ip)) return 0;
+    return beginPacket(ip, port);
+}
+
+int WiFiUDP::beginMulticastPacket() {
+    return beginPacket(_multicast, _port);
+}
+
+size_t WiFiUDP::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t WiFiUDP::write(const uint8_t* buffer, size_t size) {
+    if (_txBuffer == NULL) return 0;
+    size = min(size, (size_t)UDP_MAX_PACKET - _txLen);
+    memcpy(_txBuffer + _txLen, buffer, size);
+    _txLen += size;
+    return size;
+}
+
+int WiFiUDP::endPacket() {
+    if (_fd < 0 || _txBuffer == NULL) return 0;
+
+    // Send from this device's address so replies and remoteIP() find it
+    sockaddr_in destination = socketAddress(_txIP, _txPort);
+    iovec data = {_txBuffer, _txLen};
+    char control[CMSG_SPACE(sizeof(in_pktinfo))];
+    memset(control, 0, sizeof(control));
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_name = &destination;
+    message.msg_namelen = sizeof(destination);
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = IPPROTO_IP;
+    header->cmsg_type = IP_PKTINFO;
+    header->cmsg_len = CMSG_LEN(sizeof(in_pktinfo));
+    in_pktinfo* info = (in_pktinfo*)CMSG_DATA(header);
+    info->ipi_spec_dst.s_addr = (uint32_t)HostSim::localIP();
+
+    ssize_t n = sendmsg(_fd, &message, 0);
+    _txLen = 0;
+    return n >= 0 ? 1 : 0;
+}
+
+int WiFiUDP::parsePacket() {
+    if (_fd < 0 || _rxBuffer == NULL) return 0;
+    while (true) {
+        sockaddr_in source;
+        iovec data = {_rxBuffer, UDP_MAX_PACKET};
+        char control[CMSG_SPACE(sizeof(in_pktinfo))];
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_name = &source;
+        message.msg_namelen = sizeof(source);
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(_fd, &message, MSG_DONTWAIT);
+        if (n <= 0) {
+            _rxLen = 0;
+            _rxPos = 0;
+            return 0;
+        }
+
+        // lwIP does not deliver a device's own broadcasts back to it
+        bool multicast = false;
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level == IPPROTO_IP && header->cmsg_type == IP_PKTINFO) {
+                in_pktinfo* info = (in_pktinfo*)CMSG_DATA(header);
+                multicast = IN_MULTICAST(ntohl(info->ipi_addr.s_addr));
+            }
+        }
+        if (multicast && source.sin_addr.s_addr == (uint32_t)HostSim::localIP()) {
+            continue;
+        }
+        if (dropDatagram()) {
+            continue;
+        }
+
+        _rxLen = n;
+        _rxPos = 0;
+        _remoteIP = IPAddress((uint32_t)source.sin_addr.s_addr);
+        _remotePort = ntohs(source.sin_port);
+        return (int)n;
+    }
+}
+
+int WiFiUDP::available() {
+    return (int)(_rxLen - _rxPos);
+}
+
+int WiFiUDP::read() {
+    return _rxPos < _rxLen ? _rxBuffer[_rxPos++] : -1;
+}
+
+int WiFiUDP::read(uint8_t* buffer, size_t len) {
+    size_t n = min(len, _rxLen - _rxPos);
+    if (n == 0) return 0;
+    memcpy(buffer, _rxBuffer + _rxPos, n);
+    _rxPos += n;
+    return (int)n;
+}
+
+int WiFiUDP::peek() {
+    return _rxPos < _rxLen ? _rxBuffer[_rxPos] : -1;
+}
+
+void WiFiUDP::flush() {
+    _rxPos = _rxLen;
+}
@@ -0,0 +1,40 @@
+/**
+ * Preferences.h (host shim)
+ *
+ * NVS namespaces kept in process memory. Every Preferences object
+ * sees the same store, as on the device; HostSim::clearPreferences()
+ * wipes it.
+ */
+
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <Arduino.h>
+
+class Preferences {
+public:
+    Preferences();
+    ~Preferences();
+
+    bool begin(const char* name, bool readOnly = false, const char* partitionLabel = NULL);
+    void end();
+
+    bool clear();
+    bool remove(const char* key);
+    bool isKey(const char* key);
+
+    size_t putUInt(const char* key, uint32_t value);
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+    size_t putBytes(const char* key, const void* value, size_t len);
+    size_t getBytes(const char* key, void* buffer, size_t maxLen);
+    size_t getBytesLength(const char* key);
+    size_t putString(const char* key, const char* value);
+    size_t getString(const char* key, char* value, size_t maxLen);
+
+private:
+    char _name[16];
+    bool _started;
+    bool _readOnly;
+};
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,233 @@
+/**
+ * Storage.cpp (host shim)
+ *
+ * Preferences (NVS) in process memory and fs::FS over a host
+ * directory.
+ */
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <FS.h>
+#include "HostSim.h"
+
+#include <errno.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ========== Preferences ==========
+
+typedef std::map<std::string, std::vector<uint8_t>> Namespace;
+
+static std::mutex nvsLock;
+static std::map<std::string, Namespace> nvs;
+
+Preferences::Preferences() : _started(false), _readOnly(false) {
+    _name[0] = '\0';
+}
+
+Preferences::~Preferences() {
+    end();
+}
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partitionLabel) {
+    (void)partitionLabel;
+    if (_started || name == NULL || strlen(name) > 15) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(nvsLock);
+    if (readOnly && nvs.find(name) == nvs.end()) {
+        return false;   // NVS cannot open a missing namespace read-only
+    }
+    nvs[name];
+    strncpy(_name, name, sizeof(_name) - 1);
+    _name[sizeof(_name) - 1] = '\0';
+    _readOnly = readOnly;
+    _started = true;
+    return true;
+}
+
+void Preferences::end() {
+    _started = false;
+}
+
+bool Preferences::clear() {
+    if (!_started || _readOnly) return false;
+    std::lock_guard<std::mutex> guard(nvsLock);
+    nvs[_name].clear();
+    return true;
+}
+
+bool Preferences::remove(const char* key) {
+    if (!_started || _readOnly) return false;
+    std::lock_guard<std::mutex> guard(nvsLock);
+    return nvs[_name].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char* key) {
+    if (!_started) return false;
+    std::lock_guard<std::mutex> guard(nvsLock);
+    return nvs[_name].count(key) > 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+    if (!_started || _readOnly || key == NULL || strlen(key) > 15) return 0;
+    std::lock_guard<std::mutex> guard(nvsLock);
+    const uint8_t* bytes = (const uint8_t*)value;
+    nvs[_name][key] = std::vector<uint8_t>(bytes, bytes + len);
+    return len;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    if (!_started) return 0;
+    std::lock_guard<std::mutex> guard(nvsLock);
+    Namespace& space = nvs[_name];
+    Namespace::iterator it = space.find(key);
+    return it != space.end() ? it->second.size() : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLen) {
+    if (!_started) return 0;
+    std::lock_guard<std::mutex> guard(nvsLock);
+    Namespace& space = nvs[_name];
+    Namespace::iterator it = space.find(key);
+    if (it == space.end() || it->second.size() > maxLen) {
+        return 0;
+    }
+    memcpy(buffer, it->second.data(), it->second.size());
+    return it->second.size();
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+    uint32_t value;
+    if (getBytesLength(key) != sizeof(value) || getBytes(key, &value, sizeof(value)) != sizeof(value)) {
+        return defaultValue;
+    }
+    return value;
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+    return putBytes(key, value, strlen(value) + 1) > 0 ? strlen(value) : 0;
+}
+
+size_t Preferences::getString(const char* key, char* value, size_t maxLen) {
+    size_t len = getBytes(key, value, maxLen);
+    return len > 0 ? len - 1 : 0;
+}
+
+void HostSim::clearPreferences() {
+    std::lock_guard<std::mutex> guard(nvsLock);
+    nvs.clear();
+}
+
+// ========== FS ==========
+
+namespace fs {
+
+File::File(FILE* file, const std::string& path) : _file(file, fclose), _path(path) {}
+
+size_t File::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+    return _file ? fwrite(buffer, 1, size, _file.get()) : 0;
+}
+
+int File::available() {
+    if (!_file) return 0;
+    long remaining = (long)size() - (long)position();
+    return remaining > 0 ? (int)remaining : 0;
+}
+
+int File::read() {
+    return _file ? fgetc(_file.get()) : -1;
+}
+
+int File::peek() {
+    if (!_file) return -1;
+    int c = fgetc(_file.get());
+    if (c != EOF) ungetc(c, _file.get());
+    return c;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+    return _file ? fread(buffer, 1, size, _file.get()) : 0;
+}
+
+size_t File::readBytes(char* buffer, size_t length) {
+    return read((uint8_t*)buffer, length);
+}
+
+void File::flush() {
+    if (_file) fflush(_file.get());
+}
+
+bool File::seek(uint32_t pos) {
+    return _file && fseek(_file.get(), pos, SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+    return _file ? (size_t)ftell(_file.get()) : 0;
+}
+
+size_t File::size() const {
+    if (!_file) return 0;
+    fflush(_file.get());
+    struct stat info;
+    return fstat(fileno(_file.get()), &info) == 0 ? (size_t)info.st_size : 0;
+}
+
+void File::close() {
+    _file.reset();
+}
+
+std::string FS::hostPath(const char* path) const {
+    std::string result = _root;
+    if (path[0] != '/') result += '/';
+    return result + path;
+}
+
+File FS::open(const char* path, const char* mode, bool create) {
+    (void)create;
+    const char* hostMode = strcmp(mode, FILE_WRITE) == 0 ? "w+b" :
+                           strcmp(mode, FILE_APPEND) == 0 ? "a+b" : "rb";
+    FILE* file = fopen(hostPath(path).c_str(), hostMode);
+    if (file == NULL) return File();
+    return File(file, path);
+}
+
+bool FS::exists(const char* path) {
+    struct stat info;
+    return stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool FS::remove(const char* path) {
+    return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+    return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+    return ::mkdir(hostPath(path).c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+bool FS::rmdir(const char* path) {
+    return ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+} // namespace fs
+
+fs::FS HostSim::hostFS(const char* root) {
+    ::mkdir(root, 0755);
+    return fs::FS(root);
+}
@@ -0,0 +1,68 @@
+/**
+ * Update.h (host shim)
+ *
+ * Mirrors the Arduino UpdateClass: data is buffered into 4 KB
+ * sectors, each sector is erased and written to the next OTA
+ * partition, and the first byte is held back until end() so an
+ * interrupted update never leaves a bootable image.
+ */
+
+#ifndef HOST_UPDATE_H
+#define HOST_UPDATE_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#define U_FLASH 0
+#define U_SPIFFS 100
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+#define UPDATE_ERROR_OK (0)
+#define UPDATE_ERROR_WRITE (1)
+#define UPDATE_ERROR_ERASE (2)
+#define UPDATE_ERROR_READ (3)
+#define UPDATE_ERROR_SPACE (4)
+#define UPDATE_ERROR_SIZE (5)
+#define UPDATE_ERROR_STREAM (6)
+#define UPDATE_ERROR_MD5 (7)
+#define UPDATE_ERROR_MAGIC_BYTE (8)
+#define UPDATE_ERROR_ACTIVATE (9)
+#define UPDATE_ERROR_NO_PARTITION (10)
+#define UPDATE_ERROR_BAD_ARGUMENT (11)
+#define UPDATE_ERROR_ABORT (12)
+
+class UpdateClass {
+public:
+    UpdateClass();
+
+    bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH, int ledPin = -1,
+               uint8_t ledOn = LOW, const char* label = NULL);
+    size_t write(uint8_t* data, size_t len);
+    bool end(bool evenIfRemaining = false);
+    void abort();
+
+    bool isRunning() const { return _size > 0; }
+    bool isFinished() const { return _progress == _size; }
+    bool hasError() const { return _error != UPDATE_ERROR_OK; }
+    uint8_t getError() const { return _error; }
+    size_t size() const { return _size; }
+    size_t progress() const { return _progress; }
+    size_t remaining() const { return _size - _progress; }
+    const char* errorString();
+
+private:
+    const esp_partition_t* _partition;
+    uint8_t _buffer[4096];
+    size_t _bufferLen;
+    size_t _size;
+    size_t _progress;
+    uint8_t _error;
+    uint8_t _skipByte;
+
+    bool writeBuffer();
+    void reset();
+};
+
+extern UpdateClass Update;
+
+#endif // HOST_UPDATE_H
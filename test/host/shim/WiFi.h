@@ -0,0 +1,36 @@
+/**
+ * WiFi.h (host shim)
+ */
+
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiServer.h>
+#include <WiFiUdp.h>
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+class WiFiClass {
+public:
+    wl_status_t status();
+    int hostByName(const char* host, IPAddress& result);
+    IPAddress localIP();
+    IPAddress broadcastIP();
+    IPAddress subnetMask();
+    uint8_t* macAddress(uint8_t* mac);
+    String macAddress();
+};
+
+extern WiFiClass WiFi;
+
+#endif // HOST_WIFI_H
@@ -0,0 +1,82 @@
+/**
+ * WiFiClient.h (host shim)
+ *
+ * TCP client over a host socket. Copies share the socket, as in the
+ * ESP32 core. Reads draw from the device link budget set with
+ * HostSim::setBandwidth(), so available() reports what the link has
+ * delivered so far rather than everything the kernel has buffered.
+ */
+
+#ifndef HOST_WIFICLIENT_H
+#define HOST_WIFICLIENT_H
+
+#include <Arduino.h>
+#include <memory>
+
+class Client : public Stream {
+public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char* host, uint16_t port) = 0;
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int read(uint8_t* buffer, size_t size) = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+    virtual void stop() = 0;
+    virtual uint8_t connected() = 0;
+    virtual operator bool() = 0;
+    using Print::write;
+};
+
+class WiFiClientSocket;
+
+class WiFiClient : public Client {
+public:
+    WiFiClient();
+    /** Adopt an accepted socket (WiFiServer) */
+    explicit WiFiClient(int fd);
+    ~WiFiClient() override;
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, int32_t timeout);
+    int connect(const char* host, uint16_t port) override;
+    int connect(const char* host, uint16_t port, int32_t timeout);
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size) override;
+    size_t readBytes(char* buffer, size_t length) override { return readBytes((uint8_t*)buffer, length); }
+    size_t readBytes(uint8_t* buffer, size_t length) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+
+    /**
+     * Socket descriptor, or -1 when the client has no plain socket
+     * (not connected, or a WiFiClientSecure, whose socket lives in the
+     * TLS context and is not exposed by the ESP32 core)
+     */
+    int fd() const;
+    int setSocketOption(int level, int option, const void* value, size_t len);
+    int setNoDelay(bool nodelay);
+
+    IPAddress remoteIP() const;
+    uint16_t remotePort() const;
+    IPAddress localIP() const;
+
+protected:
+    std::shared_ptr<WiFiClientSocket> _socket;
+    bool _exposeFd;
+    int32_t _connectTimeout;
+
+    int socketFd() const;
+};
+
+#endif // HOST_WIFICLIENT_H
@@ -0,0 +1,27 @@
+/**
+ * WiFiClientSecure.h (host shim)
+ *
+ * No TLS on the host: the "secure" client is a plain TCP connection
+ * that behaves like the ESP32 core's WiFiClientSecure where it
+ * matters to the library, chiefly fd() returning -1.
+ */
+
+#ifndef HOST_WIFICLIENTSECURE_H
+#define HOST_WIFICLIENTSECURE_H
+
+#include <WiFiClient.h>
+
+class WiFiClientSecure : public WiFiClient {
+public:
+    WiFiClientSecure();
+
+    void setInsecure() {}
+    void setCACert(const char* rootCA) { (void)rootCA; }
+    void setHandshakeTimeout(unsigned long seconds) { (void)seconds; }
+
+    using WiFiClient::connect;
+    int connect(IPAddress ip, uint16_t port, const char* host, const char* rootCA,
+                const char* clientCert, const char* clientKey);
+};
+
+#endif // HOST_WIFICLIENTSECURE_H
@@ -0,0 +1,35 @@
+/**
+ * WiFiServer.h (host shim)
+ *
+ * Listens on HostSim::localIP(), so simulated devices in separate
+ * processes can serve the same port side by side.
+ */
+
+#ifndef HOST_WIFISERVER_H
+#define HOST_WIFISERVER_H
+
+#include <WiFiClient.h>
+
+class WiFiServer {
+public:
+    WiFiServer(uint16_t port = 80, uint8_t maxClients = 4);
+    ~WiFiServer();
+
+    void begin(uint16_t port = 0);
+    void end();
+    void close() { end(); }
+    void stop() { end(); }
+    /** Non-blocking accept; an unconnected client when none is waiting */
+    WiFiClient available();
+    WiFiClient accept() { return available(); }
+    void setNoDelay(bool nodelay) { _noDelay = nodelay; }
+    operator bool() const { return _fd >= 0; }
+
+private:
+    uint16_t _port;
+    uint8_t _maxClients;
+    int _fd;
+    bool _noDelay;
+};
+
+#endif // HOST_WIFISERVER_H
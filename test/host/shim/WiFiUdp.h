@@ -0,0 +1,64 @@
+/**
+ * WiFiUdp.h (host shim)
+ *
+ * UDP over host sockets. The LAN broadcast address maps to a loopback
+ * multicast group (239.255.77.77) that every simulated device joins,
+ * so discovery works between processes on one machine.
+ * Datagrams are sent from HostSim::localIP(), and a device does not
+ * hear its own broadcasts, as with lwIP.
+ */
+
+#ifndef HOST_WIFIUDP_H
+#define HOST_WIFIUDP_H
+
+#include <Arduino.h>
+
+class WiFiUDP : public Stream {
+public:
+    WiFiUDP();
+    ~WiFiUDP() override;
+
+    uint8_t begin(uint16_t port);
+    uint8_t begin(IPAddress address, uint16_t port);
+    uint8_t beginMulticast(IPAddress group, uint16_t port);
+    void stop();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int beginPacket(const char* host, uint16_t port);
+    int beginMulticastPacket();
+    int endPacket();
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+
+    int parsePacket();
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t len);
+    int read(char* buffer, size_t len) { return read((uint8_t*)buffer, len); }
+    int peek() override;
+    void flush() override;
+
+    IPAddress remoteIP() const { return _remoteIP; }
+    uint16_t remotePort() const { return _remotePort; }
+
+private:
+    int _fd;
+    uint16_t _port;
+    IPAddress _multicast;
+
+    uint8_t* _txBuffer;
+    size_t _txLen;
+    IPAddress _txIP;
+    uint16_t _txPort;
+
+    uint8_t* _rxBuffer;
+    size_t _rxLen;
+    size_t _rxPos;
+    IPAddress _remoteIP;
+    uint16_t _remotePort;
+
+    bool open(uint16_t port);
+};
+
+#endif // HOST_WIFIUDP_H
@@ -0,0 +1,12 @@
+/**
+ * esp_app_desc.h (host shim) - ESP-IDF 5.x home of the app description
+ */
+
+#ifndef HOST_ESP_APP_DESC_H
+#define HOST_ESP_APP_DESC_H
+
+#include "esp_app_format.h"
+
+const esp_app_desc_t* esp_app_get_description(void);
+
+#endif // HOST_ESP_APP_DESC_H
@@ -0,0 +1,41 @@
+/**
+ * esp_ota_ops.h (host shim)
+ *
+ * Two OTA slots, app0 and app1. The running partition is app0 until a
+ * test changes it (HostSim::resetFlash()).
+ */
+
+#ifndef HOST_ESP_OTA_OPS_H
+#define HOST_ESP_OTA_OPS_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_app_format.h"
+#include "esp_app_desc.h"
+#include "esp_idf_version.h"
+
+typedef enum {
+    ESP_OTA_IMG_NEW = 0x0U,
+    ESP_OTA_IMG_PENDING_VERIFY = 0x1U,
+    ESP_OTA_IMG_VALID = 0x2U,
+    ESP_OTA_IMG_INVALID = 0x3U,
+    ESP_OTA_IMG_ABORTED = 0x4U,
+    ESP_OTA_IMG_UNDEFINED = 0xFFFFFFFFU,
+} esp_ota_img_states_t;
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+const esp_partition_t* esp_ota_get_running_partition(void);
+const esp_partition_t* esp_ota_get_boot_partition(void);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+esp_err_t esp_ota_get_partition_description(const esp_partition_t* partition, esp_app_desc_t* app_desc);
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* ota_state);
+bool esp_ota_check_rollback_is_possible(void);
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void);
+
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0)
+/** Removed in IDF 5 in favour of esp_app_get_description() */
+const esp_app_desc_t* esp_ota_get_app_description(void);
+#endif
+
+#endif // HOST_ESP_OTA_OPS_H
@@ -0,0 +1,15 @@
+/**
+ * lwip/sockets.h (host shim) - the host's BSD sockets
+ */
+
+#ifndef HOST_LWIP_SOCKETS_H
+#define HOST_LWIP_SOCKETS_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#endif // HOST_LWIP_SOCKETS_H
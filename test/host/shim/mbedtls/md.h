@@ -0,0 +1,13 @@
+/**
+ * mbedtls/md.h (host shim)
+ */
+
+#ifndef HOST_MBEDTLS_MD_H
+#define HOST_MBEDTLS_MD_H
+
+typedef enum {
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_SHA256 = 6,
+} mbedtls_md_type_t;
+
+#endif // HOST_MBEDTLS_MD_H
@@ -0,0 +1,25 @@
+/**
+ * mbedtls/pk.h (host shim) - public key parsing and ECDSA/RSA verify over OpenSSL
+ */
+
+#ifndef HOST_MBEDTLS_PK_H
+#define HOST_MBEDTLS_PK_H
+
+#include <stddef.h>
+#include "md.h"
+
+#define MBEDTLS_ERR_PK_BAD_INPUT_DATA -0x3E80
+#define MBEDTLS_ERR_PK_KEY_INVALID_FORMAT -0x3D00
+#define MBEDTLS_ERR_ECP_VERIFY_FAILED -0x4E00
+
+typedef struct {
+    void* key;  // EVP_PKEY*, NULL when empty
+} mbedtls_pk_context;
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx);
+void mbedtls_pk_free(mbedtls_pk_context* ctx);
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen);
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t md_alg, const unsigned char* hash,
+                      size_t hash_len, const unsigned char* sig, size_t sig_len);
+
+#endif // HOST_MBEDTLS_PK_H
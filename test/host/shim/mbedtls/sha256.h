@@ -0,0 +1,21 @@
+/**
+ * mbedtls/sha256.h (host shim) - implemented over OpenSSL EVP
+ */
+
+#ifndef HOST_MBEDTLS_SHA256_H
+#define HOST_MBEDTLS_SHA256_H
+
+#include <stddef.h>
+
+typedef struct {
+    void* md;   // EVP_MD_CTX*, NULL until starts()
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224);
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen);
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char* output);
+int mbedtls_sha256(const unsigned char* input, size_t ilen, unsigned char* output, int is224);
+
+#endif // HOST_MBEDTLS_SHA256_H
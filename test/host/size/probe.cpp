@@ -0,0 +1,65 @@
+/**
+ * probe.cpp - Application linked for the size report
+ *
+ * Configures and runs the library the way a sketch would, so the linker
+ * keeps what a firmware using every runtime feature keeps and drops the
+ * rest. Attachable modules (OTAGateway, OTAMulticastSource) are left out,
+ * as in a sketch that does not construct them. Only run to print the
+ * size of an instance (--instance-size); otherwise only measured.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <string.h>
+
+static const uint8_t KEY[32] = {0};
+
+static void onProgress(size_t current, size_t total) {}
+static void onError(const char* error) {}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && strcmp(argv[1], "--instance-size") == 0) {
+        printf("%u\n", (unsigned)sizeof(ESP32_AutoOTA));
+        return 0;
+    }
+
+    ESP32_AutoOTA ota;
+    ota.setFirmwareURL("https://example.com/firmware.bin");
+    ota.setVersionURL("https://example.com/version.txt");
+    ota.addFirmwareMirror("https://mirror.example.com/firmware.bin");
+    ota.addVersionMirror("https://mirror.example.com/version.txt");
+    ota.setCurrentVersion("1.0.0");
+    ota.setStaggeredRollout(true, 25);
+    ota.setStatusLED(2);
+    ota.setParallelDownload(argc);
+    ota.setBandwidthLimit(argc * 1000);
+    ota.setBackgroundErase(argc > 2);
+    ota.setSkipUnchangedSectors(argc > 3);
+    ota.setImageValidation(true, argc > 4);
+    ota.setVersionFromImage(argc > 5);
+    ota.setLongPoll(argc > 6);
+    ota.setPeerSharing(argc > 7);
+    ota.setGatewayDiscovery(argc > 8);
+    ota.setDecryptionKey(argc > 9 ? KEY : NULL);
+    ota.setSigningKey(argc > 10 ? argv[10] : NULL);
+    ota.onUpdateProgress(onProgress);
+    ota.onUpdateError(onError);
+
+    if (argc > 11) {
+        ota.begin();
+    } else {
+        ota.beginPolled();
+        ota.poll();
+    }
+    ota.pushHeartbeat();
+    ota.notifyRelease(argv[0]);
+    ota.forceCheck();
+    ota.pauseDownload();
+    ota.resumeDownload();
+    OTAStats stats = ota.getStats();
+    ota.stop();
+
+    OTAMemorySource memory((const uint8_t*)argv[0], stats.checkCount);
+    ota.updateFrom(memory);
+    OTATrace::dump(Serial);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * Bench.h - Helpers shared by the host benchmarks
+ *
+ * Benchmarks take "--name value" arguments with defaults sized for a
+ * full run; ctest passes smaller values. Results are printed as one
+ * "name: value unit" line each so runs can be diffed.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace Bench {
+
+class Args {
+public:
+    Args(int argc, char** argv) : _argc(argc), _argv(argv) {}
+
+    double get(const char* name, double fallback) const {
+        for (int i = 1; i + 1 < _argc; i++) {
+            if (strncmp(_argv[i], "--", 2) == 0 && strcmp(_argv[i] + 2, name) == 0) {
+                return atof(_argv[i + 1]);
+            }
+        }
+        return fallback;
+    }
+
+    const char* text(const char* name, const char* fallback) const {
+        for (int i = 1; i + 1 < _argc; i++) {
+            if (strncmp(_argv[i], "--", 2) == 0 && strcmp(_argv[i] + 2, name) == 0) {
+                return _argv[i + 1];
+            }
+        }
+        return fallback;
+    }
+
+private:
+    int _argc;
+    char** _argv;
+};
+
+inline uint64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * Value below which the given fraction of samples fall (nearest rank)
+ */
+inline double percentile(std::vector<double> samples, double fraction) {
+    if (samples.empty()) return 0;
+    std::sort(samples.begin(), samples.end());
+    size_t index = (size_t)(fraction * (samples.size() - 1) + 0.5);
+    return samples[std::min(index, samples.size() - 1)];
+}
+
+inline void report(const char* name, double value, const char* unit) {
+    printf("  %-40s %14.3f %s\n", name, value, unit);
+    fflush(stdout);
+}
+
+inline void section(const char* title) {
+    printf("%s\n", title);
+    fflush(stdout);
+}
+
+} // namespace Bench
+
+#endif // BENCH_H
@@ -0,0 +1,251 @@
+/**
+ * Fixtures.cpp - Firmware images, manifests and keys for host tests
+ */
+
+#include "Fixtures.h"
+
+#include <Arduino.h>
+#include <esp_app_format.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <random>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace Fixtures {
+
+Bytes makeImage(size_t size, const char* version, const char* project, uint32_t seed, uint16_t chipId) {
+    const size_t headerLen = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t);
+    if (size < headerLen) size = headerLen;
+    Bytes image(size);
+
+    std::mt19937 generator(seed);
+    for (size_t i = 0; i < size; i += 4) {
+        uint32_t value = generator();
+        memcpy(&image[i], &value, min((size_t)4, size - i));
+    }
+
+    esp_image_header_t header = {};
+    header.magic = ESP_IMAGE_HEADER_MAGIC;
+    header.segment_count = 1;
+    header.spi_speed = 0;
+    header.spi_size = 2;
+    header.entry_addr = 0x40080000;
+    header.wp_pin = 0xEE;
+    header.chip_id = chipId;
+    memcpy(&image[0], &header, sizeof(header));
+
+    esp_image_segment_header_t segment = {0x3F400020, (uint32_t)(size - sizeof(header) - sizeof(segment))};
+    memcpy(&image[sizeof(header)], &segment, sizeof(segment));
+
+    esp_app_desc_t desc = {};
+    desc.magic_word = ESP_APP_DESC_MAGIC_WORD;
+    strncpy(desc.version, version, sizeof(desc.version) - 1);
+    strncpy(desc.project_name, project, sizeof(desc.project_name) - 1);
+    strncpy(desc.time, "00:00:00", sizeof(desc.time) - 1);
+    strncpy(desc.date, "Jan  1 2026", sizeof(desc.date) - 1);
+    strncpy(desc.idf_ver, "v4.4-host", sizeof(desc.idf_ver) - 1);
+    memcpy(&image[sizeof(header) + sizeof(segment)], &desc, sizeof(desc));
+    return image;
+}
+
+Bytes withBadMagic(const Bytes& image) {
+    Bytes damaged = image;
+    damaged[0] = 0x00;
+    return damaged;
+}
+
+Bytes withoutAppDesc(const Bytes& image) {
+    Bytes damaged = image;
+    memset(&damaged[sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t)], 0, sizeof(uint32_t));
+    return damaged;
+}
+
+Bytes nextBuild(const Bytes& previous, const char* version, uint32_t changedSectors,
+                size_t insertAt, size_t insertLen, uint32_t seed) {
+    Bytes image = previous;
+    std::mt19937 generator(seed);
+    if (insertLen > 0 && insertAt < image.size()) {
+        Bytes inserted(insertLen);
+        for (uint8_t& b : inserted) b = (uint8_t)generator();
+        image.insert(image.begin() + insertAt, inserted.begin(), inserted.end());
+    }
+
+    const size_t sector = 4096;
+    size_t sectors = image.size() / sector;
+    for (uint32_t i = 0; i < changedSectors && sectors > 1; i++) {
+        size_t offset = (1 + generator() % (sectors - 1)) * sector + generator() % (sector - 64);
+        for (size_t j = 0; j < 64; j++) image[offset + j] ^= (uint8_t)(generator() | 1);
+    }
+
+    const size_t headerLen = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t);
+    esp_image_segment_header_t segment;
+    memcpy(&segment, &image[sizeof(esp_image_header_t)], sizeof(segment));
+    segment.data_len = (uint32_t)(image.size() - headerLen);
+    memcpy(&image[sizeof(esp_image_header_t)], &segment, sizeof(segment));
+    esp_app_desc_t desc;
+    memcpy(&desc, &image[headerLen], sizeof(desc));
+    memset(desc.version, 0, sizeof(desc.version));
+    strncpy(desc.version, version, sizeof(desc.version) - 1);
+    memcpy(&image[headerLen], &desc, sizeof(desc));
+    return image;
+}
+
+Bytes readFile(const std::string& path) {
+    Bytes data;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == NULL) return data;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(file);
+    return data;
+}
+
+bool writeFile(const std::string& path, const Bytes& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == NULL) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && ok;
+}
+
+std::string toString(const Bytes& data) {
+    return std::string((const char*)data.data(), data.size());
+}
+
+Bytes sha256(const Bytes& data) {
+    Bytes digest(32);
+    unsigned int len = 0;
+    EVP_Digest(data.data(), data.size(), digest.data(), &len, EVP_sha256(), NULL);
+    return digest;
+}
+
+std::string hex(const Bytes& data) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    for (uint8_t b : data) {
+        out += digits[b >> 4];
+        out += digits[b & 0x0F];
+    }
+    return out;
+}
+
+// ========== Signing ==========
+
+SigningKey::SigningKey() {
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    EVP_PKEY* key = NULL;
+    EVP_PKEY_keygen_init(ctx);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(ctx, &key);
+    EVP_PKEY_CTX_free(ctx);
+    _key = key;
+}
+
+SigningKey::~SigningKey() {
+    EVP_PKEY_free((EVP_PKEY*)_key);
+}
+
+std::string SigningKey::publicPem() const {
+    BIO* bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_PUBKEY(bio, (EVP_PKEY*)_key);
+    char* data = NULL;
+    long len = BIO_get_mem_data(bio, &data);
+    std::string pem(data, len);
+    BIO_free(bio);
+    return pem;
+}
+
+Bytes SigningKey::sign(const Bytes& digest) const {
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new((EVP_PKEY*)_key, NULL);
+    EVP_PKEY_sign_init(ctx);
+    EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha256());
+    size_t len = 0;
+    EVP_PKEY_sign(ctx, NULL, &len, digest.data(), digest.size());
+    Bytes signature(len);
+    EVP_PKEY_sign(ctx, signature.data(), &len, digest.data(), digest.size());
+    signature.resize(len);
+    EVP_PKEY_CTX_free(ctx);
+    return signature;
+}
+
+// ========== Encryption ==========
+
+Bytes encryptImage(const Bytes& image, const uint8_t* key, size_t keyLen, const uint8_t nonce[12]) {
+    const size_t start = 16;
+    Bytes out(start + image.size());
+    memcpy(&out[0], "AOTE", 4);
+    memcpy(&out[4], nonce, 12);
+
+    uint8_t iv[16] = {};
+    memcpy(iv, nonce, 12);
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int len = 0;
+    EVP_EncryptInit_ex(ctx, keyLen == 32 ? EVP_aes_256_ctr() : EVP_aes_128_ctr(), NULL, key, iv);
+    EVP_EncryptUpdate(ctx, &out[start], &len, image.data(), (int)image.size());
+    EVP_CIPHER_CTX_free(ctx);
+    return out;
+}
+
+std::string versionFile(const char* version, const Bytes* image, const SigningKey* key) {
+    std::string body = std::string(version) + "\n";
+    if (image != nullptr) {
+        Bytes digest = sha256(*image);
+        body += "sha256=" + hex(digest) + "\n";
+        if (key != nullptr) {
+            body += "sig=" + hex(key->sign(digest)) + "\n";
+        }
+    }
+    return body;
+}
+
+// ========== Processes and files ==========
+
+std::string tempDir(const char* tag) {
+    const char* base = getenv("TMPDIR");
+    std::string pattern = std::string(base ? base : "/tmp") + "/autoota_" + tag + "_XXXXXX";
+    std::vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    if (mkdtemp(path.data()) == NULL) {
+        perror("mkdtemp");
+        abort();
+    }
+    return std::string(path.data());
+}
+
+int spawnDevice(const char* self, const std::vector<std::string>& args) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        std::vector<char*> argv;
+        argv.push_back((char*)self);
+        argv.push_back((char*)"--device");
+        for (const auto& arg : args) argv.push_back((char*)arg.c_str());
+        argv.push_back(NULL);
+        execv(self, argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+int waitDevice(int pid, uint32_t timeoutMs) {
+    uint64_t start = millis();
+    while (millis() - start < timeoutMs) {
+        int status = 0;
+        pid_t done = waitpid(pid, &status, WNOHANG);
+        if (done == pid) {
+            return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        }
+        usleep(5000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+} // namespace Fixtures
@@ -0,0 +1,119 @@
+/**
+ * Fixtures.h - Firmware images, manifests and keys for host tests
+ */
+
+#ifndef FIXTURES_H
+#define FIXTURES_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Fixtures {
+
+typedef std::vector<uint8_t> Bytes;
+
+/**
+ * A firmware image the library accepts: valid image header, one
+ * segment opening with an esp_app_desc_t, then pseudo-random filler
+ *
+ * @param size Total size in bytes
+ * @param version Embedded version string
+ * @param project Embedded project name (the host's running app is "host_app")
+ * @param seed Filler seed, so two images of one size differ
+ * @param chipId Chip ID in the image header
+ */
+Bytes makeImage(size_t size, const char* version = "2.0.0", const char* project = "host_app",
+                uint32_t seed = 1, uint16_t chipId = 0);
+
+/**
+ * Damaged copies of an image: the header's magic byte overwritten, or
+ * the app descriptor's magic word cleared
+ */
+Bytes withBadMagic(const Bytes& image);
+Bytes withoutAppDesc(const Bytes& image);
+
+/**
+ * The next build of an image, the way consecutive releases differ: new
+ * version string in the app descriptor, a few sectors changed in
+ * place, and optionally code inserted part way, which moves everything
+ * after it
+ *
+ * @param changedSectors 4 KB sectors after the first whose bytes change
+ * @param insertAt Offset where insertLen new bytes go, 0 for none
+ */
+Bytes nextBuild(const Bytes& previous, const char* version, uint32_t changedSectors,
+                size_t insertAt = 0, size_t insertLen = 0, uint32_t seed = 2);
+
+/**
+ * Read or write a whole file, e.g. a build output passed to a benchmark
+ */
+Bytes readFile(const std::string& path);
+bool writeFile(const std::string& path, const Bytes& data);
+
+std::string toString(const Bytes& data);
+
+Bytes sha256(const Bytes& data);
+std::string hex(const Bytes& data);
+
+/**
+ * An ECDSA P-256 key pair, as made by tools/ota_sign.py genkey
+ */
+class SigningKey {
+public:
+    SigningKey();
+    ~SigningKey();
+
+    SigningKey(const SigningKey&) = delete;
+    SigningKey& operator=(const SigningKey&) = delete;
+
+    std::string publicPem() const;
+
+    /**
+     * DER signature over a SHA-256 digest
+     */
+    Bytes sign(const Bytes& digest) const;
+
+private:
+    void* _key;
+};
+
+/**
+ * An AES-CTR encrypted image as written by tools/ota_encrypt.py:
+ * "AOTE", 12-byte nonce, ciphertext
+ *
+ * @param keyLen 16 or 32 (AES-128 or AES-256)
+ */
+Bytes encryptImage(const Bytes& image, const uint8_t* key, size_t keyLen, const uint8_t nonce[12]);
+
+/**
+ * Version file body: the version, then sha256= and sig= lines when
+ * requested
+ *
+ * @param image Image whose digest to publish, NULL for none
+ * @param key Key to sign the digest with, NULL for no signature
+ */
+std::string versionFile(const char* version, const Bytes* image = nullptr, const SigningKey* key = nullptr);
+
+/**
+ * Fresh empty directory under the system temp dir
+ */
+std::string tempDir(const char* tag);
+
+/**
+ * Run this executable again as another simulated device: the child
+ * gets "--device <role> <args...>" and the parent continues at once
+ *
+ * @return Child process ID
+ */
+int spawnDevice(const char* self, const std::vector<std::string>& args);
+
+/**
+ * Wait for a spawned device and return its exit status (-1 on timeout,
+ * in which case the child is killed)
+ */
+int waitDevice(int pid, uint32_t timeoutMs);
+
+} // namespace Fixtures
+
+#endif // FIXTURES_H
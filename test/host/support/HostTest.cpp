@@ -0,0 +1,134 @@
+/**
+ * HostTest.cpp - Minimal test runner for the host build
+ */
+
+#include "HostTest.h"
+#include <HostSim.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace HostTest {
+
+struct Entry {
+    const char* name;
+    TestFunction function;
+};
+
+struct Device {
+    const char* role;
+    DeviceFunction function;
+};
+
+static std::vector<Entry>& registry() {
+    static std::vector<Entry> entries;
+    return entries;
+}
+
+static std::vector<Device>& devices() {
+    static std::vector<Device> entries;
+    return entries;
+}
+
+static int failureCount = 0;
+static char executable[PATH_MAX];
+
+Registrar::Registrar(const char* name, TestFunction function) {
+    registry().push_back({name, function});
+}
+
+DeviceRegistrar::DeviceRegistrar(const char* role, DeviceFunction function) {
+    devices().push_back({role, function});
+}
+
+void fail(const char* file, int line, const std::string& message) {
+    fprintf(stderr, "  %s:%d: FAILED %s\n", file, line, message.c_str());
+    failureCount++;
+}
+
+int failures() {
+    return failureCount;
+}
+
+void resetSimulation() {
+    HostSim::setFlashLatency(0, 0, 0);
+    HostSim::resetFlash();
+    HostSim::setRunningApp("1.0.0", "host_app");
+    HostSim::setUpdateCallOverhead(0);
+    HostSim::resetUpdateCounters();
+    HostSim::setBandwidth(0);
+    HostSim::setConnectLatency(0);
+    HostSim::setPacketLoss(0);
+    HostSim::setLocalIP(IPAddress(127, 0, 0, 1));
+    HostSim::setWiFiConnected(true);
+    HostSim::resetBytesReceived();
+    HostSim::setDnsDelay(0);
+    HostSim::setDnsFailure(false);
+    HostSim::resetDnsLookups();
+    HostSim::clearPreferences();
+    HostSim::setFreeHeap(200000);
+    HostSim::setResetReason(ESP_RST_POWERON);
+    HostSim::clearSerialOutput();
+}
+
+bool waitFor(const std::function<bool()>& condition, uint32_t timeoutMs) {
+    unsigned long start = millis();
+    while (!condition()) {
+        if (millis() - start > timeoutMs) return false;
+        usleep(1000);
+    }
+    return true;
+}
+
+const char* self() {
+    return executable;
+}
+
+int run(int argc, char** argv) {
+    ssize_t len = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+    executable[len > 0 ? len : 0] = '\0';
+
+    if (argc >= 3 && strcmp(argv[1], "--device") == 0) {
+        for (const Device& device : devices()) {
+            if (strcmp(device.role, argv[2]) == 0) {
+                HostSim::setSerialEcho(false);
+                resetSimulation();
+                return device.function(argc - 3, argv + 3);
+            }
+        }
+        fprintf(stderr, "unknown device role %s\n", argv[2]);
+        return 2;
+    }
+
+    int failed = 0;
+    int ran = 0;
+    for (const Entry& entry : registry()) {
+        if (argc > 1) {
+            bool selected = false;
+            for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], entry.name) == 0) selected = true;
+            }
+            if (!selected) continue;
+        }
+
+        printf("[ RUN  ] %s\n", entry.name);
+        fflush(stdout);
+        resetSimulation();
+        int before = failureCount;
+        unsigned long start = millis();
+        try {
+            entry.function();
+        } catch (const RequireFailed&) {
+        }
+        bool ok = failureCount == before;
+        printf("[ %s ] %s (%lu ms)\n", ok ? " OK " : "FAIL", entry.name, millis() - start);
+        fflush(stdout);
+        if (!ok) failed++;
+        ran++;
+    }
+    printf("%d of %d tests passed\n", ran - failed, ran);
+    return failed;
+}
+
+} // namespace HostTest
@@ -0,0 +1,118 @@
+/**
+ * HostTest.h - Minimal test runner for the host build
+ *
+ * TEST(name) { ... } registers a test; CHECK records a failure and
+ * continues, REQUIRE stops the current test. HostTest::run() resets
+ * the simulated device before each test and returns the number of
+ * failed tests, which becomes the process exit code for ctest.
+ *
+ *   ./test_install              run every test
+ *   ./test_install name ...     run the named tests only
+ *
+ * DEVICE(role) defines a role the executable plays when started with
+ * "--device <role> <args...>", for tests that need several devices.
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <Arduino.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace HostTest {
+
+typedef void (*TestFunction)();
+typedef int (*DeviceFunction)(int argc, char** argv);
+
+struct Registrar {
+    Registrar(const char* name, TestFunction function);
+};
+
+/**
+ * A role this executable can play when spawned as another device
+ * (Fixtures::spawnDevice); the function's return is the exit code
+ */
+struct DeviceRegistrar {
+    DeviceRegistrar(const char* role, DeviceFunction function);
+};
+
+struct RequireFailed {};
+
+void fail(const char* file, int line, const std::string& message);
+
+/**
+ * Failed checks so far in this process (a device's exit code)
+ */
+int failures();
+
+/**
+ * Put the simulated device back to factory state: flash, NVS, link
+ * and DNS settings, Wi-Fi up, default local address
+ */
+void resetSimulation();
+
+/**
+ * Poll a condition every millisecond until it holds or the time is up
+ */
+bool waitFor(const std::function<bool()>& condition, uint32_t timeoutMs);
+
+/**
+ * Path of the running test executable, for spawning devices
+ */
+const char* self();
+
+int run(int argc, char** argv);
+
+template <typename A, typename B>
+std::string describe(const A& a, const B& b) {
+    return std::to_string(a) + " vs " + std::to_string(b);
+}
+
+inline std::string describe(const std::string& a, const std::string& b) {
+    return "\"" + a + "\" vs \"" + b + "\"";
+}
+
+inline std::string describe(const char* a, const char* b) {
+    return describe(std::string(a ? a : "(null)"), std::string(b ? b : "(null)"));
+}
+
+} // namespace HostTest
+
+#define TEST(name)                                                        \
+    static void name();                                                   \
+    static HostTest::Registrar name##_registrar(#name, name);             \
+    static void name()
+
+#define DEVICE(role)                                                      \
+    static int role##_device(int argc, char** argv);                      \
+    static HostTest::DeviceRegistrar role##_registrar(#role, role##_device); \
+    static int role##_device(int argc, char** argv)
+
+#define CHECK(condition)                                                  \
+    do {                                                                  \
+        if (!(condition)) HostTest::fail(__FILE__, __LINE__, #condition); \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                          \
+    do {                                                                                        \
+        if (!((a) == (b)))                                                                      \
+            HostTest::fail(__FILE__, __LINE__, #a " == " #b " (" + HostTest::describe(a, b) + ")"); \
+    } while (0)
+
+#define CHECK_STR(a, b)                                                                        \
+    do {                                                                                       \
+        if (strcmp((a), (b)) != 0)                                                             \
+            HostTest::fail(__FILE__, __LINE__, #a " == " #b " (" + HostTest::describe(a, b) + ")"); \
+    } while (0)
+
+#define REQUIRE(condition)                                                \
+    do {                                                                  \
+        if (!(condition)) {                                               \
+            HostTest::fail(__FILE__, __LINE__, #condition);               \
+            throw HostTest::RequireFailed();                              \
+        }                                                                 \
+    } while (0)
+
+#endif // HOST_TEST_H
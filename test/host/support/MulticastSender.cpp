@@ -0,0 +1,131 @@
+/**
+ * MulticastSender.cpp - Multicast image stream for host tests
+ */
+
+#include "MulticastSender.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Fixtures.h"
+
+// Packet layout of OTAMulticastSource (host_support does not see the library)
+#define MCAST_MAGIC 0x4D544F41
+#define MCAST_HEADER_LEN 20
+
+MulticastSender::MulticastSender(IPAddress group, uint16_t port, IPAddress from)
+    : _group(group), _port(port), _groups(0), _k(0), _sent(0), _beaconing(false) {
+    _fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = (uint32_t)from;
+    bind(_fd, (sockaddr*)&address, sizeof(address));
+    in_addr loopback;
+    loopback.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback));
+    int bufferSize = 1 << 20;
+    setsockopt(_fd, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+}
+
+MulticastSender::~MulticastSender() {
+    stop();
+    close(_fd);
+}
+
+void MulticastSender::load(const std::vector<uint8_t>& image, uint16_t blockSize, uint8_t k) {
+    _packets.clear();
+    _k = k;
+    uint32_t imageId;
+    memcpy(&imageId, Fixtures::sha256(image).data(), sizeof(imageId));
+
+    size_t groupBytes = (size_t)blockSize * k;
+    _groups = (image.size() + groupBytes - 1) / groupBytes;
+    for (uint32_t group = 0; group < _groups; group++) {
+        size_t start = group * groupBytes;
+        size_t len = min(groupBytes, image.size() - start);
+        size_t blocks = (len + blockSize - 1) / blockSize;
+        std::vector<uint8_t> parity(blockSize, 0);
+
+        for (size_t index = 0; index <= blocks; index++) {
+            bool isParity = index == blocks;
+            uint8_t header[MCAST_HEADER_LEN];
+            uint32_t magic = MCAST_MAGIC;
+            uint32_t size = image.size();
+            uint8_t kValue = k;
+            uint8_t indexValue = isParity ? k : index;
+            memcpy(header, &magic, 4);
+            memcpy(header + 4, &imageId, 4);
+            memcpy(header + 8, &size, 4);
+            memcpy(header + 12, &group, 4);
+            memcpy(header + 16, &blockSize, 2);
+            header[18] = kValue;
+            header[19] = indexValue;
+
+            std::vector<uint8_t> packet(header, header + sizeof(header));
+            if (isParity) {
+                packet.insert(packet.end(), parity.begin(), parity.end());
+            } else {
+                size_t offset = start + index * blockSize;
+                size_t n = min((size_t)blockSize, start + len - offset);
+                std::vector<uint8_t> block(blockSize, 0);
+                memcpy(block.data(), &image[offset], n);
+                for (size_t i = 0; i < blockSize; i++) parity[i] ^= block[i];
+                packet.insert(packet.end(), block.begin(), block.end());
+            }
+            _packets.push_back(packet);
+        }
+    }
+}
+
+void MulticastSender::beacon() {
+    stop();
+    _beaconing = true;
+    _thread = std::thread([this]() {
+        while (_beaconing) {
+            send(_packets[0]);
+            delay(20);
+        }
+    });
+}
+
+void MulticastSender::start(uint32_t bytesPerSecond, int rounds, const SkipFunction& skip) {
+    stop();
+    _sent = 0;
+    _thread = std::thread([this, bytesPerSecond, rounds, skip]() {
+        auto next = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++) {
+            for (const std::vector<uint8_t>& packet : _packets) {
+                uint32_t group;
+                memcpy(&group, &packet[12], sizeof(group));
+                if (skip && skip(group, packet[19])) continue;
+
+                send(packet);
+                next += std::chrono::microseconds((uint64_t)packet.size() * 1000000 / bytesPerSecond);
+                std::this_thread::sleep_until(next);
+            }
+        }
+    });
+}
+
+void MulticastSender::wait() {
+    if (_thread.joinable()) _thread.join();
+}
+
+void MulticastSender::send(const std::vector<uint8_t>& packet) {
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = (uint32_t)_group;
+    address.sin_port = htons(_port);
+    if (sendto(_fd, packet.data(), packet.size(), 0, (sockaddr*)&address, sizeof(address)) > 0) {
+        _sent++;
+    }
+}
+
+void MulticastSender::stop() {
+    _beaconing = false;
+    wait();
+}
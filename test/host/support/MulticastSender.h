@@ -0,0 +1,73 @@
+/**
+ * MulticastSender.h - Multicast image stream for host tests
+ *
+ * Sends an image in the OTAMulticastSource packet format, the way
+ * tools/ota_multicast_send.py does: groups of k data blocks, each
+ * followed by its XOR parity block, paced at a byte rate. Packets go
+ * from a loopback address of their own, so receivers in the test
+ * process do not discard them as their own broadcasts. Chosen packets
+ * can be left out to model loss every receiver sees.
+ */
+
+#ifndef MULTICAST_SENDER_H
+#define MULTICAST_SENDER_H
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class MulticastSender {
+public:
+    /// Return true to leave a packet out
+    typedef std::function<bool(uint32_t group, uint8_t index)> SkipFunction;
+
+    MulticastSender(IPAddress group, uint16_t port, IPAddress from = IPAddress(127, 0, 0, 9));
+    ~MulticastSender();
+
+    /**
+     * Cut an image into packets
+     */
+    void load(const std::vector<uint8_t>& image, uint16_t blockSize = 1024, uint8_t k = 8);
+
+    /**
+     * Repeat group 0's first packet every 20 ms until start(), so
+     * receivers can open() and lock on to the session beforehand
+     */
+    void beacon();
+
+    /**
+     * Stream the packets on a thread of its own
+     * @param bytesPerSecond Pace, counting headers
+     * @param rounds Times the image is sent
+     */
+    void start(uint32_t bytesPerSecond, int rounds = 1, const SkipFunction& skip = nullptr);
+
+    /**
+     * Wait for the stream to end
+     */
+    void wait();
+
+    /// Packets of the stream sent since start(), beacons not counted
+    uint32_t packetsSent() const { return _sent; }
+    uint32_t groups() const { return _groups; }
+
+private:
+    int _fd;
+    IPAddress _group;
+    uint16_t _port;
+    std::vector<std::vector<uint8_t>> _packets;
+    uint32_t _groups;
+    uint8_t _k;
+    std::atomic<uint32_t> _sent;
+    std::atomic<bool> _beaconing;
+    std::thread _thread;
+
+    void send(const std::vector<uint8_t>& packet);
+    void stop();
+};
+
+#endif // MULTICAST_SENDER_H
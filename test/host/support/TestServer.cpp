@@ -0,0 +1,380 @@
+/**
+ * TestServer.cpp - Scriptable HTTP/1.1 server for host tests
+ */
+
+#include "TestServer.h"
+
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <random>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+std::string TestRequest::header(const std::string& name) const {
+    std::string key;
+    for (char c : name) key += (char)tolower((unsigned char)c);
+    auto it = headers.find(key);
+    return it == headers.end() ? std::string() : it->second;
+}
+
+TestServer::TestServer(const char* address, uint16_t port)
+    : _address(address), _port(port), _listenFd(-1), _running(false), _connections(0), _bytesSent(0) {
+    _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, address, &addr.sin_addr);
+    if (bind(_listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(_listenFd, 64) != 0) {
+        fprintf(stderr, "TestServer: cannot listen on %s:%u: %s\n", address, port, strerror(errno));
+        abort();
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(_listenFd, (sockaddr*)&addr, &len);
+    _port = ntohs(addr.sin_port);
+
+    _running = true;
+    _acceptThread = std::thread(&TestServer::acceptLoop, this);
+}
+
+TestServer::~TestServer() {
+    stop();
+}
+
+void TestServer::stop() {
+    if (!_running.exchange(false)) return;
+    shutdown(_listenFd, SHUT_RDWR);
+    _acceptThread.join();
+    close(_listenFd);
+
+    std::vector<std::thread> workers;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int fd : _openFds) shutdown(fd, SHUT_RDWR);
+        workers.swap(_workers);
+    }
+    _changed.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void TestServer::route(const std::string& path, const TestRoute& route) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _routes[path] = route;
+    }
+    _changed.notify_all();
+}
+
+void TestServer::update(const std::string& path, const std::function<void(TestRoute&)>& change) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        change(_routes[path]);
+    }
+    _changed.notify_all();
+}
+
+void TestServer::remove(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _routes.erase(path);
+    }
+    _changed.notify_all();
+}
+
+std::string TestServer::url(const std::string& path) const {
+    return "http://" + _address + ":" + std::to_string(_port) + path;
+}
+
+std::vector<TestRequest> TestServer::requests() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _log;
+}
+
+uint32_t TestServer::requestCount(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t count = 0;
+    for (const auto& request : _log) {
+        if (request.path == path) count++;
+    }
+    return count;
+}
+
+void TestServer::clearLog() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _log.clear();
+}
+
+// ========== Connections ==========
+
+void TestServer::acceptLoop() {
+    while (_running) {
+        pollfd pfd = {_listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, 50) <= 0) continue;
+        int fd = ::accept(_listenFd, NULL, NULL);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running) {
+            close(fd);
+            break;
+        }
+        uint32_t connection = ++_connections;
+        _openFds.push_back(fd);
+        _workers.emplace_back(&TestServer::serve, this, fd, connection);
+    }
+}
+
+static bool readRequest(int fd, std::string& buffer, std::string& head, const std::atomic<bool>& running) {
+    while (running) {
+        size_t end = buffer.find("\r\n\r\n");
+        if (end != std::string::npos) {
+            head = buffer.substr(0, end);
+            buffer.erase(0, end + 4);
+            return true;
+        }
+        pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, 100);
+        if (ready < 0) return false;
+        if (ready == 0) continue;
+        char chunk[2048];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+    }
+    return false;
+}
+
+static TestRequest parseRequest(const std::string& head, uint32_t connection) {
+    TestRequest request;
+    request.timeMs = millis();
+    request.connection = connection;
+
+    size_t lineEnd = head.find("\r\n");
+    std::string first = head.substr(0, lineEnd);
+    size_t space1 = first.find(' ');
+    size_t space2 = first.find(' ', space1 + 1);
+    request.method = first.substr(0, space1);
+    request.path = first.substr(space1 + 1, space2 - space1 - 1);
+
+    size_t pos = lineEnd == std::string::npos ? head.size() : lineEnd + 2;
+    while (pos < head.size()) {
+        size_t end = head.find("\r\n", pos);
+        if (end == std::string::npos) end = head.size();
+        std::string line = head.substr(pos, end - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            std::string name;
+            for (size_t i = 0; i < colon; i++) name += (char)tolower((unsigned char)line[i]);
+            size_t start = line.find_first_not_of(' ', colon + 1);
+            request.headers[name] = start == std::string::npos ? "" : line.substr(start);
+        }
+        pos = end + 2;
+    }
+    return request;
+}
+
+void TestServer::serve(int fd, uint32_t connection) {
+    std::string buffer;
+    std::string head;
+    while (_running && readRequest(fd, buffer, head, _running)) {
+        TestRequest request = parseRequest(head, connection);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _log.push_back(request);
+        }
+        bool keepAlive = true;
+        if (!respond(fd, request, keepAlive) || !keepAlive) break;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < _openFds.size(); i++) {
+        if (_openFds[i] == fd) {
+            _openFds.erase(_openFds.begin() + i);
+            break;
+        }
+    }
+    shutdown(fd, SHUT_WR);
+    close(fd);
+}
+
+bool TestServer::sendAll(int fd, const char* data, size_t len, uint32_t bytesPerSecond) {
+    uint64_t start = micros();
+    size_t sent = 0;
+    while (sent < len) {
+        if (!_running) return false;
+        size_t chunk = len - sent;
+        if (bytesPerSecond > 0) {
+            // Send in slices of ~10 ms worth so the pacing is smooth
+            size_t slice = max((size_t)(bytesPerSecond / 100), (size_t)256);
+            chunk = min(chunk, slice);
+            uint64_t due = start + (uint64_t)sent * 1000000ULL / bytesPerSecond;
+            uint64_t now = micros();
+            if (due > now) usleep((useconds_t)(due - now));
+        }
+        ssize_t n = send(fd, data + sent, chunk, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            return false;
+        }
+        sent += n;
+        _bytesSent += n;
+    }
+    return true;
+}
+
+// Long poll: hold while the client already has the version being served
+bool TestServer::waitForChange(const TestRequest& request, const std::string& path) {
+    std::string prefer = request.header("prefer");
+    std::string current = request.header("x-current-version");
+    size_t wait = prefer.find("wait=");
+    if (wait == std::string::npos || current.empty()) return true;
+    uint32_t seconds = (uint32_t)atoi(prefer.c_str() + wait + 5);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while (_running) {
+        auto it = _routes.find(path);
+        if (it == _routes.end() || !it->second.longPoll) return true;
+        std::string body = it->second.body;
+        std::string version = body.substr(0, body.find('\n'));
+        while (!version.empty() && (version.back() == '\r' || version.back() == ' ')) version.pop_back();
+        if (version != current) return true;
+        if (_changed.wait_until(lock, deadline) == std::cv_status::timeout) return true;
+    }
+    return false;
+}
+
+static std::string statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 307: return "Temporary Redirect";
+        case 404: return "Not Found";
+        case 416: return "Range Not Satisfiable";
+        case 503: return "Service Unavailable";
+        default: return "Status";
+    }
+}
+
+bool TestServer::respond(int fd, const TestRequest& request, bool& keepAlive) {
+    std::string path = request.path;
+    TestRoute route;
+    bool found;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _routes.find(path);
+        found = it != _routes.end();
+        if (found) route = it->second;
+    }
+
+    if (found && route.longPoll) {
+        if (!waitForChange(request, path)) return false;
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _routes.find(path);
+        found = it != _routes.end();
+        if (found) route = it->second;
+    }
+
+    TestResponse response;
+    std::string connectionHeader = request.header("connection");
+    keepAlive = strcasecmp(connectionHeader.c_str(), "close") != 0;
+    int64_t dropAfter = -1;
+    int64_t stallAfter = -1;
+    uint32_t bytesPerSecond = 0;
+
+    if (!found) {
+        response.status = 404;
+    } else if (route.handler) {
+        response = route.handler(request);
+    } else {
+        if (route.headerDelayMs > 0) usleep(route.headerDelayMs * 1000);
+        keepAlive = keepAlive && route.keepAlive;
+        dropAfter = route.dropAfter;
+        stallAfter = route.stallAfter;
+        bytesPerSecond = route.bytesPerSecond;
+        response.headers = route.headers;
+
+        static std::mutex randomMutex;
+        static std::mt19937 generator(12345);
+        bool fail = false;
+        if (route.failureRate > 0) {
+            std::lock_guard<std::mutex> lock(randomMutex);
+            fail = std::uniform_real_distribution<double>(0, 1)(generator) < route.failureRate;
+        }
+
+        if (fail) {
+            response.status = 503;
+        } else if (!route.location.empty()) {
+            response.status = route.status;
+            response.headers.push_back({"Location", route.location});
+        } else if ((!route.etag.empty() && request.header("if-none-match") == route.etag) ||
+                   (!route.lastModified.empty() && request.header("if-modified-since") == route.lastModified)) {
+            response.status = 304;
+        } else {
+            response.status = route.status;
+            response.body = route.body;
+            std::string range = request.header("range");
+            if (route.ranges && route.status == 200 && range.compare(0, 6, "bytes=") == 0) {
+                uint64_t size = route.body.size();
+                uint64_t first = strtoull(range.c_str() + 6, NULL, 10);
+                size_t dash = range.find('-');
+                uint64_t last = size - 1;
+                if (dash != std::string::npos && dash + 1 < range.size()) {
+                    last = min((uint64_t)strtoull(range.c_str() + dash + 1, NULL, 10), size - 1);
+                }
+                if (first >= size) {
+                    response.status = 416;
+                    response.body.clear();
+                    response.headers.push_back({"Content-Range", "bytes */" + std::to_string(size)});
+                } else {
+                    response.status = 206;
+                    response.body = route.body.substr(first, last - first + 1);
+                    int64_t reported = (int64_t)first + route.contentRangeSkew;
+                    response.headers.push_back({"Content-Range", "bytes " + std::to_string(reported) + "-" +
+                                                                     std::to_string(reported + (int64_t)(last - first)) +
+                                                                     "/" + std::to_string(size)});
+                }
+            }
+        }
+        if (response.status == 200 || response.status == 206 || response.status == 304) {
+            if (!route.etag.empty()) response.headers.push_back({"ETag", route.etag});
+            if (!route.lastModified.empty()) response.headers.push_back({"Last-Modified", route.lastModified});
+        }
+    }
+
+    bool head = request.method == "HEAD";
+    bool bodyless = response.status == 304 || (response.status >= 100 && response.status < 200);
+    std::string out = "HTTP/1.1 " + std::to_string(response.status) + " " + statusText(response.status) + "\r\n";
+    if (!bodyless) out += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+    for (const auto& header : response.headers) {
+        out += header.first + ": " + header.second + "\r\n";
+    }
+    out += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    if (!sendAll(fd, out.data(), out.size(), 0)) return false;
+    if (head || bodyless) return true;
+
+    size_t length = response.body.size();
+    if (dropAfter >= 0 && (size_t)dropAfter < length) {
+        sendAll(fd, response.body.data(), dropAfter, bytesPerSecond);
+        keepAlive = false;
+        return false;
+    }
+    if (stallAfter >= 0 && (size_t)stallAfter < length) {
+        sendAll(fd, response.body.data(), stallAfter, bytesPerSecond);
+        while (_running) usleep(10000);
+        return false;
+    }
+    return sendAll(fd, response.body.data(), length, bytesPerSecond);
+}
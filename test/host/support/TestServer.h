@@ -0,0 +1,129 @@
+/**
+ * TestServer.h - Scriptable HTTP/1.1 server for host tests
+ *
+ * Serves routes from memory on a loopback address, one thread per
+ * connection, with keep-alive. Each route can misbehave the ways OTA
+ * servers do in the field: ignore Range, lie in Content-Range, answer
+ * slowly, trickle the body, drop the connection, fail randomly,
+ * redirect, or hold a long poll until the version changes.
+ */
+
+#ifndef TEST_SERVER_H
+#define TEST_SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct TestRequest {
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> headers;  ///< Names lowercased
+    uint64_t timeMs;                             ///< millis() when the headers were complete
+    uint32_t connection;                         ///< Connection number (reuse shows as repeats)
+
+    std::string header(const std::string& name) const;
+};
+
+struct TestResponse {
+    int status = 200;
+    std::string body;
+    std::vector<std::pair<std::string, std::string>> headers;
+};
+
+struct TestRoute {
+    std::string body;
+    int status = 200;
+    std::vector<std::pair<std::string, std::string>> headers;  ///< Extra response headers
+
+    std::string etag;               ///< Sent as ETag; If-None-Match match answers 304
+    std::string lastModified;       ///< Sent as Last-Modified; If-Modified-Since match answers 304
+    bool ranges = true;             ///< Honour Range with 206; false sends the whole body
+    int64_t contentRangeSkew = 0;   ///< Added to the start reported in Content-Range (a lying server)
+
+    uint32_t headerDelayMs = 0;     ///< Wait before sending the status line
+    uint32_t bytesPerSecond = 0;    ///< Pace the body (0 = as fast as the socket takes it)
+    double failureRate = 0;         ///< Probability of answering 503 instead
+    int64_t dropAfter = -1;         ///< Close the connection after this many body bytes
+    int64_t stallAfter = -1;        ///< Go silent after this many body bytes, keeping the connection
+    std::string location;           ///< Redirect target (use with status 301/302/307)
+    bool keepAlive = true;          ///< false answers Connection: close
+
+    bool longPoll = false;          ///< Hold "Prefer: wait=N" requests while X-Current-Version
+                                    ///< equals the body's first line
+
+    /// Custom handler; when set it replaces everything above
+    std::function<TestResponse(const TestRequest&)> handler;
+};
+
+class TestServer {
+public:
+    /**
+     * @param address Dotted-quad address to listen on
+     * @param port Port, 0 for an ephemeral one
+     */
+    explicit TestServer(const char* address = "127.0.0.1", uint16_t port = 0);
+    ~TestServer();
+
+    TestServer(const TestServer&) = delete;
+    TestServer& operator=(const TestServer&) = delete;
+
+    void route(const std::string& path, const TestRoute& route);
+
+    /**
+     * Change a route in place and wake any long poll waiting on it
+     */
+    void update(const std::string& path, const std::function<void(TestRoute&)>& change);
+
+    void remove(const std::string& path);
+
+    /**
+     * Full URL of a path on this server, e.g. http://127.0.0.1:40123/fw.bin
+     */
+    std::string url(const std::string& path) const;
+
+    uint16_t port() const { return _port; }
+    const std::string& address() const { return _address; }
+
+    std::vector<TestRequest> requests() const;
+    uint32_t requestCount(const std::string& path) const;
+    uint32_t connections() const { return _connections.load(); }
+    uint64_t bytesSent() const { return _bytesSent.load(); }
+    void clearLog();
+
+    /**
+     * Close the listener and every open connection
+     */
+    void stop();
+
+private:
+    void acceptLoop();
+    void serve(int fd, uint32_t connection);
+    bool respond(int fd, const TestRequest& request, bool& keepAlive);
+    bool sendAll(int fd, const char* data, size_t len, uint32_t bytesPerSecond);
+    bool waitForChange(const TestRequest& request, const std::string& path);
+
+    std::string _address;
+    uint16_t _port;
+    int _listenFd;
+    std::atomic<bool> _running;
+    std::thread _acceptThread;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _changed;
+    std::map<std::string, TestRoute> _routes;
+    std::vector<TestRequest> _log;
+    std::vector<std::thread> _workers;
+    std::vector<int> _openFds;
+
+    std::atomic<uint32_t> _connections;
+    std::atomic<uint64_t> _bytesSent;
+};
+
+#endif // TEST_SERVER_H
@@ -0,0 +1,161 @@
+/**
+ * test_dns_cache.cpp - Check latency with and without the DNS cache
+ *
+ * The endpoints are reached through a host name served by the DNS
+ * stand-in in the shim, which takes DNS_DELAY_MS per lookup and can be
+ * made to fail. Built with OTA_DNS_TTL_MS=500 and OTA_DNS_STALE_MS=3000
+ * so answers go stale within a test.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <OTAHttp.h>
+
+#include "Bench.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+static const uint32_t DNS_DELAY_MS = 300;
+
+struct Endpoint {
+    TestServer server;
+    std::string versionUrl;
+
+    Endpoint() {
+        OTAHttpRequest::clearDNSCache();
+        HostSim::addHost("ota.example.com", IPAddress(127, 0, 0, 1));
+        HostSim::setDnsDelay(DNS_DELAY_MS);
+        TestRoute version;
+        version.body = "1.0.0\n";
+        server.route("/version.txt", version);
+        versionUrl = "http://ota.example.com:" + std::to_string(server.port()) + "/version.txt";
+    }
+
+    ~Endpoint() {
+        HostSim::removeHost("ota.example.com");
+    }
+};
+
+struct Check {
+    bool ok;
+    double ms;          // Whole check, refresh of stale answers included
+    uint32_t dnsMs;     // Name resolution of the version request
+};
+
+static Check runCheck(ESP32_AutoOTA& ota) {
+    OTAStats before = ota.getStats();
+    uint64_t start = Bench::nowMicros();
+    ota.forceCheck();
+    bool done = HostTest::waitFor([&]() {
+        ota.poll();
+        return ota.getStats().checkCount > before.checkCount;
+    }, 10000);
+    Check check;
+    check.ms = (Bench::nowMicros() - start) / 1000.0;
+    OTAStats after = ota.getStats();
+    check.ok = done && after.checkFailures == before.checkFailures;
+    check.dnsMs = after.dnsMs;
+    return check;
+}
+
+static void configure(ESP32_AutoOTA& ota, const std::string& versionUrl) {
+    ota.setVersionURL(versionUrl.c_str());
+    ota.setFirmwareURL(versionUrl.c_str());
+    ota.setCurrentVersion("1.0.0");
+    ota.setRandomDelay(0, 0);
+}
+
+TEST(cache_removes_lookup_from_later_checks) {
+    Endpoint endpoint;
+    ESP32_AutoOTA ota;
+    configure(ota, endpoint.versionUrl);
+    REQUIRE(ota.beginPolled());
+
+    std::vector<double> cached;
+    std::vector<double> uncached;
+    for (int i = 0; i < 5; i++) {
+        Check check = runCheck(ota);
+        CHECK(check.ok);
+        if (i > 0) {
+            cached.push_back(check.ms);
+            CHECK(check.dnsMs < 50);
+        }
+    }
+    CHECK_EQ(HostSim::dnsLookups(), 1u);
+
+    for (int i = 0; i < 4; i++) {
+        OTAHttpRequest::clearDNSCache();
+        Check check = runCheck(ota);
+        CHECK(check.ok);
+        CHECK(check.dnsMs >= DNS_DELAY_MS);
+        uncached.push_back(check.ms);
+    }
+    ota.stop();
+    CHECK_EQ(HostSim::dnsLookups(), 5u);
+
+    double withCache = Bench::percentile(cached, 0.5);
+    double withoutCache = Bench::percentile(uncached, 0.5);
+    printf("  median check: %.1f ms with the cache, %.1f ms without (lookup %u ms)\n", withCache, withoutCache,
+           (unsigned)DNS_DELAY_MS);
+    CHECK(withCache + DNS_DELAY_MS * 0.8 < withoutCache);
+}
+
+TEST(failing_resolver_fails_checks_only_without_cache) {
+    Endpoint endpoint;
+    ESP32_AutoOTA ota;
+    configure(ota, endpoint.versionUrl);
+    REQUIRE(ota.beginPolled());
+    REQUIRE(runCheck(ota).ok);
+
+    HostSim::setDnsFailure(true);
+    CHECK(runCheck(ota).ok);
+
+    OTAHttpRequest::clearDNSCache();
+    CHECK(!runCheck(ota).ok);
+    ota.stop();
+}
+
+TEST(stale_answer_is_used_while_refreshed) {
+    Endpoint endpoint;
+    ESP32_AutoOTA ota;
+    configure(ota, endpoint.versionUrl);
+    REQUIRE(ota.beginPolled());
+    REQUIRE(runCheck(ota).ok);
+    REQUIRE(HostSim::dnsLookups() == 1u);
+
+    // Past the TTL with the resolver down: the stale address still
+    // serves the check, the refresh after it fails and keeps it
+    delay(600);
+    HostSim::setDnsFailure(true);
+    Check stale = runCheck(ota);
+    CHECK(stale.ok);
+    CHECK(stale.dnsMs < 50);
+    CHECK_EQ(HostSim::dnsLookups(), 2u);
+    CHECK(runCheck(ota).ok);
+
+    // Resolver back: the next refresh renews the answer, and checks
+    // within the TTL after it do not look it up again
+    HostSim::setDnsFailure(false);
+    CHECK(runCheck(ota).ok);
+    uint32_t lookups = HostSim::dnsLookups();
+    CHECK(runCheck(ota).ok);
+    CHECK_EQ(HostSim::dnsLookups(), lookups);
+    ota.stop();
+}
+
+TEST(answer_older_than_stale_limit_is_dropped) {
+    Endpoint endpoint;
+    ESP32_AutoOTA ota;
+    configure(ota, endpoint.versionUrl);
+    REQUIRE(ota.beginPolled());
+    REQUIRE(runCheck(ota).ok);
+
+    HostSim::setDnsFailure(true);
+    delay(3100);
+    CHECK(!runCheck(ota).ok);
+    ota.stop();
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
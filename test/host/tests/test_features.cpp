@@ -0,0 +1,83 @@
+/**
+ * test_features.cpp - The library built with every optional feature off
+ *
+ * Linked against autoota_minimal (all OTA_ENABLE_* switches 0): the
+ * setters of removed features are accepted and ignored, keys for them
+ * are refused, and updates still install over the single-connection path.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <esp_ota_ops.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+TEST(switches_are_off) {
+    CHECK_EQ(OTA_ENABLE_PARALLEL, 0);
+    CHECK_EQ(OTA_ENABLE_PEER_SHARE, 0);
+    CHECK_EQ(OTA_ENABLE_GATEWAY, 0);
+    CHECK_EQ(OTA_ENABLE_DECRYPT, 0);
+    CHECK_EQ(OTA_ENABLE_TRACE, 0);
+    CHECK_EQ(OTA_ENABLE_SIGNING, 0);
+    CHECK_EQ(OTA_ENABLE_CONDITIONAL, 0);
+    CHECK_EQ(OTA_ENABLE_PRE_ERASE, 0);
+}
+
+TEST(decryption_key_is_refused) {
+    static const uint8_t key[32] = {1};
+    ESP32_AutoOTA ota;
+    CHECK(!ota.setDecryptionKey(key, sizeof(key)));
+    CHECK(ota.setDecryptionKey(NULL));
+}
+
+TEST(signing_key_is_refused) {
+    Fixtures::SigningKey key;
+    std::string pem = key.publicPem();
+    ESP32_AutoOTA ota;
+    CHECK(!ota.setSigningKey(pem.c_str()));
+    CHECK(ota.setSigningKey(NULL));
+}
+
+TEST(installs_with_features_requested) {
+    Bytes image = Fixtures::makeImage(256 * 1024);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    server.route("/fw.bin", route);
+    TestRoute version;
+    version.body = Fixtures::versionFile("2.0.0", &image);
+    server.route("/version.txt", version);
+
+    std::string firmwareUrl = server.url("/fw.bin");
+    std::string versionUrl = server.url("/version.txt");
+    ESP32_AutoOTA ota;
+    ota.setFirmwareURL(firmwareUrl.c_str());
+    ota.setVersionURL(versionUrl.c_str());
+    ota.setCurrentVersion("1.0.0");
+    ota.setRandomDelay(0, 0);
+    ota.setParallelDownload(4);
+    ota.setPeerSharing(true);
+    ota.setGatewayDiscovery(true);
+    ota.setBackgroundErase(true);
+
+    uint32_t restarts = HostSim::restartCount();
+    REQUIRE(ota.beginPolled());
+    CHECK(HostTest::waitFor([&] {
+        ota.poll();
+        return HostSim::restartCount() > restarts;
+    }, 20000));
+    ota.stop();
+
+    CHECK(esp_ota_get_boot_partition() == HostSim::app1());
+    CHECK(memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0);
+    // One connection for the version file, one for the image
+    CHECK_EQ(server.requestCount("/fw.bin"), 1u);
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
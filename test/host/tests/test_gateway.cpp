@@ -0,0 +1,289 @@
+/**
+ * test_gateway.cpp - Installs through a site gateway on a loopback LAN
+ *
+ * The gateway is this executable started again as a separate device at
+ * 127.0.0.2, caching the origin's release on a host directory; the
+ * device under test finds it by broadcast. A rogue gateway is the same
+ * device with a forged cache and a forged upstream manifest, advertising
+ * the device's firmware URL. Caching of encrypted images is checked
+ * with a gateway in this process.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <OTAGateway.h>
+#include <esp_ota_ops.h>
+
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static const size_t IMAGE_SIZE = 128 * 1024;
+
+// Away from the default port, distinct per run
+static uint16_t gatewayPort() {
+    return 20000 + getpid() % 10000;
+}
+
+static bool exists(const std::string& path) {
+    return std::ifstream(path).good();
+}
+
+static void writeFile(const std::string& path, const std::string& content) {
+    std::ofstream(path, std::ios::binary) << content;
+}
+
+/**
+ * --device gateway <address> <port> <stop file> <cache dir> <version url> <firmware url>
+ */
+DEVICE(gateway) {
+    REQUIRE(argc == 6);
+    HostSim::setLocalIP(IPAddress(127, 0, 0, atoi(argv[0])));
+    uint16_t port = atoi(argv[1]);
+    std::string stopFile = argv[2];
+
+    fs::FS cache = HostSim::hostFS(argv[3]);
+    OTAGateway gateway(cache);
+    gateway.setUpstream(argv[4], argv[5]);
+    REQUIRE(gateway.begin(port));
+    HostTest::waitFor([&]() { return exists(stopFile); }, 30000);
+    gateway.end();
+    return HostTest::failures();
+}
+
+struct Site {
+    Bytes image;
+    TestServer origin;
+    TestServer rogue;
+    std::string dir;
+    std::string stopFile;
+    std::string versionUrl;
+    std::string firmwareUrl;
+    int pid;
+
+    Site(const Fixtures::SigningKey* key = nullptr)
+        : image(Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 1)), dir(Fixtures::tempDir("gateway")), pid(-1) {
+        stopFile = dir + "/stop";
+        versionUrl = origin.url("/version.txt");
+        firmwareUrl = origin.url("/fw.bin");
+        TestRoute version;
+        version.body = Fixtures::versionFile("2.0.0", &image, key);
+        origin.route("/version.txt", version);
+        TestRoute firmware;
+        firmware.body = Fixtures::toString(image);
+        origin.route("/fw.bin", firmware);
+    }
+
+    ~Site() {
+        if (pid > 0) {
+            writeFile(stopFile, "stop\n");
+            CHECK_EQ(Fixtures::waitDevice(pid, 10000), 0);
+        }
+    }
+
+    /**
+     * Start the gateway and wait until it answers discovery
+     */
+    bool startGateway(const std::string& upstreamVersionUrl) {
+        pid = Fixtures::spawnDevice(HostTest::self(), {"gateway", "2", std::to_string(gatewayPort()), stopFile,
+                                    dir + "/cache", upstreamVersionUrl, firmwareUrl});
+        char base[OTA_GATEWAY_URL_LEN];
+        return HostTest::waitFor([&]() {
+            return OTAGateway::find(firmwareUrl.c_str(), gatewayPort(), base, sizeof(base));
+        }, 10000);
+    }
+
+    /**
+     * A gateway that advertises the device's firmware URL and serves a
+     * release of its own: its cache and its upstream manifest agree, so
+     * it never replaces them with the origin's
+     */
+    bool startRogueGateway(const char* version, const Bytes& forged) {
+        std::string manifest = Fixtures::versionFile(version, &forged);
+        ::mkdir((dir + "/cache").c_str(), 0755);
+        ::mkdir((dir + "/cache" OTA_GATEWAY_DIR).c_str(), 0755);
+        writeFile(dir + "/cache" OTA_GATEWAY_DIR "/version.txt", manifest);
+        writeFile(dir + "/cache" OTA_GATEWAY_DIR "/firmware.bin", Fixtures::toString(forged));
+        TestRoute route;
+        route.body = manifest;
+        rogue.route("/version.txt", route);
+        return startGateway(rogue.url("/version.txt"));
+    }
+
+    void configure(ESP32_AutoOTA& ota) {
+        ota.setVersionURL(versionUrl.c_str());
+        ota.setFirmwareURL(firmwareUrl.c_str());
+        ota.setCurrentVersion("1.0.0");
+        ota.setRandomDelay(0, 0);
+        ota.setGatewayDiscovery(true, gatewayPort());
+    }
+
+    /**
+     * Run the device until it restarts into a new image or timeoutMs passes
+     */
+    bool install(ESP32_AutoOTA& ota, uint32_t timeoutMs = 15000) {
+        uint32_t restarts = HostSim::restartCount();
+        if (!ota.beginPolled()) return false;
+        bool done = HostTest::waitFor([&]() {
+            ota.poll();
+            return HostSim::restartCount() > restarts;
+        }, timeoutMs);
+        ota.stop();
+        return done;
+    }
+
+    /**
+     * Run the device for its first check only
+     */
+    void firstCheck(ESP32_AutoOTA& ota) {
+        REQUIRE(ota.beginPolled());
+        HostTest::waitFor([&]() {
+            ota.poll();
+            return ota.getStats().checkCount > 0;
+        }, 15000);
+        ota.stop();
+    }
+
+    bool installed() {
+        return memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0;
+    }
+};
+
+TEST(installs_through_gateway_with_origin_digest) {
+    Site site;
+    REQUIRE(site.startGateway(site.versionUrl));
+    uint32_t versionRequests = site.origin.requestCount("/version.txt");
+    CHECK_EQ(site.origin.requestCount("/fw.bin"), 1u);
+
+    ESP32_AutoOTA ota;
+    site.configure(ota);
+    CHECK(site.install(ota));
+    CHECK(site.installed());
+
+    // The image came from the gateway, the digest from the origin
+    CHECK_EQ(site.origin.requestCount("/fw.bin"), 1u);
+    CHECK_EQ(site.origin.requestCount("/version.txt"), versionRequests + 1);
+}
+
+TEST(signed_release_installs_without_asking_origin) {
+    Fixtures::SigningKey key;
+    Site site(&key);
+    REQUIRE(site.startGateway(site.versionUrl));
+    uint32_t versionRequests = site.origin.requestCount("/version.txt");
+
+    ESP32_AutoOTA ota;
+    site.configure(ota);
+    std::string pem = key.publicPem();
+    REQUIRE(ota.setSigningKey(pem.c_str()));
+    CHECK(site.install(ota));
+    CHECK(site.installed());
+    CHECK_EQ(site.origin.requestCount("/fw.bin"), 1u);
+    CHECK_EQ(site.origin.requestCount("/version.txt"), versionRequests);
+}
+
+TEST(release_the_origin_does_not_announce_is_refused) {
+    Site site;
+    Bytes forged = Fixtures::makeImage(IMAGE_SIZE, "3.0.0", "host_app", 9);
+    REQUIRE(site.startRogueGateway("3.0.0", forged));
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+
+    ESP32_AutoOTA ota;
+    site.configure(ota);
+    site.firstCheck(ota);
+    CHECK_STR(ota.getLastError(), "Update rejected: gateway release not confirmed by the origin");
+    CHECK_EQ(ota.getStats().checkFailures, 1u);
+    CHECK(esp_ota_get_boot_partition() == boot);
+}
+
+TEST(forged_image_is_rejected_then_origin_installs) {
+    Site site;
+    Bytes forged = Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 9);
+    REQUIRE(site.startRogueGateway("2.0.0", forged));
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+
+    // Checked against the origin's digest, the gateway's bytes fail
+    ESP32_AutoOTA ota;
+    site.configure(ota);
+    site.firstCheck(ota);
+    CHECK_STR(ota.getLastError(), "Image rejected: SHA-256 mismatch");
+    CHECK(esp_ota_get_boot_partition() == boot);
+    CHECK_EQ(site.origin.requestCount("/fw.bin"), 0u);
+
+    // The rejection drops the rogue, but it answers discovery again
+    // before the next check; without discovery the origin's image installs
+    ESP32_AutoOTA direct;
+    site.configure(direct);
+    direct.setGatewayDiscovery(false);
+    CHECK(site.install(direct));
+    CHECK(site.installed());
+}
+
+struct EncryptedOrigin {
+    Bytes image;
+    Bytes encrypted;
+    TestServer origin;
+    std::string versionUrl;
+    std::string firmwareUrl;
+    std::string dir;
+
+    EncryptedOrigin() : image(Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 1)), dir(Fixtures::tempDir("gateway")) {
+        uint8_t key[32];
+        uint8_t nonce[12];
+        memset(key, 0x5a, sizeof(key));
+        memset(nonce, 0xa5, sizeof(nonce));
+        encrypted = Fixtures::encryptImage(image, key, sizeof(key), nonce);
+        versionUrl = origin.url("/version.txt");
+        firmwareUrl = origin.url("/fw.enc");
+        TestRoute firmware;
+        firmware.body = Fixtures::toString(encrypted);
+        origin.route("/fw.enc", firmware);
+    }
+
+    /**
+     * Let an in-process gateway fetch the release once
+     * @return Version it caches, empty if it refused the image
+     */
+    std::string cache(const std::string& manifest) {
+        TestRoute version;
+        version.body = manifest;
+        origin.route("/version.txt", version);
+
+        fs::FS fs = HostSim::hostFS(dir.c_str());
+        OTAGateway gateway(fs);
+        gateway.setUpstream(versionUrl.c_str(), firmwareUrl.c_str());
+        REQUIRE(gateway.begin(gatewayPort()));
+        HostTest::waitFor([&]() { return origin.requestCount("/fw.enc") > 0; }, 5000);
+        HostTest::waitFor([&]() { return gateway.getVersion()[0] != '\0'; }, 1000);
+        gateway.end();
+        return gateway.getVersion();
+    }
+};
+
+TEST(encrypted_image_without_ciphertext_digest_is_not_cached) {
+    EncryptedOrigin site;
+    CHECK_STR(site.cache(Fixtures::versionFile("2.0.0", &site.image)).c_str(), "");
+}
+
+TEST(encrypted_image_is_cached_against_ciphertext_digest) {
+    EncryptedOrigin site;
+    std::string manifest = Fixtures::versionFile("2.0.0", &site.image);
+    manifest += "sha256-enc=" + Fixtures::hex(Fixtures::sha256(site.encrypted)) + "\n";
+    CHECK_STR(site.cache(manifest).c_str(), "2.0.0");
+}
+
+TEST(tampered_ciphertext_is_not_cached) {
+    EncryptedOrigin site;
+    std::string manifest = Fixtures::versionFile("2.0.0", &site.image);
+    manifest += "sha256-enc=" + Fixtures::hex(Fixtures::sha256(site.image)) + "\n";
+    CHECK_STR(site.cache(manifest).c_str(), "");
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
@@ -0,0 +1,222 @@
+/**
+ * test_http_source.cpp - OTAHttpSource resume handling, Content-Range
+ * checks of both HTTP sources, and the HTTP pipeline against the file
+ * pipeline
+ *
+ * Built with OTA_SKIP_TIMEOUT=300 so a stalled skip fails quickly.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <esp_ota_ops.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static Bytes readAll(OTAUpdateSource& source, size_t len) {
+    Bytes data;
+    uint8_t buffer[1024];
+    unsigned long lastData = millis();
+    while (data.size() < len && millis() - lastData < 2000) {
+        int n = source.read(buffer, sizeof(buffer));
+        if (n < 0) break;
+        if (n == 0) {
+            delay(1);
+            continue;
+        }
+        data.insert(data.end(), buffer, buffer + n);
+        lastData = millis();
+    }
+    return data;
+}
+
+/**
+ * Read until the source fails; false if it delivers everything instead
+ */
+static bool readFails(OTAUpdateSource& source) {
+    uint8_t buffer[1024];
+    size_t total = 0;
+    unsigned long lastData = millis();
+    while (total < source.size() && millis() - lastData < 5000) {
+        int n = source.read(buffer, sizeof(buffer));
+        if (n < 0) return true;
+        if (n == 0) {
+            delay(1);
+            continue;
+        }
+        total += n;
+        lastData = millis();
+    }
+    return false;
+}
+
+static Bytes tail(const Bytes& image, size_t offset) {
+    return Bytes(image.begin() + offset, image.end());
+}
+
+TEST(resume_uses_range) {
+    Bytes image = Fixtures::makeImage(64 * 1024);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    OTAHttpSource source(url.c_str());
+    REQUIRE(source.open(10000));
+    CHECK_EQ(source.getHTTPCode(), 206);
+    CHECK_EQ(source.size(), image.size());
+    CHECK(readAll(source, image.size() - 10000) == tail(image, 10000));
+    CHECK_EQ(server.requests().back().header("range"), std::string("bytes=10000-"));
+}
+
+TEST(resume_skips_when_range_ignored) {
+    Bytes image = Fixtures::makeImage(64 * 1024);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    route.ranges = false;
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    OTAHttpSource source(url.c_str());
+    REQUIRE(source.open(10000));
+    CHECK_EQ(source.getHTTPCode(), 200);
+    CHECK_EQ(source.size(), image.size());
+    CHECK(readAll(source, image.size() - 10000) == tail(image, 10000));
+}
+
+TEST(resume_skips_to_offset_inside_earlier_range) {
+    // A server that rounds ranges down to 4 KB blocks, with an honest Content-Range
+    Bytes image = Fixtures::makeImage(64 * 1024);
+    std::string body = Fixtures::toString(image);
+    TestServer server;
+    TestRoute route;
+    route.handler = [&](const TestRequest& request) {
+        size_t asked = strtoul(request.header("range").c_str() + 6, NULL, 10);
+        size_t first = asked & ~(size_t)4095;
+        TestResponse response;
+        response.status = 206;
+        response.body = body.substr(first);
+        response.headers.push_back({"Content-Range", "bytes " + std::to_string(first) + "-" +
+                                                         std::to_string(body.size() - 1) + "/" +
+                                                         std::to_string(body.size())});
+        return response;
+    };
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    OTAHttpSource source(url.c_str());
+    REQUIRE(source.open(10000));
+    CHECK_EQ(source.size(), image.size());
+    CHECK(readAll(source, image.size() - 10000) == tail(image, 10000));
+}
+
+TEST(rejects_range_starting_past_offset) {
+    Bytes image = Fixtures::makeImage(64 * 1024);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    route.contentRangeSkew = 512;
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    OTAHttpSource source(url.c_str());
+    CHECK(!source.open(10000));
+}
+
+TEST(parallel_rejects_chunk_at_wrong_offset) {
+    Bytes image = Fixtures::makeImage(4 * OTA_PARALLEL_CHUNK);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    route.contentRangeSkew = 512;
+    server.route("/fw.bin", route);
+
+    // The probe only reads the total; every chunk then reports the wrong start
+    std::string url = server.url("/fw.bin");
+    OTAParallelHttpSource source(url.c_str(), 2);
+    REQUIRE(source.open());
+    CHECK(readFails(source));
+}
+
+TEST(parallel_rejects_chunk_of_other_image) {
+    Bytes image = Fixtures::makeImage(4 * OTA_PARALLEL_CHUNK);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    route.bytesPerSecond = 256 * 1024;
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    OTAParallelHttpSource source(url.c_str(), 2);
+    REQUIRE(source.open());
+
+    // Replaced while the first two chunks are on the way
+    Bytes longer = Fixtures::makeImage(5 * OTA_PARALLEL_CHUNK);
+    server.update("/fw.bin", [&](TestRoute& changed) { changed.body = Fixtures::toString(longer); });
+    CHECK(readFails(source));
+}
+
+TEST(skip_gives_up_on_stalled_server) {
+    Bytes image = Fixtures::makeImage(64 * 1024);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    route.ranges = false;
+    route.stallAfter = 4000;
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    OTAHttpSource source(url.c_str());
+    unsigned long start = millis();
+    CHECK(!source.open(10000));
+    unsigned long elapsed = millis() - start;
+    CHECK(elapsed >= OTA_SKIP_TIMEOUT);
+    CHECK(elapsed < OTA_SKIP_TIMEOUT + 1000);
+}
+
+// The same image through both pipelines lands identically, with the same flash traffic
+TEST(http_pipeline_matches_file_pipeline) {
+    Bytes image = Fixtures::makeImage(512 * 1024 + 123, "2.0.0", "host_app", 9);
+
+    std::string root = Fixtures::tempDir("pipeline");
+    fs::FS storage = HostSim::hostFS(root.c_str());
+    File file = storage.open("/fw.bin", FILE_WRITE);
+    file.write(image.data(), image.size());
+    file.close();
+
+    ESP32_AutoOTA fileOta;
+    OTAFileSource fileSource(storage, "/fw.bin");
+    REQUIRE(fileOta.updateFrom(fileSource));
+    HostSim::FlashCounters fileFlash = HostSim::flashCounters();
+    Bytes fromFile(HostSim::partitionData(HostSim::app1()), HostSim::partitionData(HostSim::app1()) + image.size());
+
+    HostSim::resetFlash();
+    HostSim::setBandwidth(2 * 1024 * 1024);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    ESP32_AutoOTA httpOta;
+    OTAHttpSource httpSource(url.c_str());
+    REQUIRE(httpOta.updateFrom(httpSource));
+    HostSim::FlashCounters httpFlash = HostSim::flashCounters();
+    Bytes fromHttp(HostSim::partitionData(HostSim::app1()), HostSim::partitionData(HostSim::app1()) + image.size());
+
+    CHECK(fromFile == image);
+    CHECK(fromHttp == image);
+    CHECK_EQ(httpFlash.sectorErases, fileFlash.sectorErases);
+    CHECK_EQ(httpFlash.bytesWritten, fileFlash.bytesWritten);
+    CHECK_EQ(httpFlash.dirtyWrites, 0u);
+    CHECK_EQ(HostSim::bytesReceived() >= image.size(), true);
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
@@ -0,0 +1,119 @@
+/**
+ * test_image_check.cpp - Early image validation on the first bytes
+ *
+ * Mismatched and damaged images are served over HTTP and must be
+ * rejected from the header and app descriptor, long before the rest
+ * of the image has been downloaded and without a byte reaching flash.
+ * Each test reports how much was downloaded before the abort.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <esp_ota_ops.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static const size_t IMAGE_SIZE = 1024 * 1024;
+
+// Header and descriptor arrive with the first read of a few KB
+static const uint64_t EARLY_ABORT_BYTES = 8 * 1024;
+
+static uint64_t install(ESP32_AutoOTA& ota, const Bytes& image, bool* installed) {
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    OTAHttpSource source(url.c_str());
+    HostSim::resetBytesReceived();
+    *installed = ota.updateFrom(source);
+    return HostSim::bytesReceived();
+}
+
+static void checkRejected(ESP32_AutoOTA& ota, const Bytes& image, const char* reason) {
+    bool installed = true;
+    uint64_t received = install(ota, image, &installed);
+    printf("  %s: aborted after %llu of %zu bytes\n", reason, (unsigned long long)received, image.size());
+
+    CHECK(!installed);
+    CHECK(received < EARLY_ABORT_BYTES);
+    CHECK(strstr(ota.getLastError(), reason) != NULL);
+    CHECK_EQ(HostSim::flashCounters().bytesWritten, 0u);
+    CHECK(esp_ota_get_boot_partition() == HostSim::app0());
+}
+
+TEST(rejects_image_for_another_chip) {
+    ESP32_AutoOTA ota;
+    checkRejected(ota, Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 1, 0x0009), "another chip");
+}
+
+TEST(rejects_image_with_bad_magic) {
+    ESP32_AutoOTA ota;
+    checkRejected(ota, Fixtures::withBadMagic(Fixtures::makeImage(IMAGE_SIZE)), "not a firmware image");
+}
+
+TEST(rejects_image_without_app_descriptor) {
+    ESP32_AutoOTA ota;
+    checkRejected(ota, Fixtures::withoutAppDesc(Fixtures::makeImage(IMAGE_SIZE)), "missing app descriptor");
+}
+
+TEST(rejects_image_for_another_project) {
+    ESP32_AutoOTA ota;
+    ota.setImageValidation(true, false);
+    checkRejected(ota, Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "other_app"), "another project");
+}
+
+TEST(other_project_passes_without_project_match) {
+    ESP32_AutoOTA ota;
+    Bytes image = Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "other_app");
+    bool installed = false;
+    uint64_t received = install(ota, image, &installed);
+    CHECK(installed);
+    CHECK(received >= image.size());
+}
+
+TEST(rejects_image_with_wrong_embedded_version) {
+    Bytes image = Fixtures::makeImage(IMAGE_SIZE, "2.0.1");
+    TestServer server;
+    TestRoute version;
+    version.body = Fixtures::versionFile("2.0.0");
+    server.route("/version.txt", version);
+    TestRoute firmware;
+    firmware.body = Fixtures::toString(image);
+    server.route("/fw.bin", firmware);
+
+    std::string versionUrl = server.url("/version.txt");
+    std::string firmwareUrl = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    ota.setVersionURL(versionUrl.c_str());
+    ota.setFirmwareURL(firmwareUrl.c_str());
+    ota.setCurrentVersion("1.0.0");
+    ota.setImageValidation(false, true);
+    ota.setRandomDelay(0, 0);
+    REQUIRE(ota.beginPolled());
+    HostSim::resetBytesReceived();
+    ota.forceCheck();
+
+    bool rejected = HostTest::waitFor([&]() {
+        ota.poll();
+        return strstr(ota.getLastError(), "embedded version mismatch") != NULL;
+    }, 10000);
+    ota.stop();
+    uint64_t received = HostSim::bytesReceived();
+    printf("  embedded version mismatch: aborted after %llu of %zu bytes\n", (unsigned long long)received,
+           image.size());
+
+    CHECK(rejected);
+    CHECK(received < EARLY_ABORT_BYTES);
+    CHECK_EQ(HostSim::flashCounters().bytesWritten, 0u);
+    CHECK(esp_ota_get_boot_partition() == HostSim::app0());
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
@@ -0,0 +1,145 @@
+/**
+ * test_install.cpp - End-to-end installs through the host shims
+ *
+ * The smallest useful check that the library, the shims and the test
+ * server fit together: an image served over HTTP, from a file and
+ * from memory ends up byte-for-byte in the inactive OTA slot, which
+ * becomes the boot partition. Slow flash is summarised in one trace
+ * record per download.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <OTATrace.h>
+#include <esp_ota_ops.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static bool installed(const Bytes& image) {
+    return esp_ota_get_boot_partition() == HostSim::app1() &&
+           memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0;
+}
+
+TEST(installs_over_http) {
+    Bytes image = Fixtures::makeImage(300 * 1024);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    OTAHttpSource source(url.c_str());
+    uint32_t restarts = HostSim::restartCount();
+    REQUIRE(ota.updateFrom(source));
+    CHECK(installed(image));
+    CHECK_EQ(HostSim::restartCount(), restarts + 1);
+    CHECK_EQ(HostSim::flashCounters().dirtyWrites, 0u);
+}
+
+TEST(installs_from_file) {
+    Bytes image = Fixtures::makeImage(200 * 1024, "2.0.0", "host_app", 7);
+    std::string root = Fixtures::tempDir("install");
+    fs::FS storage = HostSim::hostFS(root.c_str());
+    File file = storage.open("/fw.bin", FILE_WRITE);
+    file.write(image.data(), image.size());
+    file.close();
+
+    ESP32_AutoOTA ota;
+    OTAFileSource source(storage, "/fw.bin");
+    REQUIRE(ota.updateFrom(source));
+    CHECK(installed(image));
+}
+
+TEST(installs_from_memory) {
+    Bytes image = Fixtures::makeImage(64 * 1024, "2.0.0", "host_app", 3);
+    ESP32_AutoOTA ota;
+    OTAMemorySource source(image.data(), image.size());
+    REQUIRE(ota.updateFrom(source));
+    CHECK(installed(image));
+}
+
+static std::vector<OTATraceRecord> stallRecords() {
+    OTATraceRecord records[OTA_TRACE_CAPACITY];
+    size_t count = OTATrace::read(records, OTA_TRACE_CAPACITY);
+    std::vector<OTATraceRecord> stalls;
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].event == OTA_EVT_FLASH_STALL) stalls.push_back(records[i]);
+    }
+    return stalls;
+}
+
+TEST(flash_stalls_are_one_trace_record) {
+    Bytes image = Fixtures::makeImage(32 * 1024, "2.0.0", "host_app", 5);
+    OTAMemorySource source(image.data(), image.size());
+
+    // Normal sector erases are not stalls
+    OTATrace::clear();
+    HostSim::setFlashLatency(40000, 0);
+    ESP32_AutoOTA ota;
+    REQUIRE(ota.updateFrom(source));
+    CHECK_EQ(stallRecords().size(), (size_t)0);
+    CHECK_EQ(ota.getStats().flashStallMs, 0u);
+    CHECK(ota.getStats().flashWriteMs >= 8 * 40);
+
+    // Eight slow sectors, one record
+    OTATrace::clear();
+    HostSim::resetFlash();
+    HostSim::setFlashLatency(OTA_FLASH_STALL_US + 50000, 0);
+    ESP32_AutoOTA slow;
+    REQUIRE(slow.updateFrom(source));
+    std::vector<OTATraceRecord> stalls = stallRecords();
+    REQUIRE(stalls.size() == 1);
+    CHECK_EQ(stalls[0].arg1, 8u);
+    CHECK(stalls[0].arg0 >= (OTA_FLASH_STALL_US + 50000) / 1000);
+    CHECK(slow.getStats().flashStallMs >= 8 * (OTA_FLASH_STALL_US + 50000) / 1000);
+}
+
+TEST(rejects_truncated_download) {
+    Bytes image = Fixtures::makeImage(128 * 1024);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    route.dropAfter = 40 * 1024;
+    route.ranges = false;
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    OTAHttpSource source(url.c_str());
+    CHECK(!ota.updateFrom(source));
+    CHECK(esp_ota_get_boot_partition() == HostSim::app0());
+    CHECK(strlen(ota.getLastError()) > 0);
+}
+
+TEST(prints_only_errors_by_default) {
+    Bytes image = Fixtures::makeImage(64 * 1024);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    route.dropAfter = 16 * 1024;
+    route.ranges = false;
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    OTAHttpSource source(url.c_str());
+    CHECK(!ota.updateFrom(source));
+    std::string quiet = HostSim::serialOutput();
+    CHECK(quiet.find("ERROR:") != std::string::npos);
+    CHECK(quiet.find("Installing firmware") == std::string::npos);
+
+    HostSim::clearSerialOutput();
+    ota.setDebugMode(true);
+    OTAHttpSource retry(url.c_str());
+    CHECK(!ota.updateFrom(retry));
+    CHECK(HostSim::serialOutput().find("Installing firmware") != std::string::npos);
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
@@ -0,0 +1,140 @@
+/**
+ * test_long_poll.cpp - Long-poll version checks over HTTP and HTTPS
+ *
+ * The test server holds "Prefer: wait=N" requests while the client
+ * already has the version it serves. Over HTTPS keepalive cannot be
+ * enabled (the shim's WiFiClientSecure hides its socket like the ESP32
+ * core's), so the hold is capped. Built with OTA_LONG_POLL_TLS_HOLD=2000
+ * and OTA_LONG_POLL_MARGIN=1000 to keep the holds short.
+ */
+
+#include <ESP32_AutoOTA.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include "HostTest.h"
+#include "TestServer.h"
+
+static const unsigned long HOLD_MS = 5000;
+
+static std::string secure(const std::string& url) {
+    return "https" + url.substr(4);
+}
+
+static void configure(ESP32_AutoOTA& ota, const std::string& versionUrl) {
+    ota.setVersionURL(versionUrl.c_str());
+    ota.setFirmwareURL(versionUrl.c_str());
+    ota.setCurrentVersion("1.0.0");
+    ota.setRandomDelay(0, 0);
+    ota.setLongPoll(true, HOLD_MS);
+}
+
+/**
+ * Start the task and wait for its first check; during() runs meanwhile
+ * @return Time the check took in milliseconds
+ */
+static unsigned long firstCheck(ESP32_AutoOTA& ota, const std::function<void()>& during = nullptr) {
+    unsigned long start = millis();
+    if (!ota.begin()) return 0;
+    std::thread extra([&]() {
+        if (during) during();
+    });
+    HostTest::waitFor([&]() { return ota.getStats().checkCount > 0; }, 20000);
+    unsigned long ms = millis() - start;
+    extra.join();
+    return ms;
+}
+
+struct HeldVersion {
+    TestServer server;
+
+    HeldVersion() {
+        TestRoute version;
+        version.body = "1.0.0\n";
+        version.longPoll = true;
+        server.route("/version.txt", version);
+    }
+
+    bool waitForRequest(uint32_t count) {
+        return HostTest::waitFor([&]() { return server.requestCount("/version.txt") >= count; }, 3000);
+    }
+
+    std::string prefer() const {
+        std::vector<TestRequest> requests = server.requests();
+        return requests.empty() ? "" : requests.back().header("prefer");
+    }
+
+    void release() {
+        server.update("/version.txt", [](TestRoute& route) { route.longPoll = false; });
+    }
+};
+
+TEST(plain_connection_asks_for_full_hold) {
+    HeldVersion held;
+    ESP32_AutoOTA ota;
+    configure(ota, held.server.url("/version.txt"));
+    unsigned long ms = firstCheck(ota, [&]() {
+        held.waitForRequest(1);
+        delay(200);
+        held.release();
+    });
+    ota.stop();
+
+    CHECK_STR(held.prefer().c_str(), "wait=5");
+    CHECK(ms < 2000);
+    CHECK_EQ(ota.getStats().checkFailures, 0u);
+}
+
+TEST(tls_hold_is_capped_and_next_request_follows) {
+    HeldVersion held;
+    ESP32_AutoOTA ota;
+    configure(ota, secure(held.server.url("/version.txt")));
+
+    // Held for the capped two seconds, answered with the same version
+    unsigned long ms = firstCheck(ota);
+    CHECK_STR(held.prefer().c_str(), "wait=2");
+    CHECK(ms >= 1900 && ms < 3000);
+    CHECK_EQ(ota.getStats().checkFailures, 0u);
+
+    // A request held for the whole capped hold counts as long polling
+    bool followed = held.waitForRequest(2);
+    held.release();
+    HostTest::waitFor([&]() { return ota.getStats().checkCount >= 2; }, 5000);
+    ota.stop();
+    CHECK(followed);
+}
+
+TEST(tls_silent_server_fails_within_capped_hold) {
+    // Accepts connections in the kernel backlog and never answers
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(listener >= 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    REQUIRE(bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0);
+    REQUIRE(listen(listener, 4) == 0);
+    REQUIRE(getsockname(listener, (sockaddr*)&addr, &len) == 0);
+    std::string url = "https://127.0.0.1:" + std::to_string(ntohs(addr.sin_port)) + "/version.txt";
+
+    ESP32_AutoOTA ota;
+    configure(ota, url);
+    unsigned long ms = firstCheck(ota);
+    ota.stop();
+    close(listener);
+
+    // The uncapped hold would have waited HOLD_MS plus the margin
+    printf("  silent TLS server: check failed after %lu ms (hold %lu ms asked)\n", ms, HOLD_MS);
+    CHECK_EQ(ota.getStats().checkFailures, 1u);
+    CHECK(ms >= OTA_LONG_POLL_TLS_HOLD + OTA_LONG_POLL_MARGIN - 100);
+    CHECK(ms < HOLD_MS);
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
@@ -0,0 +1,175 @@
+/**
+ * test_mirrors.cpp - Mirror ranking and failover against servers of different quality
+ *
+ * Each mirror is its own test server with an injected header latency
+ * and failure rate. The mirror list has to find the fastest healthy
+ * one, stay away from one that keeps failing, continue a broken
+ * download on another mirror with a Range request, and remember the
+ * scores across a reboot.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <OTAMirrorList.h>
+#include <esp_ota_ops.h>
+
+#include <memory>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+struct Mirror {
+    std::unique_ptr<TestServer> server;
+    std::string url;
+};
+
+static std::vector<Mirror> startMirrors(const std::string& body, const std::vector<uint32_t>& latencies,
+                                        const std::vector<double>& failureRates = {}) {
+    std::vector<Mirror> mirrors;
+    for (size_t i = 0; i < latencies.size(); i++) {
+        Mirror mirror;
+        mirror.server.reset(new TestServer());
+        TestRoute route;
+        route.body = body;
+        route.headerDelayMs = latencies[i];
+        route.failureRate = i < failureRates.size() ? failureRates[i] : 0;
+        mirror.server->route("/fw.bin", route);
+        mirror.url = mirror.server->url("/fw.bin");
+        mirrors.push_back(std::move(mirror));
+    }
+    return mirrors;
+}
+
+static void addAll(OTAMirrorList& list, const std::vector<Mirror>& mirrors) {
+    for (const Mirror& mirror : mirrors) {
+        list.add(mirror.url.c_str(), true);
+    }
+}
+
+/**
+ * Open the list's best mirror the way a check does
+ * @return Index of the mirror that answered, -1 if none did
+ */
+static int fetch(OTAMirrorList& list) {
+    OTAMirrorSource source(list);
+    int mirror = source.open() ? source.getMirror() : -1;
+    source.close();
+    return mirror;
+}
+
+TEST(tries_each_mirror_then_prefers_fastest) {
+    std::vector<Mirror> mirrors = startMirrors("1.0.0\n", {200, 20, 100});
+    OTAMirrorList list;
+    addAll(list, mirrors);
+
+    std::vector<int> order;
+    for (int i = 0; i < 8; i++) {
+        order.push_back(fetch(list));
+    }
+
+    // Every mirror is measured once, in list order, then the fastest keeps the traffic
+    CHECK_EQ(order[0], 0);
+    CHECK_EQ(order[1], 1);
+    CHECK_EQ(order[2], 2);
+    for (int i = 3; i < 8; i++) {
+        CHECK_EQ(order[i], 1);
+    }
+    CHECK_EQ(list.best(), 1);
+    CHECK(list.score(1) < list.score(2));
+    CHECK(list.score(2) < list.score(0));
+}
+
+TEST(failing_mirror_loses_to_slower_healthy_one) {
+    std::vector<Mirror> mirrors = startMirrors("1.0.0\n", {10, 150}, {0.7, 0});
+    OTAMirrorList list;
+    addAll(list, mirrors);
+
+    int answered[2] = {0, 0};
+    int failed = 0;
+    for (int i = 0; i < 20; i++) {
+        int mirror = fetch(list);
+        if (mirror < 0) {
+            failed++;
+        } else {
+            answered[mirror]++;
+        }
+    }
+
+    // A failure costs more than the latency difference, so the flaky
+    // mirror only gets tried again after the penalties have decayed
+    printf("  flaky fast mirror: %u requests, %d answered; healthy slow mirror: %u requests\n",
+           mirrors[0].server->requestCount("/fw.bin"), answered[0], mirrors[1].server->requestCount("/fw.bin"));
+    CHECK_EQ(failed, 0);
+    CHECK(answered[1] >= 14);
+    CHECK(mirrors[0].server->requestCount("/fw.bin") <= 8);
+    CHECK(list.failures(0) > 0);
+}
+
+TEST(download_fails_over_mid_transfer_with_range) {
+    Bytes image = Fixtures::makeImage(256 * 1024);
+    std::vector<Mirror> mirrors = startMirrors(Fixtures::toString(image), {0, 50});
+    mirrors[0].server->update("/fw.bin", [](TestRoute& route) { route.dropAfter = 100 * 1024; });
+
+    OTAMirrorList list;
+    addAll(list, mirrors);
+    ESP32_AutoOTA ota;
+    OTAMirrorSource source(list);
+    REQUIRE(ota.updateFrom(source));
+
+    CHECK(esp_ota_get_boot_partition() == HostSim::app1());
+    CHECK(memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0);
+    std::vector<TestRequest> resumed = mirrors[1].server->requests();
+    REQUIRE(resumed.size() == 1u);
+    std::string range = resumed[0].header("range");
+    CHECK(range.compare(0, 6, "bytes=") == 0);
+    CHECK(strtoul(range.c_str() + 6, NULL, 10) >= 64 * 1024);
+    CHECK(list.failures(0) > 0);
+}
+
+TEST(scores_survive_reboot_and_reordering) {
+    std::vector<Mirror> mirrors = startMirrors("1.0.0\n", {150, 10, 80});
+    {
+        OTAMirrorList list;
+        addAll(list, mirrors);
+        for (int i = 0; i < 5; i++) fetch(list);
+        REQUIRE(list.best() == 1);
+        list.save();
+    }
+
+    // Same URLs in another order, as after a configuration change
+    OTAMirrorList list;
+    list.add(mirrors[2].url.c_str(), true);
+    list.add(mirrors[0].url.c_str(), true);
+    list.add(mirrors[1].url.c_str(), true);
+    list.load();
+    CHECK_EQ(list.best(), 2);
+    CHECK_EQ(fetch(list), 2);
+    CHECK_EQ(mirrors[0].server->requestCount("/fw.bin"), 1u);
+}
+
+TEST(pinned_mirror_is_used_whatever_its_score) {
+    std::vector<Mirror> mirrors = startMirrors("1.0.0\n", {10, 150});
+    OTAMirrorList list;
+    addAll(list, mirrors);
+    for (int i = 0; i < 4; i++) fetch(list);
+    REQUIRE(list.best() == 0);
+
+    // A slow gateway prepended and pinned stays first once measured
+    list.prepend(mirrors[1].url.c_str(), true);
+    list.pin(0);
+    CHECK_EQ(fetch(list), 0);
+    CHECK(list.score(0) > list.score(1));
+    CHECK_EQ(list.best(), 0);
+    CHECK_EQ(list.best(1u << 0), 1);
+
+    // Removed, the ranking is by score again
+    list.remove(0);
+    CHECK_EQ(list.best(), 0);
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
@@ -0,0 +1,152 @@
+/**
+ * test_multicast.cpp - Multicast installs under packet loss and spoofing
+ *
+ * A MulticastSender on its own loopback address streams the image the
+ * way tools/ota_multicast_send.py does, to a device that installs with
+ * updateFrom(OTAMulticastSource, sha256). Loss is modelled at the sender
+ * (packets left out, seen by every receiver) and at the receiver
+ * (HostSim::setPacketLoss). The fallback URL serves the same image for
+ * groups parity cannot rebuild.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <OTAMulticastSource.h>
+#include <esp_ota_ops.h>
+
+#include <thread>
+#include <unistd.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "MulticastSender.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static const size_t IMAGE_SIZE = 96 * 1024;
+static const IPAddress GROUP(239, 255, 0, 1);
+static const uint32_t RATE = 512 * 1024;
+
+// Away from the default port, distinct per run
+static uint16_t groupPort() {
+    return 30000 + getpid() % 10000;
+}
+
+struct Session {
+    Bytes image;
+    Bytes digest;
+    TestServer mirror;
+    std::string fallbackUrl;
+    MulticastSender sender;
+    OTAMulticastSource source;
+    ESP32_AutoOTA ota;
+
+    Session()
+        : image(Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 1)), digest(Fixtures::sha256(image)),
+          fallbackUrl(mirror.url("/fw.bin")), sender(GROUP, groupPort()),
+          source(GROUP, groupPort(), fallbackUrl.c_str()) {
+        TestRoute firmware;
+        firmware.body = Fixtures::toString(image);
+        mirror.route("/fw.bin", firmware);
+        ota.setCurrentVersion("1.0.0");
+    }
+
+    /**
+     * Install from the stream of another image, or of this one
+     */
+    bool install(const MulticastSender::SkipFunction& skip = nullptr, const Bytes* streamed = nullptr) {
+        sender.load(streamed != nullptr ? *streamed : image);
+        bool ok = false;
+        std::thread device([&]() { ok = ota.updateFrom(source, digest.data()); });
+        // Give the device time to join before the first packet
+        delay(100);
+        sender.start(RATE, 1, skip);
+        sender.wait();
+        device.join();
+        return ok;
+    }
+
+    bool installed() {
+        return memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0;
+    }
+};
+
+TEST(untrusted_without_digest_is_refused) {
+    Session session;
+    CHECK(!session.ota.updateFrom(session.source));
+    CHECK_STR(session.ota.getLastError(), "Update rejected: untrusted source needs an expected SHA-256");
+    CHECK_EQ(session.mirror.requestCount("/fw.bin"), 0u);
+}
+
+TEST(digest_without_required_signature_is_refused) {
+    Session session;
+    Fixtures::SigningKey key;
+    std::string pem = key.publicPem();
+    REQUIRE(session.ota.setSigningKey(pem.c_str()));
+    CHECK(!session.ota.updateFrom(session.source, session.digest.data()));
+    CHECK_STR(session.ota.getLastError(), "Update rejected: release is not signed");
+}
+
+TEST(lossless_stream_installs_without_fallback) {
+    Session session;
+    CHECK(session.install());
+    CHECK(session.installed());
+    CHECK_EQ(session.source.getGroupsReceived(), session.sender.groups());
+    CHECK_EQ(session.source.getGroupsFetched(), 0u);
+    CHECK_EQ(session.mirror.requestCount("/fw.bin"), 0u);
+}
+
+TEST(one_lost_packet_per_group_is_rebuilt_from_parity) {
+    Session session;
+    CHECK(session.install([](uint32_t group, uint8_t index) { return index == group % 8; }));
+    CHECK(session.installed());
+    CHECK_EQ(session.source.getGroupsRecovered(), session.sender.groups());
+    CHECK_EQ(session.source.getGroupsFetched(), 0u);
+    CHECK_EQ(session.mirror.requestCount("/fw.bin"), 0u);
+}
+
+TEST(burst_loss_is_fetched_by_range) {
+    Session session;
+    // Groups 2 and 5 lose two data blocks each: more than parity covers
+    CHECK(session.install([](uint32_t group, uint8_t index) {
+        return (group == 2 || group == 5) && (index == 1 || index == 4);
+    }));
+    CHECK(session.installed());
+    CHECK_EQ(session.source.getGroupsFetched(), 2u);
+    CHECK_EQ(session.mirror.requestCount("/fw.bin"), 2u);
+
+    std::vector<TestRequest> requests = session.mirror.requests();
+    CHECK_STR(requests.front().header("range").c_str(), "bytes=16384-24575");
+    CHECK_STR(requests.back().header("range").c_str(), "bytes=40960-49151");
+}
+
+TEST(random_receiver_loss_still_installs) {
+    Session session;
+    HostSim::setPacketLoss(0.05, 7);
+    CHECK(session.install());
+    HostSim::setPacketLoss(0);
+    CHECK(session.installed());
+    printf("  5%% loss: %u groups received, %u rebuilt, %u fetched\n", session.source.getGroupsReceived(),
+           session.source.getGroupsRecovered(), session.source.getGroupsFetched());
+    uint32_t groups = session.source.getGroupsReceived() + session.source.getGroupsRecovered() +
+                      session.source.getGroupsFetched();
+    CHECK_EQ(groups, session.sender.groups());
+    CHECK(session.source.getGroupsReceived() < groups);
+}
+
+TEST(spoofed_stream_is_rejected_by_digest) {
+    Session session;
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+
+    // Same size and layout, other bytes: only the digest tells them apart
+    Bytes forged = Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 9);
+    CHECK(!session.install(nullptr, &forged));
+    CHECK_STR(session.ota.getLastError(), "Image rejected: SHA-256 mismatch");
+    CHECK(esp_ota_get_boot_partition() == boot);
+    CHECK(!session.installed());
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
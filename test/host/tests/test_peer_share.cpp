@@ -0,0 +1,229 @@
+/**
+ * test_peer_share.cpp - Firmware sharing between devices on a loopback LAN
+ *
+ * Each peer is this executable started again as a separate device with
+ * its own 127.0.0.x address. A seeder runs an image it installed with a
+ * verified digest and serves it with OTAPeerShare; the device under
+ * test finds it by broadcast and installs from it instead of the
+ * mirror. Peers run until a stop file appears in a shared directory.
+ * What a device serves after a series of installs, and suffix ranges,
+ * are checked with a share in this process.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <OTAPeerShare.h>
+#include <esp_ota_ops.h>
+
+#include <fstream>
+#include <unistd.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static const size_t IMAGE_SIZE = 192 * 1024;
+
+// Away from the default port, distinct per run
+static uint16_t peerPort() {
+    return 40000 + getpid() % 10000;
+}
+
+static bool exists(const std::string& path) {
+    return std::ifstream(path).good();
+}
+
+/**
+ * --device seeder <address> <port> <stop file> <served seed>
+ * Runs the release image (seed 1) by digest, with the bytes of the
+ * image of <served seed> in its partition: another seed is a peer
+ * whose flash no longer matches what it announces
+ */
+DEVICE(seeder) {
+    REQUIRE(argc == 4);
+    HostSim::setLocalIP(IPAddress(127, 0, 0, atoi(argv[0])));
+    uint16_t port = atoi(argv[1]);
+    std::string stopFile = argv[2];
+
+    Bytes release = Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 1);
+    Bytes served = Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", atoi(argv[3]));
+    HostSim::flashImage(esp_ota_get_running_partition(), served.data(), served.size());
+    OTAPeerShare::remember(Fixtures::sha256(release).data(), release.size());
+
+    OTAPeerShare share;
+    REQUIRE(share.begin(port));
+    HostTest::waitFor([&]() { return exists(stopFile); }, 30000);
+    share.end();
+    return HostTest::failures();
+}
+
+struct Lan {
+    Bytes image;
+    TestServer mirror;
+    std::string dir;
+    std::string stopFile;
+    std::vector<int> peers;
+
+    Lan() : image(Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 1)), dir(Fixtures::tempDir("peer_share")) {
+        stopFile = dir + "/stop";
+        TestRoute version;
+        version.body = Fixtures::versionFile("2.0.0", &image);
+        mirror.route("/version.txt", version);
+        TestRoute firmware;
+        firmware.body = Fixtures::toString(image);
+        mirror.route("/fw.bin", firmware);
+    }
+
+    ~Lan() {
+        std::ofstream(stopFile) << "stop\n";
+        for (int pid : peers) {
+            CHECK_EQ(Fixtures::waitDevice(pid, 10000), 0);
+        }
+    }
+
+    void addSeeder(int host, int servedSeed = 1) {
+        peers.push_back(Fixtures::spawnDevice(HostTest::self(), {"seeder", std::to_string(host),
+                                              std::to_string(peerPort()), stopFile, std::to_string(servedSeed)}));
+    }
+
+    /**
+     * Wait until the seeders answer discovery
+     */
+    bool ready() {
+        Bytes digest = Fixtures::sha256(image);
+        char url[OTA_PEER_URL_LEN];
+        return HostTest::waitFor([&]() { return OTAPeerShare::find(digest.data(), peerPort(), url, sizeof(url)); },
+                                 5000);
+    }
+
+    bool install() {
+        ESP32_AutoOTA ota;
+        std::string versionUrl = mirror.url("/version.txt");
+        std::string firmwareUrl = mirror.url("/fw.bin");
+        ota.setVersionURL(versionUrl.c_str());
+        ota.setFirmwareURL(firmwareUrl.c_str());
+        ota.setCurrentVersion("1.0.0");
+        ota.setRandomDelay(0, 0);
+        ota.setPeerSharing(true, peerPort());
+        uint32_t restarts = HostSim::restartCount();
+        if (!ota.beginPolled()) return false;
+        bool done = HostTest::waitFor([&]() {
+            ota.poll();
+            return HostSim::restartCount() > restarts;
+        }, 20000);
+        ota.stop();
+        return done && memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0;
+    }
+};
+
+TEST(installs_from_peer_instead_of_mirror) {
+    Lan lan;
+    lan.addSeeder(2);
+    REQUIRE(lan.ready());
+
+    CHECK(lan.install());
+    CHECK_EQ(lan.mirror.requestCount("/fw.bin"), 0u);
+}
+
+TEST(first_of_several_peers_serves) {
+    Lan lan;
+    for (int host = 2; host <= 5; host++) {
+        lan.addSeeder(host);
+    }
+    REQUIRE(lan.ready());
+
+    CHECK(lan.install());
+    CHECK_EQ(lan.mirror.requestCount("/fw.bin"), 0u);
+}
+
+TEST(no_peer_falls_back_to_mirror) {
+    Lan lan;
+    CHECK(lan.install());
+    CHECK_EQ(lan.mirror.requestCount("/fw.bin"), 1u);
+}
+
+TEST(peer_serving_other_bytes_is_rejected) {
+    Lan lan;
+    lan.addSeeder(2, 7);
+    REQUIRE(lan.ready());
+
+    // The digest check fails the peer download, the mirror's copy installs
+    CHECK(lan.install());
+    CHECK_EQ(lan.mirror.requestCount("/fw.bin"), 1u);
+}
+
+/**
+ * Install an image from memory, with its digest or without, and boot it
+ */
+static void installAndBoot(const Bytes& image, bool withDigest) {
+    ESP32_AutoOTA ota;
+    ota.setPeerSharing(true, peerPort());
+    OTAMemorySource source(image.data(), image.size());
+    Bytes digest = Fixtures::sha256(image);
+    REQUIRE(ota.updateFrom(source, withDigest ? digest.data() : nullptr));
+    HostSim::bootNewImage();
+}
+
+/**
+ * GET the served image with a Range header
+ * @return Status line, headers and body
+ */
+static std::string rangeGet(const Bytes& image, const char* range) {
+    // The share's task may still be starting its server
+    WiFiClient client;
+    REQUIRE(HostTest::waitFor([&]() { return client.connect(IPAddress(127, 0, 0, 1), peerPort()); }, 2000));
+    std::string request = "GET /ota/" + Fixtures::hex(Fixtures::sha256(image)) + ".bin HTTP/1.1\r\n" +
+                          "Range: " + range + "\r\n\r\n";
+    client.print(request.c_str());
+    std::string response;
+    HostTest::waitFor([&]() {
+        int c;
+        while ((c = client.read()) >= 0) response += (char)c;
+        return !client.connected() && client.available() == 0;
+    }, 5000);
+    client.stop();
+    return response;
+}
+
+TEST(install_without_digest_drops_the_recorded_one) {
+    Bytes x = Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 1);
+    Bytes y = Fixtures::makeImage(IMAGE_SIZE, "3.0.0", "host_app", 2);
+    Bytes z = Fixtures::makeImage(IMAGE_SIZE, "4.0.0", "host_app", 3);
+
+    installAndBoot(x, true);
+    OTAPeerShare share;
+    CHECK(share.begin(peerPort()));
+    share.end();
+
+    // Z lands in X's partition; it must not be served under X's digest
+    installAndBoot(y, false);
+    installAndBoot(z, false);
+    CHECK(esp_ota_get_running_partition() == HostSim::app1());
+    CHECK(!share.begin(peerPort()));
+}
+
+TEST(serves_suffix_ranges) {
+    Bytes image = Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 1);
+    installAndBoot(image, true);
+    OTAPeerShare share;
+    REQUIRE(share.begin(peerPort()));
+
+    std::string tail = rangeGet(image, "bytes=-100");
+    std::string expected = "Content-Range: bytes " + std::to_string(IMAGE_SIZE - 100) + "-" +
+                           std::to_string(IMAGE_SIZE - 1) + "/" + std::to_string(IMAGE_SIZE);
+    CHECK(tail.compare(0, 12, "HTTP/1.1 206") == 0);
+    CHECK(tail.find(expected) != std::string::npos);
+    CHECK(tail.size() > 100 && tail.compare(tail.size() - 100, 100, Fixtures::toString(image), IMAGE_SIZE - 100, 100) == 0);
+
+    // Longer than the image: all of it
+    std::string all = rangeGet(image, "bytes=-999999999");
+    CHECK(all.find("Content-Range: bytes 0-" + std::to_string(IMAGE_SIZE - 1)) != std::string::npos);
+    CHECK(rangeGet(image, "bytes=-0").compare(0, 12, "HTTP/1.1 416") == 0);
+    share.end();
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
@@ -0,0 +1,275 @@
+/**
+ * test_poll_budget.cpp - Time per poll() call in polled mode
+ *
+ * Every step that waits on the network is made slow: the endpoints are
+ * reached through a host name whose lookups take SLOW_MS, responses
+ * wait SLOW_MS before their headers, gateway and peer discovery get no
+ * answer, and the download breaks off once and has to reconnect. Each
+ * poll() call is timed from the outside and must stay within the budget
+ * plus scheduling slack, while the whole check takes seconds. Built with
+ * OTA_DNS_TTL_MS=500 so answers go stale and are refreshed within a test.
+ * stop() is checked to wait for the task, or the request task, to exit,
+ * and, called from the progress callback inside poll(), to leave the
+ * download to that poll() call to abort.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <OTAHttp.h>
+#include <esp_ota_ops.h>
+
+#include <functional>
+#include <unistd.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static const uint32_t BUDGET_MS = 10;
+static const uint32_t SLACK_MS = 40;        // Host scheduling, well below any network wait
+static const uint32_t SLOW_MS = 300;
+static const size_t IMAGE_SIZE = 160 * 1024;
+
+// Distinct per run, away from the other tests' ports
+static uint16_t gatewayPort() {
+    return 40000 + getpid() % 5000;
+}
+
+static uint16_t peerPort() {
+    return 45000 + getpid() % 5000;
+}
+
+struct Origin {
+    Bytes image;
+    TestServer server;
+    std::string versionUrl;
+    std::string firmwareUrl;
+
+    Origin() : image(Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 1)) {
+        OTAHttpRequest::clearDNSCache();
+        HostSim::addHost("ota.example.com", IPAddress(127, 0, 0, 1));
+        HostSim::setDnsDelay(SLOW_MS);
+        std::string base = "http://ota.example.com:" + std::to_string(server.port());
+        versionUrl = base + "/version.txt";
+        firmwareUrl = base + "/fw.bin";
+        publish("2.0.0", image);
+    }
+
+    ~Origin() {
+        HostSim::removeHost("ota.example.com");
+    }
+
+    void publish(const char* version, const Bytes& firmware, const Bytes* plain = nullptr) {
+        TestRoute manifest;
+        manifest.body = Fixtures::versionFile(version, plain ? plain : &image);
+        manifest.headerDelayMs = SLOW_MS;
+        server.route("/version.txt", manifest);
+        TestRoute route;
+        route.body = Fixtures::toString(firmware);
+        route.headerDelayMs = SLOW_MS;
+        server.route("/fw.bin", route);
+    }
+
+    void configure(ESP32_AutoOTA& ota) {
+        ota.setVersionURL(versionUrl.c_str());
+        ota.setFirmwareURL(firmwareUrl.c_str());
+        ota.setCurrentVersion("1.0.0");
+        ota.setRandomDelay(0, 0);
+    }
+
+    bool installed() {
+        return esp_ota_get_boot_partition() == HostSim::app1() &&
+               memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0;
+    }
+};
+
+struct Run {
+    bool done;
+    uint32_t maxCallMs;
+    uint32_t elapsedMs;
+};
+
+/**
+ * Call poll() until done() or timeoutMs, timing every call
+ */
+static Run drive(ESP32_AutoOTA& ota, const std::function<bool()>& done, uint32_t timeoutMs) {
+    Run run = {false, 0, 0};
+    unsigned long start = millis();
+    while (millis() - start < timeoutMs) {
+        unsigned long call = millis();
+        ota.poll(BUDGET_MS);
+        run.maxCallMs = std::max(run.maxCallMs, (uint32_t)(millis() - call));
+        if (done()) {
+            run.done = true;
+            break;
+        }
+        delay(1);
+    }
+    run.elapsedMs = millis() - start;
+    return run;
+}
+
+static bool restarted(uint32_t restarts) {
+    return HostSim::restartCount() > restarts;
+}
+
+TEST(install_with_discovery_and_reconnect_stays_within_budget) {
+    Origin origin;
+    origin.server.update("/fw.bin", [](TestRoute& route) { route.dropAfter = 100 * 1024; });
+
+    ESP32_AutoOTA ota;
+    origin.configure(ota);
+    ota.setGatewayDiscovery(true, gatewayPort());
+    ota.setPeerSharing(true, peerPort());
+    uint32_t restarts = HostSim::restartCount();
+    REQUIRE(ota.beginPolled());
+
+    // The first response drops the connection; the resumed range is shorter
+    Run run = drive(ota, [&]() { return restarted(restarts); }, 20000);
+    ota.stop();
+
+    CHECK(run.done);
+    CHECK(origin.installed());
+    CHECK_EQ(ota.getStats().resumes, 1u);
+    printf("  %u ms in total, longest poll() %u ms\n", run.elapsedMs, run.maxCallMs);
+
+    // Lookup, two discoveries, three slow responses and the restart delay
+    CHECK(run.elapsedMs >= 4 * SLOW_MS + 1000);
+    CHECK(run.maxCallMs <= BUDGET_MS + SLACK_MS);
+    CHECK(ota.getStats().pollMaxMs <= BUDGET_MS + SLACK_MS);
+}
+
+TEST(encrypted_parallel_install_stays_within_budget) {
+    Origin origin;
+    uint8_t key[32];
+    uint8_t nonce[OTA_CRYPT_NONCE_LEN];
+    memset(key, 0x3c, sizeof(key));
+    memset(nonce, 0xc3, sizeof(nonce));
+    origin.publish("2.0.0", Fixtures::encryptImage(origin.image, key, sizeof(key), nonce), &origin.image);
+
+    ESP32_AutoOTA ota;
+    origin.configure(ota);
+    REQUIRE(ota.setDecryptionKey(key, sizeof(key)));
+    ota.setParallelDownload(2);
+    uint32_t restarts = HostSim::restartCount();
+    REQUIRE(ota.beginPolled());
+    Run run = drive(ota, [&]() { return restarted(restarts); }, 20000);
+    ota.stop();
+
+    CHECK(run.done);
+    CHECK(origin.installed());
+    printf("  %u ms in total, longest poll() %u ms\n", run.elapsedMs, run.maxCallMs);
+    CHECK(run.maxCallMs <= BUDGET_MS + SLACK_MS);
+}
+
+TEST(stale_dns_refresh_stays_within_budget) {
+    Origin origin;
+    origin.publish("1.0.0", origin.image);
+
+    ESP32_AutoOTA ota;
+    origin.configure(ota);
+    REQUIRE(ota.beginPolled());
+    Run first = drive(ota, [&]() { return ota.getStats().checkCount == 1; }, 5000);
+    REQUIRE(first.done);
+
+    // Stale by the next check, which looks the name up again afterwards
+    delay(600);
+    HostSim::resetDnsLookups();
+    ota.forceCheck();
+    Run second = drive(ota, [&]() { return ota.getStats().checkCount == 2; }, 5000);
+    ota.stop();
+
+    CHECK(second.done);
+    CHECK_EQ(HostSim::dnsLookups(), 1u);
+    CHECK_EQ(ota.getStats().checkFailures, 0u);
+    CHECK(first.maxCallMs <= BUDGET_MS + SLACK_MS);
+    CHECK(second.maxCallMs <= BUDGET_MS + SLACK_MS);
+}
+
+TEST(stop_waits_for_the_request_task) {
+    Origin origin;
+    origin.publish("1.0.0", origin.image);
+
+    ESP32_AutoOTA ota;
+    origin.configure(ota);
+    REQUIRE(ota.beginPolled());
+    ota.poll(BUDGET_MS);
+    REQUIRE(HostTest::waitFor([&]() { return origin.server.requests().size() > 0; }, 2000));
+
+    // The version request is still waiting for its headers
+    unsigned long start = millis();
+    ota.stop();
+    CHECK(!ota.isRunning());
+    CHECK(millis() - start >= SLOW_MS / 2);
+    CHECK_EQ(ota.getStats().checkCount, 1u);
+
+    // Nothing runs on afterwards
+    ota.poll(BUDGET_MS);
+    delay(2 * SLOW_MS);
+    CHECK_EQ(origin.server.requestCount("/version.txt"), 1u);
+}
+
+TEST(stop_joins_the_task_during_a_download) {
+    Origin origin;
+    origin.server.update("/fw.bin", [](TestRoute& route) { route.bytesPerSecond = 40 * 1024; });
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+
+    ESP32_AutoOTA ota;
+    origin.configure(ota);
+    uint32_t restarts = HostSim::restartCount();
+    REQUIRE(ota.begin());
+    REQUIRE(HostTest::waitFor([&]() { return ota.getStats().bytesTransferred > 16 * 1024; }, 10000));
+
+    ota.stop();
+    CHECK(!ota.isRunning());
+
+    // The task aborted its download before it exited
+    uint64_t sent = origin.server.bytesSent();
+    delay(500);
+    CHECK_EQ(origin.server.bytesSent(), sent);
+    CHECK_EQ(HostSim::restartCount(), restarts);
+    CHECK(esp_ota_get_boot_partition() == boot);
+
+    // And a new task can start right away
+    REQUIRE(ota.begin());
+    ota.stop();
+    CHECK(!ota.isRunning());
+}
+
+static ESP32_AutoOTA* stopping = nullptr;
+
+static void stopAfter32K(size_t current, size_t total) {
+    if (current >= 32 * 1024) {
+        stopping->stop();
+    }
+}
+
+TEST(stop_from_progress_callback_inside_poll) {
+    Origin origin;
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+
+    ESP32_AutoOTA ota;
+    origin.configure(ota);
+    stopping = &ota;
+    ota.onUpdateProgress(stopAfter32K);
+    uint32_t restarts = HostSim::restartCount();
+    REQUIRE(ota.beginPolled());
+    Run run = drive(ota, [&]() { return !ota.isRunning(); }, 10000);
+
+    // The poll() call that ran the callback aborted the download
+    CHECK(run.done);
+    CHECK(ota.getStats().bytesTransferred < IMAGE_SIZE);
+    uint32_t requests = origin.server.requests().size();
+    ota.poll(BUDGET_MS);
+    delay(2 * SLOW_MS);
+    CHECK_EQ((uint32_t)origin.server.requests().size(), requests);
+    CHECK_EQ(HostSim::restartCount(), restarts);
+    CHECK(esp_ota_get_boot_partition() == boot);
+    stopping = nullptr;
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
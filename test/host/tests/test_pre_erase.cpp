@@ -0,0 +1,141 @@
+/**
+ * test_pre_erase.cpp - Background erase of the inactive partition
+ *
+ * Rate limit, the unconfirmed-image guard, erasing the previous release
+ * once the running one is confirmed, and what is left of the erased
+ * range after a failed download.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <esp_ota_ops.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static const size_t ERASE_BYTES = 256 * 1024;
+static const uint32_t ERASE_SECTORS = ERASE_BYTES / OTA_SECTOR_SIZE;
+
+// Polled instance that never reaches its first check
+static void configure(ESP32_AutoOTA& ota, unsigned long intervalMs) {
+    ota.setFirmwareURL("http://127.0.0.1:1/fw.bin");
+    ota.setVersionURL("http://127.0.0.1:1/version.txt");
+    ota.setRandomDelay(3600000, 3600000);
+    ota.setBackgroundErase(true, ERASE_BYTES, intervalMs);
+}
+
+static void pollFor(ESP32_AutoOTA& ota, uint32_t ms) {
+    unsigned long start = millis();
+    while (millis() - start < ms) {
+        ota.poll();
+        delay(1);
+    }
+}
+
+static bool eraseAll(ESP32_AutoOTA& ota, uint32_t sectors) {
+    return HostTest::waitFor([&] {
+        ota.poll();
+        return HostSim::flashCounters().sectorErases >= sectors;
+    }, 10000);
+}
+
+TEST(erases_one_sector_per_interval) {
+    ESP32_AutoOTA ota;
+    configure(ota, 100);
+    REQUIRE(ota.beginPolled());
+    pollFor(ota, 1050);
+    ota.stop();
+
+    uint32_t erases = HostSim::flashCounters().sectorErases;
+    CHECK(erases >= 9 && erases <= 12);
+}
+
+TEST(default_interval_is_a_second) {
+    CHECK(OTA_ERASE_INTERVAL_MS >= 1000);
+    ESP32_AutoOTA ota;
+    ota.setFirmwareURL("http://127.0.0.1:1/fw.bin");
+    ota.setVersionURL("http://127.0.0.1:1/version.txt");
+    ota.setRandomDelay(3600000, 3600000);
+    ota.setBackgroundErase(true);
+    REQUIRE(ota.beginPolled());
+    pollFor(ota, 1500);
+    ota.stop();
+    CHECK(HostSim::flashCounters().sectorErases <= 2);
+}
+
+TEST(erases_previous_release_once_running_image_is_confirmed) {
+    // The state after every update: the last release is still in app1
+    Bytes previous = Fixtures::makeImage(128 * 1024, "0.9.0", "host_app", 2);
+    HostSim::flashImage(HostSim::app1(), previous.data(), previous.size());
+    REQUIRE(esp_ota_check_rollback_is_possible());
+
+    ESP32_AutoOTA ota;
+    configure(ota, 1);
+    REQUIRE(ota.beginPolled());
+    pollFor(ota, 200);
+    ota.stop();
+    CHECK(HostSim::flashCounters().sectorErases > 0);
+    CHECK(!esp_ota_check_rollback_is_possible());
+}
+
+TEST(skips_while_running_image_is_unconfirmed) {
+    HostSim::setRunningState(ESP_OTA_IMG_PENDING_VERIFY);
+    ESP32_AutoOTA ota;
+    configure(ota, 1);
+    REQUIRE(ota.beginPolled());
+    pollFor(ota, 200);
+    ota.stop();
+    CHECK_EQ(HostSim::flashCounters().sectorErases, 0u);
+
+    // Confirmed: the next start erases
+    esp_ota_mark_app_valid_cancel_rollback();
+    REQUIRE(ota.beginPolled());
+    pollFor(ota, 200);
+    ota.stop();
+    CHECK(HostSim::flashCounters().sectorErases > 0);
+}
+
+TEST(keeps_erased_range_after_failed_download) {
+    Bytes image = Fixtures::makeImage(200 * 1024);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    route.dropAfter = 40 * 1024;
+    route.ranges = false;
+    server.route("/fw.bin", route);
+    std::string url = server.url("/fw.bin");
+
+    {
+        ESP32_AutoOTA ota;
+        configure(ota, 1);
+        REQUIRE(ota.beginPolled());
+        REQUIRE(eraseAll(ota, ERASE_SECTORS));
+
+        OTAHttpSource broken(url.c_str());
+        CHECK(!ota.updateFrom(broken));
+        ota.stop();
+    }
+
+    // After a reboot only the 10 written sectors are erased again
+    HostSim::resetFlashCounters();
+    ESP32_AutoOTA ota;
+    configure(ota, 1);
+    REQUIRE(ota.beginPolled());
+    pollFor(ota, 300);
+    CHECK_EQ(HostSim::flashCounters().sectorErases, 10u);
+
+    // ... and a complete download needs no erase at all
+    HostSim::resetFlashCounters();
+    OTAMemorySource memory(image.data(), image.size());
+    CHECK(ota.updateFrom(memory));
+    CHECK_EQ(HostSim::flashCounters().sectorErases, 0u);
+    CHECK(memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0);
+    ota.stop();
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
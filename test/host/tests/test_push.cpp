@@ -0,0 +1,184 @@
+/**
+ * test_push.cpp - Push-triggered checks with a broker stand-in
+ *
+ * BrokerStandIn plays the MQTT client of the application: on its own
+ * task it sends keepalive heartbeats and delivers release messages to
+ * notifyRelease(), while the OTA task checks and installs. Covers the
+ * slow fallback polling while the channel is healthy and a release
+ * announced while a check is reading the old version file.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <esp_ota_ops.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+class BrokerStandIn {
+public:
+    BrokerStandIn(ESP32_AutoOTA& ota, uint32_t keepaliveMs)
+        : _ota(ota), _keepaliveMs(keepaliveMs), _running(true), _connected(true), _delivered(0) {
+        _thread = std::thread([this]() { run(); });
+    }
+
+    ~BrokerStandIn() {
+        _running = false;
+        _thread.join();
+    }
+
+    /**
+     * Publish a release message, delivered on the broker's task
+     */
+    void publish(const std::string& version) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _queue.push_back(version);
+    }
+
+    void disconnect() { _connected = false; }
+    uint32_t delivered() const { return _delivered; }
+
+private:
+    ESP32_AutoOTA& _ota;
+    uint32_t _keepaliveMs;
+    std::atomic<bool> _running;
+    std::atomic<bool> _connected;
+    std::atomic<uint32_t> _delivered;
+    std::mutex _lock;
+    std::deque<std::string> _queue;
+    std::thread _thread;
+
+    void run() {
+        // First heartbeat right after connecting, like a CONNACK
+        unsigned long lastKeepalive = millis() - _keepaliveMs;
+        while (_running) {
+            if (_connected && millis() - lastKeepalive >= _keepaliveMs) {
+                _ota.pushHeartbeat();
+                lastKeepalive = millis();
+            }
+            std::string version;
+            {
+                std::lock_guard<std::mutex> guard(_lock);
+                if (_connected && !_queue.empty()) {
+                    version = _queue.front();
+                    _queue.pop_front();
+                }
+            }
+            if (!version.empty()) {
+                _ota.notifyRelease(version.c_str());
+                _delivered++;
+            }
+            delay(1);
+        }
+    }
+};
+
+static void configure(ESP32_AutoOTA& ota, const std::string& versionUrl, const std::string& firmwareUrl) {
+    ota.setVersionURL(versionUrl.c_str());
+    ota.setFirmwareURL(firmwareUrl.c_str());
+    ota.setCurrentVersion("1.0.0");
+    ota.setRandomDelay(0, 0);
+    ota.setCheckInterval(200);
+    ota.setPushPolicy(3600000, 100);
+}
+
+TEST(healthy_channel_slows_polling_to_fallback) {
+    TestServer server;
+    TestRoute version;
+    version.body = "1.0.0\n";
+    server.route("/version.txt", version);
+
+    std::string versionUrl = server.url("/version.txt");
+    std::string firmwareUrl = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    configure(ota, versionUrl, firmwareUrl);
+    BrokerStandIn broker(ota, 50);
+    delay(20);
+    REQUIRE(ota.begin());
+    delay(1500);
+    ota.stop();
+
+    // 200 ms polling would have made 7 or more
+    CHECK_EQ(server.requestCount("/version.txt"), 1u);
+}
+
+TEST(release_announced_during_check_is_not_lost) {
+    Bytes image = Fixtures::makeImage(128 * 1024, "2.0.0");
+    TestServer server;
+    std::atomic<int> versionRequests(0);
+    BrokerStandIn* broker = nullptr;
+    TestRoute version;
+    version.handler = [&](const TestRequest&) {
+        TestResponse response;
+        if (versionRequests++ == 0) {
+            // Release goes out while this response is on its way
+            broker->publish("2.0.0");
+            HostTest::waitFor([&]() { return broker->delivered() > 0; }, 1000);
+            response.body = "1.0.0\n";
+        } else {
+            response.body = "2.0.0\n";
+        }
+        return response;
+    };
+    server.route("/version.txt", version);
+    TestRoute firmware;
+    firmware.body = Fixtures::toString(image);
+    server.route("/fw.bin", firmware);
+
+    std::string versionUrl = server.url("/version.txt");
+    std::string firmwareUrl = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    configure(ota, versionUrl, firmwareUrl);
+    BrokerStandIn channel(ota, 50);
+    broker = &channel;
+    delay(20);
+
+    uint32_t restarts = HostSim::restartCount();
+    REQUIRE(ota.begin());
+    bool installed = HostTest::waitFor([&]() { return HostSim::restartCount() > restarts; }, 5000);
+    ota.stop();
+
+    CHECK(installed);
+    CHECK_EQ(versionRequests.load(), 2);
+    CHECK(memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0);
+}
+
+TEST(announcements_racing_checks_are_never_dropped) {
+    TestServer server;
+    TestRoute version;
+    version.body = "1.0.0\n";
+    version.headerDelayMs = 5;
+    server.route("/version.txt", version);
+
+    std::string versionUrl = server.url("/version.txt");
+    std::string firmwareUrl = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    configure(ota, versionUrl, firmwareUrl);
+    ota.setPushPolicy(3600000, 0);
+    BrokerStandIn broker(ota, 50);
+    delay(20);
+    REQUIRE(ota.begin());
+
+    // Every announcement must be followed by a check that starts after it
+    for (int i = 0; i < 50; i++) {
+        uint32_t before = server.requestCount("/version.txt");
+        broker.publish("2.0.0");
+        delay(3 + i % 7);
+        bool checked = HostTest::waitFor([&]() { return server.requestCount("/version.txt") > before; }, 1000);
+        CHECK(checked);
+        if (!checked) break;
+    }
+    ota.stop();
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
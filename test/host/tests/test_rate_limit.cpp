@@ -0,0 +1,195 @@
+/**
+ * test_rate_limit.cpp - Download rate limit and pause against a competing stream
+ *
+ * Checks the achieved download rate against setBandwidthLimit(), and
+ * measures the round trip of small telemetry requests sharing a capped
+ * link with the download: idle, next to an unlimited download, next to
+ * one limited to half the link, and while the download is paused.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <esp_ota_ops.h>
+
+#include <atomic>
+#include <thread>
+
+#include "Bench.h"
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static const uint32_t LINK_RATE = 256 * 1024;
+
+static std::atomic<unsigned long> downloadEnd(0);
+
+static void onComplete() {
+    downloadEnd = millis();
+}
+
+static bool installed(const Bytes& image) {
+    return esp_ota_get_boot_partition() == HostSim::app1() &&
+           memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0;
+}
+
+/**
+ * Round trips of a small request every 20 ms while work() runs
+ */
+static std::vector<double> telemetryDuring(const std::string& url, const std::function<void()>& work) {
+    std::atomic<bool> running(true);
+    std::vector<double> samples;
+    std::thread competing([&]() {
+        while (running) {
+            HTTPClient http;
+            uint64_t start = Bench::nowMicros();
+            http.begin(url.c_str());
+            if (http.GET() == 200 && http.getString().length() > 0) {
+                samples.push_back((Bench::nowMicros() - start) / 1000.0);
+            }
+            http.end();
+            delay(20);
+        }
+    });
+    work();
+    running = false;
+    competing.join();
+    return samples;
+}
+
+struct Download {
+    bool ok;
+    double ms;
+};
+
+/**
+ * Install over HTTP; ms runs to the end of the download, not the restart
+ */
+static Download download(ESP32_AutoOTA& ota, const std::string& url, const std::function<void()>& during = nullptr) {
+    ota.onUpdateComplete(onComplete);
+    downloadEnd = 0;
+    OTAHttpSource source(url.c_str());
+    unsigned long start = millis();
+    Download result;
+    std::thread installer([&]() { result.ok = ota.updateFrom(source); });
+    if (during) during();
+    installer.join();
+    result.ms = downloadEnd > 0 ? downloadEnd - start : 0;
+    return result;
+}
+
+static void checkRate(uint32_t limit, size_t size) {
+    Bytes image = Fixtures::makeImage(size);
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    ota.setBandwidthLimit(limit);
+    Download result = download(ota, url);
+    REQUIRE(result.ok);
+
+    double achieved = size / (result.ms / 1000.0);
+    printf("  limit %u B/s: achieved %.0f B/s (%+.1f%%), throttled %u ms\n", (unsigned)limit, achieved,
+           100.0 * (achieved / limit - 1), (unsigned)ota.getStats().throttleMs);
+    CHECK(achieved > limit * 0.9);
+    CHECK(achieved < limit * 1.1);
+    CHECK(ota.getStats().throttleMs > 0);
+    CHECK(installed(image));
+}
+
+TEST(achieved_rate_matches_limit) {
+    checkRate(64 * 1024, 160 * 1024);
+    HostSim::resetFlash();
+    checkRate(160 * 1024, 400 * 1024);
+}
+
+TEST(limit_keeps_competing_stream_responsive) {
+    Bytes image = Fixtures::makeImage(256 * 1024);
+    TestServer server;
+    TestRoute firmware;
+    firmware.body = Fixtures::toString(image);
+    server.route("/fw.bin", firmware);
+    TestRoute telemetry;
+    telemetry.body = std::string(512, 't');
+    server.route("/telemetry", telemetry);
+
+    std::string firmwareUrl = server.url("/fw.bin");
+    std::string telemetryUrl = server.url("/telemetry");
+    HostSim::setBandwidth(LINK_RATE);
+
+    std::vector<double> idle = telemetryDuring(telemetryUrl, []() { delay(1000); });
+
+    // Sampling stops when the download does, not after the restart delay
+    ESP32_AutoOTA unlimited;
+    std::vector<double> busy;
+    Download full = download(unlimited, firmwareUrl, [&]() {
+        busy = telemetryDuring(telemetryUrl, []() { HostTest::waitFor([]() { return downloadEnd > 0; }, 30000); });
+    });
+    REQUIRE(full.ok);
+    CHECK(installed(image));
+
+    HostSim::resetFlash();
+    ESP32_AutoOTA limited;
+    limited.setBandwidthLimit(LINK_RATE / 2);
+    std::vector<double> shared;
+    Download half = download(limited, firmwareUrl, [&]() {
+        shared = telemetryDuring(telemetryUrl, []() { HostTest::waitFor([]() { return downloadEnd > 0; }, 30000); });
+    });
+    REQUIRE(half.ok);
+    CHECK(installed(image));
+
+    double idleP95 = Bench::percentile(idle, 0.95);
+    double busyP95 = Bench::percentile(busy, 0.95);
+    double sharedP95 = Bench::percentile(shared, 0.95);
+    printf("  telemetry p95: idle %.1f ms, unlimited download %.1f ms (%.0f ms), half-link limit %.1f ms (%.0f ms)\n",
+           idleP95, busyP95, full.ms, sharedP95, half.ms);
+    REQUIRE(busy.size() >= 5 && shared.size() >= 5);
+    CHECK(sharedP95 < busyP95);
+    CHECK(sharedP95 < idleP95 + 20);
+    CHECK(half.ms > full.ms);
+}
+
+TEST(pause_frees_the_link_and_resume_completes) {
+    Bytes image = Fixtures::makeImage(256 * 1024);
+    TestServer server;
+    TestRoute firmware;
+    firmware.body = Fixtures::toString(image);
+    server.route("/fw.bin", firmware);
+    TestRoute telemetry;
+    telemetry.body = std::string(512, 't');
+    server.route("/telemetry", telemetry);
+
+    std::string firmwareUrl = server.url("/fw.bin");
+    std::string telemetryUrl = server.url("/telemetry");
+    HostSim::setBandwidth(LINK_RATE);
+
+    ESP32_AutoOTA ota;
+    std::vector<double> paused;
+    uint64_t receivedWhilePaused = 0;
+    Download result = download(ota, firmwareUrl, [&]() {
+        HostTest::waitFor([]() { return HostSim::bytesReceived() > 64 * 1024; }, 10000);
+        ota.pauseDownload();
+        delay(100);
+        uint64_t before = HostSim::bytesReceived();
+        paused = telemetryDuring(telemetryUrl, []() { delay(1000); });
+        receivedWhilePaused = HostSim::bytesReceived() - before - paused.size() * 512;
+        ota.resumeDownload();
+    });
+
+    double pausedP95 = Bench::percentile(paused, 0.95);
+    printf("  telemetry p95 while paused: %.1f ms, %llu download bytes received while paused\n", pausedP95,
+           (unsigned long long)receivedWhilePaused);
+    REQUIRE(result.ok);
+    CHECK(installed(image));
+    CHECK(receivedWhilePaused < 16 * 1024);
+    CHECK(pausedP95 < 20);
+    CHECK(ota.getStats().throttleMs >= 1000);
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
@@ -0,0 +1,181 @@
+/**
+ * test_redirects.cpp - Redirect following and the resolved-location cache
+ *
+ * An "origin" server answers like a GitHub release URL, with redirects
+ * to a "cdn" server on another port. The first check follows the
+ * chain; later checks go straight to the cached location until it
+ * fails or expires, and the stats count hops and cache hits.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <OTAHttp.h>
+#include <esp_ota_ops.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static TestRoute redirectTo(const std::string& location, int status = 302) {
+    TestRoute route;
+    route.status = status;
+    route.location = location;
+    return route;
+}
+
+static bool runCheck(ESP32_AutoOTA& ota) {
+    uint32_t before = ota.getStats().checkCount;
+    ota.forceCheck();
+    return HostTest::waitFor([&]() {
+        ota.poll();
+        return ota.getStats().checkCount > before;
+    }, 10000);
+}
+
+struct Release {
+    TestServer origin;
+    TestServer cdn;
+    std::string versionUrl;
+
+    /**
+     * origin /latest/version.txt -> origin /v2/version.txt -> cdn <path>
+     */
+    explicit Release(const std::string& cdnPath) {
+        OTAHttpRequest::clearRedirectCache();
+        TestRoute version;
+        version.body = "1.0.0\n";
+        cdn.route(cdnPath, version);
+        origin.route("/latest/version.txt", redirectTo("/v2/version.txt"));
+        origin.route("/v2/version.txt", redirectTo(cdn.url(cdnPath)));
+        versionUrl = origin.url("/latest/version.txt");
+    }
+
+    uint32_t originRequests() const {
+        return origin.requestCount("/latest/version.txt");
+    }
+};
+
+static void configure(ESP32_AutoOTA& ota, const std::string& versionUrl) {
+    ota.setVersionURL(versionUrl.c_str());
+    ota.setFirmwareURL(versionUrl.c_str());
+    ota.setCurrentVersion("1.0.0");
+    ota.setRandomDelay(0, 0);
+}
+
+TEST(cached_location_skips_the_chain) {
+    Release release("/assets/version.txt");
+    ESP32_AutoOTA ota;
+    configure(ota, release.versionUrl);
+    REQUIRE(ota.beginPolled());
+
+    REQUIRE(runCheck(ota));
+    CHECK_EQ(ota.getStats().redirectHops, 2u);
+    CHECK_EQ(ota.getStats().redirectCacheHits, 0u);
+
+    REQUIRE(runCheck(ota));
+    REQUIRE(runCheck(ota));
+    ota.stop();
+
+    CHECK_EQ(ota.getStats().checkFailures, 0u);
+    CHECK_EQ(ota.getStats().redirectHops, 2u);
+    CHECK_EQ(ota.getStats().redirectCacheHits, 2u);
+    CHECK_EQ(release.originRequests(), 1u);
+    CHECK_EQ(release.cdn.requestCount("/assets/version.txt"), 3u);
+}
+
+TEST(failed_location_is_resolved_again) {
+    Release release("/assets/old/version.txt");
+    ESP32_AutoOTA ota;
+    configure(ota, release.versionUrl);
+    REQUIRE(ota.beginPolled());
+    REQUIRE(runCheck(ota));
+
+    // The CDN drops the old object; the origin now points elsewhere
+    TestRoute version;
+    version.body = "1.0.0\n";
+    release.cdn.route("/assets/new/version.txt", version);
+    release.cdn.remove("/assets/old/version.txt");
+    release.origin.route("/v2/version.txt", redirectTo(release.cdn.url("/assets/new/version.txt")));
+
+    REQUIRE(runCheck(ota));
+    REQUIRE(runCheck(ota));
+    ota.stop();
+
+    CHECK_EQ(ota.getStats().checkFailures, 0u);
+    CHECK_EQ(release.originRequests(), 2u);
+    CHECK_EQ(release.cdn.requestCount("/assets/old/version.txt"), 2u);
+    CHECK_EQ(release.cdn.requestCount("/assets/new/version.txt"), 2u);
+    CHECK_EQ(ota.getStats().redirectHops, 4u);
+    CHECK_EQ(ota.getStats().redirectCacheHits, 1u);
+}
+
+TEST(signed_location_expires_at_half_its_lifetime) {
+    Release release("/assets/version.txt?X-Amz-Expires=2&X-Amz-Signature=abc");
+    ESP32_AutoOTA ota;
+    configure(ota, release.versionUrl);
+    REQUIRE(ota.beginPolled());
+
+    REQUIRE(runCheck(ota));
+    REQUIRE(runCheck(ota));
+    CHECK_EQ(release.originRequests(), 1u);
+
+    delay(1100);
+    REQUIRE(runCheck(ota));
+    ota.stop();
+
+    CHECK_EQ(ota.getStats().checkFailures, 0u);
+    CHECK_EQ(release.originRequests(), 2u);
+    CHECK_EQ(ota.getStats().redirectCacheHits, 1u);
+}
+
+TEST(download_resumes_on_cached_location) {
+    OTAHttpRequest::clearRedirectCache();
+    Bytes image = Fixtures::makeImage(256 * 1024);
+    TestServer origin;
+    TestServer cdn;
+    TestRoute firmware;
+    firmware.body = Fixtures::toString(image);
+    firmware.dropAfter = 100 * 1024;
+    cdn.route("/assets/fw.bin", firmware);
+    origin.route("/releases/download/v2/fw.bin", redirectTo(cdn.url("/assets/fw.bin")));
+
+    std::string url = origin.url("/releases/download/v2/fw.bin");
+    ESP32_AutoOTA ota;
+    OTAHttpSource source(url.c_str());
+    REQUIRE(ota.updateFrom(source));
+
+    // The Range request after the drop goes straight to the CDN
+    CHECK(memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0);
+    CHECK_EQ(origin.requestCount("/releases/download/v2/fw.bin"), 1u);
+    CHECK(cdn.requestCount("/assets/fw.bin") >= 2u);
+}
+
+TEST(gives_up_after_max_hops) {
+    OTAHttpRequest::clearRedirectCache();
+    TestServer origin;
+    for (int i = 0; i <= OTA_HTTP_MAX_REDIRECTS; i++) {
+        origin.route("/hop" + std::to_string(i), redirectTo("/hop" + std::to_string(i + 1), 307));
+    }
+    TestRoute version;
+    version.body = "1.0.0\n";
+    origin.route("/hop" + std::to_string(OTA_HTTP_MAX_REDIRECTS + 1), version);
+
+    std::string url = origin.url("/hop0");
+    OTAHttpRequest request;
+    REQUIRE(request.begin(url.c_str()));
+    int code = request.GET();
+    CHECK_EQ(code, 307);
+    CHECK_EQ(request.getRedirects(), (uint8_t)OTA_HTTP_MAX_REDIRECTS);
+    request.end();
+
+    // Nothing cached for a chain that never ended
+    REQUIRE(request.begin(url.c_str()));
+    CHECK(!request.getCacheHit());
+    request.end();
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
@@ -0,0 +1,112 @@
+/**
+ * test_scheduler.cpp - OTAScheduler retry semantics on virtual time
+ */
+
+#include <OTAScheduler.h>
+
+#include "HostTest.h"
+
+static const uint32_t INTERVAL = 300000;
+
+static void configure(OTAScheduler& scheduler, uint32_t retryDelay, uint8_t maxRetries) {
+    scheduler.setCheckInterval(INTERVAL);
+    scheduler.setRandomDelay(1000, 2000);
+    scheduler.setRetryPolicy(retryDelay, maxRetries);
+    scheduler.seed(42);
+    scheduler.start(0);
+}
+
+static bool withinJitter(uint32_t wait, uint32_t base) {
+    return wait >= base - base / 10 && wait <= base + base / 10;
+}
+
+TEST(failed_check_waits_the_interval_by_default) {
+    OTAScheduler scheduler;
+    configure(scheduler, 0, 3);
+    uint32_t now = scheduler.getNextCheckTime();
+    CHECK(scheduler.isDue(now));
+
+    CHECK(!scheduler.checkCompleted(now, false));
+    CHECK(withinJitter(scheduler.timeUntilDue(now), INTERVAL));
+    CHECK_EQ(scheduler.getRetryCount(), 1);
+}
+
+TEST(retry_counter_resets_at_max_retries) {
+    OTAScheduler scheduler;
+    configure(scheduler, 0, 3);
+    uint32_t now = scheduler.getNextCheckTime();
+
+    CHECK(!scheduler.checkCompleted(now, false));
+    CHECK(!scheduler.checkCompleted(now, false));
+    CHECK(scheduler.checkCompleted(now, false));     // Third failure reaches the limit
+    CHECK_EQ(scheduler.getRetryCount(), 0);
+}
+
+TEST(retry_delay_brings_retry_forward) {
+    OTAScheduler scheduler;
+    configure(scheduler, 60000, 3);
+    uint32_t now = scheduler.getNextCheckTime();
+
+    CHECK(!scheduler.checkCompleted(now, false));
+    CHECK(withinJitter(scheduler.timeUntilDue(now), 60000));
+    CHECK(!scheduler.checkCompleted(now, false));
+    CHECK(scheduler.checkCompleted(now, false));
+    CHECK(withinJitter(scheduler.timeUntilDue(now), INTERVAL));
+}
+
+TEST(success_resets_retries) {
+    OTAScheduler scheduler;
+    configure(scheduler, 0, 3);
+    uint32_t now = scheduler.getNextCheckTime();
+
+    scheduler.checkCompleted(now, false);
+    scheduler.checkCompleted(now, false);
+    CHECK(!scheduler.checkCompleted(now, true));
+    CHECK_EQ(scheduler.getRetryCount(), 0);
+    CHECK(withinJitter(scheduler.timeUntilDue(now), INTERVAL));
+}
+
+TEST(announcement_served_by_check_is_cleared) {
+    OTAScheduler scheduler;
+    configure(scheduler, 0, 3);
+    uint32_t now = scheduler.getNextCheckTime();
+
+    scheduler.announce(now, 5000);
+    uint32_t started = now + 5000;
+    CHECK(scheduler.isDue(started));
+    scheduler.checkStarted(started);
+    scheduler.checkCompleted(started + 200, true);
+    CHECK(withinJitter(scheduler.timeUntilDue(started + 200), INTERVAL));
+}
+
+TEST(announcement_during_check_survives_it) {
+    OTAScheduler scheduler;
+    configure(scheduler, 0, 3);
+    uint32_t started = scheduler.getNextCheckTime();
+    scheduler.checkStarted(started);
+
+    // Arrives while the check is reading the old version file, also
+    // within the millisecond it started in
+    scheduler.announce(started, 0);
+    scheduler.checkCompleted(started + 200, true);
+    CHECK(scheduler.isDue(started + 200));
+
+    scheduler.checkStarted(started + 200);
+    scheduler.checkCompleted(started + 400, true);
+    CHECK(withinJitter(scheduler.timeUntilDue(started + 400), INTERVAL));
+}
+
+TEST(announcement_not_yet_due_outlives_earlier_check) {
+    OTAScheduler scheduler;
+    configure(scheduler, 0, 3);
+    uint32_t started = scheduler.getNextCheckTime();
+
+    scheduler.announce(started - 100, 3000);
+    scheduler.checkStarted(started);
+    scheduler.checkCompleted(started + 200, true);
+    CHECK_EQ(scheduler.timeUntilDue(started + 200), 2700u);
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
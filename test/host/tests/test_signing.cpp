@@ -0,0 +1,183 @@
+/**
+ * test_signing.cpp - Signed releases through the version file and updateFrom()
+ *
+ * The release is signed with a P-256 key made by Fixtures::SigningKey,
+ * the same format tools/ota_sign.py writes into version.txt. A device
+ * with the public key installs a correctly signed image and refuses an
+ * unsigned release, a tampered image and a release signed with another
+ * key, and updateFrom() without a digest and signature; after a refusal
+ * the running firmware stays the boot partition.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <esp_ota_ops.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static const size_t IMAGE_SIZE = 128 * 1024;
+
+struct Release {
+    Bytes image;
+    Fixtures::SigningKey key;
+    TestServer server;
+    std::string versionUrl;
+    std::string firmwareUrl;
+
+    Release() : image(Fixtures::makeImage(IMAGE_SIZE, "2.0.0", "host_app", 1)) {
+        versionUrl = server.url("/version.txt");
+        firmwareUrl = server.url("/fw.bin");
+        publish(Fixtures::versionFile("2.0.0", &image, &key), image);
+    }
+
+    void publish(const std::string& manifest, const Bytes& firmware) {
+        TestRoute version;
+        version.body = manifest;
+        server.route("/version.txt", version);
+        TestRoute route;
+        route.body = Fixtures::toString(firmware);
+        server.route("/fw.bin", route);
+    }
+
+    /**
+     * Run a device with the release's public key until it restarts into
+     * the new image or reports an error
+     * @return true if it restarted
+     */
+    bool run(ESP32_AutoOTA& ota, const Fixtures::SigningKey& trusted) {
+        ota.setVersionURL(versionUrl.c_str());
+        ota.setFirmwareURL(firmwareUrl.c_str());
+        ota.setCurrentVersion("1.0.0");
+        ota.setRandomDelay(0, 0);
+        std::string pem = trusted.publicPem();
+        REQUIRE(ota.setSigningKey(pem.c_str()));
+
+        uint32_t restarts = HostSim::restartCount();
+        REQUIRE(ota.beginPolled());
+        HostTest::waitFor([&]() {
+            ota.poll();
+            return HostSim::restartCount() > restarts || ota.getLastError()[0] != '\0';
+        }, 15000);
+        ota.stop();
+        return HostSim::restartCount() > restarts;
+    }
+
+    bool installed() {
+        return esp_ota_get_boot_partition() == HostSim::app1() &&
+               memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0;
+    }
+};
+
+static Bytes tamper(const Bytes& image) {
+    Bytes tampered = image;
+    tampered[tampered.size() / 2] ^= 0x01;
+    return tampered;
+}
+
+TEST(valid_signature_installs) {
+    Release release;
+    ESP32_AutoOTA ota;
+    CHECK(release.run(ota, release.key));
+    CHECK(release.installed());
+    CHECK_STR(ota.getLastError(), "");
+    CHECK_EQ(release.server.requestCount("/fw.bin"), 1u);
+}
+
+TEST(unsigned_release_is_refused_before_download) {
+    Release release;
+    release.publish(Fixtures::versionFile("2.0.0", &release.image), release.image);
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+
+    ESP32_AutoOTA ota;
+    CHECK(!release.run(ota, release.key));
+    CHECK_STR(ota.getLastError(), "Update rejected: release is not signed");
+    CHECK_EQ(release.server.requestCount("/fw.bin"), 0u);
+    CHECK(esp_ota_get_boot_partition() == boot);
+}
+
+TEST(tampered_image_is_rejected) {
+    Release release;
+    release.publish(Fixtures::versionFile("2.0.0", &release.image, &release.key), tamper(release.image));
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+
+    ESP32_AutoOTA ota;
+    CHECK(!release.run(ota, release.key));
+    CHECK_STR(ota.getLastError(), "Image rejected: SHA-256 mismatch");
+    CHECK(esp_ota_get_boot_partition() == boot);
+}
+
+TEST(tampered_image_with_matching_digest_fails_signature) {
+    Release release;
+    // The attacker controls the image and the sha256= line, not the key
+    Bytes tampered = tamper(release.image);
+    std::string manifest = "2.0.0\nsha256=" + Fixtures::hex(Fixtures::sha256(tampered)) + "\n" +
+                           "sig=" + Fixtures::hex(release.key.sign(Fixtures::sha256(release.image))) + "\n";
+    release.publish(manifest, tampered);
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+
+    ESP32_AutoOTA ota;
+    CHECK(!release.run(ota, release.key));
+    CHECK_STR(ota.getLastError(), "Image rejected: bad signature");
+    CHECK(esp_ota_get_boot_partition() == boot);
+}
+
+TEST(release_signed_with_other_key_is_rejected) {
+    Release release;
+    Fixtures::SigningKey other;
+    release.publish(Fixtures::versionFile("2.0.0", &release.image, &other), release.image);
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+
+    ESP32_AutoOTA ota;
+    CHECK(!release.run(ota, release.key));
+    CHECK_STR(ota.getLastError(), "Image rejected: bad signature");
+    CHECK(esp_ota_get_boot_partition() == boot);
+}
+
+TEST(update_from_checks_digest_and_signature) {
+    Release release;
+    Bytes digest = Fixtures::sha256(release.image);
+    Bytes signature = release.key.sign(digest);
+    Fixtures::SigningKey other;
+    Bytes otherSignature = other.sign(digest);
+    std::string pem = release.key.publicPem();
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+
+    ESP32_AutoOTA ota;
+    REQUIRE(ota.setSigningKey(pem.c_str()));
+    OTAHttpSource source(release.firmwareUrl.c_str());
+
+    CHECK(!ota.updateFrom(source, digest.data()));
+    CHECK_STR(ota.getLastError(), "Update rejected: release is not signed");
+    CHECK(!ota.updateFrom(source, NULL, signature.data(), signature.size()));
+    CHECK_STR(ota.getLastError(), "Update rejected: release is not signed");
+    CHECK(!ota.updateFrom(source, digest.data(), otherSignature.data(), otherSignature.size()));
+    CHECK_STR(ota.getLastError(), "Image rejected: bad signature");
+    CHECK(esp_ota_get_boot_partition() == boot);
+
+    CHECK(ota.updateFrom(source, digest.data(), signature.data(), signature.size()));
+    CHECK(release.installed());
+}
+
+TEST(update_from_trusted_source_without_digest_is_refused) {
+    Release release;
+    std::string pem = release.key.publicPem();
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+
+    ESP32_AutoOTA ota;
+    REQUIRE(ota.setSigningKey(pem.c_str()));
+    OTAHttpSource source(release.firmwareUrl.c_str());
+    REQUIRE(source.isTrusted());
+
+    CHECK(!ota.updateFrom(source));
+    CHECK_STR(ota.getLastError(), "Update rejected: release is not signed");
+    CHECK(esp_ota_get_boot_partition() == boot);
+    CHECK_EQ(release.server.requestCount("/fw.bin"), 0u);
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
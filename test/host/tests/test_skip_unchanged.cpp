@@ -0,0 +1,77 @@
+/**
+ * test_skip_unchanged.cpp - Skip-unchanged writes from a file source
+ *
+ * The inactive partition holds the previous build and the next one is
+ * installed from a file: only the sectors that differ are erased and
+ * written, and the partition ends up holding exactly the new image.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <esp_ota_ops.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+
+using Fixtures::Bytes;
+
+static bool installFile(const Bytes& previous, const Bytes& next, OTAStats& stats) {
+    HostSim::flashImage(HostSim::app1(), previous.data(), previous.size());
+    HostSim::resetFlashCounters();
+
+    std::string root = Fixtures::tempDir("skip");
+    REQUIRE(Fixtures::writeFile(root + "/fw.bin", next));
+    fs::FS storage = HostSim::hostFS(root.c_str());
+    OTAFileSource source(storage, "/fw.bin");
+
+    ESP32_AutoOTA ota;
+    ota.setSkipUnchangedSectors(true);
+    bool ok = ota.updateFrom(source);
+    stats = ota.getStats();
+    return ok;
+}
+
+static bool installed(const Bytes& image) {
+    return esp_ota_get_boot_partition() == HostSim::app1() &&
+           memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0;
+}
+
+TEST(writes_only_changed_sectors) {
+    Bytes previous = Fixtures::makeImage(256 * 1024, "1.0.0");
+    Bytes next = Fixtures::nextBuild(previous, "1.0.1", 3);
+    OTAStats stats;
+    REQUIRE(installFile(previous, next, stats));
+    CHECK(installed(next));
+
+    // The first sector (new version string) and the three changed ones
+    uint32_t sectors = next.size() / OTA_SECTOR_SIZE;
+    CHECK(HostSim::flashCounters().sectorErases <= 4u);
+    CHECK_EQ(stats.flashSectorsSkipped + HostSim::flashCounters().sectorErases, sectors);
+    CHECK_EQ(HostSim::flashCounters().dirtyWrites, 0u);
+}
+
+TEST(rewrites_sectors_moved_by_an_insert) {
+    Bytes previous = Fixtures::makeImage(256 * 1024, "1.0.0");
+    Bytes next = Fixtures::nextBuild(previous, "1.1.0", 0, 128 * 1024, 1000);
+    OTAStats stats;
+    REQUIRE(installFile(previous, next, stats));
+    CHECK(installed(next));
+
+    // Everything from the insert on moved
+    CHECK_EQ(stats.flashSectorsSkipped, 31u);
+    CHECK_EQ(HostSim::flashCounters().dirtyWrites, 0u);
+}
+
+TEST(unrelated_contents_are_all_written) {
+    Bytes previous = Fixtures::makeImage(128 * 1024, "1.0.0", "host_app", 5);
+    Bytes next = Fixtures::makeImage(160 * 1024, "2.0.0", "host_app", 6);
+    OTAStats stats;
+    REQUIRE(installFile(previous, next, stats));
+    CHECK(installed(next));
+    CHECK_EQ(stats.flashSectorsSkipped, 0u);
+    CHECK_EQ(HostSim::flashCounters().sectorErases, 40u);
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
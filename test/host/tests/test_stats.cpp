@@ -0,0 +1,124 @@
+/**
+ * test_stats.cpp - Statistics snapshots under concurrent writes
+ *
+ * OTASeqlock is hammered by a writer thread while readers check that
+ * every snapshot is consistent; then getStats() is read from another
+ * thread while polled-mode checks update the real counters.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <OTASeqlock.h>
+
+#include <thread>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+// Every field holds the same value after each complete update
+struct Sample {
+    uint32_t words[24];
+    uint64_t wide;
+};
+
+TEST(seqlock_snapshots_are_never_torn) {
+    OTASeqlock lock;
+    Sample shared;
+    memset(&shared, 0, sizeof(shared));
+    std::atomic<bool> running(true);
+    std::atomic<uint32_t> writes(0);
+    std::atomic<uint32_t> torn(0);
+    std::atomic<uint32_t> reads(0);
+
+    std::thread writer([&]() {
+        uint32_t value = 0;
+        while (running) {
+            value++;
+            lock.writeBegin();
+            for (uint32_t& word : shared.words) word = value;
+            shared.wide = ((uint64_t)value << 32) | value;
+            lock.writeEnd();
+            writes++;
+        }
+    });
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r++) {
+        readers.emplace_back([&]() {
+            uint32_t last = 0;
+            while (running) {
+                Sample copy;
+                lock.read(&copy, &shared, sizeof(copy));
+                bool consistent = copy.wide == (((uint64_t)copy.words[0] << 32) | copy.words[0]);
+                for (uint32_t word : copy.words) consistent = consistent && word == copy.words[0];
+                if (!consistent || copy.words[0] < last) torn++;
+                last = copy.words[0];
+                reads++;
+            }
+        });
+    }
+
+    delay(500);
+    running = false;
+    writer.join();
+    for (auto& reader : readers) reader.join();
+
+    CHECK_EQ(torn.load(), 0u);
+    CHECK(writes.load() > 1000);
+    CHECK(reads.load() > 1000);
+}
+
+TEST(get_stats_while_polled_checks_run) {
+    TestServer server;
+    TestRoute route;
+    route.body = "1.0.0\n";
+    server.route("/version.txt", route);
+    server.route("/fw.bin", TestRoute());
+
+    std::string versionUrl = server.url("/version.txt");
+    std::string firmwareUrl = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    ota.setVersionURL(versionUrl.c_str());
+    ota.setFirmwareURL(firmwareUrl.c_str());
+    ota.setCurrentVersion("1.0.0");
+    ota.setRandomDelay(0, 0);
+    ota.setCheckInterval(10);
+    REQUIRE(ota.beginPolled());
+
+    std::atomic<bool> running(true);
+    std::atomic<uint32_t> inconsistent(0);
+    std::atomic<uint32_t> snapshots(0);
+    std::thread reader([&]() {
+        uint32_t lastCount = 0;
+        while (running) {
+            OTAStats stats = ota.getStats();
+            if (stats.checkFailures > stats.checkCount || stats.retries > stats.checkFailures ||
+                stats.checkCount < lastCount) {
+                inconsistent++;
+            }
+            lastCount = stats.checkCount;
+            snapshots++;
+        }
+    });
+
+    unsigned long start = millis();
+    while (millis() - start < 1000) {
+        ota.poll();
+        delay(1);
+    }
+    running = false;
+    reader.join();
+    ota.stop();
+
+    OTAStats stats = ota.getStats();
+    CHECK(stats.checkCount >= 10);
+    CHECK_EQ(stats.checkFailures, 0u);
+    CHECK(stats.okCount >= 10);
+    CHECK(stats.bytesTransferred >= stats.okCount * 6);
+    CHECK_EQ(inconsistent.load(), 0u);
+    CHECK(snapshots.load() > 100);
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
@@ -0,0 +1,102 @@
+/**
+ * test_trace.cpp - OTATrace on uninitialised RTC memory
+ *
+ * Each case runs in a fresh process (a spawned device), because the
+ * trace checks its RTC buffer once per boot. RTC memory is filled
+ * with garbage first, as after a power-on, and the trace is used
+ * before begin().
+ */
+
+#include <HostSim.h>
+#include <OTATrace.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+
+class CapturePrint : public Print {
+public:
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+    std::string text;
+};
+
+DEVICE(record_first) {
+    HostSim::fillRtcMemory(0xA5);
+    OTATrace::record(OTA_EVT_CHECK_START, 7, 1234);
+
+    OTATraceRecord records[OTA_TRACE_CAPACITY];
+    size_t count = OTATrace::read(records, OTA_TRACE_CAPACITY);
+    CHECK_EQ(count, (size_t)1);
+    CHECK_EQ(records[0].event, OTA_EVT_CHECK_START);
+    CHECK_EQ(records[0].arg0, 7);
+    CHECK_EQ(records[0].arg1, 1234u);
+
+    OTATrace::begin();
+    count = OTATrace::read(records, OTA_TRACE_CAPACITY);
+    CHECK_EQ(count, (size_t)2);
+    CHECK_EQ(records[1].event, OTA_EVT_BOOT);
+    CHECK_EQ(records[1].arg1, 1u);    // Garbage boot count was discarded
+    return HostTest::failures();
+}
+
+DEVICE(read_first) {
+    HostSim::fillRtcMemory(0x5A);
+    OTATraceRecord records[OTA_TRACE_CAPACITY];
+    CHECK_EQ(OTATrace::read(records, OTA_TRACE_CAPACITY), (size_t)0);
+
+    CapturePrint out;
+    OTATrace::dump(out);
+    CHECK_EQ(out.text, std::string("OTATRACE 1 0\r\n"));
+    return HostTest::failures();
+}
+
+DEVICE(clear_first) {
+    HostSim::fillRtcMemory(0xFF);
+    OTATrace::clear();
+    OTATrace::record(OTA_EVT_REBOOT, 0, 42);
+    OTATraceRecord records[OTA_TRACE_CAPACITY];
+    CHECK_EQ(OTATrace::read(records, OTA_TRACE_CAPACITY), (size_t)1);
+    CHECK_EQ(records[0].arg1, 42u);
+    return HostTest::failures();
+}
+
+DEVICE(wraps_around) {
+    HostSim::fillRtcMemory(0x00);
+    OTATrace::begin();
+    for (uint32_t i = 0; i < OTA_TRACE_CAPACITY * 3; i++) {
+        OTATrace::record(OTA_EVT_DOWNLOAD_PROGRESS, 0, i);
+    }
+    OTATraceRecord records[OTA_TRACE_CAPACITY];
+    size_t count = OTATrace::read(records, OTA_TRACE_CAPACITY);
+    CHECK_EQ(count, (size_t)OTA_TRACE_CAPACITY);
+    CHECK_EQ(records[0].arg1, (uint32_t)OTA_TRACE_CAPACITY * 2);
+    CHECK_EQ(records[count - 1].arg1, (uint32_t)OTA_TRACE_CAPACITY * 3 - 1);
+    return HostTest::failures();
+}
+
+static void runDevice(const char* role) {
+    int pid = Fixtures::spawnDevice(HostTest::self(), {role});
+    CHECK_EQ(Fixtures::waitDevice(pid, 10000), 0);
+}
+
+TEST(record_before_begin_on_garbage) {
+    runDevice("record_first");
+}
+
+TEST(read_before_begin_on_garbage) {
+    runDevice("read_first");
+}
+
+TEST(clear_before_begin_on_garbage) {
+    runDevice("clear_first");
+}
+
+TEST(ring_keeps_newest_records) {
+    runDevice("wraps_around");
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
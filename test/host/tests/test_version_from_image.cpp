@@ -0,0 +1,167 @@
+/**
+ * test_version_from_image.cpp - Version checks with a Range request on the image
+ *
+ * With setVersionFromImage() the check asks the firmware URL for the
+ * image header and app descriptor only, reads the embedded version,
+ * and revalidates with the ETag and Last-Modified the server sent, so
+ * an unchanged image costs a 304.
+ */
+
+#include <ESP32_AutoOTA.h>
+#include <HostSim.h>
+#include <esp_ota_ops.h>
+
+#include "Fixtures.h"
+#include "HostTest.h"
+#include "TestServer.h"
+
+using Fixtures::Bytes;
+
+static const size_t IMAGE_SIZE = 512 * 1024;
+
+static void configure(ESP32_AutoOTA& ota, const std::string& firmwareUrl) {
+    ota.setFirmwareURL(firmwareUrl.c_str());
+    ota.setVersionFromImage(true);
+    ota.setCurrentVersion("1.0.0");
+    ota.setRandomDelay(0, 0);
+}
+
+static bool runCheck(ESP32_AutoOTA& ota) {
+    uint32_t before = ota.getStats().checkCount;
+    ota.forceCheck();
+    return HostTest::waitFor([&]() {
+        ota.poll();
+        return ota.getStats().checkCount > before;
+    }, 10000);
+}
+
+static std::vector<TestRequest> requestsFor(const TestServer& server, const std::string& path) {
+    std::vector<TestRequest> matching;
+    for (const TestRequest& request : server.requests()) {
+        if (request.path == path) matching.push_back(request);
+    }
+    return matching;
+}
+
+TEST(reads_version_from_image_prefix) {
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(Fixtures::makeImage(IMAGE_SIZE, "1.0.0"));
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    configure(ota, url);
+    REQUIRE(ota.beginPolled());
+    uint32_t restarts = HostSim::restartCount();
+    REQUIRE(runCheck(ota));
+    ota.stop();
+
+    std::vector<TestRequest> requests = requestsFor(server, "/fw.bin");
+    REQUIRE(requests.size() == 1u);
+    std::string range = "bytes=0-" + std::to_string(OTA_IMAGE_HEADER_LEN - 1);
+    CHECK_STR(requests[0].header("range").c_str(), range.c_str());
+    CHECK(server.bytesSent() < 1024);
+    CHECK_EQ(ota.getStats().checkFailures, 0u);
+    CHECK_EQ(HostSim::restartCount(), restarts);
+}
+
+TEST(unchanged_image_answers_304) {
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(Fixtures::makeImage(IMAGE_SIZE, "1.0.0"));
+    route.etag = "\"build-1\"";
+    route.lastModified = "Thu, 01 Jan 2026 00:00:00 GMT";
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    configure(ota, url);
+    REQUIRE(ota.beginPolled());
+    REQUIRE(runCheck(ota));
+    REQUIRE(runCheck(ota));
+    ota.stop();
+
+    std::vector<TestRequest> requests = requestsFor(server, "/fw.bin");
+    REQUIRE(requests.size() == 2u);
+    CHECK_STR(requests[1].header("if-none-match").c_str(), "\"build-1\"");
+    CHECK_STR(requests[1].header("if-modified-since").c_str(), "Thu, 01 Jan 2026 00:00:00 GMT");
+    CHECK_EQ(ota.getStats().notModifiedCount, 1u);
+    CHECK_EQ(ota.getStats().checkFailures, 0u);
+}
+
+TEST(long_validators_are_truncated_and_terminated) {
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(Fixtures::makeImage(IMAGE_SIZE, "1.0.0"));
+    route.etag = "\"" + std::string(150, 'e') + "\"";
+    route.lastModified = std::string(60, 'm');
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    configure(ota, url);
+    REQUIRE(ota.beginPolled());
+    REQUIRE(runCheck(ota));
+    REQUIRE(runCheck(ota));
+    ota.stop();
+
+    // Cut to the buffers (80 and 32 bytes with the terminator), so they
+    // never match and the second check is a full 206 again
+    std::vector<TestRequest> requests = requestsFor(server, "/fw.bin");
+    REQUIRE(requests.size() == 2u);
+    CHECK_STR(requests[1].header("if-none-match").c_str(), route.etag.substr(0, 79).c_str());
+    CHECK_STR(requests[1].header("if-modified-since").c_str(), route.lastModified.substr(0, 31).c_str());
+    CHECK_EQ(ota.getStats().notModifiedCount, 0u);
+    CHECK_EQ(ota.getStats().checkFailures, 0u);
+}
+
+TEST(works_when_server_ignores_range) {
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(Fixtures::makeImage(IMAGE_SIZE, "1.0.0"));
+    route.ranges = false;
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    configure(ota, url);
+    REQUIRE(ota.beginPolled());
+    HostSim::resetBytesReceived();
+    REQUIRE(runCheck(ota));
+    ota.stop();
+
+    // The rest of the 200 body is left unread on the closed connection
+    CHECK_EQ(ota.getStats().checkFailures, 0u);
+    CHECK(HostSim::bytesReceived() < IMAGE_SIZE / 4);
+}
+
+TEST(newer_embedded_version_is_installed) {
+    Bytes image = Fixtures::makeImage(IMAGE_SIZE, "2.0.0");
+    TestServer server;
+    TestRoute route;
+    route.body = Fixtures::toString(image);
+    server.route("/fw.bin", route);
+
+    std::string url = server.url("/fw.bin");
+    ESP32_AutoOTA ota;
+    configure(ota, url);
+    ota.setImageValidation(true, true);
+    REQUIRE(ota.beginPolled());
+    uint32_t restarts = HostSim::restartCount();
+    ota.forceCheck();
+    bool restarted = HostTest::waitFor([&]() {
+        ota.poll();
+        return HostSim::restartCount() > restarts;
+    }, 10000);
+    ota.stop();
+
+    CHECK(restarted);
+    CHECK(esp_ota_get_boot_partition() == HostSim::app1());
+    CHECK(memcmp(HostSim::partitionData(HostSim::app1()), image.data(), image.size()) == 0);
+    CHECK_EQ(server.requestCount("/fw.bin"), 2u);
+}
+
+int main(int argc, char** argv) {
+    return HostTest::run(argc, argv);
+}
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+ota_encrypt.py
+
+Encrypt a firmware image for ESP32_AutoOTA::setDecryptionKey() /
+OTADecryptSource.
+
+Output: "AOTE" + 12-byte random nonce, then the image encrypted with
+AES-CTR. The counter block is the nonce followed by the 32-bit
+big-endian block index, starting at 0. Also prints the version file's
+sha256= line (the plain image, checked by devices) and sha256-enc= line
+(the encrypted file, checked by a site gateway before it caches it).
+
+Usage:
+    python3 ota_encrypt.py genkey ota.key              # Writes ota.key and ota_key.h
+    python3 ota_encrypt.py encrypt firmware.bin firmware.enc --key ota.key
+    python3 ota_encrypt.py decrypt firmware.enc firmware.bin --key ota.key
+
+Requires the "cryptography" package (pip install cryptography).
+"""
+
+import argparse
+import hashlib
+import os
+import sys
+
+MAGIC = b"AOTE"  # keep in sync with include/OTADecrypt.h
+NONCE_LEN = 12
+
+
+def load_key(path):
+    with open(path, "rb") as f:
+        key = f.read()
+    if len(key) not in (16, 32):
+        sys.exit("%s: key must be 16 or 32 bytes, got %d" % (path, len(key)))
+    return key
+
+
+def write_private(path, data):
+    # Owner-only from the start; refuse to overwrite an existing key
+    try:
+        fd = os.open(path, os.O_WRONLY | os.O_CREAT | os.O_EXCL, 0o600)
+    except FileExistsError:
+        sys.exit("%s: already exists" % path)
+    with os.fdopen(fd, "wb") as f:
+        f.write(data)
+
+
+def ctr(key, nonce, data):
+    from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+    cipher = Cipher(algorithms.AES(key), modes.CTR(nonce + b"\0\0\0\0"))
+    return cipher.encryptor().update(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("genkey")
+    p.add_argument("key")
+    p.add_argument("--bits", type=int, choices=(128, 256), default=256)
+    p.add_argument("--header", help="C header for the sketch (default: <key>_key.h)")
+
+    for name in ("encrypt", "decrypt"):
+        p = sub.add_parser(name)
+        p.add_argument("input")
+        p.add_argument("output")
+        p.add_argument("--key", required=True, help="raw key file (16 or 32 bytes)")
+
+    args = parser.parse_args()
+
+    if args.command == "genkey":
+        key = os.urandom(args.bits // 8)
+        header = args.header or os.path.splitext(args.key)[0] + "_key.h"
+        write_private(args.key, key)
+        # C array for the sketch; keep both files out of version control
+        write_private(header, ("const uint8_t OTA_KEY[%d] = { %s };\n" %
+                               (len(key), ", ".join("0x%02x" % b for b in key))).encode())
+        print("wrote %s and %s" % (args.key, header))
+        return
+
+    key = load_key(args.key)
+    with open(args.input, "rb") as f:
+        data = f.read()
+
+    if args.command == "encrypt":
+        nonce = os.urandom(NONCE_LEN)
+        out = MAGIC + nonce + ctr(key, nonce, data)
+        print("sha256=%s" % hashlib.sha256(data).hexdigest())
+        print("sha256-enc=%s" % hashlib.sha256(out).hexdigest())
+    else:
+        if data[:4] != MAGIC:
+            sys.exit("%s: not an encrypted image" % args.input)
+        nonce = data[4:4 + NONCE_LEN]
+        out = ctr(key, nonce, data[4 + NONCE_LEN:])
+
+    with open(args.output, "wb") as f:
+        f.write(out)
+
+
+if __name__ == "__main__":
+    main()
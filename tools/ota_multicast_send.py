@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""
+ota_multicast_send.py
+
+Stream a firmware image to ESP32_AutoOTA devices over UDP multicast
+(OTAMulticastSource), or simulate a session to size its parameters.
+
+Every group of K blocks is followed by one XOR parity block, so each
+receiver can lose one packet per group. Groups lost beyond that are
+fetched by the device from the fallback URL with a Range request.
+
+Usage:
+    python3 ota_multicast_send.py send firmware.bin --group 239.255.0.1 --rounds 2
+    python3 ota_multicast_send.py simulate firmware.bin --loss 0.02 --receivers 1,10,100,500
+"""
+
+import argparse
+import hashlib
+import random
+import socket
+import struct
+import sys
+import time
+
+MAGIC = 0x4D544F41  # "AOTM", keep in sync with include/OTAMulticastSource.h
+HEADER = struct.Struct("<IIIIHBB")
+MAX_BLOCK = 1400
+MAX_K = 16
+
+
+def build_packets(image, block_size, k):
+    """Yield (group, index, packet) in send order, parity last in each group."""
+    image_id = struct.unpack("<I", hashlib.sha256(image).digest()[:4])[0]
+    group_bytes = block_size * k
+    groups = (len(image) + group_bytes - 1) // group_bytes
+
+    for group in range(groups):
+        start = group * group_bytes
+        data = image[start:start + group_bytes]
+        blocks = (len(data) + block_size - 1) // block_size
+        parity = bytearray(block_size)
+        for index in range(blocks):
+            block = data[index * block_size:(index + 1) * block_size].ljust(block_size, b"\0")
+            for i in range(block_size):
+                parity[i] ^= block[i]
+            yield group, index, HEADER.pack(MAGIC, image_id, len(image), group, block_size, k, index) + block
+        yield group, k, HEADER.pack(MAGIC, image_id, len(image), group, block_size, k, k) + bytes(parity)
+
+
+def send(args):
+    with open(args.image, "rb") as f:
+        image = f.read()
+    packets = [p for _, _, p in build_packets(image, args.block, args.k)]
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, args.ttl)
+    if args.interface:
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton(args.interface))
+
+    interval = (args.block + HEADER.size) / (args.rate * 1024.0)
+    print("%d bytes, %d packets per round, %.1f s per round" %
+          (len(image), len(packets), len(packets) * interval))
+
+    for round_ in range(args.rounds):
+        next_send = time.monotonic()
+        for packet in packets:
+            sock.sendto(packet, (args.group, args.port))
+            next_send += interval
+            delay = next_send - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+        print("round %d done" % (round_ + 1))
+
+
+def simulate(args):
+    """Model one session: independent packet loss per receiver, lost
+    groups fetched one after another from a shared fallback server."""
+    with open(args.image, "rb") as f:
+        size = len(f.read())
+
+    group_bytes = args.block * args.k
+    groups = (size + group_bytes - 1) // group_bytes
+    packet_time = (args.block + HEADER.size) / (args.rate * 1024.0)
+    group_time = (args.k + 1) * packet_time
+    stream_end = groups * group_time
+    fetch_time = args.rtt / 1000.0 + group_bytes / (args.server_rate * 1024.0)
+    rng = random.Random(args.seed)
+
+    print("image %d bytes, %d groups, stream %.1f s, loss %.1f%%" %
+          (size, groups, stream_end, args.loss * 100))
+    print("%10s %10s %10s %10s %12s %14s" %
+          ("receivers", "mean s", "p95 s", "max s", "fetched", "unicast-only s"))
+
+    for receivers in args.receivers:
+        # Every receiver asks the fallback server for a lost group when the
+        # stream moves past it; the server handles one request at a time.
+        requests = []
+        for r in range(receivers):
+            for g in range(groups):
+                lost = sum(1 for _ in range(args.k + 1) if rng.random() < args.loss)
+                if lost > 1:
+                    requests.append(((g + 1) * group_time, r))
+        requests.sort()
+
+        done = [stream_end] * receivers
+        server_free = 0.0
+        for at, r in requests:
+            server_free = max(server_free, at) + fetch_time
+            done[r] = max(done[r], server_free)
+
+        done.sort()
+        unicast_only = receivers * size / (args.server_rate * 1024.0)
+        print("%10d %10.1f %10.1f %10.1f %12d %14.1f" %
+              (receivers, sum(done) / receivers, done[int(receivers * 0.95) - 1 if receivers > 1 else 0],
+               done[-1], len(requests), unicast_only))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    for name in ("send", "simulate"):
+        p = sub.add_parser(name)
+        p.add_argument("image", help="firmware.bin")
+        p.add_argument("--block", type=int, default=1024, help="payload bytes per packet (max %d)" % MAX_BLOCK)
+        p.add_argument("--k", type=int, default=8, help="data blocks per parity block (max %d)" % MAX_K)
+        p.add_argument("--rate", type=float, default=64, help="stream rate in KB/s")
+
+    send_parser = sub.choices["send"]
+    send_parser.add_argument("--group", default="239.255.0.1")
+    send_parser.add_argument("--port", type=int, default=3233)
+    send_parser.add_argument("--rounds", type=int, default=1, help="times the image is repeated")
+    send_parser.add_argument("--ttl", type=int, default=1)
+    send_parser.add_argument("--interface", help="local address to send from")
+
+    sim_parser = sub.choices["simulate"]
+    sim_parser.add_argument("--loss", type=float, default=0.02, help="packet loss per receiver (0-1)")
+    sim_parser.add_argument("--receivers", default="1,10,50,100,500",
+                            type=lambda s: [int(n) for n in s.split(",")])
+    sim_parser.add_argument("--server-rate", type=float, default=1024, help="fallback server KB/s")
+    sim_parser.add_argument("--rtt", type=float, default=50, help="fallback request round trip in ms")
+    sim_parser.add_argument("--seed", type=int, default=1)
+
+    args = parser.parse_args()
+    if not 0 < args.block <= MAX_BLOCK or not 0 < args.k <= MAX_K:
+        sys.exit("block must be 1-%d and k 1-%d" % (MAX_BLOCK, MAX_K))
+
+    send(args) if args.command == "send" else simulate(args)
+
+
+if __name__ == "__main__":
+    main()
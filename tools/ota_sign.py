@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""
+ota_sign.py
+
+Sign firmware releases for ESP32_AutoOTA::setSigningKey().
+
+The signature is ECDSA P-256 over the SHA-256 of the image as it is
+written to flash (for encrypted releases: the plain image, before
+ota_encrypt.py). "sign" prints the sha256= and sig= lines to append to
+version.txt below the version number.
+
+Usage:
+    python3 ota_sign.py genkey signing.pem            # Also writes signing.pub.pem
+    python3 ota_sign.py sign firmware.bin --key signing.pem >> version.txt
+    python3 ota_sign.py verify firmware.bin version.txt --key signing.pub.pem
+
+Requires the "cryptography" package (pip install cryptography).
+"""
+
+import argparse
+import hashlib
+import os
+import sys
+
+from cryptography.exceptions import InvalidSignature
+from cryptography.hazmat.primitives import hashes, serialization
+from cryptography.hazmat.primitives.asymmetric import ec, utils
+
+SIGNATURE_MAX = 72  # keep in sync with OTA_SIGNATURE_MAX in include/ESP32_AutoOTA.h
+
+
+def digest(path):
+    with open(path, "rb") as f:
+        return hashlib.sha256(f.read()).digest()
+
+
+def genkey(args):
+    key = ec.generate_private_key(ec.SECP256R1())
+    # Owner-only from the start; refuse to overwrite an existing key
+    try:
+        fd = os.open(args.key, os.O_WRONLY | os.O_CREAT | os.O_EXCL, 0o600)
+    except FileExistsError:
+        sys.exit("%s: already exists" % args.key)
+    with os.fdopen(fd, "wb") as f:
+        f.write(key.private_bytes(serialization.Encoding.PEM,
+                                  serialization.PrivateFormat.PKCS8,
+                                  serialization.NoEncryption()))
+
+    public = key.public_key().public_bytes(serialization.Encoding.PEM,
+                                           serialization.PublicFormat.SubjectPublicKeyInfo)
+    public_path = args.key.rsplit(".", 1)[0] + ".pub.pem"
+    with open(public_path, "wb") as f:
+        f.write(public)
+
+    # For the sketch; the private key stays on the build machine
+    print("const char OTA_SIGNING_KEY[] =")
+    for line in public.decode().strip().splitlines():
+        print('    "%s\\n"' % line)
+    print(";")
+
+
+def sign(args):
+    with open(args.key, "rb") as f:
+        key = serialization.load_pem_private_key(f.read(), password=None)
+    if not isinstance(key, ec.EllipticCurvePrivateKey) or key.curve.name != "secp256r1":
+        sys.exit("%s: not an ECDSA P-256 key" % args.key)
+
+    h = digest(args.image)
+    signature = key.sign(h, ec.ECDSA(utils.Prehashed(hashes.SHA256())))
+    assert len(signature) <= SIGNATURE_MAX
+    print("sha256=%s" % h.hex())
+    print("sig=%s" % signature.hex())
+
+
+def verify(args):
+    with open(args.key, "rb") as f:
+        key = serialization.load_pem_public_key(f.read())
+
+    fields = {}
+    with open(args.manifest) as f:
+        for line in f.read().splitlines()[1:]:
+            name, _, value = line.strip().partition("=")
+            fields[name] = value
+
+    if "sig" not in fields:
+        sys.exit("%s: no sig= line" % args.manifest)
+
+    h = digest(args.image)
+    if "sha256" in fields and fields["sha256"].lower() != h.hex():
+        sys.exit("FAIL: SHA-256 mismatch")
+    try:
+        key.verify(bytes.fromhex(fields["sig"]), h, ec.ECDSA(utils.Prehashed(hashes.SHA256())))
+    except (InvalidSignature, ValueError):
+        sys.exit("FAIL: bad signature")
+    print("OK")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("genkey")
+    p.add_argument("key", help="private key output (PEM)")
+
+    p = sub.add_parser("sign")
+    p.add_argument("image")
+    p.add_argument("--key", required=True, help="private key (PEM)")
+
+    p = sub.add_parser("verify")
+    p.add_argument("image")
+    p.add_argument("manifest", help="version.txt")
+    p.add_argument("--key", required=True, help="public key (PEM)")
+
+    args = parser.parse_args()
+    {"genkey": genkey, "sign": sign, "verify": verify}[args.command](args)
+
+
+if __name__ == "__main__":
+    main()
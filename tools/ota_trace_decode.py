@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+ota_trace_decode.py
+
+Decode an ESP32_AutoOTA trace dump (OTATrace::dump) into readable events.
+
+Usage:
+    python3 ota_trace_decode.py serial_log.txt
+    curl http://device/trace | python3 ota_trace_decode.py
+"""
+
+import struct
+import sys
+
+# Keep in sync with OTATraceEvent in include/OTATrace.h
+EVENTS = {
+    1: "BOOT",
+    2: "TASK_START",
+    3: "CHECK_START",
+    4: "CHECK_RESULT",
+    5: "DOWNLOAD_START",
+    6: "DOWNLOAD_PROGRESS",
+    7: "FLASH_STALL",
+    8: "DOWNLOAD_END",
+    9: "DOWNLOAD_ABORT",
+    10: "REBOOT",
+    11: "ROLLOUT_SKIP",
+    12: "DOWNLOAD_PAUSE",
+    13: "DOWNLOAD_RESUME",
+    14: "RELEASE_NOTIFY",
+}
+
+RESET_REASONS = [
+    "UNKNOWN", "POWERON", "EXT", "SW", "PANIC", "INT_WDT",
+    "TASK_WDT", "WDT", "DEEPSLEEP", "BROWNOUT", "SDIO",
+]
+
+ABORT_REASONS = {1: "write error", 2: "source error", 3: "stall timeout", 4: "image rejected", 5: "hash mismatch",
+                 6: "bad signature"}
+
+RECORD = struct.Struct("<IHHI")
+
+
+def describe(event, arg0, arg1):
+    if event == 1:
+        reason = RESET_REASONS[arg0] if arg0 < len(RESET_REASONS) else str(arg0)
+        return "reset=%s boot#%d" % (reason, arg1)
+    if event == 2:
+        return "first check in %.1f s" % (arg1 / 1000.0)
+    if event == 4:
+        code = arg0 - 0x10000 if arg0 & 0x8000 else arg0
+        return "http=%d ttfb=%d ms" % (code, arg1)
+    if event == 5:
+        return "size=%d" % arg1
+    if event == 6:
+        return "written=%d" % arg1
+    if event == 7:
+        return "%d slow writes, slowest %d ms" % (arg1, arg0)
+    if event == 8:
+        return "update_error=%d written=%d" % (arg0, arg1)
+    if event == 9:
+        return "%s after %d bytes" % (ABORT_REASONS.get(arg0, str(arg0)), arg1)
+    if event == 10:
+        return "installed %d bytes" % arg1
+    if event == 11:
+        return "device outside %d%% group" % arg0
+    if event == 12:
+        return "at %d bytes" % arg1
+    if event == 13:
+        return "at offset %d%s" % (arg1, " (reconnected)" if arg0 else "")
+    if event == 14:
+        return "check in %.1f s" % (arg1 / 1000.0)
+    return "arg0=%d arg1=%d" % (arg0, arg1)
+
+
+def decode(lines):
+    records = []
+    for line in lines:
+        line = line.strip()
+        if line.startswith("OTATRACE"):
+            parts = line.split()
+            if len(parts) >= 2 and parts[1] != "1":
+                sys.stderr.write("warning: unknown trace version %s\n" % parts[1])
+            records = []  # a later dump supersedes earlier ones
+        elif line.startswith("T "):
+            raw = bytes.fromhex(line[2:])
+            if len(raw) == RECORD.size:
+                records.append(RECORD.unpack(raw))
+    return records
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    records = decode(source)
+    if not records:
+        sys.exit("no trace records found")
+
+    for timestamp, event, arg0, arg1 in records:
+        if event == 1:
+            print("-" * 60)
+        name = EVENTS.get(event, "EVENT_%d" % event)
+        print("%10.3f  %-18s %s" % (timestamp / 1000.0, name, describe(event, arg0, arg1)))
+
+
+if __name__ == "__main__":
+    main()